@@ -0,0 +1,153 @@
+/*
+ bench_render.c - speed of the grain render kernels (cm_render.h).
+ Copyright (C) 2012 - 2017  Matthias W. Müller - circuit.music.labs
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ info@circuitmusiclabs.com
+
+ */
+
+// Grains of 150 ms are rendered as the objects render them: the window pass (linear, from a mono window buffer)
+// followed by the source pass, multiplied with the window, from a stereo buffer~ (buffer) or from the ringbuffer of
+// cm.livecloud~ (ring), at random positions and pitches. ns per grain sample for every kernel implementation the CPU
+// supports and every interpolation mode (s_interp, s_taps), the speedup is relative to the scalar kernels.
+
+#include "cm_bench.h"
+#include "cm_render.h"
+#include <stdlib.h>
+#include <math.h>
+
+#define FRAMES 1323000 // 30 s stereo source
+#define WINDOWFRAMES 512
+#define COUNT 6615 // grain samples (150 ms)
+#define GRAINS 400 // per run
+
+typedef struct kernelset {
+	const char *name;
+	const cm_render_kernels *kernels;
+} kernelset;
+
+typedef struct mode {
+	const char *name;
+	long interp;
+	long taps;
+} mode;
+
+static const mode modes[] = {
+	{"off", CM_INTERP_OFF, 0},
+	{"linear", CM_INTERP_LINEAR, 0},
+	{"hermite", CM_INTERP_HERMITE, 0},
+	{"lagrange", CM_INTERP_LAGRANGE, 0},
+	{"sinc 8", CM_INTERP_SINC, 8},
+	{"sinc 16", CM_INTERP_SINC, 16},
+	{"sinc 32", CM_INTERP_SINC, 32}
+};
+#define MODES (long)(sizeof(modes) / sizeof(mode))
+
+static kernelset sets[4];
+static long setcount = 0;
+
+static void find_kernels(void) {
+	sets[setcount].name = "scalar";
+	sets[setcount++].kernels = &cm_render_scalar_kernels;
+#ifdef CM_RENDER_X86
+	sets[setcount].name = "sse2";
+	sets[setcount++].kernels = &cm_render_sse2_kernels;
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		sets[setcount].name = "avx2";
+		sets[setcount++].kernels = &cm_render_avx2_kernels;
+	}
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("avx512f")) {
+		sets[setcount].name = "avx512";
+		sets[setcount++].kernels = &cm_render_avx512_kernels;
+	}
+#endif
+}
+
+int main(void) {
+	float *src, *window, *grain;
+	double *ring;
+	double *start, *pitch;
+	double best[2][4] = {{0.0}};
+	double time;
+	long m, set, run, g, k, kind;
+	const cm_interp_table *fir;
+
+	cm_render_init();
+	find_kernels();
+	src = (float *)malloc(sizeof(float) * (FRAMES + 1) * 2);
+	ring = (double *)malloc(sizeof(double) * FRAMES);
+	window = (float *)malloc(sizeof(float) * (WINDOWFRAMES + 1));
+	grain = (float *)malloc(sizeof(float) * COUNT);
+	start = (double *)malloc(sizeof(double) * GRAINS);
+	pitch = (double *)malloc(sizeof(double) * GRAINS);
+	for (k = 0; k < (FRAMES + 1) * 2; k++) {
+		src[k] = (float)(2.0 * cm_bench_unit() - 1.0);
+	}
+	for (k = 0; k < FRAMES; k++) {
+		ring[k] = src[k * 2];
+	}
+	for (k = 0; k <= WINDOWFRAMES; k++) {
+		window[k] = (float)(0.5 - 0.5 * cos(2.0 * 3.14159265358979323846 * k / WINDOWFRAMES));
+	}
+	for (g = 0; g < GRAINS; g++) {
+		pitch[g] = 0.25 + 1.75 * cm_bench_unit();
+		start[g] = (FRAMES - 64 - COUNT * pitch[g]) * cm_bench_unit();
+	}
+
+	printf("render kernels (ns per grain sample, buffer / ring)");
+	for (set = 0; set < setcount; set++) {
+		printf("   %13s", sets[set].name);
+	}
+	printf("\n");
+	for (m = 0; m < MODES; m++) {
+		fir = cm_interp_select(modes[m].interp, modes[m].taps);
+		kind = cm_render_kind(modes[m].interp);
+		printf("%-51s", modes[m].name);
+		for (set = 0; set < setcount; set++) {
+			best[0][set] = best[1][set] = 0.0;
+			for (run = 0; run < CM_BENCH_RUNS; run++) {
+				time = cm_bench_now();
+				for (g = 0; g < GRAINS; g++) {
+					sets[set].kernels->buffer[CM_RENDER_LINEAR][0](grain, NULL, window, 1, 0, WINDOWFRAMES, 0, cm_phase_from((double)WINDOWFRAMES / COUNT), COUNT, NULL);
+					sets[set].kernels->buffer[kind][1](grain, grain, src, 2, 0, FRAMES, cm_phase_from(start[g]), cm_phase_from(pitch[g]), COUNT, fir);
+					cm_bench_sink = grain[g];
+				}
+				cm_bench_best(&best[0][set], time);
+				time = cm_bench_now();
+				for (g = 0; g < GRAINS; g++) {
+					sets[set].kernels->buffer[CM_RENDER_LINEAR][0](grain, NULL, window, 1, 0, WINDOWFRAMES, 0, cm_phase_from((double)WINDOWFRAMES / COUNT), COUNT, NULL);
+					sets[set].kernels->ring[kind][1](grain, grain, ring, FRAMES, cm_phase_from(start[g]), cm_phase_from(pitch[g]), COUNT, fir);
+					cm_bench_sink = grain[g];
+				}
+				cm_bench_best(&best[1][set], time);
+			}
+			printf("   %6.2f/%6.2f", cm_bench_ns(best[0][set], (double)GRAINS * COUNT), cm_bench_ns(best[1][set], (double)GRAINS * COUNT));
+		}
+		printf("\n%-51s", "  speedup");
+		for (set = 0; set < setcount; set++) {
+			printf("   %5.1fx/%5.1fx", best[0][0] / best[0][set], best[1][0] / best[1][set]);
+		}
+		printf("\n");
+	}
+	free(src);
+	free(ring);
+	free(window);
+	free(grain);
+	free(start);
+	free(pitch);
+	return 0;
+}
@@ -0,0 +1,168 @@
+/*
+ bench_slots.c - cost of the grain slot bookkeeping of the perform routines.
+ Copyright (C) 2012 - 2017  Matthias W. Müller - circuit.music.labs
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ info@circuitmusiclabs.com
+
+ */
+
+// The sample loop of the perform routines with the two ways of keeping track of the playing grains:
+//   busy flags   a trigger searches the cloud for the first slot which is not busy, every output sample visits all
+//                cloudsize slots and mixes the busy ones (the former perform routines)
+//   slot array   a permutation of the slot indices with the playing grains first: a trigger takes the first free
+//                entry, every output sample visits the playing grains only, a finished grain is swapped with the
+//                last playing one (the objects' slots array)
+// Both loops see the same triggers and mix the same grains (one rendered sample each), so the difference is the
+// bookkeeping. The cloud is filled to 10, 50 and 90 percent on average; ns per output sample.
+
+#include "cm_bench.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define FRAMES 200000 // output samples per run
+#define GRAINLENGTH 2205 // 50 ms at 44.1 kHz
+#define MEMORY 65536 // rendered grain samples (power of two)
+
+typedef struct grain {
+	long pos; // playback position
+	long length; // grain length
+	long offset; // start of the grain in the rendered samples
+	double amp; // output gain
+	char busy; // busy flag (busy flag loop only)
+} grain;
+
+static float memory[MEMORY];
+static char *triggers;
+static double *out;
+
+static void start(grain *g) {
+	g->pos = 0;
+	g->length = GRAINLENGTH / 2 + cm_bench_below(GRAINLENGTH);
+	g->offset = cm_bench_below(MEMORY);
+	g->amp = cm_bench_unit();
+}
+
+// the former loop: search for a free slot, visit every slot for every sample
+static long run_busy(grain *cloud, long cloudsize) {
+	long frame, i, count = 0, started = 0;
+	double sample;
+	for (i = 0; i < cloudsize; i++) {
+		cloud[i].busy = 0;
+	}
+	for (frame = 0; frame < FRAMES; frame++) {
+		if (triggers[frame] && count < cloudsize) {
+			for (i = 0; i < cloudsize; i++) {
+				if (!cloud[i].busy) {
+					cloud[i].busy = 1;
+					start(&cloud[i]);
+					count++;
+					started++;
+					break;
+				}
+			}
+		}
+		sample = 0.0;
+		for (i = 0; i < cloudsize; i++) {
+			if (cloud[i].busy) {
+				sample += memory[(cloud[i].offset + cloud[i].pos++) & (MEMORY - 1)] * cloud[i].amp;
+				if (cloud[i].pos >= cloud[i].length) {
+					cloud[i].busy = 0;
+					count--;
+				}
+			}
+		}
+		out[frame] = sample;
+	}
+	return started;
+}
+
+// the slot index array: take the first free slot, visit the playing grains only
+static long run_slots(grain *cloud, long *slots, long cloudsize) {
+	long frame, a, i, count = 0, started = 0;
+	double sample;
+	for (i = 0; i < cloudsize; i++) {
+		slots[i] = i;
+	}
+	for (frame = 0; frame < FRAMES; frame++) {
+		if (triggers[frame] && count < cloudsize) {
+			start(&cloud[slots[count++]]);
+			started++;
+		}
+		sample = 0.0;
+		for (a = 0; a < count; a++) {
+			i = slots[a];
+			sample += memory[(cloud[i].offset + cloud[i].pos++) & (MEMORY - 1)] * cloud[i].amp;
+			if (cloud[i].pos >= cloud[i].length) {
+				count--;
+				slots[a] = slots[count];
+				slots[count] = i;
+				a--;
+			}
+		}
+		out[frame] = sample;
+	}
+	return started;
+}
+
+int main(void) {
+	static const long sizes[] = {16, 128, 1024};
+	static const double fills[] = {0.1, 0.5, 0.9};
+	grain *cloud;
+	long *slots;
+	long s, f, k, run, started_busy = 0, started_slots = 0;
+	double rate, start_time, busy_time, slots_time;
+
+	triggers = (char *)malloc(FRAMES);
+	out = (double *)malloc(sizeof(double) * FRAMES);
+	cloud = (grain *)malloc(sizeof(grain) * sizes[2]);
+	slots = (long *)malloc(sizeof(long) * sizes[2]);
+	for (k = 0; k < MEMORY; k++) {
+		memory[k] = (float)(2.0 * cm_bench_unit() - 1.0);
+	}
+
+	printf("grain slots (ns per output sample)      busy flags   slot array   speedup\n");
+	for (s = 0; s < 3; s++) {
+		for (f = 0; f < 3; f++) {
+			rate = fills[f] * sizes[s] / GRAINLENGTH; // triggers per sample for the average fill
+			for (k = 0; k < FRAMES; k++) {
+				triggers[k] = cm_bench_unit() < rate;
+			}
+			busy_time = slots_time = 0.0;
+			for (run = 0; run < CM_BENCH_RUNS; run++) {
+				cm_bench_state = 1; // same grains for both loops
+				start_time = cm_bench_now();
+				started_busy = run_busy(cloud, sizes[s]);
+				cm_bench_best(&busy_time, start_time);
+				cm_bench_sink = out[FRAMES - 1];
+				cm_bench_state = 1;
+				start_time = cm_bench_now();
+				started_slots = run_slots(cloud, slots, sizes[s]);
+				cm_bench_best(&slots_time, start_time);
+				cm_bench_sink = out[FRAMES - 1];
+			}
+			if (started_busy != started_slots) {
+				printf("the loops started different grains (%ld, %ld)\n", started_busy, started_slots);
+				return 1;
+			}
+			printf("cloud %4ld, %2.0f%% full                    %8.2f     %8.2f     %5.1fx\n", sizes[s], fills[f] * 100.0, cm_bench_ns(busy_time, FRAMES), cm_bench_ns(slots_time, FRAMES), busy_time / slots_time);
+		}
+	}
+	free(triggers);
+	free(out);
+	free(cloud);
+	free(slots);
+	return 0;
+}
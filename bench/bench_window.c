@@ -0,0 +1,141 @@
+/*
+ bench_window.c - speed of the analytic grain windows (cm_shape.h).
+ Copyright (C) 2012 - 2017  Matthias W. Müller - circuit.music.labs
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ info@circuitmusiclabs.com
+
+ */
+
+// Windows of 150 ms grains with random shape parameters (alpha 0.1 - 10) are computed as cm.gausscloud~ computes them:
+// the whole window for rendered grains (cm_shape_window) and in blocks of CM_SHAPE_BLOCK samples for streaming grains
+// (cm_shape_fill).
+// Every shape is compared with the lookup of a 1024 point window table with linear interpolation (the window buffer~
+// of the other objects), the gauss window also with the former per-sample evaluation with exp and pow (speed and
+// largest difference of the float window values). ns per window sample.
+
+#include "cm_bench.h"
+#include "cm_shape.h"
+#include <stdlib.h>
+
+#define LENGTH 6615 // window samples (150 ms)
+#define WINDOWS 2000 // per run
+#define TABLE 1024 // window table points
+
+typedef struct shape {
+	const char *name;
+	long kind;
+} shape;
+
+static const shape shapes[] = {
+	{"gauss", CM_SHAPE_GAUSS},
+	{"tukey", CM_SHAPE_TUKEY},
+	{"kaiser", CM_SHAPE_KAISER},
+	{"planck", CM_SHAPE_PLANCK},
+	{"expodec", CM_SHAPE_EXPODEC},
+	{"rexpodec", CM_SHAPE_REXPODEC},
+	{"skew", CM_SHAPE_SKEW}
+};
+#define SHAPES (long)(sizeof(shapes) / sizeof(shape))
+
+static double alphas[WINDOWS];
+static float window[LENGTH];
+static float table[TABLE + 1]; // guard point for the interpolation
+
+// the former gauss window of cm.gausscloud~ (one exp and one pow per sample)
+static double cm_gauss(long *pos, long *length, double *alpha) {
+	double n;
+	double N = *length - 1;
+	double stdev = N / (2 * (*alpha));
+	n = *pos - N / 2;
+	return exp(-0.5 * pow((n / stdev), 2));
+}
+
+int main(void) {
+	cm_shape state;
+	double whole, single, lookup, former, time, error, maxerror, index, step, frac;
+	long s, run, w, pos, i, count, length = LENGTH;
+
+	for (w = 0; w < WINDOWS; w++) {
+		alphas[w] = 0.1 + 9.9 * cm_bench_unit();
+	}
+	cm_shape_window(table, TABLE + 1, CM_SHAPE_GAUSS, 3.0);
+
+	printf("window shapes (ns per window sample)   whole window   in blocks\n");
+	for (s = 0; s < SHAPES; s++) {
+		whole = single = 0.0;
+		for (run = 0; run < CM_BENCH_RUNS; run++) {
+			time = cm_bench_now();
+			for (w = 0; w < WINDOWS; w++) {
+				cm_shape_window(window, LENGTH, shapes[s].kind, alphas[w]);
+				cm_bench_sink = window[w];
+			}
+			cm_bench_best(&whole, time);
+			time = cm_bench_now();
+			for (w = 0; w < WINDOWS; w++) {
+				cm_shape_init(&state, shapes[s].kind, alphas[w], LENGTH);
+				for (pos = 0; pos < LENGTH; pos += count) {
+					count = LENGTH - pos < CM_SHAPE_BLOCK ? LENGTH - pos : CM_SHAPE_BLOCK;
+					cm_shape_fill(&state, pos, count, window + pos);
+				}
+				cm_bench_sink = window[w];
+			}
+			cm_bench_best(&single, time);
+		}
+		printf("%-38s %8.2f       %8.2f\n", shapes[s].name, cm_bench_ns(whole, (double)WINDOWS * LENGTH), cm_bench_ns(single, (double)WINDOWS * LENGTH));
+	}
+
+	// the window table (any shape, the values do not change the speed)
+	lookup = 0.0;
+	step = (double)TABLE / (LENGTH - 1);
+	for (run = 0; run < CM_BENCH_RUNS; run++) {
+		time = cm_bench_now();
+		for (w = 0; w < WINDOWS; w++) {
+			index = 0.0;
+			for (pos = 0; pos < LENGTH; pos++) {
+				i = (long)index;
+				frac = index - i;
+				window[pos] = table[i] + (float)frac * (table[i + 1] - table[i]);
+				index += step;
+			}
+			cm_bench_sink = window[w];
+		}
+		cm_bench_best(&lookup, time);
+	}
+	printf("%-38s %8.2f\n", "1024 point table, linear", cm_bench_ns(lookup, (double)WINDOWS * LENGTH));
+
+	// the former gauss window
+	former = 0.0;
+	for (run = 0; run < CM_BENCH_RUNS; run++) {
+		time = cm_bench_now();
+		for (w = 0; w < WINDOWS; w++) {
+			for (pos = 0; pos < LENGTH; pos++) {
+				window[pos] = cm_gauss(&pos, &length, &alphas[w]);
+			}
+			cm_bench_sink = window[w];
+		}
+		cm_bench_best(&former, time);
+	}
+	maxerror = 0.0;
+	for (w = 0; w < WINDOWS; w += 10) {
+		cm_shape_window(window, LENGTH, CM_SHAPE_GAUSS, alphas[w]);
+		for (pos = 0; pos < LENGTH; pos++) {
+			error = fabs(window[pos] - (float)cm_gauss(&pos, &length, &alphas[w]));
+			maxerror = error > maxerror ? error : maxerror;
+		}
+	}
+	printf("%-38s %8.2f       (largest difference to gauss: %.1e)\n", "gauss with exp and pow (former)", cm_bench_ns(former, (double)WINDOWS * LENGTH), maxerror);
+	return 0;
+}
@@ -0,0 +1,77 @@
+/*
+ cm_bench.h - timing helpers for the petra benchmarks.
+ Copyright (C) 2012 - 2017  Matthias W. Müller - circuit.music.labs
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ info@circuitmusiclabs.com
+
+ */
+
+// Every measurement is repeated CM_BENCH_RUNS times and the fastest run is reported (the others are disturbed by the
+// rest of the system). The input is generated from a fixed seed, so the runs are reproducible.
+
+#ifndef CM_BENCH_H
+#define CM_BENCH_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+#define CM_BENCH_RUNS 5 // repetitions of every measurement
+
+static volatile double cm_bench_sink; // results are written here, so the compiler cannot drop the measured loops
+
+// monotonic time in seconds
+static double cm_bench_now(void) {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (double)t.tv_sec + (double)t.tv_nsec * 1e-9;
+}
+
+// keep the fastest of the runs: call with the start time of a run, returns the best time so far in seconds
+static double cm_bench_best(double *best, double start) {
+	double elapsed = cm_bench_now() - start;
+	if (*best <= 0.0 || elapsed < *best) {
+		*best = elapsed;
+	}
+	return *best;
+}
+
+// nanoseconds per sample of a measurement
+static double cm_bench_ns(double seconds, double samples) {
+	return seconds / samples * 1e9;
+}
+
+// reproducible input (splitmix64)
+static uint64_t cm_bench_state = 0x5EED5EEDULL;
+
+static inline uint64_t cm_bench_next(void) {
+	uint64_t z = (cm_bench_state += 0x9E3779B97F4A7C15ULL);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
+
+// uniform double in [0, 1)
+static inline double cm_bench_unit(void) {
+	return (double)(cm_bench_next() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// uniform integer in [0, range)
+static inline long cm_bench_below(long range) {
+	return (long)(cm_bench_next() % (uint64_t)range);
+}
+
+#endif
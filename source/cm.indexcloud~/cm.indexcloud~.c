@@ -27,7 +27,15 @@
 #include "buffer.h"
 #include "ext_atomic.h"
 #include "ext_obex.h"
-#include <stdlib.h> // for arc4random_uniform
+#include "../cm.shared/cm_slab.h" // slab allocator for the grain memory
+#include "../cm.shared/cm_trigger.h" // trigger detection pre-scan
+#include "../cm.shared/cm_swap.h" // grain storage handover between main and audio thread
+#include "../cm.shared/cm_render.h" // vectorized grain render kernels
+#include "../cm.shared/cm_envcache.h" // windows resampled to recent grain lengths
+#include "../cm.shared/cm_mipmap.h" // band-limited source pyramid for high pitch ratios
+#include "../cm.shared/cm_random.h" // per-instance random number generator
+#include "../cm.shared/cm_distrib.h" // distributions of the randomized grain parameters
+#include "../cm.shared/cm_queue.h" // event queue from the message methods to the audio thread
 #include <math.h> // for stereo functions
 #define MIN_CLOUDSIZE 1 // min cloud size in ms
 #define MIN_GRAINLENGTH 1 // min grain length in ms
@@ -42,8 +50,9 @@
 #define DEFAULT_WINLENGTH 512 // default window length
 #define MIN_WINDOWLENGTH 16 // min window length in samples
 #define MAX_WININDEX 7 // max object attribute value for window type
+#define WINTYPES (MAX_WININDEX + 1) // number of window types in the window bank
 #define FLOAT_INLETS 10 // number of object float inlets
-#define RANDMAX 10000
+#define GRAIN_VALUES 5 // number of grain parameters of the grain message
 
 #ifdef WIN_VERSION
 #define M_PI 3.14159265358979323846264338327950288
@@ -54,14 +63,52 @@
 /* GRAIN MEMORY STORAGE                                                                                                 */
 /************************************************************************************************************************/
 typedef struct cmcloud {
-	double *left;
-	double *right;
+	float *left; // grain samples (windowed, without pan and gain): mono grains and left channel of multichannel grains
+	float *right; // right channel of multichannel grains (points to left for mono grains)
 	long length;
 	long pos;
-	t_bool busy; // used to store the flag if a grain is currently playing or not
+	long slab; // slab of the grain memory block in the slab pool
+	t_bool stream; // grain is rendered lazily in the playback loop (streaming engine)
+	t_bool retired; // grain was started before the last storage swap (its memory belongs to the retired storage)
+	double phase; // streaming engine: current read position in the sample buffer
+	double incr; // streaming engine: sample buffer read increment per output sample
+	double w_phase; // streaming engine: current read position in the window array
+	double w_incr; // streaming engine: window array read increment per output sample
+	long w_type; // streaming engine: window type of the grain (index into the window bank)
+	double amp_left; // left output gain (pan * gain), applied during playback
+	double amp_right; // right output gain (pan * gain), applied during playback
 } cm_cloud;
 
 
+/************************************************************************************************************************/
+/* GRAIN STORAGE (BUILT ON THE MAIN THREAD)                                                                             */
+/************************************************************************************************************************/
+typedef struct cmstorage {
+	cm_cloud *cloud; // struct array for storing the grains
+	long *slots; // cloud slot indices
+	cm_slabpool *pool; // slab pool providing the grain memory
+	cm_envcache *envcache; // envelopes resampled to recent grain lengths
+	long slotcount; // number of entries in the cloud and slots arrays
+	long cloudsize; // max number of playing grains
+	long grainlength; // max grain length in ms
+} cm_storage;
+
+
+/************************************************************************************************************************/
+/* WINDOW BANK (SHARED BY ALL INSTANCES, BUILT ON THE MAIN THREAD)                                                     */
+/************************************************************************************************************************/
+// all window types at the same length: a "wintype" message only changes the index of the next grain,
+// a "winlength" message acquires the bank of the new length on the main thread which is swapped in by the audio thread (see cm_swap.h)
+// the banks are read-only and shared by all instances with the same window length (reference counted, main thread only):
+// the bank of the default length is built once when the class is loaded, other lengths when first requested
+typedef struct cmwinbank {
+	double *windows; // window arrays of all types, each with length + 1 values (the extra value is read by cm_lininterpwin)
+	long length; // window length
+	long refcount; // number of references (instances and the class for the default length)
+	struct cmwinbank *next; // next bank in the list of shared banks
+} cm_winbank;
+
+
 /************************************************************************************************************************/
 /* OBJECT STRUCTURE                                                                                                     */
 /************************************************************************************************************************/
@@ -69,40 +116,63 @@ typedef struct _cmindexcloud {
 	t_pxobject obj;
 	t_symbol *buffer_name; // sample buffer name
 	t_buffer_ref *buffer; // sample buffer reference
-	double *window; // window array
-	long window_type; // window typedef
-	long window_type_new;
-	long window_length; // window length
-	long window_length_new;
-	t_bool wintype_request;
-	t_bool wintype_verify;
-	t_bool winlength_request;
-	t_bool winlength_verify;
+	cm_winbank *bank; // shared window bank read by the audio thread
+	cm_winbank *bank_pending; // window bank acquired on the main thread, waiting to be installed by the audio thread
+	cm_winbank *bank_retired; // window bank replaced by the last swap, released on the main thread
+	t_int32_atomic bank_state; // state of the window bank swap (see cm_swap.h)
+	void *bank_qelem; // qelem for acquiring the window bank on the main thread
+	long window_type; // window type of new grains
+	long window_length_new; // new window length obtained from "winlength" method
+	t_bool winlength_request; // flag set to true when "winlength" method called
 	double m_sr; // system millisampling rate (samples per milliseconds = sr * 0.001)
 	short connect_status[FLOAT_INLETS]; // array for signal inlet connection statuses
-	double *object_inlets; // array to store the incoming values coming from the object inlets
+	double *object_inlets; // latest values of the float inlets (written by the message methods only, see cm_queue.h)
 	double *grain_params; // array to store the processed values coming from the object inlets
 	double *randomized; // array to store the randomized grain values
 	double tr_prev; // trigger sample from previous signal vector (required to check if input ramp resets to zero)
+	cm_triggerscan scan; // trigger flags of the current signal vector
+	cm_sigparams sigparams; // signal-connected grain parameters, read at the trigger frame
 	t_bool buffer_modified; // checkflag to see if buffer has been modified
-	short grains_count; // currently playing grains
+	long grains_count; // currently playing grains
 	void *grains_count_out; // outlet for number of currently playing grains (for debugging)
 	t_atom_long attr_stereo; // attribute: number of channels to be played
 	t_atom_long attr_winterp; // attribute: window interpolation on/off
-	t_atom_long attr_sinterp; // attribute: window interpolation on/off
+	t_atom_long attr_sinterp; // attribute: sample interpolation mode
+	t_atom_long attr_staps; // attribute: number of sinc interpolation taps
+	t_atom_long attr_smipmap; // attribute: band-limited source pyramid on/off
 	t_atom_long attr_zero; // attribute: zero crossing trigger on/off
+	t_atom_long attr_stream; // attribute: streaming grain playback on/off
+	t_atom_long attr_seed; // attribute: random seed (0: seed from the system time)
+	t_atom_long attr_deterministic; // attribute: deterministic render mode on/off
+	cm_rng rng; // random number generator of the grain parameters (see cm_random.h)
+	t_atom_long attr_dist[CM_DIST_PARAMS]; // attributes: distribution of each randomized grain parameter
+	t_symbol *dist_name; // histogram buffer name
+	t_buffer_ref *d_buffer; // histogram buffer reference (NULL until the first distbuffer message)
+	cm_dist dist; // inverse CDF tables of the histogram buffer (see cm_distrib.h)
+	void *dist_qelem; // qelem for building the distribution tables on the main thread
 	double piovr2; // pi over two for panning function
 	double root2ovr2; // root of 2 over two for panning function
-	t_bool bang_trigger; // trigger received from bang method
+	long bangs; // bangs waiting for a trigger frame
+	cm_queue queue; // events and float inlet values of the message methods (see cm_queue.h)
+	cm_schedule schedule; // grain messages of the current signal vector (see cm_queue.h)
 	cm_cloud *cloud; // struct array for storing the grains and associated variables in memory
-	long cloudsize; // size of the cloud struct array, value obtained from argument and "cloudsize" method
-	t_bool resize_request; // flag set to true when "cloudsize" method called
+	long *slots; // cloud slot indices: the playing grains (first grains_count entries) followed by the free slots
+	cm_slabpool *pool; // slab pool providing the grain memory
+	cm_envcache *envcache; // envelope cache of the grain storage (see cm_envcache.h)
+	void *pool_qelem; // qelem for growing the slab pool on the main thread
+	long cloudsize; // max number of playing grains, value obtained from argument and "cloudsize" method
 	long cloudsize_new; // new cloudsize obtained from "cloudsize" method
-	t_bool resize_verify; // check-flag for proper memroy re-allocation
 	long grainlength; // maximum grain length
-	t_bool length_request; // flag set to true when "grainlength" method called
 	long grainlength_new; // new grain length obtained from "grainlength" method
-	t_bool length_verify; // check flag for proper memory re-allocation
+	t_bool resize_request; // flag set to true when "cloudsize" or "grainlength" method called
+	t_bool reset_request; // flag set by the dsp method in deterministic mode: the audio thread clears the cloud
+	cm_storage pending; // grain storage built on the main thread, waiting to be installed by the audio thread
+	cm_storage retired; // grain storage replaced by the last swap (freed when its grains have finished)
+	long retired_grains; // number of playing grains belonging to the retired storage
+	t_int32_atomic swap_state; // state of the grain storage swap (see cm_swap.h)
+	void *resize_qelem; // qelem for rebuilding the grain storage on the main thread
+	cm_mipmap mipmap; // decimated copies of the sample buffer (see cm_mipmap.h)
+	void *mipmap_qelem; // qelem for passing the sample buffer to the pyramid worker
 } t_cmindexcloud;
 
 
@@ -119,7 +189,8 @@ typedef struct cmpanner {
 /* STATIC DECLARATIONS                                                                                                  */
 /************************************************************************************************************************/
 static t_class *cmindexcloud_class; // class pointer
-static t_symbol *ps_buffer_modified, *ps_stereo;
+static t_symbol *ps_buffer_modified, *ps_globalsymbol_unbinding, *ps_stereo;
+static cm_winbank *cmindexcloud_banks; // shared window banks, one per window length (main thread only)
 
 
 /************************************************************************************************************************/
@@ -128,16 +199,30 @@ static t_symbol *ps_buffer_modified, *ps_stereo;
 void *cmindexcloud_new(t_symbol *s, long argc, t_atom *argv);
 void cmindexcloud_dsp64(t_cmindexcloud *x, t_object *dsp64, short *count, double samplerate, long maxvectorsize, long flags);
 void cmindexcloud_perform64(t_cmindexcloud *x, t_object *dsp64, double **ins, long numins, double **outs, long numouts, long sampleframes, long flags, void *userparam);
+void cmindexcloud_mix(t_cmindexcloud *x, t_double *out_left, t_double *out_right, long frames, float *b_sample, long b_framecount, t_atom_long b_channelcount);
 void cmindexcloud_assist(t_cmindexcloud *x, void *b, long msg, long arg, char *dst);
 void cmindexcloud_free(t_cmindexcloud *x);
 void cmindexcloud_float(t_cmindexcloud *x, double f);
 void cmindexcloud_dblclick(t_cmindexcloud *x);
 t_max_err cmindexcloud_notify(t_cmindexcloud *x, t_symbol *s, t_symbol *msg, void *sender, void *data);
 void cmindexcloud_set(t_cmindexcloud *x, t_symbol *s, long ac, t_atom *av);
+void cmindexcloud_distbuffer(t_cmindexcloud *x, t_symbol *s, long ac, t_atom *av);
 void cmindexcloud_cloudsize(t_cmindexcloud *x, t_symbol *s, long ac, t_atom *av);
 void cmindexcloud_grainlength(t_cmindexcloud *x, t_symbol *s, long ac, t_atom *av);
 void cmindexcloud_bang(t_cmindexcloud *x);
-t_bool cmindexcloud_resize(t_cmindexcloud *x);
+void cmindexcloud_grain(t_cmindexcloud *x, t_symbol *s, long ac, t_atom *av);
+t_bool cmindexcloud_storage_new(t_cmindexcloud *x, cm_storage *storage, long cloudsize, long grainlength);
+void cmindexcloud_storage_free(cm_storage *storage);
+void cmindexcloud_rebuild(t_cmindexcloud *x);
+void cmindexcloud_mipmap_update(t_cmindexcloud *x);
+void cmindexcloud_swap(t_cmindexcloud *x);
+void cmindexcloud_finish(t_cmindexcloud *x, long i);
+void cmindexcloud_reset(t_cmindexcloud *x);
+void cmindexcloud_post(t_cmindexcloud *x, const cm_event *event);
+void cmindexcloud_events(t_cmindexcloud *x, long n);
+void cmindexcloud_footprint(t_cmindexcloud *x);
+void cmindexcloud_pool_grow(t_cmindexcloud *x);
+t_ptr_size cmindexcloud_grainbytes(t_cmindexcloud *x, long grainlength);
 
 void cmindexcloud_wintype(t_cmindexcloud *x, t_symbol *s, long ac, t_atom *av);
 void cmindexcloud_winlength(t_cmindexcloud *x, t_symbol *s, long ac, t_atom *av);
@@ -145,16 +230,22 @@ void cmindexcloud_winlength(t_cmindexcloud *x, t_symbol *s, long ac, t_atom *av)
 t_max_err cmindexcloud_stereo_set(t_cmindexcloud *x, t_object *attr, long argc, t_atom *argv);
 t_max_err cmindexcloud_winterp_set(t_cmindexcloud *x, t_object *attr, long argc, t_atom *argv);
 t_max_err cmindexcloud_sinterp_set(t_cmindexcloud *x, t_object *attr, long argc, t_atom *argv);
+t_max_err cmindexcloud_staps_set(t_cmindexcloud *x, t_object *attr, long argc, t_atom *argv);
+t_max_err cmindexcloud_smipmap_set(t_cmindexcloud *x, t_object *attr, long argc, t_atom *argv);
 t_max_err cmindexcloud_zero_set(t_cmindexcloud *x, t_object *attr, long argc, t_atom *argv);
+t_max_err cmindexcloud_stream_set(t_cmindexcloud *x, t_object *attr, long argc, t_atom *argv);
+t_max_err cmindexcloud_seed_set(t_cmindexcloud *x, t_object *attr, long argc, t_atom *argv);
+t_max_err cmindexcloud_deterministic_set(t_cmindexcloud *x, t_object *attr, long argc, t_atom *argv);
+void cmindexcloud_dist_update(t_cmindexcloud *x);
 
-void cmindexcloud_windowwrite(t_cmindexcloud *x);
-t_bool cmindexcloud_do_wintype(t_cmindexcloud *x);
-t_bool cmindexcloud_do_winlength(t_cmindexcloud *x);
+cm_winbank *cmindexcloud_bank_acquire(long length);
+void cmindexcloud_bank_release(cm_winbank *bank);
+void cmindexcloud_bank_update(t_cmindexcloud *x);
+void cmindexcloud_bank_swap(t_cmindexcloud *x);
+void cm_windowwrite(double *window, long length, long type);
 
 // PANNING FUNCTION
 void cm_panning(cm_panstruct *panstruct, double *pos, t_cmindexcloud *x);
-// RANDOM NUMBER GENERATOR
-double cm_random(double *min, double *max);
 // LINEAR INTERPOLATION FUNCTIONS
 double cm_lininterp(double distance, float *b_sample, t_atom_long b_channelcount, t_atom_long b_framecount, short channel);
 double cm_lininterpwin(double distance, double *buffer, t_atom_long b_channelcount, t_atom_long b_framecount, short channel);
@@ -182,11 +273,14 @@ void ext_main(void *r) {
 	class_addmethod(cmindexcloud_class, (method)cmindexcloud_dblclick,		"dblclick",		A_CANT, 0); // Bind the double click message
 	class_addmethod(cmindexcloud_class, (method)cmindexcloud_notify, 		"notify", 		A_CANT, 0); // Bind the notify message
 	class_addmethod(cmindexcloud_class, (method)cmindexcloud_set,			"set", 			A_GIMME, 0); // Bind the set message for user buffer set
+	class_addmethod(cmindexcloud_class, (method)cmindexcloud_distbuffer,	"distbuffer",	A_GIMME, 0); // Bind the distbuffer message for the histogram buffer
 	class_addmethod(cmindexcloud_class, (method)cmindexcloud_cloudsize,		"cloudsize",	A_GIMME, 0); // Bind the cloudsize message
 	class_addmethod(cmindexcloud_class, (method)cmindexcloud_grainlength,	"grainlength",	A_GIMME, 0); // Bind the cloudsize message
 	class_addmethod(cmindexcloud_class, (method)cmindexcloud_wintype,		"wintype", 		A_GIMME, 0); // Bind the window type message
 	class_addmethod(cmindexcloud_class, (method)cmindexcloud_winlength,		"winlength", 	A_GIMME, 0); // Bind the window length message
 	class_addmethod(cmindexcloud_class, (method)cmindexcloud_bang,			"bang",			0);
+	class_addmethod(cmindexcloud_class, (method)cmindexcloud_grain,			"grain",		A_GIMME, 0); // Bind the grain message for explicit grains
+	class_addmethod(cmindexcloud_class, (method)cmindexcloud_footprint,	"footprint",	0); // Bind the footprint message
 	
 	
 	CLASS_ATTR_ATOM_LONG(cmindexcloud_class, "stereo", 0, t_cmindexcloud, attr_stereo);
@@ -205,7 +299,20 @@ void ext_main(void *r) {
 	CLASS_ATTR_ACCESSORS(cmindexcloud_class, "s_interp", (method)NULL, (method)cmindexcloud_sinterp_set);
 	CLASS_ATTR_BASIC(cmindexcloud_class, "s_interp", 0);
 	CLASS_ATTR_SAVE(cmindexcloud_class, "s_interp", 0);
-	CLASS_ATTR_STYLE_LABEL(cmindexcloud_class, "s_interp", 0, "onoff", "Sample interpolation on/off");
+	CLASS_ATTR_ENUMINDEX(cmindexcloud_class, "s_interp", 0, "off linear hermite lagrange sinc");
+	CLASS_ATTR_STYLE_LABEL(cmindexcloud_class, "s_interp", 0, "enumindex", "Sample interpolation mode");
+	
+	CLASS_ATTR_ATOM_LONG(cmindexcloud_class, "s_taps", 0, t_cmindexcloud, attr_staps);
+	CLASS_ATTR_ACCESSORS(cmindexcloud_class, "s_taps", (method)NULL, (method)cmindexcloud_staps_set);
+	CLASS_ATTR_BASIC(cmindexcloud_class, "s_taps", 0);
+	CLASS_ATTR_SAVE(cmindexcloud_class, "s_taps", 0);
+	CLASS_ATTR_STYLE_LABEL(cmindexcloud_class, "s_taps", 0, "text", "Sinc interpolation taps (8, 16, 32)");
+	
+	CLASS_ATTR_ATOM_LONG(cmindexcloud_class, "s_mipmap", 0, t_cmindexcloud, attr_smipmap);
+	CLASS_ATTR_ACCESSORS(cmindexcloud_class, "s_mipmap", (method)NULL, (method)cmindexcloud_smipmap_set);
+	CLASS_ATTR_BASIC(cmindexcloud_class, "s_mipmap", 0);
+	CLASS_ATTR_SAVE(cmindexcloud_class, "s_mipmap", 0);
+	CLASS_ATTR_STYLE_LABEL(cmindexcloud_class, "s_mipmap", 0, "onoff", "Band-limited source for high pitch on/off");
 	
 	CLASS_ATTR_ATOM_LONG(cmindexcloud_class, "zero", 0, t_cmindexcloud, attr_zero);
 	CLASS_ATTR_ACCESSORS(cmindexcloud_class, "zero", (method)NULL, (method)cmindexcloud_zero_set);
@@ -213,15 +320,83 @@ void ext_main(void *r) {
 	CLASS_ATTR_SAVE(cmindexcloud_class, "zero", 0);
 	CLASS_ATTR_STYLE_LABEL(cmindexcloud_class, "zero", 0, "onoff", "Zero crossing trigger mode on/off");
 	
+	CLASS_ATTR_ATOM_LONG(cmindexcloud_class, "stream", 0, t_cmindexcloud, attr_stream);
+	CLASS_ATTR_ACCESSORS(cmindexcloud_class, "stream", (method)NULL, (method)cmindexcloud_stream_set);
+	CLASS_ATTR_BASIC(cmindexcloud_class, "stream", 0);
+	CLASS_ATTR_SAVE(cmindexcloud_class, "stream", 0);
+	CLASS_ATTR_STYLE_LABEL(cmindexcloud_class, "stream", 0, "onoff", "Streaming grain playback on/off");
+	
+	CLASS_ATTR_ATOM_LONG(cmindexcloud_class, "seed", 0, t_cmindexcloud, attr_seed);
+	CLASS_ATTR_ACCESSORS(cmindexcloud_class, "seed", (method)NULL, (method)cmindexcloud_seed_set);
+	CLASS_ATTR_BASIC(cmindexcloud_class, "seed", 0);
+	CLASS_ATTR_SAVE(cmindexcloud_class, "seed", 0);
+	CLASS_ATTR_STYLE_LABEL(cmindexcloud_class, "seed", 0, "text", "Random seed (0 = seed from the system time)");
+
+	CLASS_ATTR_ATOM_LONG(cmindexcloud_class, "deterministic", 0, t_cmindexcloud, attr_deterministic);
+	CLASS_ATTR_ACCESSORS(cmindexcloud_class, "deterministic", (method)NULL, (method)cmindexcloud_deterministic_set);
+	CLASS_ATTR_BASIC(cmindexcloud_class, "deterministic", 0);
+	CLASS_ATTR_SAVE(cmindexcloud_class, "deterministic", 0);
+	CLASS_ATTR_STYLE_LABEL(cmindexcloud_class, "deterministic", 0, "onoff", "Deterministic render mode on/off");
+
+	CLASS_ATTR_ATOM_LONG(cmindexcloud_class, "d_start", 0, t_cmindexcloud, attr_dist[0]);
+	CLASS_ATTR_FILTER_CLIP(cmindexcloud_class, "d_start", 0, CM_DIST_KINDS - 1);
+	CLASS_ATTR_BASIC(cmindexcloud_class, "d_start", 0);
+	CLASS_ATTR_SAVE(cmindexcloud_class, "d_start", 0);
+	CLASS_ATTR_ENUMINDEX(cmindexcloud_class, "d_start", 0, "uniform triangular gauss exponential buffer");
+	CLASS_ATTR_STYLE_LABEL(cmindexcloud_class, "d_start", 0, "enumindex", "Start position distribution");
+	
+	CLASS_ATTR_ATOM_LONG(cmindexcloud_class, "d_length", 0, t_cmindexcloud, attr_dist[1]);
+	CLASS_ATTR_FILTER_CLIP(cmindexcloud_class, "d_length", 0, CM_DIST_KINDS - 1);
+	CLASS_ATTR_BASIC(cmindexcloud_class, "d_length", 0);
+	CLASS_ATTR_SAVE(cmindexcloud_class, "d_length", 0);
+	CLASS_ATTR_ENUMINDEX(cmindexcloud_class, "d_length", 0, "uniform triangular gauss exponential buffer");
+	CLASS_ATTR_STYLE_LABEL(cmindexcloud_class, "d_length", 0, "enumindex", "Grain length distribution");
+	
+	CLASS_ATTR_ATOM_LONG(cmindexcloud_class, "d_pitch", 0, t_cmindexcloud, attr_dist[2]);
+	CLASS_ATTR_FILTER_CLIP(cmindexcloud_class, "d_pitch", 0, CM_DIST_KINDS - 1);
+	CLASS_ATTR_BASIC(cmindexcloud_class, "d_pitch", 0);
+	CLASS_ATTR_SAVE(cmindexcloud_class, "d_pitch", 0);
+	CLASS_ATTR_ENUMINDEX(cmindexcloud_class, "d_pitch", 0, "uniform triangular gauss exponential buffer");
+	CLASS_ATTR_STYLE_LABEL(cmindexcloud_class, "d_pitch", 0, "enumindex", "Pitch distribution");
+	
+	CLASS_ATTR_ATOM_LONG(cmindexcloud_class, "d_pan", 0, t_cmindexcloud, attr_dist[3]);
+	CLASS_ATTR_FILTER_CLIP(cmindexcloud_class, "d_pan", 0, CM_DIST_KINDS - 1);
+	CLASS_ATTR_BASIC(cmindexcloud_class, "d_pan", 0);
+	CLASS_ATTR_SAVE(cmindexcloud_class, "d_pan", 0);
+	CLASS_ATTR_ENUMINDEX(cmindexcloud_class, "d_pan", 0, "uniform triangular gauss exponential buffer");
+	CLASS_ATTR_STYLE_LABEL(cmindexcloud_class, "d_pan", 0, "enumindex", "Pan distribution");
+	
+	CLASS_ATTR_ATOM_LONG(cmindexcloud_class, "d_gain", 0, t_cmindexcloud, attr_dist[4]);
+	CLASS_ATTR_FILTER_CLIP(cmindexcloud_class, "d_gain", 0, CM_DIST_KINDS - 1);
+	CLASS_ATTR_BASIC(cmindexcloud_class, "d_gain", 0);
+	CLASS_ATTR_SAVE(cmindexcloud_class, "d_gain", 0);
+	CLASS_ATTR_ENUMINDEX(cmindexcloud_class, "d_gain", 0, "uniform triangular gauss exponential buffer");
+	CLASS_ATTR_STYLE_LABEL(cmindexcloud_class, "d_gain", 0, "enumindex", "Gain distribution");
+	
 	CLASS_ATTR_ORDER(cmindexcloud_class, "stereo", 0, "1");
 	CLASS_ATTR_ORDER(cmindexcloud_class, "w_interp", 0, "2");
 	CLASS_ATTR_ORDER(cmindexcloud_class, "s_interp", 0, "3");
-	CLASS_ATTR_ORDER(cmindexcloud_class, "zero", 0, "4");
+	CLASS_ATTR_ORDER(cmindexcloud_class, "s_taps", 0, "4");
+	CLASS_ATTR_ORDER(cmindexcloud_class, "s_mipmap", 0, "5");
+	CLASS_ATTR_ORDER(cmindexcloud_class, "zero", 0, "6");
+	CLASS_ATTR_ORDER(cmindexcloud_class, "stream", 0, "7");
+	CLASS_ATTR_ORDER(cmindexcloud_class, "seed", 0, "8");
+	CLASS_ATTR_ORDER(cmindexcloud_class, "deterministic", 0, "9");
+	CLASS_ATTR_ORDER(cmindexcloud_class, "d_start", 0, "10");
+	CLASS_ATTR_ORDER(cmindexcloud_class, "d_length", 0, "11");
+	CLASS_ATTR_ORDER(cmindexcloud_class, "d_pitch", 0, "12");
+	CLASS_ATTR_ORDER(cmindexcloud_class, "d_pan", 0, "13");
+	CLASS_ATTR_ORDER(cmindexcloud_class, "d_gain", 0, "14");
 	
 	class_dspinit(cmindexcloud_class); // Add standard Max/MSP methods to your class
 	class_register(CLASS_BOX, cmindexcloud_class); // Register the class with Max
 	ps_buffer_modified = gensym("buffer_modified"); // assign the buffer modified message to the static pointer created above
+	ps_globalsymbol_unbinding = gensym("globalsymbol_unbinding"); // a buffer~ goes away (or is renamed)
 	ps_stereo = gensym("stereo");
+	
+	cm_render_init(); // select the grain render kernels for this CPU
+	cm_dist_setup(); // build the inverse CDF table of the gauss distribution
+	cmindexcloud_bank_acquire(DEFAULT_WINLENGTH); // build the default window bank once, the reference of the class is never released
 }
 
 
@@ -229,7 +404,6 @@ void ext_main(void *r) {
 /* NEW INSTANCE ROUTINE                                                                                                 */
 /************************************************************************************************************************/
 void *cmindexcloud_new(t_symbol *s, long argc, t_atom *argv) {
-	long i;
 	t_cmindexcloud *x = (t_cmindexcloud *)object_alloc(cmindexcloud_class); // create the object and allocate required memory
 	dsp_setup((t_pxobject *)x, 11); // create 11 inlets
 	
@@ -244,10 +418,21 @@ void *cmindexcloud_new(t_symbol *s, long argc, t_atom *argv) {
 	
 	
 	// HANDLE ATTRIBUTES
+	cm_rng_init(&x->rng, 0, x); // random number generator of the grain parameters (seeded by the seed attribute)
 	object_attr_setlong(x, gensym("stereo"), 0); // initialize stereo attribute
 	object_attr_setlong(x, gensym("w_interp"), 0); // initialize window interpolation attribute
 	object_attr_setlong(x, gensym("s_interp"), 1); // initialize window interpolation attribute
+	object_attr_setlong(x, gensym("s_taps"), CM_SINC_DEFTAPS); // initialize sinc taps attribute
+	object_attr_setlong(x, gensym("s_mipmap"), 1); // initialize source pyramid attribute
 	object_attr_setlong(x, gensym("zero"), 0); // initialize zero crossing attribute
+	object_attr_setlong(x, gensym("stream"), 0); // initialize streaming playback attribute
+	object_attr_setlong(x, gensym("seed"), 0); // initialize random seed attribute
+	object_attr_setlong(x, gensym("deterministic"), 0); // initialize deterministic mode attribute
+	object_attr_setlong(x, gensym("d_start"), CM_DIST_UNIFORM); // initialize start position distribution attribute
+	object_attr_setlong(x, gensym("d_length"), CM_DIST_UNIFORM); // initialize grain length distribution attribute
+	object_attr_setlong(x, gensym("d_pitch"), CM_DIST_UNIFORM); // initialize pitch distribution attribute
+	object_attr_setlong(x, gensym("d_pan"), CM_DIST_UNIFORM); // initialize pan distribution attribute
+	object_attr_setlong(x, gensym("d_gain"), CM_DIST_UNIFORM); // initialize gain distribution attribute
 	attr_args_process(x, argc, argv); // get attribute values if supplied as argument
 	
 	// CHECK IF USER SUPPLIED MAXIMUM GRAINS IS IN THE LEGAL RANGE
@@ -271,16 +456,18 @@ void *cmindexcloud_new(t_symbol *s, long argc, t_atom *argv) {
 	x->m_sr = sys_getsr() * 0.001; // get the current sample rate and write it into the object structure
 	
 	x->window_type = DEFAULT_WINTYPE; // get user supplied argument for window type
-	x->window_length = DEFAULT_WINLENGTH; // get user supplied argument for window length
+	x->window_length_new = DEFAULT_WINLENGTH; // get user supplied argument for window length
 
 	
 	/************************************************************************************************************************/
-	// ALLOCATE MEMORY FOR THE WINDOW ARRAY; this is new
-	x->window = (double *)sysmem_newptrclear((x->window_length) * sizeof(double));
-	if (x->window == NULL) {
+	// REFERENCE THE SHARED WINDOW BANK (ALL WINDOW TYPES)
+	x->bank = cmindexcloud_bank_acquire(x->window_length_new);
+	if (x->bank == NULL) {
 		object_error((t_object *)x, "out of memory");
 		return NULL;
 	}
+	x->bank_pending = NULL;
+	x->bank_retired = NULL;
 	
 	// ALLOCATE MEMORY FOR THE OBJET FLOAT_INLETS ARRAY
 	x->object_inlets = (double *)sysmem_newptrclear((FLOAT_INLETS) * sizeof(double));
@@ -303,26 +490,22 @@ void *cmindexcloud_new(t_symbol *s, long argc, t_atom *argv) {
 		return NULL;
 	}
 	
-	// ALLOCATE MEMORY FOR THE GRAINMEM ARRAY
-	x->cloud = (cm_cloud *)sysmem_newptrclear((x->cloudsize) * sizeof(cm_cloud));
-	if (x->cloud == NULL) {
+	// ALLOCATE THE GRAIN STORAGE (CLOUD ARRAY, SLOT INDEX ARRAY AND SLAB POOL)
+	if (!cmindexcloud_storage_new(x, &x->pending, x->cloudsize, x->grainlength)) {
 		object_error((t_object *)x, "out of memory");
 		return NULL;
 	}
-	
-	// ALLOCATE MEMORY FOR THE GRAIN ARRAY IN EACH MEMBER OF THE GRAINMEM STRUCT
-	for (i = 0; i < x->cloudsize; i++) {
-		x->cloud[i].left = (double *)sysmem_newptrclear(((x->grainlength * x->m_sr) * MAX_PITCH) * sizeof(double));
-		if (x->cloud[i].left == NULL) {
-			object_error((t_object *)x, "out of memory");
-			return NULL;
-		}
-		x->cloud[i].right = (double *)sysmem_newptrclear(((x->grainlength * x->m_sr) * MAX_PITCH) * sizeof(double));
-		if (x->cloud[i].right == NULL) {
-			object_error((t_object *)x, "out of memory");
-			return NULL;
-		}
-	}
+	x->cloud = x->pending.cloud;
+	x->slots = x->pending.slots;
+	x->pool = x->pending.pool;
+	x->envcache = x->pending.envcache;
+	memset(&x->pending, 0, sizeof(cm_storage));
+	memset(&x->retired, 0, sizeof(cm_storage));
+	x->pool_qelem = qelem_new(x, (method)cmindexcloud_pool_grow); // grows the slab pool on the main thread
+	x->resize_qelem = qelem_new(x, (method)cmindexcloud_rebuild); // rebuilds the grain storage on the main thread
+	x->mipmap_qelem = qelem_new(x, (method)cmindexcloud_mipmap_update); // passes the sample buffer to the pyramid worker
+	x->bank_qelem = qelem_new(x, (method)cmindexcloud_bank_update); // acquires the window bank on the main thread
+	x->dist_qelem = qelem_new(x, (method)cmindexcloud_dist_update); // builds the distribution tables on the main thread
 	
 	/************************************************************************************************************************/
 	// INITIALIZE VALUES
@@ -339,48 +522,37 @@ void *cmindexcloud_new(t_symbol *s, long argc, t_atom *argv) {
 	x->tr_prev = 0.0; // initialize value for previous trigger sample
 	x->grains_count = 0; // initialize the grains count value
 	x->buffer_modified = false; // initialize buffer modified flag
-	x->wintype_request = false; // initialize window write flag
 	
 	// calculate constants for panning function
 	x->piovr2 = 4.0 * atan(1.0) * 0.5;
 	x->root2ovr2 = sqrt(2.0) * 0.5;
 	
-	// bang trigger flag
-	x->bang_trigger = false;
-	
-	// cloud structure members
-	for (i = 0; i < x->cloudsize; i++) {
-		x->cloud[i].length = 0;
-		x->cloud[i].pos = 0;
-		x->cloud[i].busy = false;
+	// pending bangs and the event queue of the message methods
+	x->bangs = 0;
+	cm_schedule_clear(&x->schedule);
+	if (!cm_queue_init(&x->queue, x->object_inlets, FLOAT_INLETS)) {
+		object_error((t_object *)x, "out of memory");
+		return NULL;
 	}
 	
 	x->cloudsize_new = x->cloudsize;
 	x->grainlength_new = x->grainlength;
 	
-	x->wintype_request = false;
-	x->wintype_verify = false;
-	
 	x->winlength_request = false;
-	x->winlength_verify = false;
+	x->bank_state = CM_SWAP_IDLE;
 	
 	x->resize_request = false;
-	x->resize_verify = false;
-	
-	x->length_request = false;
-	x->length_verify = false;
+	x->retired_grains = 0;
+	x->swap_state = CM_SWAP_IDLE;
+	cm_mipmap_init(&x->mipmap, x->mipmap_qelem);
+	cm_dist_init(&x->dist);
+	x->dist_name = NULL;
+	x->d_buffer = NULL; // created by the first distbuffer message
 	
 	/************************************************************************************************************************/
 	// BUFFER REFERENCES
 	x->buffer = buffer_ref_new((t_object *)x, x->buffer_name); // write the buffer reference into the object structure
-	
-	
-	// WRITE WINDOW INTO WINDOW ARRAY
-	cmindexcloud_windowwrite(x);
-	
-#ifdef WIN_VERSION
-	srand((unsigned int)clock());
-#endif
+	qelem_set(x->mipmap_qelem); // build the source pyramid of the sample buffer on the worker thread
 	
 	return x;
 }
@@ -390,7 +562,6 @@ void *cmindexcloud_new(t_symbol *s, long argc, t_atom *argv) {
 /* THE 64 BIT DSP METHOD                                                                                                */
 /************************************************************************************************************************/
 void cmindexcloud_dsp64(t_cmindexcloud *x, t_object *dsp64, short *count, double samplerate, long maxvectorsize, long flags) {
-	int i;
 	x->connect_status[0] = count[1]; // 2nd inlet: write connection flag into object structure (1 if signal connected)
 	x->connect_status[1] = count[2]; // 3rd inlet: write connection flag into object structure (1 if signal connected)
 	x->connect_status[2] = count[3]; // 4th inlet: write connection flag into object structure (1 if signal connected)
@@ -404,20 +575,26 @@ void cmindexcloud_dsp64(t_cmindexcloud *x, t_object *dsp64, short *count, double
 	
 	if (x->m_sr != samplerate * 0.001) { // check if sample rate stored in object structure is the same as the current project sample rate
 		x->m_sr = samplerate * 0.001;
-		for (i = 0; i < x->cloudsize; i++) {
-			x->cloud[i].left = (double *)sysmem_resizeptrclear(x->cloud[i].left, ((x->grainlength * x->m_sr) * MAX_PITCH) * sizeof(double));
-			if (x->cloud[i].left == NULL) {
-				object_error((t_object *)x, "out of memory");
-				return;
-			}
-		}
-		for (i = 0; i < x->cloudsize; i++) {
-			x->cloud[i].right = (double *)sysmem_resizeptrclear(x->cloud[i].right, ((x->grainlength * x->m_sr) * MAX_PITCH) * sizeof(double));
-			if (x->cloud[i].right == NULL) {
-				object_error((t_object *)x, "out of memory");
-				return;
-			}
-		}
+		// the size classes of the slab pool depend on the sample rate: rebuild the grain storage on the main thread
+		x->resize_request = true;
+		qelem_set(x->resize_qelem);
+	}
+	
+	// DETERMINISTIC MODE: FINISH THE MAIN THREAD WORK NOW (INSTALLED WITH THE FIRST SIGNAL VECTOR), RESTART THE RANDOM
+	// SEQUENCE AND LET THE AUDIO THREAD CLEAR THE CLOUD
+	if (x->attr_deterministic) {
+		cmindexcloud_rebuild(x);
+		cmindexcloud_mipmap_update(x);
+		cmindexcloud_bank_update(x);
+		cmindexcloud_dist_update(x);
+		cm_rng_reseed(&x->rng, x->attr_seed ? x->attr_seed : CM_RNG_DEFAULTSEED, x);
+		x->reset_request = true;
+	}
+	
+	// ALLOCATE THE TRIGGER FLAGS FOR THE MAX VECTOR SIZE
+	if (!cm_trigger_resize(&x->scan, maxvectorsize)) {
+		object_error((t_object *)x, "out of memory");
+		return;
 	}
 	
 	// CALL THE PERFORM ROUTINE
@@ -432,23 +609,29 @@ void cmindexcloud_dsp64(t_cmindexcloud *x, t_object *dsp64, short *count, double
 void cmindexcloud_perform64(t_cmindexcloud *x, t_object *dsp64, double **ins, long numins, double **outs, long numouts, long sampleframes, long flags, void *userparam) {
 	// VARIABLE DECLARATIONS
 	t_bool trigger = false; // trigger occurred yes/no
-	long i, r; // for loop counterS
+	t_bool scheduled; // the trigger is a grain message
+	long tr_frame; // frame of the next signal trigger or bang (n: none)
+	const double *inlets; // latest float inlet values (see cm_queue.h)
 	long n = sampleframes; // number of samples per signal vector
-	double tr_curr; // current trigger value
 	double distance; // floating point index for reading from buffers
 	long index; // truncated index for reading from buffers
-	double b_read, w_read; // current sample read from the sample buffer and window array
-	double outsample_left = 0.0; // temporary left output sample used for adding up all grain samples
-	double outsample_right = 0.0; // temporary right output sample used for adding up all grain samples
+	long frame; // current frame in the signal vector
+	long mixed = 0; // number of frames already mixed into the output vectors
 	int slot = 0; // variable for the current slot in the arrays to write grain info to
 	cm_panstruct panstruct; // struct for holding the calculated constant power left and right stereo values
+	cm_mipmap_source source; // sample buffer or decimated copy the grain is rendered from
 	long b_framecount; // number of frames in the sample buffer
 	t_atom_long b_channelcount; // number of channels in the sample buffer
 	
 	long readpos;
+	long type; // window type of the new grain
+	double *window; // window array of the new grain
+	float *envelope; // window resampled to the grain length
+	t_bool cached; // envelope taken from the envelope cache
 	long start;
 	long smp_length;
 	long pitch_length;
+	long channels; // number of channels stored in the grain memory
 	double gain;
 	double pan_left, pan_right;
 	
@@ -460,58 +643,31 @@ void cmindexcloud_perform64(t_cmindexcloud *x, t_object *dsp64, double **ins, lo
 	t_buffer_obj *buffer = buffer_ref_getobject(x->buffer);
 	float *b_sample = buffer_locksamples(buffer);
 	
-	// CLOUDSIZE - MEMORY RESIZE
-	if (!x->grains_count && x->resize_request) {
-		// allocate new memory and check if all went well
-		x->resize_verify = cmindexcloud_resize(x);
-		if (x->resize_verify) { // if all OK
-			x->resize_verify = false;
-			x->resize_request = false;
-		}
-		else {
-			// if mem-allocation fails, go to zero and try again next time:
-			// x->resize_request is not reset
-			goto zero;
-		}
+	// DETERMINISTIC MODE: CLEAR THE CLOUD WITH THE FIRST SIGNAL VECTOR AFTER THE DSP START
+	if (x->reset_request) {
+		cmindexcloud_reset(x);
 	}
-	
-	// WINDOW TYPE
-	if (!x->grains_count && x->wintype_request) {
-		x->wintype_verify = cmindexcloud_do_wintype(x);
-		if (x->wintype_verify) {
-			x->wintype_verify = false;
-			x->wintype_request = false;
-		}
-		else {
-			goto zero;
-		}
+	// MESSAGE EVENTS: APPLY THE BANGS AND GRAIN MESSAGES IN THE ORDER THEY WERE SENT, READ THE LATEST FLOAT INLET VALUES
+	cmindexcloud_events(x, n);
+	inlets = cm_queue_params(&x->queue);
+	// GRAIN STORAGE SWAP: INSTALL THE STORAGE BUILT ON THE MAIN THREAD
+	if (x->swap_state == CM_SWAP_READY) {
+		cmindexcloud_swap(x);
 	}
-	
-	// WINDOW LENGTH
-	if (!x->grains_count && x->winlength_request) {
-		x->winlength_verify = cmindexcloud_do_winlength(x);
-		if (x->winlength_verify) {
-			x->winlength_verify = false;
-			x->winlength_request = false;
-		}
-		else {
-			goto zero;
-		}
+	// DISTRIBUTION TABLE SWAP: INSTALL THE HISTOGRAM TABLES BUILT ON THE MAIN THREAD
+	if (cm_dist_install(&x->dist)) {
+		qelem_set(x->dist_qelem);
 	}
-	
-	// CLOUDSIZE - GRAIN LENGTH
-	if (x->grains_count == 0 && x->length_request) {
-		// allocate new memory and check if all went well
-		x->length_verify = cmindexcloud_resize(x);
-		if (x->length_verify) { // if all OK
-			x->length_verify = false;
-			x->length_request = false;
-		}
-		else {
-			// if mem-allocation fails, go to zero and try again next time:
-			// x->length_request is not reset
-			goto zero;
-		}
+	if (x->d_buffer && cm_dist_check(&x->dist, buffer_ref_getobject(x->d_buffer))) {
+		qelem_set(x->dist_qelem);
+	}
+	// SOURCE PYRAMID SWAP: INSTALL THE PYRAMID BUILT BY THE WORKER THREAD
+	if (cm_mipmap_install(&x->mipmap)) {
+		qelem_set(x->mipmap_qelem);
+	}
+	// WINDOW BANK SWAP: INSTALL THE BANK BUILT ON THE MAIN THREAD
+	if (x->bank_state == CM_SWAP_READY) {
+		cmindexcloud_bank_swap(x);
 	}
 	
 	if (!x->grains_count && x->buffer_modified) {
@@ -530,61 +686,57 @@ void cmindexcloud_perform64(t_cmindexcloud *x, t_object *dsp64, double **ins, lo
 	// GET INLET VALUES
 	t_double *tr_sigin 	= (t_double *)ins[0]; // get trigger input signal from 1st inlet
 	
-	x->grain_params[0] = x->connect_status[0] ? *ins[1] * x->m_sr : x->object_inlets[0] * x->m_sr;	// start min
-	x->grain_params[1] = x->connect_status[1] ? *ins[2] * x->m_sr : x->object_inlets[1] * x->m_sr;	// start max
-	x->grain_params[2] = x->connect_status[2] ? *ins[3] * x->m_sr : x->object_inlets[2] * x->m_sr;	// length min
-	x->grain_params[3] = x->connect_status[3] ? *ins[4] * x->m_sr : x->object_inlets[3] * x->m_sr;	// length max
-	x->grain_params[4] = x->connect_status[4] ? *ins[5] : x->object_inlets[4];						// pitch min
-	x->grain_params[5] = x->connect_status[5] ? *ins[6] : x->object_inlets[5];						// pitch max
-	x->grain_params[6] = x->connect_status[6] ? *ins[7] : x->object_inlets[6];						// pan min
-	x->grain_params[7] = x->connect_status[7] ? *ins[8] : x->object_inlets[7];						// pan max
-	x->grain_params[8] = x->connect_status[8] ? *ins[9] : x->object_inlets[8];						// gain min
-	x->grain_params[9] = x->connect_status[9] ? *ins[10] : x->object_inlets[9];						// gain max
-	
+	x->grain_params[0] = x->connect_status[0] ? *ins[1] * x->m_sr : inlets[0] * x->m_sr;	// start min
+	x->grain_params[1] = x->connect_status[1] ? *ins[2] * x->m_sr : inlets[1] * x->m_sr;	// start max
+	x->grain_params[2] = x->connect_status[2] ? *ins[3] * x->m_sr : inlets[2] * x->m_sr;	// length min
+	x->grain_params[3] = x->connect_status[3] ? *ins[4] * x->m_sr : inlets[3] * x->m_sr;	// length max
+	x->grain_params[4] = x->connect_status[4] ? *ins[5] : inlets[4];						// pitch min
+	x->grain_params[5] = x->connect_status[5] ? *ins[6] : inlets[5];						// pitch max
+	x->grain_params[6] = x->connect_status[6] ? *ins[7] : inlets[6];						// pan min
+	x->grain_params[7] = x->connect_status[7] ? *ins[8] : inlets[7];						// pan max
+	x->grain_params[8] = x->connect_status[8] ? *ins[9] : inlets[8];						// gain min
+	x->grain_params[9] = x->connect_status[9] ? *ins[10] : inlets[9];						// gain max
+	cm_sigparams_collect(&x->sigparams, x->connect_status, ins + 1, FLOAT_INLETS, 4, x->m_sr); // signal inlets are read again at each trigger frame
+	
+	
+	// TRIGGER PRE-SCAN
+	if (!cm_trigger_scan(&x->scan, tr_sigin, n, &x->tr_prev, x->attr_zero, &x->bangs)) {
+		goto zero;
+	}
 	
-	// DSP LOOP
-	while (n--) {
-		tr_curr = *tr_sigin++; // get current trigger value
-		
-		if (x->attr_zero) {
-			if (signbit(tr_curr) != signbit(x->tr_prev)) { // zero crossing from negative to positive
-				trigger = true;
-			}
-			else if (x->bang_trigger) {
-				trigger = true;
-				x->bang_trigger = false;
-			}
-		}
-		else {
-			if ((x->tr_prev - tr_curr) > 0.9) {
-				trigger = true;
-			}
-			else if (x->bang_trigger) {
-				trigger = true;
-				x->bang_trigger = false;
-			}
-		}
+	// DSP LOOP (FROM TRIGGER TO TRIGGER)
+	// clear the output vectors: the playing grains are added to them grain by grain
+	for (frame = 0; frame < n; frame++) {
+		out_left[frame] = 0.0;
+		out_right[frame] = 0.0;
+	}
+	tr_frame = cm_trigger_next(&x->scan, -1);
+	frame = cm_schedule_next(&x->schedule, tr_frame, 0);
+	while (frame < n) {
+		trigger = true;
+		scheduled = cm_schedule_due(&x->schedule, frame); // grain messages start before a signal trigger at the same frame
 		
 		/************************************************************************************************************************/
 		// IN CASE OF TRIGGER, LIMIT NOT MODIFIED AND GRAINS COUNT IN THE LEGAL RANGE (AVAILABLE SLOTS)
-		if (trigger && x->grains_count < x->cloudsize && !x->resize_request && !x->length_request && !x->wintype_request && !x->winlength_request && !x->buffer_modified && b_sample) {
+		if (trigger && !x->buffer_modified && b_sample) {
+			// mix the playing grains up to the trigger position first: grains which have finished free their slots
+			cmindexcloud_mix(x, out_left + mixed, out_right + mixed, frame - mixed, b_sample, b_framecount, b_channelcount);
+			mixed = frame;
+		}
+		if (trigger && x->grains_count < x->cloudsize && !x->buffer_modified && b_sample) {
 			trigger = false; // reset trigger
+			// TAKE THE FIRST FREE SLOT FOR THE NEW GRAIN
+			slot = x->slots[x->grains_count];
 			x->grains_count++; // increment grains_count
-			// FIND A FREE SLOT FOR THE NEW GRAIN
-			i = 0;
-			while (i < x->cloudsize) {
-				if (!x->cloud[i].busy) {
-					x->cloud[i].busy = true;
-					slot = i;
-					break;
-				}
-				i++;
-			}
 			
-			// randomize grain parameters
-			for (i = 0; i < 5; i++) {
-				r = i * 2;
-				x->randomized[i] = cm_random(&x->grain_params[r], &x->grain_params[r+1]);
+			if (scheduled) { // grain message: the grain parameters are given, nothing is randomized
+				cm_schedule_take(&x->schedule, x->randomized, GRAIN_VALUES, 2, x->m_sr); // the first two parameters in ms
+			}
+			else { // randomize grain parameters
+				cm_sigparams_read(&x->sigparams, x->grain_params, frame); // grain parameters of the signal inlets at the trigger frame
+				cm_rng_update(&x->rng); // apply a seed requested on the main thread
+				cm_dist_fill(&x->rng, x->grain_params, x->randomized, 5, x->attr_dist, x->dist.active); // draw all randomized grain parameters of the trigger
+				tr_frame = cm_trigger_next(&x->scan, frame);
 			}
 			
 			// check for parameter sanity of the length value
@@ -644,77 +796,76 @@ void cmindexcloud_perform64(t_cmindexcloud *x, t_object *dsp64, double **ins, lo
 			// write gain value
 			gain = x->randomized[4];
 			
+			// the window type is read once per grain: a "wintype" message takes effect with the next grain
+			type = x->window_type;
+			window = x->bank->windows + type * (x->bank->length + 1);
 			
-			// grain is written into memory here
-			for (readpos = 0; readpos < smp_length; readpos++) {
-				if (x->attr_winterp) {
-					distance = ((double)readpos / (double)smp_length) * (double)x->window_length;
-					w_read = cm_lininterpwin(distance, x->window, 1, x->window_length, 0);
+			x->cloud[slot].stream = x->attr_stream;
+			x->cloud[slot].retired = false;
+			x->cloud[slot].amp_left = pan_left * gain; // pan and gain are applied during playback
+			x->cloud[slot].amp_right = pan_right * gain;
+			
+			// mono grains are stored once, two channels are only stored for multichannel playback of a multichannel buffer
+			channels = (b_channelcount > 1 && x->attr_stereo) ? 2 : 1;
+			
+			// get the grain memory from the slab pool: if the pool is exhausted, play the grain with the streaming engine
+			// and let the main thread add another slab
+			if (!x->cloud[slot].stream) {
+				x->cloud[slot].left = (float *)cm_slab_alloc(x->pool, smp_length * channels * sizeof(float), &x->cloud[slot].slab);
+				if (x->cloud[slot].left) {
+					x->cloud[slot].right = x->cloud[slot].left + smp_length * (channels - 1);
 				}
 				else {
-					index = (long)(((double)readpos / (double)smp_length) * (double)x->window_length);
-					w_read = x->window[index];
-				}
-				// GET GRAIN SAMPLE FROM SAMPLE BUFFER
-				distance = start + (((double)readpos / (double)smp_length) * (double)pitch_length);
-				
-				if (b_channelcount > 1 && x->attr_stereo) { // if more than one channel
-					if (x->attr_sinterp) {
-						// get interpolated sample
-						x->cloud[slot].left[readpos] = ((cm_lininterp(distance, b_sample, b_channelcount, b_framecount, 0) * w_read) * pan_left) * gain;
-						x->cloud[slot].right[readpos] = ((cm_lininterp(distance, b_sample, b_channelcount, b_framecount, 1) * w_read) * pan_right) * gain;
-					}
-					else {
-						// get non-interpolated sample
-						x->cloud[slot].left[readpos] = ((b_sample[(long)distance * b_channelcount] * w_read) * pan_left) * gain;
-						x->cloud[slot].right[readpos] = ((b_sample[((long)distance * b_channelcount) + 1] * w_read) * pan_right) * gain;
-					}
-				}
-				else { // if only one channel
-					if (x->attr_sinterp) {
-						b_read = cm_lininterp(distance, b_sample, b_channelcount, b_framecount, 0) * w_read; // get interpolated sample
-						x->cloud[slot].left[readpos] = (b_read * pan_left) * gain;
-						x->cloud[slot].right[readpos] = (b_read * pan_right) * gain;
-					}
-					else {
-						x->cloud[slot].left[readpos] = ((b_sample[(long)distance * b_channelcount] * w_read) * pan_left) * gain;
-						x->cloud[slot].right[readpos] = ((b_sample[(long)distance * b_channelcount] * w_read) * pan_right) * gain;
-					}
+					x->cloud[slot].stream = true;
+					qelem_set(x->pool_qelem);
 				}
 			}
-		}
-		/************************************************************************************************************************/
-		// CONTINUE WITH THE PLAYBACK ROUTINE
-		
-		// playback only if there are grains to play
-		if (x->grains_count) {
-			for (i = 0; i < x->cloudsize; i++) {
-				if (x->cloud[i].busy) {
-					r = x->cloud[i].pos++;
-					outsample_left += x->cloud[i].left[r];
-					outsample_right += x->cloud[i].right[r];
-					if (x->cloud[i].pos == x->cloud[i].length) {
-						x->cloud[i].pos = 0;
-						x->cloud[i].busy = false;
-						x->grains_count--;
-						if (x->grains_count < 0) {
-							x->grains_count = 0;
+			
+			// streaming engine: only store the running values, the grain is rendered in the playback loop
+			if (x->cloud[slot].stream) {
+				x->cloud[slot].phase = start;
+				x->cloud[slot].incr = (double)pitch_length / (double)smp_length;
+				x->cloud[slot].w_phase = 0.0;
+				x->cloud[slot].w_incr = (double)x->bank->length / (double)smp_length;
+				x->cloud[slot].w_type = type;
+			}
+			
+			// grain is written into memory here
+			if (!x->cloud[slot].stream) {
+				// WINDOW: TAKE THE ENVELOPE FROM THE CACHE OR WRITE THE WINDOW VALUES INTO THE CACHE (OR THE GRAIN MEMORY)
+				envelope = cm_envcache_get(x->envcache, window, x->attr_winterp, smp_length, smp_length, &cached);
+				if (!envelope) {
+					envelope = x->cloud[slot].left;
+				}
+				if (!cached) {
+					for (readpos = 0; readpos < smp_length; readpos++) {
+						if (x->attr_winterp) {
+							distance = ((double)readpos / (double)smp_length) * (double)x->bank->length;
+							envelope[readpos] = cm_lininterpwin(distance, window, 1, x->bank->length, 0);
+						}
+						else {
+							index = (long)(((double)readpos / (double)smp_length) * (double)x->bank->length);
+							envelope[readpos] = window[index];
 						}
 					}
 				}
+				cm_mipmap_select(&x->mipmap, x->attr_smipmap ? (double)pitch_length / (double)smp_length : 1.0, b_sample, b_channelcount, b_framecount, &source); // sample buffer or decimated copy for the pitch
+				// SOURCE: MULTIPLY THE WINDOW WITH THE SOURCE SAMPLES (THE RIGHT CHANNEL FIRST, THE ENVELOPE CAN BE THE LEFT CHANNEL)
+				if (b_channelcount > 1 && x->attr_stereo) {
+					cm_render_buffer(x->cloud[slot].right, envelope, source.samples, source.channels, 1, source.frames, start * source.scale, pitch_length * source.scale, (double)smp_length, smp_length, x->attr_sinterp, x->attr_staps);
+				}
+				cm_render_buffer(x->cloud[slot].left, envelope, source.samples, source.channels, 0, source.frames, start * source.scale, pitch_length * source.scale, (double)smp_length, smp_length, x->attr_sinterp, x->attr_staps);
 			}
 		}
 		
-		/************************************************************************************************************************/
-		x->tr_prev = tr_curr; // store current trigger value in object structure
-		
-		*out_left++ = outsample_left; // write added sample values to left output vector
-		*out_right++ = outsample_right; // write added sample values to right output vector
-		
-		outsample_left = 0.0;
-		outsample_right = 0.0;
+		// a trigger which could not be served is retried at the next frame, otherwise continue with the next trigger
+		// (a grain message or a signal trigger, which may be at the same frame)
+		frame = trigger ? frame + 1 : cm_schedule_next(&x->schedule, tr_frame, frame);
 	}
 	
+	// MIX THE PLAYING GRAINS INTO THE REST OF THE SIGNAL VECTOR
+	cmindexcloud_mix(x, out_left + mixed, out_right + mixed, n - mixed, b_sample, b_framecount, b_channelcount);
+	
 	/************************************************************************************************************************/
 	// STORE UPDATED RUNNING VALUES INTO THE OBJECT STRUCTURE
 	buffer_unlocksamples(buffer);
@@ -722,6 +873,7 @@ void cmindexcloud_perform64(t_cmindexcloud *x, t_object *dsp64, double **ins, lo
 	return;
 	
 zero:
+	cm_trigger_skip(&x->bangs); // the bangs of this vector are dropped with its signal triggers
 	while (n--) {
 		*out_left++ = 0.0;
 		*out_right++ = 0.0;
@@ -731,6 +883,133 @@ zero:
 }
 
 
+/************************************************************************************************************************/
+/* THE STREAMING GRAIN VARIANTS                                                                                         */
+/************************************************************************************************************************/
+// add the next run frames of a streaming grain to the output vectors, reading directly from the sample buffer and the window array
+// (winterp, sinterp and stereo are compile-time constants in the variants below, the loop itself has no branch on the attributes)
+static CM_INLINE void cmindexcloud_stream(t_cmindexcloud *x, long i, t_double *out_left, t_double *out_right, long run, float *b_sample, long b_framecount, t_atom_long b_channelcount, const cm_interp_table *fir, const t_bool winterp, const long sinterp, const t_bool stereo) {
+	long frame; // loop counter
+	double distance; // floating point index for reading from buffers
+	double w_read, b_read; // current samples read from the window and the sample buffer
+	cm_mipmap_source source; // sample buffer or decimated copy matching the grain pitch
+	double *window = x->bank->windows + x->cloud[i].w_type * (x->bank->length + 1); // window array of the grain
+	cm_mipmap_select(&x->mipmap, x->attr_smipmap ? x->cloud[i].incr : 1.0, b_sample, b_channelcount, b_framecount, &source);
+	for (frame = 0; frame < run; frame++) {
+		x->cloud[i].pos++;
+		distance = x->cloud[i].phase * source.scale;
+		if ((long)x->cloud[i].phase < b_framecount) {
+			if (winterp) {
+				w_read = cm_lininterpwin(x->cloud[i].w_phase, window, 1, x->bank->length, 0);
+			}
+			else {
+				w_read = window[(long)x->cloud[i].w_phase];
+			}
+			if (stereo) { // if more than one channel
+				if (sinterp == CM_RENDER_FIR) {
+					out_left[frame] += (cm_interp_buffer(fir, distance, source.samples, source.channels, source.frames, 0) * w_read) * x->cloud[i].amp_left;
+					out_right[frame] += (cm_interp_buffer(fir, distance, source.samples, source.channels, source.frames, 1) * w_read) * x->cloud[i].amp_right;
+				}
+				else if (sinterp == CM_RENDER_LINEAR) {
+					out_left[frame] += (cm_lininterp(distance, source.samples, source.channels, source.frames, 0) * w_read) * x->cloud[i].amp_left;
+					out_right[frame] += (cm_lininterp(distance, source.samples, source.channels, source.frames, 1) * w_read) * x->cloud[i].amp_right;
+				}
+				else {
+					out_left[frame] += (source.samples[(long)distance * source.channels] * w_read) * x->cloud[i].amp_left;
+					out_right[frame] += (source.samples[((long)distance * source.channels) + 1] * w_read) * x->cloud[i].amp_right;
+				}
+			}
+			else { // if only one channel
+				if (sinterp == CM_RENDER_FIR) {
+					b_read = cm_interp_buffer(fir, distance, source.samples, source.channels, source.frames, 0) * w_read;
+				}
+				else if (sinterp == CM_RENDER_LINEAR) {
+					b_read = cm_lininterp(distance, source.samples, source.channels, source.frames, 0) * w_read;
+				}
+				else {
+					b_read = source.samples[(long)distance * source.channels] * w_read;
+				}
+				out_left[frame] += b_read * x->cloud[i].amp_left;
+				out_right[frame] += b_read * x->cloud[i].amp_right;
+			}
+			x->cloud[i].phase += x->cloud[i].incr;
+			x->cloud[i].w_phase += x->cloud[i].w_incr;
+		}
+		else { // buffer got shorter while the grain was playing: end the grain
+			x->cloud[i].pos = x->cloud[i].length;
+			break;
+		}
+	}
+}
+
+// one variant per attribute combination, selected once per mix call
+#define CMINDEXCLOUD_STREAM_VARIANT(name, winterp, sinterp, stereo) \
+	static void name(t_cmindexcloud *x, long i, t_double *out_left, t_double *out_right, long run, float *b_sample, long b_framecount, t_atom_long b_channelcount, const cm_interp_table *fir) { \
+		cmindexcloud_stream(x, i, out_left, out_right, run, b_sample, b_framecount, b_channelcount, fir, winterp, sinterp, stereo); \
+	}
+CMINDEXCLOUD_STREAM_VARIANT(cmindexcloud_stream_000, false, CM_RENDER_NEAREST, false)
+CMINDEXCLOUD_STREAM_VARIANT(cmindexcloud_stream_001, false, CM_RENDER_NEAREST, true)
+CMINDEXCLOUD_STREAM_VARIANT(cmindexcloud_stream_010, false, CM_RENDER_LINEAR, false)
+CMINDEXCLOUD_STREAM_VARIANT(cmindexcloud_stream_011, false, CM_RENDER_LINEAR, true)
+CMINDEXCLOUD_STREAM_VARIANT(cmindexcloud_stream_020, false, CM_RENDER_FIR, false)
+CMINDEXCLOUD_STREAM_VARIANT(cmindexcloud_stream_021, false, CM_RENDER_FIR, true)
+CMINDEXCLOUD_STREAM_VARIANT(cmindexcloud_stream_100, true, CM_RENDER_NEAREST, false)
+CMINDEXCLOUD_STREAM_VARIANT(cmindexcloud_stream_101, true, CM_RENDER_NEAREST, true)
+CMINDEXCLOUD_STREAM_VARIANT(cmindexcloud_stream_110, true, CM_RENDER_LINEAR, false)
+CMINDEXCLOUD_STREAM_VARIANT(cmindexcloud_stream_111, true, CM_RENDER_LINEAR, true)
+CMINDEXCLOUD_STREAM_VARIANT(cmindexcloud_stream_120, true, CM_RENDER_FIR, false)
+CMINDEXCLOUD_STREAM_VARIANT(cmindexcloud_stream_121, true, CM_RENDER_FIR, true)
+
+typedef void (*cmindexcloud_stream_method)(t_cmindexcloud *x, long i, t_double *out_left, t_double *out_right, long run, float *b_sample, long b_framecount, t_atom_long b_channelcount, const cm_interp_table *fir);
+static const cmindexcloud_stream_method cmindexcloud_streamers[2][3][2] = { { { cmindexcloud_stream_000, cmindexcloud_stream_001 }, { cmindexcloud_stream_010, cmindexcloud_stream_011 }, { cmindexcloud_stream_020, cmindexcloud_stream_021 } }, { { cmindexcloud_stream_100, cmindexcloud_stream_101 }, { cmindexcloud_stream_110, cmindexcloud_stream_111 }, { cmindexcloud_stream_120, cmindexcloud_stream_121 } } }; // [winterp][sinterp][stereo]
+
+
+/************************************************************************************************************************/
+/* THE GRAIN MIXING ROUTINE                                                                                             */
+/************************************************************************************************************************/
+// add the next frames samples of every playing grain to the output vectors (grain by grain) and retire finished grains
+void cmindexcloud_mix(t_cmindexcloud *x, t_double *out_left, t_double *out_right, long frames, float *b_sample, long b_framecount, t_atom_long b_channelcount) {
+	long a, i, frame; // loop counters
+	long run; // number of frames to mix for the current grain
+	float *left, *right; // grain memory at the current playback position
+	double amp_left, amp_right; // output gains of the current grain
+	cmindexcloud_stream_method stream = cmindexcloud_streamers[x->attr_winterp ? 1 : 0][cm_render_kind(x->attr_sinterp)][(b_channelcount > 1 && x->attr_stereo) ? 1 : 0]; // streaming variant for the current attributes
+	const cm_interp_table *fir = cm_interp_select(x->attr_sinterp, x->attr_staps); // coefficient table of the sample interpolation
+	
+	for (a = 0; a < x->grains_count; a++) { // only visit the playing grains
+		i = x->slots[a];
+		run = x->cloud[i].length - x->cloud[i].pos;
+		if (run > frames) {
+			run = frames;
+		}
+		if (x->cloud[i].stream) {
+			// STREAMING ENGINE: READ THE GRAIN SAMPLE DIRECTLY FROM THE BUFFER AND WINDOW ARRAY
+			stream(x, i, out_left, out_right, run, b_sample, b_framecount, b_channelcount, fir);
+		}
+		else {
+			// RENDERED GRAIN: ADD THE WHOLE RUN IN ONE CONTIGUOUS LOOP
+			left = x->cloud[i].left + x->cloud[i].pos;
+			right = x->cloud[i].right + x->cloud[i].pos;
+			amp_left = x->cloud[i].amp_left;
+			amp_right = x->cloud[i].amp_right;
+			for (frame = 0; frame < run; frame++) {
+				out_left[frame] += left[frame] * amp_left;
+				out_right[frame] += right[frame] * amp_right;
+			}
+			x->cloud[i].pos += run;
+		}
+		if (x->cloud[i].pos >= x->cloud[i].length) {
+			cmindexcloud_finish(x, i);
+			// swap the last playing grain into this position and visit it next
+			x->grains_count--;
+			x->slots[a] = x->slots[x->grains_count];
+			x->slots[x->grains_count] = i;
+			a--;
+		}
+	}
+}
+
+
 /************************************************************************************************************************/
 /* ASSIST METHOD FOR INLET AND OUTLET ANNOTATION                                                                        */
 /************************************************************************************************************************/
@@ -792,17 +1071,34 @@ void cmindexcloud_assist(t_cmindexcloud *x, void *b, long msg, long arg, char *d
 /* FREE FUNCTION                                                                                                        */
 /************************************************************************************************************************/
 void cmindexcloud_free(t_cmindexcloud *x) {
-	int i;
 	dsp_free((t_pxobject *)x); // free memory allocated for the object
 	object_free(x->buffer); // free the buffer reference
-	
-	sysmem_freeptr(x->window); // free memory allocated to the window array
-	
-	for (i = 0; i < x->cloudsize; i++) {
-		sysmem_freeptr(x->cloud[i].left);
-		sysmem_freeptr(x->cloud[i].right);
+	if (x->d_buffer) {
+		object_free(x->d_buffer); // free the histogram buffer reference
 	}
+	
+	qelem_free(x->bank_qelem); // free the window bank qelem before the window banks
+	cmindexcloud_bank_release(x->bank); // release the shared window banks
+	cmindexcloud_bank_release(x->bank_pending);
+	cmindexcloud_bank_release(x->bank_retired);
+	
+	qelem_free(x->pool_qelem); // free the slab pool qelem before the pool itself
+	qelem_free(x->resize_qelem); // free the rebuild qelem before the grain storage
+	qelem_free(x->dist_qelem); // free the distribution qelem before the tables
+	cm_dist_free(&x->dist);
+	cm_mipmap_stop(&x->mipmap); // end the pyramid worker before the qelem it sets
+	qelem_free(x->mipmap_qelem); // free the pyramid qelem before the pyramids
+	cm_mipmap_free(&x->mipmap);
+	cm_slab_free(x->pool); // free the grain memory
+	sysmem_freeptr(x->pool);
 	sysmem_freeptr(x->cloud);
+	sysmem_freeptr(x->slots);
+	cm_envcache_free(x->envcache); // free the envelope cache
+	sysmem_freeptr(x->envcache);
+	cmindexcloud_storage_free(&x->pending); // free the storage of a swap in flight
+	cmindexcloud_storage_free(&x->retired);
+	cm_trigger_free(&x->scan); // free the trigger flags
+	cm_queue_free(&x->queue); // free the event queue
 	
 	sysmem_freeptr(x->object_inlets); // free memory allocated to the object inlets array
 	sysmem_freeptr(x->grain_params); // free memory allocated to the grain parameters array
@@ -821,7 +1117,7 @@ void cmindexcloud_float(t_cmindexcloud *x, double f) {
 				dump = f;
 			}
 			else {
-				x->object_inlets[0] = f;
+				cm_queue_param(&x->queue, x->object_inlets, FLOAT_INLETS, 0, f);
 			}
 			break;
 		case 2: // second inlet
@@ -829,7 +1125,7 @@ void cmindexcloud_float(t_cmindexcloud *x, double f) {
 				dump = f;
 			}
 			else {
-				x->object_inlets[1] = f;
+				cm_queue_param(&x->queue, x->object_inlets, FLOAT_INLETS, 1, f);
 			}
 			break;
 		case 3: // 4th inlet
@@ -840,7 +1136,7 @@ void cmindexcloud_float(t_cmindexcloud *x, double f) {
 				dump = f;
 			}
 			else {
-				x->object_inlets[2] = f;
+				cm_queue_param(&x->queue, x->object_inlets, FLOAT_INLETS, 2, f);
 			}
 			break;
 		case 4: // 5th inlet
@@ -851,7 +1147,7 @@ void cmindexcloud_float(t_cmindexcloud *x, double f) {
 				dump = f;
 			}
 			else {
-				x->object_inlets[3] = f;
+				cm_queue_param(&x->queue, x->object_inlets, FLOAT_INLETS, 3, f);
 			}
 			break;
 		case 5: // 6th inlet
@@ -862,7 +1158,7 @@ void cmindexcloud_float(t_cmindexcloud *x, double f) {
 				dump = f;
 			}
 			else {
-				x->object_inlets[4] = f;
+				cm_queue_param(&x->queue, x->object_inlets, FLOAT_INLETS, 4, f);
 			}
 			break;
 		case 6: // 7th inlet
@@ -873,7 +1169,7 @@ void cmindexcloud_float(t_cmindexcloud *x, double f) {
 				dump = f;
 			}
 			else {
-				x->object_inlets[5] = f;
+				cm_queue_param(&x->queue, x->object_inlets, FLOAT_INLETS, 5, f);
 			}
 			break;
 		case 7:
@@ -881,7 +1177,7 @@ void cmindexcloud_float(t_cmindexcloud *x, double f) {
 				dump = f;
 			}
 			else {
-				x->object_inlets[6] = f;
+				cm_queue_param(&x->queue, x->object_inlets, FLOAT_INLETS, 6, f);
 			}
 			break;
 		case 8:
@@ -889,7 +1185,7 @@ void cmindexcloud_float(t_cmindexcloud *x, double f) {
 				dump = f;
 			}
 			else {
-				x->object_inlets[7] = f;
+				cm_queue_param(&x->queue, x->object_inlets, FLOAT_INLETS, 7, f);
 			}
 			break;
 		case 9:
@@ -897,7 +1193,7 @@ void cmindexcloud_float(t_cmindexcloud *x, double f) {
 				dump = f;
 			}
 			else {
-				x->object_inlets[8] = f;
+				cm_queue_param(&x->queue, x->object_inlets, FLOAT_INLETS, 8, f);
 			}
 			break;
 		case 10:
@@ -905,7 +1201,7 @@ void cmindexcloud_float(t_cmindexcloud *x, double f) {
 				dump = f;
 			}
 			else {
-				x->object_inlets[9] = f;
+				cm_queue_param(&x->queue, x->object_inlets, FLOAT_INLETS, 9, f);
 			}
 			break;
 	}
@@ -924,10 +1220,30 @@ void cmindexcloud_dblclick(t_cmindexcloud *x) {
 /* NOTIFY METHOD FOR THE BUFFER REFERENCES                                                                              */
 /************************************************************************************************************************/
 t_max_err cmindexcloud_notify(t_cmindexcloud *x, t_symbol *s, t_symbol *msg, void *sender, void *data) {
-	if (msg == ps_buffer_modified) {
-		x->buffer_modified = true;
+	t_symbol *buffer_name = (t_symbol *)object_method((t_object *)sender, gensym("getname"));
+	if (buffer_name == x->buffer_name) { // check if calling object was the sample buffer
+		if (msg == ps_buffer_modified) {
+			x->buffer_modified = true;
+			cm_mipmap_modified(&x->mipmap); // the source pyramid is rebuilt on the worker thread
+			qelem_set(x->mipmap_qelem);
+		}
+		else if (msg == ps_globalsymbol_unbinding) { // the buffer~ goes away: the pyramid worker stops reading it
+			cm_mipmap_release(&x->mipmap);
+			cm_mipmap_modified(&x->mipmap);
+			qelem_set(x->mipmap_qelem);
+		}
+		return buffer_ref_notify(x->buffer, s, msg, sender, data); // return with the calling buffer
+	}
+	else if (x->d_buffer && buffer_name == x->dist_name) { // check if calling object was the histogram buffer
+		if (msg == ps_buffer_modified) { // the distribution tables are rebuilt on the main thread
+			cm_dist_modified(&x->dist);
+			qelem_set(x->dist_qelem);
+		}
+		return buffer_ref_notify(x->d_buffer, s, msg, sender, data); // return with the calling buffer
+	}
+	else { // if calling object was none of the expected buffers
+		return MAX_ERR_NONE; // return generic MAX_ERR_NONE
 	}
-	return buffer_ref_notify(x->buffer, s, msg, sender, data); // return with the calling buffer
 }
 
 
@@ -938,7 +1254,10 @@ void cmindexcloud_doset(t_cmindexcloud *x, t_symbol *s, long ac, t_atom *av) {
 	if (ac == 1) {
 		x->buffer_modified = true;
 		x->buffer_name = atom_getsym(av); // write buffer name into object structure
+		cm_mipmap_release(&x->mipmap); // the pyramid worker stops reading the replaced buffer
 		buffer_ref_set(x->buffer, x->buffer_name);
+		cm_mipmap_modified(&x->mipmap); // rebuild the source pyramid for the new buffer
+		qelem_set(x->mipmap_qelem);
 		if (buffer_getchannelcount((t_object *)(buffer_ref_getobject(x->buffer))) > 2) {
 			object_error((t_object *)x, "referenced sample buffer has more than 2 channels. using channels 1 and 2.");
 		}
@@ -958,20 +1277,39 @@ void cmindexcloud_set(t_cmindexcloud *x, t_symbol *s, long ac, t_atom *av) {
 
 
 /************************************************************************************************************************/
-/* THE ACTUAL WINDOW TYPE SET METHOD                                                                                    */
+/* THE ACTUAL HISTOGRAM BUFFER SET METHOD                                                                               */
 /************************************************************************************************************************/
-t_bool cmindexcloud_do_wintype(t_cmindexcloud *x) {
-	x->window_type = x->window_type_new;
-	
-	// write window into window array
-	cmindexcloud_windowwrite(x);
-	
-	return true;
+void cmindexcloud_dodistbuffer(t_cmindexcloud *x, t_symbol *s, long ac, t_atom *av) {
+	if (ac == 1) {
+		x->dist_name = atom_getsym(av); // write buffer name into object structure
+		if (x->d_buffer) {
+			buffer_ref_set(x->d_buffer, x->dist_name);
+		}
+		else {
+			x->d_buffer = buffer_ref_new((t_object *)x, x->dist_name);
+		}
+		cm_dist_modified(&x->dist); // build the tables of the new histogram buffer
+		qelem_set(x->dist_qelem);
+		if (buffer_getchannelcount((t_object *)(buffer_ref_getobject(x->d_buffer))) > 5) {
+			object_error((t_object *)x, "referenced histogram buffer has more than 5 channels. using channels 1 to 5.");
+		}
+	}
+	else {
+		object_error((t_object *)x, "argument required (histogram buffer name)");
+	}
+}
+
+
+/************************************************************************************************************************/
+/* THE HISTOGRAM BUFFER SET METHOD                                                                                      */
+/************************************************************************************************************************/
+void cmindexcloud_distbuffer(t_cmindexcloud *x, t_symbol *s, long ac, t_atom *av) {
+	defer(x, (method)cmindexcloud_dodistbuffer, s, ac, av);
 }
 
 
 /************************************************************************************************************************/
-/* THE WINDOW TYPE REQUEST METHOD                                                                                       */
+/* THE WINDOW TYPE SET METHOD                                                                                           */
 /************************************************************************************************************************/
 void cmindexcloud_wintype(t_cmindexcloud *x, t_symbol *s, long ac, t_atom *av) {
 	long arg = atom_getlong(av);
@@ -981,8 +1319,7 @@ void cmindexcloud_wintype(t_cmindexcloud *x, t_symbol *s, long ac, t_atom *av) {
 			object_error((t_object *)x, "invalid window type");
 		}
 		else {
-			x->window_type_new = arg;
-			x->wintype_request = true;
+			x->window_type = arg; // all window types are in the window bank: the next grain uses the new type
 		}
 	}
 	else {
@@ -991,31 +1328,6 @@ void cmindexcloud_wintype(t_cmindexcloud *x, t_symbol *s, long ac, t_atom *av) {
 }
 
 
-
-/************************************************************************************************************************/
-/* THE ACTUAL WINDOW LENGTH SET METHOD                                                                                  */
-/************************************************************************************************************************/
-t_bool cmindexcloud_do_winlength(t_cmindexcloud *x) {
-	x->window_length = x->window_length_new;
-	
-	sysmem_freeptr(x->window);
-	
-	// resize and clear window array
-	x->window = (double *)sysmem_newptrclear(x->window_length * sizeof(double));
-	
-	// check if all went well
-	if (x->window == NULL) {
-		object_error((t_object *)x, "out of memory");
-		return false; // x->wintype_request will not be reset if memory allocation fails
-	}
-	
-	// write window into window array
-	cmindexcloud_windowwrite(x);
-	
-	return true;
-}
-
-
 /************************************************************************************************************************/
 /* THE WINDOW LENGTH REQUEST METHOD                                                                                     */
 /************************************************************************************************************************/
@@ -1028,6 +1340,7 @@ void cmindexcloud_winlength(t_cmindexcloud *x, t_symbol *s, long ac, t_atom *av)
 		else {
 			x->window_length_new = arg;
 			x->winlength_request = true;
+			qelem_set(x->bank_qelem); // acquire the window bank of the new length on the main thread
 		}
 	}
 	else {
@@ -1036,8 +1349,6 @@ void cmindexcloud_winlength(t_cmindexcloud *x, t_symbol *s, long ac, t_atom *av)
 }
 
 
-
-
 /************************************************************************************************************************/
 /* THE RESIZE REQUEST METHOD                                                                                            */
 /************************************************************************************************************************/
@@ -1051,6 +1362,7 @@ void cmindexcloud_cloudsize(t_cmindexcloud *x, t_symbol *s, long ac, t_atom *av)
 		else {
 			x->cloudsize_new = arg;
 			x->resize_request = true;
+			qelem_set(x->resize_qelem); // build the new grain storage on the main thread
 		}
 	}
 	else {
@@ -1070,7 +1382,8 @@ void cmindexcloud_grainlength(t_cmindexcloud *x, t_symbol *s, long ac, t_atom *a
 		}
 		else {
 			x->grainlength_new = arg;
-			x->length_request = true;
+			x->resize_request = true;
+			qelem_set(x->resize_qelem); // build the new grain storage on the main thread
 		}
 	}
 	else {
@@ -1080,49 +1393,335 @@ void cmindexcloud_grainlength(t_cmindexcloud *x, t_symbol *s, long ac, t_atom *a
 
 
 /************************************************************************************************************************/
-/* THE ACTUAL RESIZE METHOD                                                                                             */
+/* GRAIN STORAGE ALLOCATION (MAIN THREAD)                                                                               */
 /************************************************************************************************************************/
-t_bool cmindexcloud_resize(t_cmindexcloud *x) {
-	int i;
+// allocate a new grain storage; returns false if memory allocation failed (the partly allocated storage is freed by cmindexcloud_storage_free)
+t_bool cmindexcloud_storage_new(t_cmindexcloud *x, cm_storage *storage, long cloudsize, long grainlength) {
+	long i;
 	
-	for (i = 0; i < x->cloudsize; i++) {
-		sysmem_freeptr(x->cloud[i].left);
-		sysmem_freeptr(x->cloud[i].right);
+	memset(storage, 0, sizeof(cm_storage));
+	storage->cloudsize = cloudsize;
+	storage->grainlength = grainlength;
+	// the playing grains are moved into the new storage: it never has less slots than the current cloud size
+	storage->slotcount = cloudsize > x->cloudsize ? cloudsize : x->cloudsize;
+	
+	// ALLOCATE MEMORY FOR THE GRAINMEM ARRAY
+	storage->cloud = (cm_cloud *)sysmem_newptrclear((storage->slotcount) * sizeof(cm_cloud));
+	if (storage->cloud == NULL) {
+		return false;
 	}
-	sysmem_freeptr(x->cloud);
 	
-	if (x->resize_request) {
-		x->cloudsize = x->cloudsize_new;
+	// ALLOCATE MEMORY FOR THE SLOT INDEX ARRAY
+	storage->slots = (long *)sysmem_newptrclear((storage->slotcount) * sizeof(long));
+	if (storage->slots == NULL) {
+		return false;
 	}
-	else if (x->length_request) {
-		x->grainlength = x->grainlength_new;
+	for (i = 0; i < storage->slotcount; i++) {
+		storage->cloud[i].length = 0;
+		storage->cloud[i].pos = 0;
+		storage->cloud[i].stream = false;
+		storage->cloud[i].retired = false;
+		storage->slots[i] = i;
 	}
 	
-	// ALLOCATE MEMORY FOR THE GRAINMEM ARRAY
-	x->cloud = (cm_cloud *)sysmem_newptrclear((x->cloudsize) * sizeof(cm_cloud));
-	if (x->cloud == NULL) {
-		object_error((t_object *)x, "out of memory");
-		x->resize_verify = false;
+	// CREATE THE SLAB POOL FOR THE GRAIN MEMORY
+	storage->pool = (cm_slabpool *)sysmem_newptrclear(sizeof(cm_slabpool));
+	if (storage->pool == NULL) {
+		return false;
+	}
+	if (!cm_slab_new(storage->pool, cmindexcloud_grainbytes(x, grainlength), storage->slotcount, x->attr_stream ? 0 : (x->attr_deterministic ? CM_SLAB_PREFILL_ALL : CM_SLAB_PREFILL))) {
+		return false;
+	}
+	
+	// ALLOCATE THE ENVELOPE CACHE (ENVELOPES UP TO THE MAX GRAIN LENGTH)
+	storage->envcache = (cm_envcache *)sysmem_newptrclear(sizeof(cm_envcache));
+	if (storage->envcache == NULL) {
+		return false;
+	}
+	if (!cm_envcache_new(storage->envcache, (long)(grainlength * x->m_sr) + 1)) {
 		return false;
 	}
 	
-	// ALLOCATE MEMORY FOR THE GRAIN ARRAY IN EACH MEMBER OF THE GRAINMEM STRUCT
-	for (i = 0; i < x->cloudsize; i++) {
-		x->cloud[i].left = (double *)sysmem_newptrclear(((x->grainlength * x->m_sr) * MAX_PITCH) * sizeof(double));
-		if (x->cloud[i].left == NULL) {
+	return true;
+}
+
+// free all memory of a grain storage (no grain must be playing from it)
+void cmindexcloud_storage_free(cm_storage *storage) {
+	if (storage->pool) {
+		cm_slab_free(storage->pool);
+		sysmem_freeptr(storage->pool);
+	}
+	if (storage->cloud) {
+		sysmem_freeptr(storage->cloud);
+	}
+	if (storage->slots) {
+		sysmem_freeptr(storage->slots);
+	}
+	if (storage->envcache) {
+		cm_envcache_free(storage->envcache);
+		sysmem_freeptr(storage->envcache);
+	}
+	memset(storage, 0, sizeof(cm_storage));
+}
+
+
+/************************************************************************************************************************/
+/* THE GRAIN STORAGE REBUILD METHOD (CALLED FROM THE QELEM)                                                             */
+/************************************************************************************************************************/
+void cmindexcloud_rebuild(t_cmindexcloud *x) {
+	// free the storage retired by the audio thread
+	if (x->swap_state == CM_SWAP_RETIRED) {
+		cmindexcloud_storage_free(&x->retired);
+		cm_swap_advance(&x->swap_state, CM_SWAP_RETIRED, CM_SWAP_IDLE);
+	}
+	// build the requested storage and hand it to the audio thread (a request arriving during a swap is served after it)
+	if (x->resize_request && x->swap_state == CM_SWAP_IDLE) {
+		x->resize_request = false;
+		if (!cmindexcloud_storage_new(x, &x->pending, x->cloudsize_new, x->grainlength_new)) {
 			object_error((t_object *)x, "out of memory");
-			x->resize_verify = false;
-			return false;
+			cmindexcloud_storage_free(&x->pending);
+			return;
+		}
+		cm_swap_advance(&x->swap_state, CM_SWAP_IDLE, CM_SWAP_READY);
+	}
+}
+
+
+/************************************************************************************************************************/
+/* THE SOURCE PYRAMID UPDATE METHOD (CALLED FROM THE QELEM)                                                             */
+/************************************************************************************************************************/
+void cmindexcloud_mipmap_update(t_cmindexcloud *x) {
+	t_bool ok;
+	if (x->attr_deterministic) { // the pyramid is ready when the first signal vector is rendered
+		ok = cm_mipmap_finish(&x->mipmap, buffer_ref_getobject(x->buffer), x->attr_smipmap);
+	}
+	else {
+		ok = cm_mipmap_update(&x->mipmap, buffer_ref_getobject(x->buffer), x->attr_smipmap);
+	}
+	if (!ok) {
+		object_error((t_object *)x, "out of memory");
+	}
+}
+
+
+/************************************************************************************************************************/
+/* THE DISTRIBUTION TABLE UPDATE METHOD (CALLED FROM THE QELEM)                                                         */
+/************************************************************************************************************************/
+void cmindexcloud_dist_update(t_cmindexcloud *x) {
+	if (!cm_dist_update(&x->dist, x->d_buffer ? buffer_ref_getobject(x->d_buffer) : NULL)) {
+		object_error((t_object *)x, "out of memory");
+	}
+}
+
+
+/************************************************************************************************************************/
+/* THE GRAIN STORAGE SWAP (AUDIO THREAD)                                                                                */
+/************************************************************************************************************************/
+// install the storage built on the main thread: the playing grains are moved into the new cloud array
+// and keep their grain memory in the retired slab pool until they have finished
+void cmindexcloud_swap(t_cmindexcloud *x) {
+	long a; // loop counter
+	
+	if (x->grains_count > x->pending.slotcount) { // not enough slots for the playing grains: try again with the next signal vector
+		return;
+	}
+	// the slots of the new storage are in order: the playing grains take the first entries
+	for (a = 0; a < x->grains_count; a++) {
+		x->pending.cloud[a] = x->cloud[x->slots[a]];
+		x->pending.cloud[a].retired = true;
+	}
+	x->retired.cloud = x->cloud;
+	x->retired.slots = x->slots;
+	x->retired.pool = x->pool;
+	x->retired.envcache = x->envcache;
+	x->cloud = x->pending.cloud;
+	x->slots = x->pending.slots;
+	x->pool = x->pending.pool;
+	cm_envcache_inherit(x->pending.envcache, x->envcache); // keep the hit counters
+	x->envcache = x->pending.envcache;
+	x->cloudsize = x->pending.cloudsize;
+	x->grainlength = x->pending.grainlength;
+	memset(&x->pending, 0, sizeof(cm_storage));
+	
+	x->retired_grains = x->grains_count;
+	if (x->retired_grains > 0) {
+		cm_swap_advance(&x->swap_state, CM_SWAP_READY, CM_SWAP_DRAINING);
+	}
+	else if (cm_swap_advance(&x->swap_state, CM_SWAP_READY, CM_SWAP_RETIRED)) {
+		qelem_set(x->resize_qelem);
+	}
+}
+
+
+/************************************************************************************************************************/
+/* SHARED WINDOW BANKS (MAIN THREAD)                                                                                    */
+/************************************************************************************************************************/
+// reference the window bank of the given length, building it if no instance uses this length yet
+// returns NULL if memory allocation failed
+cm_winbank *cmindexcloud_bank_acquire(long length) {
+	cm_winbank *bank;
+	long type;
+	double *window;
+	
+	for (bank = cmindexcloud_banks; bank; bank = bank->next) {
+		if (bank->length == length) {
+			bank->refcount++;
+			return bank;
 		}
-		x->cloud[i].right = (double *)sysmem_newptrclear(((x->grainlength * x->m_sr) * MAX_PITCH) * sizeof(double));
-		if (x->cloud[i].right == NULL) {
+	}
+	bank = (cm_winbank *)sysmem_newptrclear(sizeof(cm_winbank));
+	if (bank == NULL) {
+		return NULL;
+	}
+	bank->windows = (double *)sysmem_newptr(WINTYPES * (length + 1) * sizeof(double));
+	if (bank->windows == NULL) {
+		sysmem_freeptr(bank);
+		return NULL;
+	}
+	bank->length = length;
+	for (type = 0; type < WINTYPES; type++) {
+		window = bank->windows + type * (length + 1);
+		cm_windowwrite(window, length, type);
+		window[length] = window[length - 1];
+	}
+	bank->refcount = 1;
+	bank->next = cmindexcloud_banks;
+	cmindexcloud_banks = bank;
+	return bank;
+}
+
+// drop a reference to a window bank, the last reference frees it
+void cmindexcloud_bank_release(cm_winbank *bank) {
+	cm_winbank **link;
+	if (bank == NULL || --bank->refcount > 0) {
+		return;
+	}
+	for (link = &cmindexcloud_banks; *link; link = &(*link)->next) {
+		if (*link == bank) {
+			*link = bank->next;
+			break;
+		}
+	}
+	sysmem_freeptr(bank->windows);
+	sysmem_freeptr(bank);
+}
+
+
+/************************************************************************************************************************/
+/* THE WINDOW BANK UPDATE METHOD (CALLED FROM THE QELEM)                                                                */
+/************************************************************************************************************************/
+void cmindexcloud_bank_update(t_cmindexcloud *x) {
+	// release the bank retired by the audio thread
+	if (x->bank_state == CM_SWAP_RETIRED) {
+		cmindexcloud_bank_release(x->bank_retired);
+		x->bank_retired = NULL;
+		cm_swap_advance(&x->bank_state, CM_SWAP_RETIRED, CM_SWAP_IDLE);
+	}
+	// acquire the requested bank and hand it to the audio thread (a request arriving during a swap is served after it)
+	if (x->winlength_request && x->bank_state == CM_SWAP_IDLE) {
+		x->winlength_request = false;
+		x->bank_pending = cmindexcloud_bank_acquire(x->window_length_new);
+		if (x->bank_pending == NULL) {
 			object_error((t_object *)x, "out of memory");
-			x->resize_verify = false;
-			return false;
+			return;
 		}
+		cm_swap_advance(&x->bank_state, CM_SWAP_IDLE, CM_SWAP_READY);
 	}
+}
+
+
+/************************************************************************************************************************/
+/* THE WINDOW BANK SWAP (AUDIO THREAD)                                                                                  */
+/************************************************************************************************************************/
+// install the bank acquired on the main thread: rendered grains already hold their window, streaming grains
+// continue at the same relative position in the new bank, so the retired bank can be released right away
+void cmindexcloud_bank_swap(t_cmindexcloud *x) {
+	long a, i; // loop counter, cloud slot
+	double scale = (double)x->bank_pending->length / (double)x->bank->length;
 	
-	return true;
+	for (a = 0; a < x->grains_count; a++) {
+		i = x->slots[a];
+		if (x->cloud[i].stream) {
+			x->cloud[i].w_phase *= scale;
+			x->cloud[i].w_incr *= scale;
+		}
+	}
+	x->bank_retired = x->bank;
+	x->bank = x->bank_pending;
+	x->bank_pending = NULL;
+	cm_envcache_clear(x->envcache); // the envelopes were resampled from the replaced bank
+	if (cm_swap_advance(&x->bank_state, CM_SWAP_READY, CM_SWAP_RETIRED)) {
+		qelem_set(x->bank_qelem);
+	}
+}
+
+
+/************************************************************************************************************************/
+/* THE GRAIN FINISH AND CLOUD RESET METHODS (AUDIO THREAD)                                                              */
+/************************************************************************************************************************/
+// release the memory of a finished grain (the caller removes it from the playing grains)
+void cmindexcloud_finish(t_cmindexcloud *x, long i) {
+	if (!x->cloud[i].stream) { // return the grain memory to the slab pool
+		cm_slab_release(x->cloud[i].retired ? x->retired.pool : x->pool, x->cloud[i].left, x->cloud[i].slab);
+		x->cloud[i].left = NULL;
+		x->cloud[i].right = NULL;
+	}
+	if (x->cloud[i].retired) { // after the last grain of the retired storage the main thread can free it
+		x->cloud[i].retired = false;
+		x->retired_grains--;
+		if (x->retired_grains == 0 && cm_swap_advance(&x->swap_state, CM_SWAP_DRAINING, CM_SWAP_RETIRED)) {
+			qelem_set(x->resize_qelem);
+		}
+	}
+	x->cloud[i].pos = 0;
+}
+
+// deterministic mode: stop the playing grains and the trigger detection as if the object had just been created
+void cmindexcloud_reset(t_cmindexcloud *x) {
+	long a; // loop counter
+	
+	x->reset_request = false;
+	for (a = 0; a < x->grains_count; a++) {
+		cmindexcloud_finish(x, x->slots[a]);
+	}
+	x->grains_count = 0;
+	x->tr_prev = 0.0;
+	x->bangs = 0;
+	cm_schedule_clear(&x->schedule);
+	x->buffer_modified = false;
+}
+
+
+/************************************************************************************************************************/
+/* THE MESSAGE EVENT METHODS                                                                                            */
+/************************************************************************************************************************/
+// message methods: append an event to the queue of the audio thread
+void cmindexcloud_post(t_cmindexcloud *x, const cm_event *event) {
+	t_bool report; // first dropped event of an overflow
+	if (!cm_queue_push(&x->queue, event, &report) && report) {
+		object_error((t_object *)x, "too many messages per signal vector: events dropped");
+	}
+}
+
+// audio thread: apply the events of the message methods in the order they were sent, add the grain messages to the
+// schedule of the signal vector (n frames)
+void cmindexcloud_events(t_cmindexcloud *x, long n) {
+	const cm_event *event;
+	long k; // loop counter
+	long count = cm_queue_count(&x->queue);
+	cm_schedule_begin(&x->schedule, n);
+	for (k = 0; k < count; k++) {
+		event = cm_queue_event(&x->queue, k);
+		if (event->type == CM_EVENT_GRAIN && !cm_schedule_add(&x->schedule, event)) {
+			break; // the schedule is full: the remaining events wait until scheduled grains have started
+		}
+		switch (event->type) {
+			case CM_EVENT_BANG:
+				cm_trigger_bang(&x->bangs, n);
+				break;
+		}
+	}
+	cm_queue_release(&x->queue, k);
 }
 
 
@@ -1130,7 +1729,33 @@ t_bool cmindexcloud_resize(t_cmindexcloud *x) {
 /* THE BANG METHOD                                                                                                      */
 /************************************************************************************************************************/
 void cmindexcloud_bang(t_cmindexcloud *x) {
-	x->bang_trigger = true;
+	cm_event event;
+	memset(&event, 0, sizeof(cm_event));
+	event.type = CM_EVENT_BANG;
+	cmindexcloud_post(x, &event); // every bang triggers a grain
+}
+
+
+/************************************************************************************************************************/
+/* THE GRAIN METHOD                                                                                                     */
+/************************************************************************************************************************/
+// grain start length pitch pan gain [offset]: start a grain with the given parameters (no randomization) at the
+// offset in samples from the start of the next signal vector (later vectors for offsets beyond it)
+void cmindexcloud_grain(t_cmindexcloud *x, t_symbol *s, long ac, t_atom *av) {
+	cm_event event;
+	long k; // loop counter
+	memset(&event, 0, sizeof(cm_event));
+	event.type = CM_EVENT_GRAIN;
+	if (ac >= GRAIN_VALUES && av) {
+		for (k = 0; k < GRAIN_VALUES; k++) {
+			event.values[k] = atom_getfloat(av + k);
+		}
+		event.frame = ac > GRAIN_VALUES ? (long)atom_getlong(av + GRAIN_VALUES) : 0;
+		cmindexcloud_post(x, &event);
+	}
+	else {
+		object_error((t_object *)x, "arguments required (start, length, pitch, pan, gain, [offset])");
+	}
 }
 
 
@@ -1161,7 +1786,47 @@ t_max_err cmindexcloud_winterp_set(t_cmindexcloud *x, t_object *attr, long ac, t
 /************************************************************************************************************************/
 t_max_err cmindexcloud_sinterp_set(t_cmindexcloud *x, t_object *attr, long ac, t_atom *av) {
 	if (ac && av) {
-		x->attr_sinterp = atom_getlong(av)? 1 : 0;
+		x->attr_sinterp = atom_getlong(av);
+		if (x->attr_sinterp < CM_INTERP_OFF) {
+			x->attr_sinterp = CM_INTERP_OFF;
+		}
+		else if (x->attr_sinterp >= CM_INTERP_MODES) {
+			x->attr_sinterp = CM_INTERP_MODES - 1;
+		}
+	}
+	return MAX_ERR_NONE;
+}
+
+
+/************************************************************************************************************************/
+/* THE SINC TAPS ATTRIBUTE SET METHOD                                                                                   */
+/************************************************************************************************************************/
+t_max_err cmindexcloud_staps_set(t_cmindexcloud *x, t_object *attr, long ac, t_atom *av) {
+	if (ac && av) {
+		x->attr_staps = atom_getlong(av);
+		if (x->attr_staps <= CM_SINC_MINTAPS) { // round up to the next tap count with a coefficient table
+			x->attr_staps = CM_SINC_MINTAPS;
+		}
+		else if (x->attr_staps <= 16) {
+			x->attr_staps = 16;
+		}
+		else {
+			x->attr_staps = CM_SINC_MAXTAPS;
+		}
+	}
+	return MAX_ERR_NONE;
+}
+
+
+/************************************************************************************************************************/
+/* THE SOURCE PYRAMID ATTRIBUTE SET METHOD                                                                              */
+/************************************************************************************************************************/
+t_max_err cmindexcloud_smipmap_set(t_cmindexcloud *x, t_object *attr, long ac, t_atom *av) {
+	if (ac && av) {
+		x->attr_smipmap = atom_getlong(av)? 1 : 0;
+		if (x->mipmap_qelem) { // build or drop the pyramid on the worker thread (not yet created when called from the new routine)
+			qelem_set(x->mipmap_qelem);
+		}
 	}
 	return MAX_ERR_NONE;
 }
@@ -1177,47 +1842,105 @@ t_max_err cmindexcloud_zero_set(t_cmindexcloud *x, t_object *attr, long ac, t_at
 	return MAX_ERR_NONE;
 }
 
+/************************************************************************************************************************/
+/* THE STREAMING PLAYBACK ATTRIBUTE SET METHOD                                                                          */
+/************************************************************************************************************************/
+t_max_err cmindexcloud_stream_set(t_cmindexcloud *x, t_object *attr, long ac, t_atom *av) {
+	if (ac && av) {
+		x->attr_stream = atom_getlong(av)? 1 : 0;
+	}
+	return MAX_ERR_NONE;
+}
+
+
+/************************************************************************************************************************/
+/* THE RANDOM SEED ATTRIBUTE SET METHOD                                                                                 */
+/************************************************************************************************************************/
+t_max_err cmindexcloud_seed_set(t_cmindexcloud *x, t_object *attr, long ac, t_atom *av) {
+	if (ac && av) {
+		x->attr_seed = atom_getlong(av);
+		cm_rng_reseed(&x->rng, x->attr_seed, x); // applied by the audio thread before the next grain
+	}
+	return MAX_ERR_NONE;
+}
+
+
+/************************************************************************************************************************/
+/* THE DETERMINISTIC MODE ATTRIBUTE SET METHOD                                                                          */
+/************************************************************************************************************************/
+t_max_err cmindexcloud_deterministic_set(t_cmindexcloud *x, t_object *attr, long ac, t_atom *av) {
+	if (ac && av) {
+		x->attr_deterministic = atom_getlong(av)? 1 : 0;
+		if (x->attr_deterministic && x->resize_qelem) { // rebuild the grain storage with all slabs allocated
+			x->resize_request = true;
+			qelem_set(x->resize_qelem);
+		}
+	}
+	return MAX_ERR_NONE;
+}
+
+
+/************************************************************************************************************************/
+/* THE FOOTPRINT METHOD                                                                                                 */
+/************************************************************************************************************************/
+void cmindexcloud_footprint(t_cmindexcloud *x) {
+	// memory the grains would take up if every slot was allocated for the longest grain at the highest pitch
+	double worstcase = (double)x->cloudsize * (x->grainlength * x->m_sr) * MAX_PITCH * 2 * sizeof(double);
+	cm_slab_footprint(x->pool, (t_object *)x, worstcase);
+	cm_envcache_footprint(x->envcache, (t_object *)x);
+}
+
+
+/************************************************************************************************************************/
+/* THE SLAB POOL GROW METHOD (CALLED FROM THE QELEM)                                                                    */
+/************************************************************************************************************************/
+void cmindexcloud_pool_grow(t_cmindexcloud *x) {
+	if (!cm_slab_grow(x->pool)) {
+		object_error((t_object *)x, "out of memory");
+	}
+}
+
+
+/************************************************************************************************************************/
+/* GRAIN MEMORY SIZE                                                                                                    */
+/************************************************************************************************************************/
+// number of bytes required for the longest possible grain (two channels)
+t_ptr_size cmindexcloud_grainbytes(t_cmindexcloud *x, long grainlength) {
+	return ((t_ptr_size)(grainlength * x->m_sr) + 1) * 2 * sizeof(float);
+}
+
 /************************************************************************************************************************/
 /* THE WINDOW_WRITE FUNCTION                                                                                            */
 /************************************************************************************************************************/
-void cmindexcloud_windowwrite(t_cmindexcloud *x) {
-	//	int i;
-	long length = x->window_length;
-	switch (x->window_type) {
+// write the window of the given type into a window array (main thread)
+void cm_windowwrite(double *window, long length, long type) {
+	switch (type) {
 		case 0:
-			object_post((t_object*)x, "hann - %d", length);
-			cm_hann(x->window, &length);
+			cm_hann(window, &length);
 			break;
 		case 1:
-			object_post((t_object*)x, "hamming - %d", length);
-			cm_hamming(x->window, &length);
+			cm_hamming(window, &length);
 			break;
 		case 2:
-			object_post((t_object*)x, "rectangular - %d", length);
-			cm_rectangular(x->window, &length);
+			cm_rectangular(window, &length);
 			break;
 		case 3:
-			object_post((t_object*)x, "bartlett - %d", length);
-			cm_bartlett(x->window, &length);
+			cm_bartlett(window, &length);
 			break;
 		case 4:
-			object_post((t_object*)x, "flattop - %d", length);
-			cm_flattop(x->window, &length);
+			cm_flattop(window, &length);
 			break;
 		case 5:
-			object_post((t_object*)x, "gauss (alpha 2) - %d", length);
-			cm_gauss2(x->window, &length);
+			cm_gauss2(window, &length);
 			break;
 		case 6:
-			object_post((t_object*)x, "gauss (alpha 4) - %d", length);
-			cm_gauss4(x->window, &length);
+			cm_gauss4(window, &length);
 			break;
 		case 7:
-			object_post((t_object*)x, "gauss (alpha 8) - %d", length);
-			cm_gauss8(x->window, &length);
+			cm_gauss8(window, &length);
 			break;
 		default:
-			cm_hann(x->window, &length);
+			cm_hann(window, &length);
 	}
 	return;
 }
@@ -1232,15 +1955,6 @@ void cm_panning(cm_panstruct *panstruct, double *pos, t_cmindexcloud *x) {
 	panstruct->right = x->root2ovr2 * (cos((*pos * x->piovr2) * 0.5) + sin((*pos * x->piovr2) * 0.5));
 	return;
 }
-// RANDOM NUMBER GENERATOR (USE POINTERS FOR MORE EFFICIENCY)
-double cm_random(double *min, double *max) {
-#ifdef MAC_VERSION
-	return *min + ((*max - *min) * (((double)arc4random_uniform(RANDMAX)) / (double)RANDMAX));
-#endif
-#ifdef WIN_VERSION
-	return *min + ((*max - *min) * ((double)(rand() % RANDMAX) / (double)RANDMAX));
-#endif
-}
 
 // LINEAR INTERPOLATION FUNCTION
 double cm_lininterp(double distance, float *buffer, t_atom_long b_channelcount, t_atom_long b_framecount, short channel) {
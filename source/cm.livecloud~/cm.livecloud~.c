@@ -27,7 +27,15 @@
 #include "buffer.h"
 #include "ext_atomic.h"
 #include "ext_obex.h"
-#include <stdlib.h> // for arc4random_uniform
+#include "../cm.shared/cm_slab.h" // slab allocator for the grain memory
+#include "../cm.shared/cm_trigger.h" // trigger detection pre-scan
+#include "../cm.shared/cm_swap.h" // grain storage handover between main and audio thread
+#include "../cm.shared/cm_render.h" // vectorized grain render kernels
+#include "../cm.shared/cm_envcache.h" // windows resampled to recent grain lengths
+#include "../cm.shared/cm_window.h" // internal copy of the window buffer
+#include "../cm.shared/cm_random.h" // per-instance random number generator
+#include "../cm.shared/cm_distrib.h" // distributions of the randomized grain parameters
+#include "../cm.shared/cm_queue.h" // event queue from the message methods to the audio thread
 #include <math.h> // for stereo functions
 #define MIN_CLOUDSIZE 1 // min cloud size in ms
 #define MIN_GRAINLENGTH 1 // min grain length in ms
@@ -39,7 +47,7 @@
 #define MAX_GAIN 2.0  // max gain
 #define ARGUMENTS 3 // constant number of arguments required for the external
 #define FLOAT_INLETS 10 // number of object float inlets
-#define RANDMAX 10000
+#define GRAIN_VALUES 5 // number of grain parameters of the grain message
 #define DEFAULT_BUFFERMS 2000
 #define MIN_BUFFERMS 100
 
@@ -48,14 +56,41 @@
 /* GRAIN MEMORY STORAGE                                                                                                 */
 /************************************************************************************************************************/
 typedef struct cmcloud {
-	double *left;
-	double *right;
+	float *left; // grain samples (windowed, without pan and gain)
+	float *right; // points to left (the ringbuffer is mono)
 	long length;
 	long pos;
-	t_bool busy; // used to store the flag if a grain is currently playing or not
+	long slab; // slab of the grain memory block in the slab pool
+	t_bool stream; // grain is rendered lazily in the playback loop (streaming engine)
+	t_bool retired; // grain was started before the last storage swap (its memory belongs to the retired storage)
+	double phase; // streaming engine: current read position in the ringbuffer
+	double incr; // streaming engine: ringbuffer read increment per output sample
+	double w_phase; // streaming engine: current read position in the window buffer
+	double w_incr; // streaming engine: window buffer read increment per output sample
+	double amp_left; // left output gain (pan * gain), applied during playback
+	double amp_right; // right output gain (pan * gain), applied during playback
 } cm_cloud;
 
 
+/************************************************************************************************************************/
+/* GRAIN STORAGE (BUILT ON THE MAIN THREAD)                                                                             */
+/************************************************************************************************************************/
+typedef struct cmstorage {
+	cm_cloud *cloud; // struct array for storing the grains
+	long *slots; // cloud slot indices
+	cm_slabpool *pool; // slab pool providing the grain memory
+	cm_envcache *envcache; // envelopes resampled to recent grain lengths
+	long slotcount; // number of entries in the cloud and slots arrays
+	long cloudsize; // max number of playing grains
+	long grainlength; // max grain length in ms
+	double *ringbuffer; // new ringbuffer (NULL if the ringbuffer length did not change)
+	long bufferms; // ringbuffer length in ms
+	long bufferframes; // ringbuffer length in samples
+	long writepos; // write position in the new ringbuffer
+	long snapshot; // write position of the current ringbuffer when its content was copied
+} cm_storage;
+
+
 /************************************************************************************************************************/
 /* OBJECT STRUCTURE                                                                                                     */
 /************************************************************************************************************************/
@@ -65,38 +100,58 @@ typedef struct _cmlivecloud {
 	t_buffer_ref *w_buffer; // window buffer reference
 	double m_sr; // system millisampling rate (samples per milliseconds = sr * 0.001)
 	short connect_status[FLOAT_INLETS]; // array for signal inlet connection statuses
-	double *object_inlets; // array to store the incoming values coming from the object inlets
+	double *object_inlets; // latest values of the float inlets (written by the message methods only, see cm_queue.h)
 	double *grain_params; // array to store the processed values coming from the object inlets
 	double *randomized; // array to store the randomized grain values
 	double tr_prev; // trigger sample from previous signal vector (required to check if input ramp resets to zero)
-	t_bool buffer_modified; // checkflag to see if buffer has been modified
-	short grains_count; // currently playing grains
+	cm_triggerscan scan; // trigger flags of the current signal vector
+	cm_sigparams sigparams; // signal-connected grain parameters, read at the trigger frame
+	long grains_count; // currently playing grains
 	void *grains_count_out; // outlet for number of currently playing grains (for debugging)
 	void *rec_position_out; // outlet for current record position in buffer
 	t_atom_long attr_winterp; // attribute: window interpolation on/off
-	t_atom_long attr_sinterp; // attribute: window interpolation on/off
+	t_atom_long attr_sinterp; // attribute: sample interpolation mode
+	t_atom_long attr_staps; // attribute: number of sinc interpolation taps
 	t_atom_long attr_zero; // attribute: zero crossing trigger on/off
+	t_atom_long attr_stream; // attribute: streaming grain playback on/off
+	t_atom_long attr_seed; // attribute: random seed (0: seed from the system time)
+	t_atom_long attr_deterministic; // attribute: deterministic render mode on/off
+	cm_rng rng; // random number generator of the grain parameters (see cm_random.h)
+	t_atom_long attr_dist[CM_DIST_PARAMS]; // attributes: distribution of each randomized grain parameter
+	t_symbol *dist_name; // histogram buffer name
+	t_buffer_ref *d_buffer; // histogram buffer reference (NULL until the first distbuffer message)
+	cm_dist dist; // inverse CDF tables of the histogram buffer (see cm_distrib.h)
+	void *dist_qelem; // qelem for building the distribution tables on the main thread
 	double piovr2; // pi over two for panning function
 	double root2ovr2; // root of 2 over two for panning function
 	double *ringbuffer; // circular buffer for recording the audio input
 	long bufferms; // length of internal circular
-	t_bool bufferms_request; // flag set to true when "bufferms" method called
 	long bufferms_new; // new buffer length obtained from the "bufferms" method
-	t_bool bufferms_verify; // check flag for proper memory re-allocation
 	long bufferframes; // size of buffer in samples
 	long writepos; // buffer write position
 	t_bool record; // record on/off flag from "record" method
 	t_bool recordflag; // boolean to indicate that recording has been started (disables recording until all currently playing grains have finished
-	t_bool bang_trigger; // trigger received from bang method
+	long bangs; // bangs waiting for a trigger frame
+	cm_queue queue; // events and float inlet values of the message methods (see cm_queue.h)
+	cm_schedule schedule; // grain messages of the current signal vector (see cm_queue.h)
 	cm_cloud *cloud; // struct array for storing the grains and associated variables in memory
-	long cloudsize; // size of the cloud struct array, value obtained from argument and "cloudsize" method
-	t_bool resize_request; // flag set to true when "cloudsize" method called
+	long *slots; // cloud slot indices: the playing grains (first grains_count entries) followed by the free slots
+	cm_slabpool *pool; // slab pool providing the grain memory
+	cm_envcache *envcache; // envelope cache of the grain storage (see cm_envcache.h)
+	void *pool_qelem; // qelem for growing the slab pool on the main thread
+	long cloudsize; // max number of playing grains, value obtained from argument and "cloudsize" method
 	long cloudsize_new; // new cloudsize obtained from "cloudsize" method
-	t_bool resize_verify; // check-flag for proper memroy re-allocation
 	long grainlength; // maximum grain length
-	t_bool length_request; // flag set to true when "grainlength" method called
 	long grainlength_new; // new grain length obtained from "grainlength" method
-	t_bool length_verify; // check flag for proper memory re-allocation
+	t_bool resize_request; // flag set to true when "cloudsize", "bufferms" or "grainlength" method called
+	t_bool reset_request; // flag set by the dsp method in deterministic mode: the audio thread clears the cloud
+	cm_storage pending; // grain storage built on the main thread, waiting to be installed by the audio thread
+	cm_storage retired; // grain storage replaced by the last swap (freed when its grains have finished)
+	long retired_grains; // number of playing grains belonging to the retired storage
+	t_int32_atomic swap_state; // state of the grain storage swap (see cm_swap.h)
+	void *resize_qelem; // qelem for rebuilding the grain storage on the main thread
+	cm_window window; // internal copy of the window buffer (see cm_window.h)
+	void *window_qelem; // qelem for copying the window buffer on the main thread
 } t_cmlivecloud;
 
 
@@ -122,28 +177,46 @@ static t_symbol *ps_buffer_modified, *ps_stereo;
 void *cmlivecloud_new(t_symbol *s, long argc, t_atom *argv);
 void cmlivecloud_dsp64(t_cmlivecloud *x, t_object *dsp64, short *count, double samplerate, long maxvectorsize, long flags);
 void cmlivecloud_perform64(t_cmlivecloud *x, t_object *dsp64, double **ins, long numins, double **outs, long numouts, long sampleframes, long flags, void *userparam);
+void cmlivecloud_mix(t_cmlivecloud *x, t_double *out_left, t_double *out_right, long frames, float *w_sample, long w_framecount);
+void cmlivecloud_writering(t_cmlivecloud *x, t_double *rec_sigin, long frames);
 void cmlivecloud_assist(t_cmlivecloud *x, void *b, long msg, long arg, char *dst);
 void cmlivecloud_free(t_cmlivecloud *x);
 void cmlivecloud_float(t_cmlivecloud *x, double f);
 void cmlivecloud_dblclick(t_cmlivecloud *x);
 t_max_err cmlivecloud_notify(t_cmlivecloud *x, t_symbol *s, t_symbol *msg, void *sender, void *data);
 void cmlivecloud_set(t_cmlivecloud *x, t_symbol *s, long ac, t_atom *av);
+void cmlivecloud_distbuffer(t_cmlivecloud *x, t_symbol *s, long ac, t_atom *av);
 void cmlivecloud_cloudsize(t_cmlivecloud *x, t_symbol *s, long ac, t_atom *av);
 void cmlivecloud_grainlength(t_cmlivecloud *x, t_symbol *s, long ac, t_atom *av);
 void cmlivecloud_record(t_cmlivecloud *x, t_symbol *s, long ac, t_atom *av);
 void cmlivecloud_bang(t_cmlivecloud *x);
+void cmlivecloud_grain(t_cmlivecloud *x, t_symbol *s, long ac, t_atom *av);
 t_max_err cmlivecloud_stereo_set(t_cmlivecloud *x, t_object *attr, long argc, t_atom *argv);
 t_max_err cmlivecloud_winterp_set(t_cmlivecloud *x, t_object *attr, long argc, t_atom *argv);
 t_max_err cmlivecloud_sinterp_set(t_cmlivecloud *x, t_object *attr, long argc, t_atom *argv);
+t_max_err cmlivecloud_staps_set(t_cmlivecloud *x, t_object *attr, long argc, t_atom *argv);
 t_max_err cmlivecloud_zero_set(t_cmlivecloud *x, t_object *attr, long argc, t_atom *argv);
-t_bool cmlivecloud_resize(t_cmlivecloud *x);
+t_max_err cmlivecloud_stream_set(t_cmlivecloud *x, t_object *attr, long argc, t_atom *argv);
+t_max_err cmlivecloud_seed_set(t_cmlivecloud *x, t_object *attr, long argc, t_atom *argv);
+t_max_err cmlivecloud_deterministic_set(t_cmlivecloud *x, t_object *attr, long argc, t_atom *argv);
+void cmlivecloud_dist_update(t_cmlivecloud *x);
+t_bool cmlivecloud_storage_new(t_cmlivecloud *x, cm_storage *storage, long cloudsize, long grainlength, long bufferms);
+void cmlivecloud_storage_free(cm_storage *storage);
+void cmlivecloud_rebuild(t_cmlivecloud *x);
+void cmlivecloud_window_update(t_cmlivecloud *x);
+void cmlivecloud_window_rescale(t_cmlivecloud *x, double scale);
+void cmlivecloud_swap(t_cmlivecloud *x);
+void cmlivecloud_finish(t_cmlivecloud *x, long i);
+void cmlivecloud_reset(t_cmlivecloud *x);
+void cmlivecloud_post(t_cmlivecloud *x, const cm_event *event);
+void cmlivecloud_events(t_cmlivecloud *x, long n);
+void cmlivecloud_footprint(t_cmlivecloud *x);
+void cmlivecloud_pool_grow(t_cmlivecloud *x);
+t_ptr_size cmlivecloud_grainbytes(t_cmlivecloud *x, long grainlength);
 void cmlivecloud_bufferms(t_cmlivecloud *x, t_symbol *s, long ac, t_atom *av);
-t_bool cmlivecloud_ringbuffer_resize(t_cmlivecloud *x);
 
 // PANNING FUNCTION
 void cm_panning(cm_panstruct *panstruct, double *pos, t_cmlivecloud *x);
-// RANDOM NUMBER GENERATOR
-double cm_random(double *min, double *max);
 // LINEAR INTERPOLATION FUNCTION
 double cm_lininterp(double distance, float *b_sample, t_atom_long b_channelcount, t_atom_long b_framecount, short channel);
 double cm_lininterpring(double distance, long index, long next, double *ringbuffer);
@@ -162,11 +235,14 @@ void ext_main(void *r) {
 	class_addmethod(cmlivecloud_class, (method)cmlivecloud_dblclick, 	"dblclick",		A_CANT, 0); // Bind the double click message
 	class_addmethod(cmlivecloud_class, (method)cmlivecloud_notify, 		"notify",		A_CANT, 0); // Bind the notify message
 	class_addmethod(cmlivecloud_class, (method)cmlivecloud_set, 		"set",			A_GIMME, 0); // Bind the set message for user buffer set
+	class_addmethod(cmlivecloud_class, (method)cmlivecloud_distbuffer,	"distbuffer",	A_GIMME, 0); // Bind the distbuffer message for the histogram buffer
 	class_addmethod(cmlivecloud_class, (method)cmlivecloud_cloudsize,	"cloudsize",	A_GIMME, 0); // Bind the cloudsize message
 	class_addmethod(cmlivecloud_class, (method)cmlivecloud_grainlength,	"grainlength",	A_GIMME, 0); // Bind the grainlength message
 	class_addmethod(cmlivecloud_class, (method)cmlivecloud_bufferms,	"bufferms",		A_GIMME, 0); // Bind the bufferms message
 	class_addmethod(cmlivecloud_class, (method)cmlivecloud_record, 		"record",		A_GIMME, 0); // Bind the record message
 	class_addmethod(cmlivecloud_class, (method)cmlivecloud_bang,		"bang",			0);
+	class_addmethod(cmlivecloud_class, (method)cmlivecloud_grain,		"grain",		A_GIMME, 0); // Bind the grain message for explicit grains
+	class_addmethod(cmlivecloud_class, (method)cmlivecloud_footprint,	"footprint",	0); // Bind the footprint message
 
 	CLASS_ATTR_ATOM_LONG(cmlivecloud_class, "w_interp", 0, t_cmlivecloud, attr_winterp);
 	CLASS_ATTR_ACCESSORS(cmlivecloud_class, "w_interp", (method)NULL, (method)cmlivecloud_winterp_set);
@@ -178,7 +254,14 @@ void ext_main(void *r) {
 	CLASS_ATTR_ACCESSORS(cmlivecloud_class, "s_interp", (method)NULL, (method)cmlivecloud_sinterp_set);
 	CLASS_ATTR_BASIC(cmlivecloud_class, "s_interp", 0);
 	CLASS_ATTR_SAVE(cmlivecloud_class, "s_interp", 0);
-	CLASS_ATTR_STYLE_LABEL(cmlivecloud_class, "s_interp", 0, "onoff", "Sample interpolation on/off");
+	CLASS_ATTR_ENUMINDEX(cmlivecloud_class, "s_interp", 0, "off linear hermite lagrange sinc");
+	CLASS_ATTR_STYLE_LABEL(cmlivecloud_class, "s_interp", 0, "enumindex", "Sample interpolation mode");
+	
+	CLASS_ATTR_ATOM_LONG(cmlivecloud_class, "s_taps", 0, t_cmlivecloud, attr_staps);
+	CLASS_ATTR_ACCESSORS(cmlivecloud_class, "s_taps", (method)NULL, (method)cmlivecloud_staps_set);
+	CLASS_ATTR_BASIC(cmlivecloud_class, "s_taps", 0);
+	CLASS_ATTR_SAVE(cmlivecloud_class, "s_taps", 0);
+	CLASS_ATTR_STYLE_LABEL(cmlivecloud_class, "s_taps", 0, "text", "Sinc interpolation taps (8, 16, 32)");
 
 	CLASS_ATTR_ATOM_LONG(cmlivecloud_class, "zero", 0, t_cmlivecloud, attr_zero);
 	CLASS_ATTR_ACCESSORS(cmlivecloud_class, "zero", (method)NULL, (method)cmlivecloud_zero_set);
@@ -186,14 +269,79 @@ void ext_main(void *r) {
 	CLASS_ATTR_SAVE(cmlivecloud_class, "zero", 0);
 	CLASS_ATTR_STYLE_LABEL(cmlivecloud_class, "zero", 0, "onoff", "Zero crossing trigger mode on/off");
 
+	CLASS_ATTR_ATOM_LONG(cmlivecloud_class, "stream", 0, t_cmlivecloud, attr_stream);
+	CLASS_ATTR_ACCESSORS(cmlivecloud_class, "stream", (method)NULL, (method)cmlivecloud_stream_set);
+	CLASS_ATTR_BASIC(cmlivecloud_class, "stream", 0);
+	CLASS_ATTR_SAVE(cmlivecloud_class, "stream", 0);
+	CLASS_ATTR_STYLE_LABEL(cmlivecloud_class, "stream", 0, "onoff", "Streaming grain playback on/off");
+
+	CLASS_ATTR_ATOM_LONG(cmlivecloud_class, "seed", 0, t_cmlivecloud, attr_seed);
+	CLASS_ATTR_ACCESSORS(cmlivecloud_class, "seed", (method)NULL, (method)cmlivecloud_seed_set);
+	CLASS_ATTR_BASIC(cmlivecloud_class, "seed", 0);
+	CLASS_ATTR_SAVE(cmlivecloud_class, "seed", 0);
+	CLASS_ATTR_STYLE_LABEL(cmlivecloud_class, "seed", 0, "text", "Random seed (0 = seed from the system time)");
+
+	CLASS_ATTR_ATOM_LONG(cmlivecloud_class, "deterministic", 0, t_cmlivecloud, attr_deterministic);
+	CLASS_ATTR_ACCESSORS(cmlivecloud_class, "deterministic", (method)NULL, (method)cmlivecloud_deterministic_set);
+	CLASS_ATTR_BASIC(cmlivecloud_class, "deterministic", 0);
+	CLASS_ATTR_SAVE(cmlivecloud_class, "deterministic", 0);
+	CLASS_ATTR_STYLE_LABEL(cmlivecloud_class, "deterministic", 0, "onoff", "Deterministic render mode on/off");
+
+	CLASS_ATTR_ATOM_LONG(cmlivecloud_class, "d_delay", 0, t_cmlivecloud, attr_dist[0]);
+	CLASS_ATTR_FILTER_CLIP(cmlivecloud_class, "d_delay", 0, CM_DIST_KINDS - 1);
+	CLASS_ATTR_BASIC(cmlivecloud_class, "d_delay", 0);
+	CLASS_ATTR_SAVE(cmlivecloud_class, "d_delay", 0);
+	CLASS_ATTR_ENUMINDEX(cmlivecloud_class, "d_delay", 0, "uniform triangular gauss exponential buffer");
+	CLASS_ATTR_STYLE_LABEL(cmlivecloud_class, "d_delay", 0, "enumindex", "Delay distribution");
+	
+	CLASS_ATTR_ATOM_LONG(cmlivecloud_class, "d_length", 0, t_cmlivecloud, attr_dist[1]);
+	CLASS_ATTR_FILTER_CLIP(cmlivecloud_class, "d_length", 0, CM_DIST_KINDS - 1);
+	CLASS_ATTR_BASIC(cmlivecloud_class, "d_length", 0);
+	CLASS_ATTR_SAVE(cmlivecloud_class, "d_length", 0);
+	CLASS_ATTR_ENUMINDEX(cmlivecloud_class, "d_length", 0, "uniform triangular gauss exponential buffer");
+	CLASS_ATTR_STYLE_LABEL(cmlivecloud_class, "d_length", 0, "enumindex", "Grain length distribution");
+	
+	CLASS_ATTR_ATOM_LONG(cmlivecloud_class, "d_pitch", 0, t_cmlivecloud, attr_dist[2]);
+	CLASS_ATTR_FILTER_CLIP(cmlivecloud_class, "d_pitch", 0, CM_DIST_KINDS - 1);
+	CLASS_ATTR_BASIC(cmlivecloud_class, "d_pitch", 0);
+	CLASS_ATTR_SAVE(cmlivecloud_class, "d_pitch", 0);
+	CLASS_ATTR_ENUMINDEX(cmlivecloud_class, "d_pitch", 0, "uniform triangular gauss exponential buffer");
+	CLASS_ATTR_STYLE_LABEL(cmlivecloud_class, "d_pitch", 0, "enumindex", "Pitch distribution");
+	
+	CLASS_ATTR_ATOM_LONG(cmlivecloud_class, "d_pan", 0, t_cmlivecloud, attr_dist[3]);
+	CLASS_ATTR_FILTER_CLIP(cmlivecloud_class, "d_pan", 0, CM_DIST_KINDS - 1);
+	CLASS_ATTR_BASIC(cmlivecloud_class, "d_pan", 0);
+	CLASS_ATTR_SAVE(cmlivecloud_class, "d_pan", 0);
+	CLASS_ATTR_ENUMINDEX(cmlivecloud_class, "d_pan", 0, "uniform triangular gauss exponential buffer");
+	CLASS_ATTR_STYLE_LABEL(cmlivecloud_class, "d_pan", 0, "enumindex", "Pan distribution");
+	
+	CLASS_ATTR_ATOM_LONG(cmlivecloud_class, "d_gain", 0, t_cmlivecloud, attr_dist[4]);
+	CLASS_ATTR_FILTER_CLIP(cmlivecloud_class, "d_gain", 0, CM_DIST_KINDS - 1);
+	CLASS_ATTR_BASIC(cmlivecloud_class, "d_gain", 0);
+	CLASS_ATTR_SAVE(cmlivecloud_class, "d_gain", 0);
+	CLASS_ATTR_ENUMINDEX(cmlivecloud_class, "d_gain", 0, "uniform triangular gauss exponential buffer");
+	CLASS_ATTR_STYLE_LABEL(cmlivecloud_class, "d_gain", 0, "enumindex", "Gain distribution");
+	
 	CLASS_ATTR_ORDER(cmlivecloud_class, "w_interp", 0, "1");
 	CLASS_ATTR_ORDER(cmlivecloud_class, "s_interp", 0, "2");
-	CLASS_ATTR_ORDER(cmlivecloud_class, "zero", 0, "3");
+	CLASS_ATTR_ORDER(cmlivecloud_class, "s_taps", 0, "3");
+	CLASS_ATTR_ORDER(cmlivecloud_class, "zero", 0, "4");
+	CLASS_ATTR_ORDER(cmlivecloud_class, "stream", 0, "5");
+	CLASS_ATTR_ORDER(cmlivecloud_class, "seed", 0, "6");
+	CLASS_ATTR_ORDER(cmlivecloud_class, "deterministic", 0, "7");
+	CLASS_ATTR_ORDER(cmlivecloud_class, "d_delay", 0, "8");
+	CLASS_ATTR_ORDER(cmlivecloud_class, "d_length", 0, "9");
+	CLASS_ATTR_ORDER(cmlivecloud_class, "d_pitch", 0, "10");
+	CLASS_ATTR_ORDER(cmlivecloud_class, "d_pan", 0, "11");
+	CLASS_ATTR_ORDER(cmlivecloud_class, "d_gain", 0, "12");
 
 	class_dspinit(cmlivecloud_class); // Add standard Max/MSP methods to your class
 	class_register(CLASS_BOX, cmlivecloud_class); // Register the class with Max
 	ps_buffer_modified = gensym("buffer_modified"); // assign the buffer modified message to the static pointer created above
 	ps_stereo = gensym("stereo");
+	
+	cm_render_init(); // select the grain render kernels for this CPU
+	cm_dist_setup(); // build the inverse CDF table of the gauss distribution
 }
 
 
@@ -201,7 +349,6 @@ void ext_main(void *r) {
 /* NEW INSTANCE ROUTINE                                                                                                 */
 /************************************************************************************************************************/
 void *cmlivecloud_new(t_symbol *s, long argc, t_atom *argv) {
-	int i;
 	t_cmlivecloud *x = (t_cmlivecloud *)object_alloc(cmlivecloud_class); // create the object and allocate required memory
 	dsp_setup((t_pxobject *)x, 12); // create 12 inlets
 
@@ -230,9 +377,19 @@ void *cmlivecloud_new(t_symbol *s, long argc, t_atom *argv) {
 	}
 
 	// HANDLE ATTRIBUTES
+	cm_rng_init(&x->rng, 0, x); // random number generator of the grain parameters (seeded by the seed attribute)
 	object_attr_setlong(x, gensym("w_interp"), 0); // initialize window interpolation attribute
 	object_attr_setlong(x, gensym("s_interp"), 1); // initialize window interpolation attribute
+	object_attr_setlong(x, gensym("s_taps"), CM_SINC_DEFTAPS); // initialize sinc taps attribute
 	object_attr_setlong(x, gensym("zero"), 0); // initialize zero crossing attribute
+	object_attr_setlong(x, gensym("stream"), 0); // initialize streaming playback attribute
+	object_attr_setlong(x, gensym("seed"), 0); // initialize random seed attribute
+	object_attr_setlong(x, gensym("deterministic"), 0); // initialize deterministic mode attribute
+	object_attr_setlong(x, gensym("d_delay"), CM_DIST_UNIFORM); // initialize delay distribution attribute
+	object_attr_setlong(x, gensym("d_length"), CM_DIST_UNIFORM); // initialize grain length distribution attribute
+	object_attr_setlong(x, gensym("d_pitch"), CM_DIST_UNIFORM); // initialize pitch distribution attribute
+	object_attr_setlong(x, gensym("d_pan"), CM_DIST_UNIFORM); // initialize pan distribution attribute
+	object_attr_setlong(x, gensym("d_gain"), CM_DIST_UNIFORM); // initialize gain distribution attribute
 	attr_args_process(x, argc, argv); // get attribute values if supplied as argument
 
 	// CHECK IF USER SUPPLIED MAXIMUM GRAINS IS IN THE LEGAL RANGE
@@ -286,26 +443,21 @@ void *cmlivecloud_new(t_symbol *s, long argc, t_atom *argv) {
 		return NULL;
 	}
 	
-	// ALLOCATE MEMORY FOR THE cloud ARRAY
-	x->cloud = (cm_cloud *)sysmem_newptrclear((x->cloudsize) * sizeof(cm_cloud));
-	if (x->cloud == NULL) {
+	// ALLOCATE THE GRAIN STORAGE (CLOUD ARRAY, SLOT INDEX ARRAY AND SLAB POOL)
+	if (!cmlivecloud_storage_new(x, &x->pending, x->cloudsize, x->grainlength, x->bufferms)) {
 		object_error((t_object *)x, "out of memory");
 		return NULL;
 	}
-	
-	// ALLOCATE MEMORY FOR THE GRAIN ARRAY IN EACH MEMBER OF THE cloud STRUCT
-	for (i = 0; i < x->cloudsize; i++) {
-		x->cloud[i].left = (double *)sysmem_newptrclear(((x->grainlength * x->m_sr) * MAX_PITCH) * sizeof(double));
-		if (x->cloud[i].left == NULL) {
-			object_error((t_object *)x, "out of memory");
-			return NULL;
-		}
-		x->cloud[i].right = (double *)sysmem_newptrclear(((x->grainlength * x->m_sr) * MAX_PITCH) * sizeof(double));
-		if (x->cloud[i].right == NULL) {
-			object_error((t_object *)x, "out of memory");
-			return NULL;
-		}
-	}
+	x->cloud = x->pending.cloud;
+	x->slots = x->pending.slots;
+	x->pool = x->pending.pool;
+	x->envcache = x->pending.envcache;
+	memset(&x->pending, 0, sizeof(cm_storage));
+	memset(&x->retired, 0, sizeof(cm_storage));
+	x->pool_qelem = qelem_new(x, (method)cmlivecloud_pool_grow); // grows the slab pool on the main thread
+	x->resize_qelem = qelem_new(x, (method)cmlivecloud_rebuild); // rebuilds the grain storage on the main thread
+	x->window_qelem = qelem_new(x, (method)cmlivecloud_window_update); // copies the window buffer on the main thread
+	x->dist_qelem = qelem_new(x, (method)cmlivecloud_dist_update); // builds the distribution tables on the main thread
 
 
 	
@@ -323,7 +475,6 @@ void *cmlivecloud_new(t_symbol *s, long argc, t_atom *argv) {
 	x->object_inlets[9] = 1.0; // initialize value for max gain
 	x->tr_prev = 0.0; // initialize value for previous trigger sample
 	x->grains_count = 0; // initialize the grains count value
-	x->buffer_modified = false; // initialized buffer modified flag
 
 	x->writepos = 0;
 	x->bufferframes = x->bufferms * x->m_sr;
@@ -333,35 +484,31 @@ void *cmlivecloud_new(t_symbol *s, long argc, t_atom *argv) {
 	x->piovr2 = 4.0 * atan(1.0) * 0.5;
 	x->root2ovr2 = sqrt(2.0) * 0.5;
 	
-	// bang trigger flag
-	x->bang_trigger = false;
-	
-	// cloud structure members
-	for (i = 0; i < x->cloudsize; i++) {
-		x->cloud[i].length = 0;
-		x->cloud[i].pos = 0;
-		x->cloud[i].busy = false;
+	// pending bangs and the event queue of the message methods
+	x->bangs = 0;
+	cm_schedule_clear(&x->schedule);
+	if (!cm_queue_init(&x->queue, x->object_inlets, FLOAT_INLETS)) {
+		object_error((t_object *)x, "out of memory");
+		return NULL;
 	}
 	
 	x->cloudsize_new = x->cloudsize;
 	x->grainlength_new = x->grainlength;
 	
-	x->resize_request = false;
-	x->resize_verify = false;
-	
-	x->length_request = false;
-	x->length_verify = false;
+	x->bufferms_new = x->bufferms;
 	
-	x->bufferms_request = false;
-	x->bufferms_verify = false;
+	x->resize_request = false;
+	x->retired_grains = 0;
+	x->swap_state = CM_SWAP_IDLE;
+	cm_window_init(&x->window);
+	cm_dist_init(&x->dist);
+	x->dist_name = NULL;
+	x->d_buffer = NULL; // created by the first distbuffer message
 
 	/************************************************************************************************************************/
 	// BUFFER REFERENCES
 	x->w_buffer = buffer_ref_new((t_object *)x, x->window_name); // write the window buffer reference into the object structure
-
-	#ifdef WIN_VERSION
-		srand((unsigned int)clock());
-	#endif
+	qelem_set(x->window_qelem); // copy the window buffer on the main thread
 
 	return x;
 }
@@ -371,7 +518,6 @@ void *cmlivecloud_new(t_symbol *s, long argc, t_atom *argv) {
 /* THE 64 BIT DSP METHOD                                                                                                */
 /************************************************************************************************************************/
 void cmlivecloud_dsp64(t_cmlivecloud *x, t_object *dsp64, short *count, double samplerate, long maxvectorsize, long flags) {
-	int i;
 	x->connect_status[0] = count[2]; // signal connect status:	delay min
 	x->connect_status[1] = count[3]; // signal connect status:	delay max
 	x->connect_status[2] = count[4]; // signal connect status:	length min
@@ -385,20 +531,9 @@ void cmlivecloud_dsp64(t_cmlivecloud *x, t_object *dsp64, short *count, double s
 
 	if (x->m_sr != samplerate * 0.001) { // check if sample rate stored in object structure is the same as the current project sample rate
 		x->m_sr = samplerate * 0.001;
-		for (i = 0; i < x->cloudsize; i++) {
-			x->cloud[i].left = (double *)sysmem_resizeptrclear(x->cloud[i].left, ((x->grainlength * x->m_sr) * MAX_PITCH) * sizeof(double));
-			if (x->cloud[i].left == NULL) {
-				object_error((t_object *)x, "out of memory");
-				return;
-			}
-		}
-		for (i = 0; i < x->cloudsize; i++) {
-			x->cloud[i].right = (double *)sysmem_resizeptrclear(x->cloud[i].right, ((x->grainlength * x->m_sr) * MAX_PITCH) * sizeof(double));
-			if (x->cloud[i].right == NULL) {
-				object_error((t_object *)x, "out of memory");
-				return;
-			}
-		}
+		// the size classes of the slab pool depend on the sample rate: rebuild the grain storage on the main thread
+		x->resize_request = true;
+		qelem_set(x->resize_qelem);
 		x->ringbuffer = (double *)sysmem_resizeptrclear(x->ringbuffer, (x->bufferms * x->m_sr) * sizeof(double));
 		if (x->ringbuffer == NULL) {
 			object_error((t_object *)x, "out of memory");
@@ -408,6 +543,22 @@ void cmlivecloud_dsp64(t_cmlivecloud *x, t_object *dsp64, short *count, double s
 
 	x->bufferframes = x->bufferms * x->m_sr;
 
+	// DETERMINISTIC MODE: FINISH THE MAIN THREAD WORK NOW (INSTALLED WITH THE FIRST SIGNAL VECTOR), RESTART THE RANDOM
+	// SEQUENCE AND LET THE AUDIO THREAD CLEAR THE CLOUD
+	if (x->attr_deterministic) {
+		cmlivecloud_rebuild(x);
+		cmlivecloud_window_update(x);
+		cmlivecloud_dist_update(x);
+		cm_rng_reseed(&x->rng, x->attr_seed ? x->attr_seed : CM_RNG_DEFAULTSEED, x);
+		x->reset_request = true;
+	}
+	
+	// ALLOCATE THE TRIGGER FLAGS FOR THE MAX VECTOR SIZE
+	if (!cm_trigger_resize(&x->scan, maxvectorsize)) {
+		object_error((t_object *)x, "out of memory");
+		return;
+	}
+	
 	// CALL THE PERFORM ROUTINE
 	object_method(dsp64, gensym("dsp_add64"), x, cmlivecloud_perform64, 0, NULL);
 }
@@ -419,19 +570,16 @@ void cmlivecloud_dsp64(t_cmlivecloud *x, t_object *dsp64, short *count, double s
 void cmlivecloud_perform64(t_cmlivecloud *x, t_object *dsp64, double **ins, long numins, double **outs, long numouts, long sampleframes, long flags, void *userparam) {
 	// VARIABLE DECLARATIONS
 	t_bool trigger = false; // trigger occurred yes/no
-	long i, r; // for loop counterS
+	t_bool scheduled; // the trigger is a grain message
+	long tr_frame; // frame of the next signal trigger or bang (n: none)
+	const double *inlets; // latest float inlet values (see cm_queue.h)
 	long n = sampleframes; // number of samples per signal vector
-	double tr_curr, sig_curr; // current trigger and signal value
-	double distance; // floating point index for reading from buffers
-	long next;
-	long index; // truncated index for reading from buffers
-	double w_read, b_read; // current sample read from the window buffer
-	double outsample_left = 0.0; // temporary left output sample used for adding up all grain samples
-	double outsample_right = 0.0; // temporary right output sample used for adding up all grain samples
+	long frame; // current frame in the signal vector
+	long mixed = 0; // number of frames already mixed into the output vectors
+	long recorded = 0; // number of frames already recorded into the ringbuffer
 	int slot = 0; // variable for the current slot in the arrays to write grain info to
 	cm_panstruct panstruct; // struct for holding the calculated constant power left and right stereo values
 	
-	long readpos;
 	double start;
 	double smp_length;
 	double pitch_length;
@@ -444,87 +592,66 @@ void cmlivecloud_perform64(t_cmlivecloud *x, t_object *dsp64, double **ins, long
 	t_double *out_right = (t_double *)outs[1]; // assign pointer to right output
 	
 	// BUFFER VARIABLE DECLARATIONS
-	t_buffer_obj *w_buffer = buffer_ref_getobject(x->w_buffer);
-	float *w_sample = buffer_locksamples(w_buffer);
-	long w_framecount; // number of frames in the window buffer
-	t_atom_long w_channelcount; // number of channels in the window buffer
+	float *w_sample; // internal copy of the window buffer (the window buffer itself is never locked)
+	long w_framecount; // number of frames in the window table
+	double w_scale; // factor from positions in the replaced window table to positions in the new one
+	float *envelope; // window resampled to the grain length
+	t_bool cached; // envelope taken from the envelope cache
 	
-	// CLOUDSIZE - MEMORY RESIZE
-	if (x->grains_count == 0 && x->resize_request) {
-		// allocate new memory and check if all went well
-		x->resize_verify = cmlivecloud_resize(x);
-		if (x->resize_verify) { // if all OK
-			x->resize_verify = false;
-			x->resize_request = false;
-		}
-		else {
-			// if mem-allocation fails, go to zero and try again next time:
-			// x->resize_request is not reset
-			goto zero;
-		}
+	// DETERMINISTIC MODE: CLEAR THE CLOUD WITH THE FIRST SIGNAL VECTOR AFTER THE DSP START
+	if (x->reset_request) {
+		cmlivecloud_reset(x);
 	}
-	
-	// CLOUDSIZE - GRAIN LENGTH
-	if (x->grains_count == 0 && x->length_request) {
-		// allocate new memory and check if all went well
-		x->length_verify = cmlivecloud_resize(x);
-		if (x->length_verify) { // if all OK
-			x->length_verify = false;
-			x->length_request = false;
-		}
-		else {
-			// if mem-allocation fails, go to zero and try again next time:
-			// x->length_request is not reset
-			goto zero;
-		}
+	// MESSAGE EVENTS: APPLY THE BANGS, GRAIN MESSAGES AND RECORD SWITCHES IN THE ORDER THEY WERE SENT, READ THE LATEST FLOAT INLET VALUES
+	cmlivecloud_events(x, n);
+	inlets = cm_queue_params(&x->queue);
+	// GRAIN STORAGE SWAP: INSTALL THE STORAGE BUILT ON THE MAIN THREAD
+	if (x->swap_state == CM_SWAP_READY) {
+		cmlivecloud_swap(x);
 	}
-	
-	// RINGBUFFER - MEMORY RESIZE
-	if (x->grains_count == 0 && x->bufferms_request) {
-		// allocate new memory and check if all went well
-		x->bufferms_verify = cmlivecloud_ringbuffer_resize(x);
-		if (x->bufferms_verify) { // if all OK
-			x->bufferms_verify = false;
-			x->bufferms_request = false;
-		}
-		else {
-			// if mem-allocation fails, go to zero and try again next time:
-			// x->bufferms_request is not reset
-			goto zero;
-		}
+	// DISTRIBUTION TABLE SWAP: INSTALL THE HISTOGRAM TABLES BUILT ON THE MAIN THREAD
+	if (cm_dist_install(&x->dist)) {
+		qelem_set(x->dist_qelem);
 	}
-	
-	if (x->grains_count == 0 && x->buffer_modified) {
-		x->buffer_modified = false;
+	if (x->d_buffer && cm_dist_check(&x->dist, buffer_ref_getobject(x->d_buffer))) {
+		qelem_set(x->dist_qelem);
+	}
+	// WINDOW TABLE SWAP: INSTALL THE TABLE COPIED ON THE MAIN THREAD (STREAMING GRAINS KEEP THEIR RELATIVE POSITION)
+	if (cm_window_install(&x->window, &w_scale)) {
+		cmlivecloud_window_rescale(x, w_scale);
+		cm_envcache_clear(x->envcache); // the envelopes were resampled from the replaced table
+		qelem_set(x->window_qelem);
+	}
+	if (cm_window_check(&x->window, buffer_ref_getobject(x->w_buffer))) {
+		qelem_set(x->window_qelem);
 	}
+	w_sample = x->window.active ? x->window.active->samples : NULL;
+	w_framecount = x->window.active ? x->window.active->length : 0;
 	
 	if (x->grains_count == 0 && x->recordflag) {
 		x->recordflag = false;
 	}
 
 	// BUFFER CHECKS
-	if (!w_sample) { // if the sample buffer does not exist
+	if (!w_sample) { // if the window buffer does not exist
 		goto zero;
 	}
 
-	// GET BUFFER INFORMATION
-	w_framecount = buffer_getframecount(w_buffer); // get number of frames in the window buffer
-	w_channelcount = buffer_getchannelcount(w_buffer); // get number of channels in the sample buffer
-
 	// GET INLET VALUES
 	t_double *tr_sigin		= (t_double *)ins[0]; // get trigger input signal from 1st inlet
 	t_double *rec_sigin	= (t_double *)ins[1]; // get trigger input signal from 1st inlet
 
-	x->grain_params[0] = x->connect_status[0] ? *ins[2] * x->m_sr : x->object_inlets[0] * x->m_sr;	// delay min
-	x->grain_params[1] = x->connect_status[1] ? *ins[3] * x->m_sr : x->object_inlets[1] * x->m_sr;	// delay max
-	x->grain_params[2] = x->connect_status[2] ? *ins[4] * x->m_sr : x->object_inlets[2] * x->m_sr;	// length min
-	x->grain_params[3] = x->connect_status[3] ? *ins[5] * x->m_sr : x->object_inlets[3] * x->m_sr;	// length max
-	x->grain_params[4] = x->connect_status[4] ? *ins[6] : x->object_inlets[4];						// pitch min
-	x->grain_params[5] = x->connect_status[5] ? *ins[7] : x->object_inlets[5];						// pitch max
-	x->grain_params[6] = x->connect_status[6] ? *ins[8] : x->object_inlets[6];						// pan min
-	x->grain_params[7] = x->connect_status[7] ? *ins[9] : x->object_inlets[7];						// pan max
-	x->grain_params[8] = x->connect_status[8] ? *ins[10] : x->object_inlets[8];						// gain min
-	x->grain_params[9] = x->connect_status[9] ? *ins[11] : x->object_inlets[9];						// gain max
+	x->grain_params[0] = x->connect_status[0] ? *ins[2] * x->m_sr : inlets[0] * x->m_sr;	// delay min
+	x->grain_params[1] = x->connect_status[1] ? *ins[3] * x->m_sr : inlets[1] * x->m_sr;	// delay max
+	x->grain_params[2] = x->connect_status[2] ? *ins[4] * x->m_sr : inlets[2] * x->m_sr;	// length min
+	x->grain_params[3] = x->connect_status[3] ? *ins[5] * x->m_sr : inlets[3] * x->m_sr;	// length max
+	x->grain_params[4] = x->connect_status[4] ? *ins[6] : inlets[4];						// pitch min
+	x->grain_params[5] = x->connect_status[5] ? *ins[7] : inlets[5];						// pitch max
+	x->grain_params[6] = x->connect_status[6] ? *ins[8] : inlets[6];						// pan min
+	x->grain_params[7] = x->connect_status[7] ? *ins[9] : inlets[7];						// pan max
+	x->grain_params[8] = x->connect_status[8] ? *ins[10] : inlets[8];						// gain min
+	x->grain_params[9] = x->connect_status[9] ? *ins[11] : inlets[9];						// gain max
+	cm_sigparams_collect(&x->sigparams, x->connect_status, ins + 2, FLOAT_INLETS, 4, x->m_sr); // signal inlets are read again at each trigger frame
 	
 	
 	if (x->grain_params[2] > x->grainlength * x->m_sr) {
@@ -535,63 +662,50 @@ void cmlivecloud_perform64(t_cmlivecloud *x, t_object *dsp64, double **ins, long
 	}
 	
 
-	// DSP LOOP
-	while (n--) {
-		tr_curr = *tr_sigin++; // get current trigger value
-		sig_curr = *rec_sigin++; // get current signal value
-
-		// WRITE INTO RINGBUFFER:
-		if (x->record && !x->bufferms_request) {
-			x->ringbuffer[x->writepos++] = sig_curr;
-			if (x->writepos == x->bufferframes) {
-				x->writepos = 0;
-			}
-		}
-
-
-		// process trigger value
-		if (x->attr_zero) { // if zero crossing attr is set
-			if (signbit(tr_curr) != signbit(x->tr_prev)) { // zero crossing from negative to positive
-				trigger = true;
-			}
-			else if (x->bang_trigger) {
-				trigger = true;
-				x->bang_trigger = false;
-			}
-		}
-		else { // if zero crossing attr is not set
-			if ((x->tr_prev - tr_curr) > 0.9) {
-				trigger = true;
-			}
-			else if (x->bang_trigger) {
-				trigger = true;
-				x->bang_trigger = false;
-			}
-		}
-
+	// TRIGGER PRE-SCAN
+	if (!cm_trigger_scan(&x->scan, tr_sigin, n, &x->tr_prev, x->attr_zero, &x->bangs)) {
+		goto zero;
+	}
+	
+	// DSP LOOP (FROM TRIGGER TO TRIGGER)
+	// clear the output vectors: the playing grains are added to them grain by grain
+	for (frame = 0; frame < n; frame++) {
+		out_left[frame] = 0.0;
+		out_right[frame] = 0.0;
+	}
+	tr_frame = cm_trigger_next(&x->scan, -1);
+	frame = cm_schedule_next(&x->schedule, tr_frame, 0);
+	while (frame < n) {
+		trigger = true;
+		scheduled = cm_schedule_due(&x->schedule, frame); // grain messages start before a signal trigger at the same frame
+		
+		// WRITE INTO RINGBUFFER (UP TO AND INCLUDING THE TRIGGER FRAME)
+		cmlivecloud_writering(x, rec_sigin + recorded, frame + 1 - recorded);
+		recorded = frame + 1;
+		
 		/************************************************************************************************************************/
 		// IN CASE OF TRIGGER, LIMIT NOT MODIFIED AND GRAINS COUNT IN THE LEGAL RANGE (AVAILABLE SLOTS)
-		if (trigger && x->grains_count < x->cloudsize && !x->resize_request && !x->length_request && !x->bufferms_request && !x->recordflag && !x->buffer_modified && w_sample) {
+		if (trigger && !x->recordflag && w_sample) {
+			// mix the playing grains up to the trigger position first: grains which have finished free their slots
+			cmlivecloud_mix(x, out_left + mixed, out_right + mixed, frame - mixed, w_sample, w_framecount);
+			mixed = frame;
+		}
+		if (trigger && x->grains_count < x->cloudsize && !x->recordflag && w_sample) {
 
 			trigger = false; // reset trigger
+			// TAKE THE FIRST FREE SLOT FOR THE NEW GRAIN
+			slot = x->slots[x->grains_count];
 			x->grains_count++; // increment grains_count
 
-			// FIND A FREE SLOT FOR THE NEW GRAIN
-			i = 0;
-			while (i < x->cloudsize) {
-				if (!x->cloud[i].busy) {
-					x->cloud[i].busy = true;
-					slot = i;
-					break;
-				}
-				i++;
-			}
-
 			
-			// randomize grain parameters
-			for (i = 0; i < 5; i++) {
-				r = i * 2;
-				x->randomized[i] = cm_random(&x->grain_params[r], &x->grain_params[r+1]);
+			if (scheduled) { // grain message: the grain parameters are given, nothing is randomized
+				cm_schedule_take(&x->schedule, x->randomized, GRAIN_VALUES, 2, x->m_sr); // the first two parameters in ms
+			}
+			else { // randomize grain parameters
+				cm_sigparams_read(&x->sigparams, x->grain_params, frame); // grain parameters of the signal inlets at the trigger frame
+				cm_rng_update(&x->rng); // apply a seed requested on the main thread
+				cm_dist_fill(&x->rng, x->grain_params, x->randomized, 5, x->attr_dist, x->dist.active); // draw all randomized grain parameters of the trigger
+				tr_frame = cm_trigger_next(&x->scan, frame);
 			}
 
 			// check for parameter sanity for delay value
@@ -643,9 +757,33 @@ void cmlivecloud_perform64(t_cmlivecloud *x, t_object *dsp64, double **ins, long
 				pitch_length = x->bufferframes;
 			}
 
+			x->cloud[slot].stream = x->attr_stream;
+			x->cloud[slot].retired = false;
+
+			// get the grain memory from the slab pool: if the pool is exhausted, play the grain with the streaming engine
+			// and let the main thread add another slab
+			if (!x->cloud[slot].stream) {
+				x->cloud[slot].left = (float *)cm_slab_alloc(x->pool, (long)ceil(smp_length) * sizeof(float), &x->cloud[slot].slab);
+				if (x->cloud[slot].left) {
+					x->cloud[slot].right = x->cloud[slot].left; // mono grain: pan and gain are applied during playback
+				}
+				else {
+					x->cloud[slot].stream = true;
+					qelem_set(x->pool_qelem);
+				}
+			}
+
 			// calculate the maximum delay value according to the actual grain length
 			// in order to avoid running over the record position
 			max_delay = x->bufferframes - pitch_length;
+			// a streaming grain reads the ringbuffer while recording continues: for pitch values below 1 it falls behind,
+			// and it is mixed up to one signal vector after recording, so it must not be overtaken by the record position
+			if (x->cloud[slot].stream) {
+				max_delay = x->bufferframes - (smp_length > pitch_length ? smp_length : pitch_length) - sampleframes;
+				if (max_delay < 0) {
+					max_delay = 0;
+				}
+			}
 			// adjust delay according to the above calculation
 			if (x->randomized[0] > max_delay) {
 				x->randomized[0] = max_delay;
@@ -672,76 +810,44 @@ void cmlivecloud_perform64(t_cmlivecloud *x, t_object *dsp64, double **ins, long
 			}
 			x->cloud[slot].length = smp_length; // IMPORTANT!! DO NOT FORGET TO WRITE THE SAMPLE LENGTH INTO THE MEMORY STRUCTURE
 
-			for (readpos = 0; readpos < smp_length; readpos++) {
-				if (x->attr_winterp) {
-					distance = ((double)readpos / (double)smp_length) * (double)w_framecount;
-					w_read = cm_lininterp(distance, w_sample, w_channelcount, w_framecount, 0);
-				}
-				else {
-					index = (long)(((double)readpos / (double)smp_length) * (double)w_framecount);
-					w_read = w_sample[index];
-				}
+			x->cloud[slot].amp_left = pan_left * gain; // pan and gain are applied during playback
+			x->cloud[slot].amp_right = pan_right * gain;
 
-				if (x->attr_sinterp) {
-					distance = (double)start + (((double)readpos / (double)smp_length) * (double)pitch_length);
-					index = (long)distance; // get truncated index
-					next = index + 1;
-					distance -= (long)distance; // calculate fraction value for interpolation
-					if (index >= x->bufferframes) {
-						index -= x->bufferframes;
-					}
-					if (next >= x->bufferframes) {
-						next -= x->bufferframes;
-					}
-					b_read = cm_lininterpring(distance, index, next, x->ringbuffer) * w_read; // get interpolated sample
-					x->cloud[slot].left[readpos] = (b_read * pan_left) * gain;
-					x->cloud[slot].right[readpos] = (b_read * pan_right) * gain;
-				}
-				else {
-					index = (long)((double)start + (((double)readpos / (double)smp_length) * (double)pitch_length));
-					if (index >= x->bufferframes) {
-						index -= x->bufferframes;
-					}
-					x->cloud[slot].left[readpos] = ((x->ringbuffer[index] * w_read) * pan_left) * gain;
-					x->cloud[slot].right[readpos] = ((x->ringbuffer[index] * w_read) * pan_right) * gain;
-				}
+			// streaming engine: only store the running values, the grain is rendered in the playback loop
+			if (x->cloud[slot].stream) {
+				x->cloud[slot].phase = start;
+				x->cloud[slot].incr = pitch_length / smp_length;
+				x->cloud[slot].w_phase = 0.0;
+				x->cloud[slot].w_incr = (double)w_framecount / smp_length;
 			}
-		}
-		/************************************************************************************************************************/
-		// CONTINUE WITH THE PLAYBACK ROUTINE
-		
-		// playback only if there are grains to play
-		if (x->grains_count) {
-			for (i = 0; i < x->cloudsize; i++) {
-				if (x->cloud[i].busy) {
-					r = x->cloud[i].pos++;
-					outsample_left += x->cloud[i].left[r];
-					outsample_right += x->cloud[i].right[r];
-					if (x->cloud[i].pos == x->cloud[i].length) {
-						x->cloud[i].pos = 0;
-						x->cloud[i].busy = false;
-						x->grains_count--;
-						if (x->grains_count < 0) {
-							x->grains_count = 0;
-						}
-					}
+
+			if (!x->cloud[slot].stream) {
+				// WINDOW: TAKE THE ENVELOPE FROM THE CACHE OR WRITE THE WINDOW VALUES INTO THE CACHE (OR THE GRAIN MEMORY)
+				envelope = cm_envcache_get(x->envcache, w_sample, x->attr_winterp, smp_length, (long)ceil(smp_length), &cached);
+				if (!envelope) {
+					envelope = x->cloud[slot].left;
+				}
+				if (!cached) {
+					cm_render_buffer(envelope, NULL, w_sample, 1, 0, w_framecount, 0.0, (double)w_framecount, smp_length, (long)ceil(smp_length), x->attr_winterp ? CM_INTERP_LINEAR : CM_INTERP_OFF, 0);
 				}
+				// SOURCE: MULTIPLY THE WINDOW WITH THE SAMPLES FROM THE RINGBUFFER
+				cm_render_ring(x->cloud[slot].left, envelope, x->ringbuffer, x->bufferframes, start, pitch_length, smp_length, (long)ceil(smp_length), x->attr_sinterp, x->attr_staps);
 			}
 		}
-
-		/************************************************************************************************************************/
-		x->tr_prev = tr_curr; // store current trigger value in object structure
-
-		*out_left++ = outsample_left; // write added sample values to left output vector
-		*out_right++ = outsample_right; // write added sample values to right output vector
 		
-		outsample_left = 0.0;
-		outsample_right = 0.0;
+		// a trigger which could not be served is retried at the next frame, otherwise continue with the next trigger
+		// (a grain message or a signal trigger, which may be at the same frame)
+		frame = trigger ? frame + 1 : cm_schedule_next(&x->schedule, tr_frame, frame);
 	}
+	
+	// WRITE THE REST OF THE SIGNAL VECTOR INTO THE RINGBUFFER
+	cmlivecloud_writering(x, rec_sigin + recorded, n - recorded);
+	
+	// MIX THE PLAYING GRAINS INTO THE REST OF THE SIGNAL VECTOR
+	cmlivecloud_mix(x, out_left + mixed, out_right + mixed, n - mixed, w_sample, w_framecount);
 
 	/************************************************************************************************************************/
 	// STORE UPDATED RUNNING VALUES INTO THE OBJECT STRUCTURE
-	buffer_unlocksamples(w_buffer);
 //	if (x->randomized[0] == x->bufferframes) {
 //		x->randomized[0] = 0;
 //	}
@@ -750,15 +856,146 @@ void cmlivecloud_perform64(t_cmlivecloud *x, t_object *dsp64, double **ins, long
 	return;
 
 zero:
+	cm_trigger_skip(&x->bangs); // the bangs of this vector are dropped with its signal triggers
 	while (n--) {
 		*out_left++ = 0.0;
 		*out_right++ = 0.0;
 	}
-	buffer_unlocksamples(w_buffer);
 	return; // THIS RETURN WAS MISSING FOR A LONG, LONG TIME. MAYBE THIS HELPS WITH STABILITY!?
 }
 
 
+/************************************************************************************************************************/
+/* THE STREAMING GRAIN VARIANTS                                                                                         */
+/************************************************************************************************************************/
+// add the next run frames of a streaming grain to the output vectors, reading directly from the ringbuffer
+// (winterp and sinterp are compile-time constants in the variants below, the loop itself has no branch on the attributes)
+static CM_INLINE void cmlivecloud_stream(t_cmlivecloud *x, long i, t_double *out_left, t_double *out_right, long run, double *ring, long ringframes, float *w_sample, long w_framecount, const cm_interp_table *fir, const t_bool winterp, const long sinterp) {
+	long frame; // loop counter
+	long index; // truncated index for reading from the ringbuffer
+	long next; // next index for interpolation
+	double w_read, b_read; // current samples read from the window buffer and the ringbuffer
+	for (frame = 0; frame < run; frame++) {
+		x->cloud[i].pos++;
+		if ((long)x->cloud[i].w_phase < w_framecount) {
+			if (winterp) {
+				w_read = cm_lininterp(x->cloud[i].w_phase, w_sample, 1, w_framecount, 0);
+			}
+			else {
+				w_read = w_sample[(long)x->cloud[i].w_phase];
+			}
+			index = (long)x->cloud[i].phase;
+			if (sinterp == CM_RENDER_FIR) {
+				b_read = cm_interp_ring(fir, x->cloud[i].phase, ring, ringframes) * w_read;
+			}
+			else if (sinterp == CM_RENDER_LINEAR) {
+				next = index + 1;
+				if (next >= ringframes) {
+					next -= ringframes;
+				}
+				b_read = cm_lininterpring(x->cloud[i].phase - index, index, next, ring) * w_read;
+			}
+			else {
+				b_read = ring[index] * w_read;
+			}
+			out_left[frame] += b_read * x->cloud[i].amp_left;
+			out_right[frame] += b_read * x->cloud[i].amp_right;
+			x->cloud[i].phase += x->cloud[i].incr;
+			if (x->cloud[i].phase >= ringframes) {
+				x->cloud[i].phase -= ringframes;
+			}
+			x->cloud[i].w_phase += x->cloud[i].w_incr;
+		}
+		else { // window buffer got shorter while the grain was playing: end the grain
+			x->cloud[i].pos = x->cloud[i].length;
+			break;
+		}
+	}
+}
+
+// one variant per attribute combination, selected once per mix call
+#define CMLIVECLOUD_STREAM_VARIANT(name, winterp, sinterp) \
+	static void name(t_cmlivecloud *x, long i, t_double *out_left, t_double *out_right, long run, double *ring, long ringframes, float *w_sample, long w_framecount, const cm_interp_table *fir) { \
+		cmlivecloud_stream(x, i, out_left, out_right, run, ring, ringframes, w_sample, w_framecount, fir, winterp, sinterp); \
+	}
+CMLIVECLOUD_STREAM_VARIANT(cmlivecloud_stream_00, false, CM_RENDER_NEAREST)
+CMLIVECLOUD_STREAM_VARIANT(cmlivecloud_stream_01, false, CM_RENDER_LINEAR)
+CMLIVECLOUD_STREAM_VARIANT(cmlivecloud_stream_02, false, CM_RENDER_FIR)
+CMLIVECLOUD_STREAM_VARIANT(cmlivecloud_stream_10, true, CM_RENDER_NEAREST)
+CMLIVECLOUD_STREAM_VARIANT(cmlivecloud_stream_11, true, CM_RENDER_LINEAR)
+CMLIVECLOUD_STREAM_VARIANT(cmlivecloud_stream_12, true, CM_RENDER_FIR)
+
+typedef void (*cmlivecloud_stream_method)(t_cmlivecloud *x, long i, t_double *out_left, t_double *out_right, long run, double *ring, long ringframes, float *w_sample, long w_framecount, const cm_interp_table *fir);
+static const cmlivecloud_stream_method cmlivecloud_streamers[2][3] = { { cmlivecloud_stream_00, cmlivecloud_stream_01, cmlivecloud_stream_02 }, { cmlivecloud_stream_10, cmlivecloud_stream_11, cmlivecloud_stream_12 } }; // [winterp][sinterp]
+
+
+/************************************************************************************************************************/
+/* THE GRAIN MIXING ROUTINE                                                                                             */
+/************************************************************************************************************************/
+// add the next frames samples of every playing grain to the output vectors (grain by grain) and retire finished grains
+void cmlivecloud_mix(t_cmlivecloud *x, t_double *out_left, t_double *out_right, long frames, float *w_sample, long w_framecount) {
+	long a, i, frame; // loop counters
+	long run; // number of frames to mix for the current grain
+	float *left, *right; // grain memory at the current playback position
+	double amp_left, amp_right; // output gains of the current grain
+	double *ring; // ringbuffer the grain reads from
+	long ringframes; // size of this ringbuffer in samples
+	cmlivecloud_stream_method stream = cmlivecloud_streamers[x->attr_winterp ? 1 : 0][cm_render_kind(x->attr_sinterp)]; // streaming variant for the current attributes
+	const cm_interp_table *fir = cm_interp_select(x->attr_sinterp, x->attr_staps); // coefficient table of the sample interpolation
+	
+	for (a = 0; a < x->grains_count; a++) { // only visit the playing grains
+		i = x->slots[a];
+		run = x->cloud[i].length - x->cloud[i].pos;
+		if (run > frames) {
+			run = frames;
+		}
+		if (x->cloud[i].stream) {
+			// STREAMING ENGINE: READ THE GRAIN SAMPLE DIRECTLY FROM THE RINGBUFFER
+			// (grains started before a ringbuffer swap keep reading the retired ringbuffer)
+			ring = (x->cloud[i].retired && x->retired.ringbuffer) ? x->retired.ringbuffer : x->ringbuffer;
+			ringframes = (x->cloud[i].retired && x->retired.ringbuffer) ? x->retired.bufferframes : x->bufferframes;
+			stream(x, i, out_left, out_right, run, ring, ringframes, w_sample, w_framecount, fir);
+		}
+		else {
+			// RENDERED GRAIN: ADD THE WHOLE RUN IN ONE CONTIGUOUS LOOP
+			left = x->cloud[i].left + x->cloud[i].pos;
+			right = x->cloud[i].right + x->cloud[i].pos;
+			amp_left = x->cloud[i].amp_left;
+			amp_right = x->cloud[i].amp_right;
+			for (frame = 0; frame < run; frame++) {
+				out_left[frame] += left[frame] * amp_left;
+				out_right[frame] += right[frame] * amp_right;
+			}
+			x->cloud[i].pos += run;
+		}
+		if (x->cloud[i].pos >= x->cloud[i].length) {
+			cmlivecloud_finish(x, i);
+			// swap the last playing grain into this position and visit it next
+			x->grains_count--;
+			x->slots[a] = x->slots[x->grains_count];
+			x->slots[x->grains_count] = i;
+			a--;
+		}
+	}
+}
+
+
+/************************************************************************************************************************/
+/* THE RINGBUFFER WRITE ROUTINE                                                                                         */
+/************************************************************************************************************************/
+// write the next frames samples of the input signal into the ringbuffer
+void cmlivecloud_writering(t_cmlivecloud *x, t_double *rec_sigin, long frames) {
+	if (x->record) {
+		while (frames-- > 0) {
+			x->ringbuffer[x->writepos++] = *rec_sigin++;
+			if (x->writepos == x->bufferframes) {
+				x->writepos = 0;
+			}
+		}
+	}
+}
+
+
 /************************************************************************************************************************/
 /* ASSIST METHOD FOR INLET AND OUTLET ANNOTATION                                                                        */
 /************************************************************************************************************************/
@@ -826,18 +1063,32 @@ void cmlivecloud_assist(t_cmlivecloud *x, void *b, long msg, long arg, char *dst
 /* FREE FUNCTION                                                                                                        */
 /************************************************************************************************************************/
 void cmlivecloud_free(t_cmlivecloud *x) {
-	int i;
 	dsp_free((t_pxobject *)x); // free memory allocated for the object
 	object_free(x->w_buffer); // free the window buffer reference
+	if (x->d_buffer) {
+		object_free(x->d_buffer); // free the histogram buffer reference
+	}
 	sysmem_freeptr(x->object_inlets); // free memory allocated to the object inlets array
 	sysmem_freeptr(x->grain_params); // free memory allocated to the grain parameters array
 	sysmem_freeptr(x->randomized); // free memory allocated to the grain parameters array
 
-	for (i = 0; i < x->cloudsize; i++) {
-		sysmem_freeptr(x->cloud[i].left);
-		sysmem_freeptr(x->cloud[i].right);
-	}
+	qelem_free(x->pool_qelem); // free the slab pool qelem before the pool itself
+	qelem_free(x->resize_qelem); // free the rebuild qelem before the grain storage
+	qelem_free(x->dist_qelem); // free the distribution qelem before the tables
+	cm_dist_free(&x->dist);
+	qelem_free(x->window_qelem); // free the window table qelem before the tables
+	cm_window_free(&x->window);
+	cm_slab_free(x->pool); // free the grain memory
+	sysmem_freeptr(x->pool);
 	sysmem_freeptr(x->cloud);
+	sysmem_freeptr(x->slots);
+	sysmem_freeptr(x->ringbuffer);
+	cm_envcache_free(x->envcache); // free the envelope cache
+	sysmem_freeptr(x->envcache);
+	cmlivecloud_storage_free(&x->pending); // free the storage of a swap in flight
+	cmlivecloud_storage_free(&x->retired);
+	cm_trigger_free(&x->scan); // free the trigger flags
+	cm_queue_free(&x->queue); // free the event queue
 
 }
 
@@ -853,7 +1104,7 @@ void cmlivecloud_float(t_cmlivecloud *x, double f) {
 				dump = f;
 			}
 			else {
-				x->object_inlets[0] = f;
+				cm_queue_param(&x->queue, x->object_inlets, FLOAT_INLETS, 0, f);
 			}
 			break;
 
@@ -862,7 +1113,7 @@ void cmlivecloud_float(t_cmlivecloud *x, double f) {
 				dump = f;
 			}
 			else {
-				x->object_inlets[1] = f;
+				cm_queue_param(&x->queue, x->object_inlets, FLOAT_INLETS, 1, f);
 			}
 			break;
 
@@ -871,7 +1122,7 @@ void cmlivecloud_float(t_cmlivecloud *x, double f) {
 				dump = f;
 			}
 			else {
-				x->object_inlets[2] = f;
+				cm_queue_param(&x->queue, x->object_inlets, FLOAT_INLETS, 2, f);
 			}
 			break;
 
@@ -880,7 +1131,7 @@ void cmlivecloud_float(t_cmlivecloud *x, double f) {
 				dump = f;
 			}
 			else {
-				x->object_inlets[3] = f;
+				cm_queue_param(&x->queue, x->object_inlets, FLOAT_INLETS, 3, f);
 			}
 			break;
 
@@ -889,7 +1140,7 @@ void cmlivecloud_float(t_cmlivecloud *x, double f) {
 				dump = f;
 			}
 			else {
-				x->object_inlets[4] = f;
+				cm_queue_param(&x->queue, x->object_inlets, FLOAT_INLETS, 4, f);
 			}
 			break;
 
@@ -898,7 +1149,7 @@ void cmlivecloud_float(t_cmlivecloud *x, double f) {
 				dump = f;
 			}
 			else {
-				x->object_inlets[5] = f;
+				cm_queue_param(&x->queue, x->object_inlets, FLOAT_INLETS, 5, f);
 			}
 			break;
 
@@ -907,7 +1158,7 @@ void cmlivecloud_float(t_cmlivecloud *x, double f) {
 				dump = f;
 			}
 			else {
-				x->object_inlets[6] = f;
+				cm_queue_param(&x->queue, x->object_inlets, FLOAT_INLETS, 6, f);
 			}
 			break;
 
@@ -916,7 +1167,7 @@ void cmlivecloud_float(t_cmlivecloud *x, double f) {
 				dump = f;
 			}
 			else {
-				x->object_inlets[7] = f;
+				cm_queue_param(&x->queue, x->object_inlets, FLOAT_INLETS, 7, f);
 			}
 			break;
 
@@ -925,7 +1176,7 @@ void cmlivecloud_float(t_cmlivecloud *x, double f) {
 				dump = f;
 			}
 			else {
-				x->object_inlets[8] = f;
+				cm_queue_param(&x->queue, x->object_inlets, FLOAT_INLETS, 8, f);
 			}
 			break;
 
@@ -934,7 +1185,7 @@ void cmlivecloud_float(t_cmlivecloud *x, double f) {
 				dump = f;
 			}
 			else {
-				x->object_inlets[9] = f;
+				cm_queue_param(&x->queue, x->object_inlets, FLOAT_INLETS, 9, f);
 			}
 			break;
 	}
@@ -954,12 +1205,20 @@ void cmlivecloud_dblclick(t_cmlivecloud *x) {
 /************************************************************************************************************************/
 t_max_err cmlivecloud_notify(t_cmlivecloud *x, t_symbol *s, t_symbol *msg, void *sender, void *data) {
 	t_symbol *buffer_name = (t_symbol *)object_method((t_object *)sender, gensym("getname"));
-	if (msg == ps_buffer_modified) {
-		x->buffer_modified = true;
-	}
 	if (buffer_name == x->window_name) { // check if calling object was the window buffer
+		if (msg == ps_buffer_modified) { // the window table is copied on the main thread, the grains keep playing meanwhile
+			cm_window_modified(&x->window);
+			qelem_set(x->window_qelem);
+		}
 		return buffer_ref_notify(x->w_buffer, s, msg, sender, data); // return with the calling buffer
 	}
+	else if (x->d_buffer && buffer_name == x->dist_name) { // check if calling object was the histogram buffer
+		if (msg == ps_buffer_modified) { // the distribution tables are rebuilt on the main thread
+			cm_dist_modified(&x->dist);
+			qelem_set(x->dist_qelem);
+		}
+		return buffer_ref_notify(x->d_buffer, s, msg, sender, data); // return with the calling buffer
+	}
 	else { // if calling object was none of the expected buffers
 		return MAX_ERR_NONE; // return generic MAX_ERR_NONE
 	}
@@ -971,11 +1230,12 @@ t_max_err cmlivecloud_notify(t_cmlivecloud *x, t_symbol *s, t_symbol *msg, void
 /************************************************************************************************************************/
 void cmlivecloud_doset(t_cmlivecloud *x, t_symbol *s, long ac, t_atom *av) {
 	if (ac == 1) {
-		x->buffer_modified = true;
 		x->window_name = atom_getsym(av); // write buffer name into object structure
 		buffer_ref_set(x->w_buffer, x->window_name);
+		cm_window_modified(&x->window); // copy the new window buffer
+		qelem_set(x->window_qelem);
 		if (buffer_getchannelcount((t_object *)(buffer_ref_getobject(x->w_buffer))) > 1) {
-			object_error((t_object *)x, "referenced window buffer has more than 1 channel. expect strange results.");
+			object_error((t_object *)x, "referenced window buffer has more than 1 channel. using channel 1.");
 		}
 	}
 	else {
@@ -992,6 +1252,38 @@ void cmlivecloud_set(t_cmlivecloud *x, t_symbol *s, long ac, t_atom *av) {
 }
 
 
+/************************************************************************************************************************/
+/* THE ACTUAL HISTOGRAM BUFFER SET METHOD                                                                               */
+/************************************************************************************************************************/
+void cmlivecloud_dodistbuffer(t_cmlivecloud *x, t_symbol *s, long ac, t_atom *av) {
+	if (ac == 1) {
+		x->dist_name = atom_getsym(av); // write buffer name into object structure
+		if (x->d_buffer) {
+			buffer_ref_set(x->d_buffer, x->dist_name);
+		}
+		else {
+			x->d_buffer = buffer_ref_new((t_object *)x, x->dist_name);
+		}
+		cm_dist_modified(&x->dist); // build the tables of the new histogram buffer
+		qelem_set(x->dist_qelem);
+		if (buffer_getchannelcount((t_object *)(buffer_ref_getobject(x->d_buffer))) > 5) {
+			object_error((t_object *)x, "referenced histogram buffer has more than 5 channels. using channels 1 to 5.");
+		}
+	}
+	else {
+		object_error((t_object *)x, "argument required (histogram buffer name)");
+	}
+}
+
+
+/************************************************************************************************************************/
+/* THE HISTOGRAM BUFFER SET METHOD                                                                                      */
+/************************************************************************************************************************/
+void cmlivecloud_distbuffer(t_cmlivecloud *x, t_symbol *s, long ac, t_atom *av) {
+	defer(x, (method)cmlivecloud_dodistbuffer, s, ac, av);
+}
+
+
 /************************************************************************************************************************/
 /* THE RESIZE REQUEST METHOD                                                                                            */
 /************************************************************************************************************************/
@@ -1004,6 +1296,7 @@ void cmlivecloud_cloudsize(t_cmlivecloud *x, t_symbol *s, long ac, t_atom *av) {
 		else {
 			x->cloudsize_new = arg;
 			x->resize_request = true;
+			qelem_set(x->resize_qelem); // build the new grain storage on the main thread
 		}
 	}
 	else {
@@ -1023,7 +1316,8 @@ void cmlivecloud_grainlength(t_cmlivecloud *x, t_symbol *s, long ac, t_atom *av)
 		}
 		else {
 			x->grainlength_new = arg;
-			x->length_request = true;
+			x->resize_request = true;
+			qelem_set(x->resize_qelem); // build the new grain storage on the main thread
 		}
 	}
 	else {
@@ -1033,51 +1327,227 @@ void cmlivecloud_grainlength(t_cmlivecloud *x, t_symbol *s, long ac, t_atom *av)
 
 
 /************************************************************************************************************************/
-/* THE ACTUAL RESIZE METHOD                                                                                             */
+/* GRAIN STORAGE ALLOCATION (MAIN THREAD)                                                                               */
 /************************************************************************************************************************/
-t_bool cmlivecloud_resize(t_cmlivecloud *x) {
-	int i;
+// allocate a new grain storage; returns false if memory allocation failed (the partly allocated storage is freed by cmlivecloud_storage_free)
+t_bool cmlivecloud_storage_new(t_cmlivecloud *x, cm_storage *storage, long cloudsize, long grainlength, long bufferms) {
+	long i;
+	long count, read; // number of frames to copy and read position in the current ringbuffer
 	
-	for (i = 0; i < x->cloudsize; i++) {
-		sysmem_freeptr(x->cloud[i].left);
-		sysmem_freeptr(x->cloud[i].right);
+	memset(storage, 0, sizeof(cm_storage));
+	storage->cloudsize = cloudsize;
+	storage->grainlength = grainlength;
+	// the playing grains are moved into the new storage: it never has less slots than the current cloud size
+	storage->slotcount = cloudsize > x->cloudsize ? cloudsize : x->cloudsize;
+	
+	// ALLOCATE MEMORY FOR THE GRAINMEM ARRAY
+	storage->cloud = (cm_cloud *)sysmem_newptrclear((storage->slotcount) * sizeof(cm_cloud));
+	if (storage->cloud == NULL) {
+		return false;
 	}
-	sysmem_freeptr(x->cloud);
 	
-	if (x->resize_request) {
-		x->cloudsize = x->cloudsize_new;
+	// ALLOCATE MEMORY FOR THE SLOT INDEX ARRAY
+	storage->slots = (long *)sysmem_newptrclear((storage->slotcount) * sizeof(long));
+	if (storage->slots == NULL) {
+		return false;
 	}
-	else if (x->length_request) {
-		x->grainlength = x->grainlength_new;
+	for (i = 0; i < storage->slotcount; i++) {
+		storage->cloud[i].length = 0;
+		storage->cloud[i].pos = 0;
+		storage->cloud[i].stream = false;
+		storage->cloud[i].retired = false;
+		storage->slots[i] = i;
 	}
 	
-	// ALLOCATE MEMORY FOR THE GRAINMEM ARRAY
-	x->cloud = (cm_cloud *)sysmem_newptrclear((x->cloudsize) * sizeof(cm_cloud));
-	if (x->cloud == NULL) {
-		object_error((t_object *)x, "out of memory");
-		x->resize_verify = false;
+	// CREATE THE SLAB POOL FOR THE GRAIN MEMORY
+	storage->pool = (cm_slabpool *)sysmem_newptrclear(sizeof(cm_slabpool));
+	if (storage->pool == NULL) {
+		return false;
+	}
+	if (!cm_slab_new(storage->pool, cmlivecloud_grainbytes(x, grainlength), storage->slotcount, x->attr_stream ? 0 : (x->attr_deterministic ? CM_SLAB_PREFILL_ALL : CM_SLAB_PREFILL))) {
 		return false;
 	}
 	
-	// ALLOCATE MEMORY FOR THE GRAIN ARRAY IN EACH MEMBER OF THE GRAINMEM STRUCT
-	for (i = 0; i < x->cloudsize; i++) {
-		x->cloud[i].left = (double *)sysmem_newptrclear(((x->grainlength * x->m_sr) * MAX_PITCH) * sizeof(double));
-		if (x->cloud[i].left == NULL) {
-			object_error((t_object *)x, "out of memory");
-			x->resize_verify = false;
+	// ALLOCATE THE ENVELOPE CACHE (ENVELOPES UP TO THE MAX GRAIN LENGTH)
+	storage->envcache = (cm_envcache *)sysmem_newptrclear(sizeof(cm_envcache));
+	if (storage->envcache == NULL) {
+		return false;
+	}
+	if (!cm_envcache_new(storage->envcache, (long)(grainlength * x->m_sr) + 1)) {
+		return false;
+	}
+	
+	// ALLOCATE THE NEW RINGBUFFER (ONLY IF ITS LENGTH CHANGED) AND COPY THE MOST RECENT PART OF THE CURRENT ONE:
+	// the audio thread keeps recording meanwhile and copies the frames recorded after the snapshot when it installs the storage
+	storage->bufferms = bufferms;
+	storage->bufferframes = bufferms * x->m_sr;
+	if (bufferms != x->bufferms) {
+		storage->ringbuffer = (double *)sysmem_newptrclear(storage->bufferframes * sizeof(double));
+		if (storage->ringbuffer == NULL) {
 			return false;
 		}
-		x->cloud[i].right = (double *)sysmem_newptrclear(((x->grainlength * x->m_sr) * MAX_PITCH) * sizeof(double));
-		if (x->cloud[i].right == NULL) {
-			object_error((t_object *)x, "out of memory");
-			x->resize_verify = false;
-			return false;
+		count = storage->bufferframes < x->bufferframes ? storage->bufferframes : x->bufferframes;
+		storage->snapshot = x->writepos;
+		read = storage->snapshot - count;
+		if (read < 0) {
+			read += x->bufferframes;
+		}
+		for (i = 0; i < count; i++) { // oldest frames first: they are the first ones to be overwritten by the recording
+			storage->ringbuffer[i] = x->ringbuffer[read++];
+			if (read >= x->bufferframes) {
+				read = 0;
+			}
 		}
+		storage->writepos = count < storage->bufferframes ? count : 0;
 	}
 	
 	return true;
 }
 
+// free all memory of a grain storage (no grain must be playing from it)
+void cmlivecloud_storage_free(cm_storage *storage) {
+	if (storage->pool) {
+		cm_slab_free(storage->pool);
+		sysmem_freeptr(storage->pool);
+	}
+	if (storage->cloud) {
+		sysmem_freeptr(storage->cloud);
+	}
+	if (storage->slots) {
+		sysmem_freeptr(storage->slots);
+	}
+	if (storage->envcache) {
+		cm_envcache_free(storage->envcache);
+		sysmem_freeptr(storage->envcache);
+	}
+	if (storage->ringbuffer) {
+		sysmem_freeptr(storage->ringbuffer);
+	}
+	memset(storage, 0, sizeof(cm_storage));
+}
+
+
+/************************************************************************************************************************/
+/* THE GRAIN STORAGE REBUILD METHOD (CALLED FROM THE QELEM)                                                             */
+/************************************************************************************************************************/
+void cmlivecloud_rebuild(t_cmlivecloud *x) {
+	// free the storage retired by the audio thread
+	if (x->swap_state == CM_SWAP_RETIRED) {
+		cmlivecloud_storage_free(&x->retired);
+		cm_swap_advance(&x->swap_state, CM_SWAP_RETIRED, CM_SWAP_IDLE);
+	}
+	// build the requested storage and hand it to the audio thread (a request arriving during a swap is served after it)
+	if (x->resize_request && x->swap_state == CM_SWAP_IDLE) {
+		x->resize_request = false;
+		if (!cmlivecloud_storage_new(x, &x->pending, x->cloudsize_new, x->grainlength_new, x->bufferms_new)) {
+			object_error((t_object *)x, "out of memory");
+			cmlivecloud_storage_free(&x->pending);
+			return;
+		}
+		cm_swap_advance(&x->swap_state, CM_SWAP_IDLE, CM_SWAP_READY);
+	}
+}
+
+
+/************************************************************************************************************************/
+/* THE WINDOW TABLE UPDATE METHOD (CALLED FROM THE QELEM)                                                               */
+/************************************************************************************************************************/
+void cmlivecloud_window_update(t_cmlivecloud *x) {
+	if (!cm_window_update(&x->window, buffer_ref_getobject(x->w_buffer))) {
+		object_error((t_object *)x, "out of memory");
+	}
+}
+
+
+/************************************************************************************************************************/
+/* THE DISTRIBUTION TABLE UPDATE METHOD (CALLED FROM THE QELEM)                                                         */
+/************************************************************************************************************************/
+void cmlivecloud_dist_update(t_cmlivecloud *x) {
+	if (!cm_dist_update(&x->dist, x->d_buffer ? buffer_ref_getobject(x->d_buffer) : NULL)) {
+		object_error((t_object *)x, "out of memory");
+	}
+}
+
+// audio thread: move the window positions of the streaming grains into the newly installed window table
+void cmlivecloud_window_rescale(t_cmlivecloud *x, double scale) {
+	long a, i; // loop counter, cloud slot
+	for (a = 0; a < x->grains_count; a++) {
+		i = x->slots[a];
+		if (x->cloud[i].stream) {
+			x->cloud[i].w_phase *= scale;
+			x->cloud[i].w_incr *= scale;
+		}
+	}
+}
+
+
+/************************************************************************************************************************/
+/* THE GRAIN STORAGE SWAP (AUDIO THREAD)                                                                                */
+/************************************************************************************************************************/
+// install the storage built on the main thread: the playing grains are moved into the new cloud array
+// and keep their grain memory in the retired slab pool until they have finished
+void cmlivecloud_swap(t_cmlivecloud *x) {
+	long a; // loop counter
+	long frames, read, write; // frames recorded since the snapshot, read and write position
+	
+	if (x->grains_count > x->pending.slotcount) { // not enough slots for the playing grains: try again with the next signal vector
+		return;
+	}
+	// the slots of the new storage are in order: the playing grains take the first entries
+	for (a = 0; a < x->grains_count; a++) {
+		x->pending.cloud[a] = x->cloud[x->slots[a]];
+		x->pending.cloud[a].retired = true;
+	}
+	x->retired.cloud = x->cloud;
+	x->retired.slots = x->slots;
+	x->retired.pool = x->pool;
+	x->retired.envcache = x->envcache;
+	x->cloud = x->pending.cloud;
+	x->slots = x->pending.slots;
+	x->pool = x->pending.pool;
+	cm_envcache_inherit(x->pending.envcache, x->envcache); // keep the hit counters
+	x->envcache = x->pending.envcache;
+	x->cloudsize = x->pending.cloudsize;
+	x->grainlength = x->pending.grainlength;
+	
+	// NEW RINGBUFFER: COPY THE FRAMES RECORDED SINCE THE SNAPSHOT, THE PLAYING GRAINS KEEP READING THE RETIRED ONE
+	if (x->pending.ringbuffer) {
+		frames = x->writepos - x->pending.snapshot;
+		if (frames < 0) {
+			frames += x->bufferframes;
+		}
+		if (frames > x->pending.bufferframes) {
+			frames = x->pending.bufferframes;
+		}
+		read = x->pending.snapshot;
+		write = x->pending.writepos;
+		while (frames-- > 0) {
+			if (read >= x->bufferframes) {
+				read = 0;
+			}
+			x->pending.ringbuffer[write++] = x->ringbuffer[read++];
+			if (write == x->pending.bufferframes) {
+				write = 0;
+			}
+		}
+		x->retired.ringbuffer = x->ringbuffer;
+		x->retired.bufferframes = x->bufferframes;
+		x->ringbuffer = x->pending.ringbuffer;
+		x->bufferms = x->pending.bufferms;
+		x->bufferframes = x->pending.bufferframes;
+		x->writepos = write;
+	}
+	memset(&x->pending, 0, sizeof(cm_storage));
+	
+	x->retired_grains = x->grains_count;
+	if (x->retired_grains > 0) {
+		cm_swap_advance(&x->swap_state, CM_SWAP_READY, CM_SWAP_DRAINING);
+	}
+	else if (cm_swap_advance(&x->swap_state, CM_SWAP_READY, CM_SWAP_RETIRED)) {
+		qelem_set(x->resize_qelem);
+	}
+}
+
 
 /************************************************************************************************************************/
 /* THE BUFFERMS REQUEST METHOD                                                                                          */
@@ -1090,7 +1560,8 @@ void cmlivecloud_bufferms(t_cmlivecloud *x, t_symbol *s, long ac, t_atom *av) {
 		}
 		else {
 			x->bufferms_new = arg;
-			x->bufferms_request = true;
+			x->resize_request = true;
+			qelem_set(x->resize_qelem); // build the new grain storage on the main thread
 		}
 	}
 	else {
@@ -1101,42 +1572,90 @@ void cmlivecloud_bufferms(t_cmlivecloud *x, t_symbol *s, long ac, t_atom *av) {
 
 
 /************************************************************************************************************************/
-/* THE ACTUAL RESIZE METHOD                                                                                             */
+/* THE RECORD METHOD                                                                                                    */
 /************************************************************************************************************************/
-t_bool cmlivecloud_ringbuffer_resize(t_cmlivecloud *x) {
-	
-	sysmem_freeptr(x->ringbuffer);
-	
-	x->bufferms = x->bufferms_new;
-	x->bufferframes = x->bufferms * x->m_sr;
-	x->writepos = 0;
-	
-	x->ringbuffer = (double *)sysmem_newptrclear((x->bufferms * x->m_sr) * sizeof(double));
-	if (x->ringbuffer == NULL) {
-		object_error((t_object *)x, "out of memory");
-		return false;
+void cmlivecloud_record(t_cmlivecloud *x, t_symbol *s, long ac, t_atom *av) {
+	cm_event event;
+	memset(&event, 0, sizeof(cm_event));
+	event.type = CM_EVENT_RECORD;
+	event.index = atom_getlong(av) > 0 ? 1 : 0; // any non-zero value switches recording on
+	cmlivecloud_post(x, &event);
+}
+
+
+/************************************************************************************************************************/
+/* THE GRAIN FINISH AND CLOUD RESET METHODS (AUDIO THREAD)                                                              */
+/************************************************************************************************************************/
+// release the memory of a finished grain (the caller removes it from the playing grains)
+void cmlivecloud_finish(t_cmlivecloud *x, long i) {
+	if (!x->cloud[i].stream) { // return the grain memory to the slab pool
+		cm_slab_release(x->cloud[i].retired ? x->retired.pool : x->pool, x->cloud[i].left, x->cloud[i].slab);
+		x->cloud[i].left = NULL;
+		x->cloud[i].right = NULL;
 	}
-	else {
-		return true;
+	if (x->cloud[i].retired) { // after the last grain of the retired storage the main thread can free it
+		x->cloud[i].retired = false;
+		x->retired_grains--;
+		if (x->retired_grains == 0 && cm_swap_advance(&x->swap_state, CM_SWAP_DRAINING, CM_SWAP_RETIRED)) {
+			qelem_set(x->resize_qelem);
+		}
 	}
+	x->cloud[i].pos = 0;
+}
+
+// deterministic mode: stop the playing grains and the trigger detection as if the object had just been created
+void cmlivecloud_reset(t_cmlivecloud *x) {
+	long a; // loop counter
+	
+	x->reset_request = false;
+	for (a = 0; a < x->grains_count; a++) {
+		cmlivecloud_finish(x, x->slots[a]);
+	}
+	x->grains_count = 0;
+	x->tr_prev = 0.0;
+	x->bangs = 0;
+	cm_schedule_clear(&x->schedule);
+	memset(x->ringbuffer, 0, x->bufferframes * sizeof(double)); // record from silence
+	x->writepos = 0;
 }
 
 
 /************************************************************************************************************************/
-/* THE RECORD METHOD                                                                                                    */
+/* THE MESSAGE EVENT METHODS                                                                                            */
 /************************************************************************************************************************/
-void cmlivecloud_record(t_cmlivecloud *x, t_symbol *s, long ac, t_atom *av) {
-	long arg;
-	arg = atom_getlong(av);
-	if (arg <= 0) { // smaller or equal to zero
-		x->record = false;
-//		object_post((t_object*)x, "record off");
+// message methods: append an event to the queue of the audio thread
+void cmlivecloud_post(t_cmlivecloud *x, const cm_event *event) {
+	t_bool report; // first dropped event of an overflow
+	if (!cm_queue_push(&x->queue, event, &report) && report) {
+		object_error((t_object *)x, "too many messages per signal vector: events dropped");
 	}
-	else { // any non-zero value sets x->record to true
-		x->record = true;
-		x->recordflag = true;
-//		object_post((t_object*)x, "record on");
+}
+
+// audio thread: apply the events of the message methods in the order they were sent, add the grain messages to the
+// schedule of the signal vector (n frames)
+void cmlivecloud_events(t_cmlivecloud *x, long n) {
+	const cm_event *event;
+	long k; // loop counter
+	long count = cm_queue_count(&x->queue);
+	cm_schedule_begin(&x->schedule, n);
+	for (k = 0; k < count; k++) {
+		event = cm_queue_event(&x->queue, k);
+		if (event->type == CM_EVENT_GRAIN && !cm_schedule_add(&x->schedule, event)) {
+			break; // the schedule is full: the remaining events wait until scheduled grains have started
+		}
+		switch (event->type) {
+			case CM_EVENT_BANG:
+				cm_trigger_bang(&x->bangs, n);
+				break;
+			case CM_EVENT_RECORD:
+				x->record = event->index ? true : false;
+				if (event->index) {
+					x->recordflag = true;
+				}
+				break;
+		}
 	}
+	cm_queue_release(&x->queue, k);
 }
 
 
@@ -1144,7 +1663,33 @@ void cmlivecloud_record(t_cmlivecloud *x, t_symbol *s, long ac, t_atom *av) {
 /* THE BANG METHOD                                                                                                      */
 /************************************************************************************************************************/
 void cmlivecloud_bang(t_cmlivecloud *x) {
-	x->bang_trigger = true;
+	cm_event event;
+	memset(&event, 0, sizeof(cm_event));
+	event.type = CM_EVENT_BANG;
+	cmlivecloud_post(x, &event); // every bang triggers a grain
+}
+
+
+/************************************************************************************************************************/
+/* THE GRAIN METHOD                                                                                                     */
+/************************************************************************************************************************/
+// grain delay length pitch pan gain [offset]: start a grain with the given parameters (no randomization) at the
+// offset in samples from the start of the next signal vector (later vectors for offsets beyond it)
+void cmlivecloud_grain(t_cmlivecloud *x, t_symbol *s, long ac, t_atom *av) {
+	cm_event event;
+	long k; // loop counter
+	memset(&event, 0, sizeof(cm_event));
+	event.type = CM_EVENT_GRAIN;
+	if (ac >= GRAIN_VALUES && av) {
+		for (k = 0; k < GRAIN_VALUES; k++) {
+			event.values[k] = atom_getfloat(av + k);
+		}
+		event.frame = ac > GRAIN_VALUES ? (long)atom_getlong(av + GRAIN_VALUES) : 0;
+		cmlivecloud_post(x, &event);
+	}
+	else {
+		object_error((t_object *)x, "arguments required (delay, length, pitch, pan, gain, [offset])");
+	}
 }
 
 
@@ -1164,7 +1709,33 @@ t_max_err cmlivecloud_winterp_set(t_cmlivecloud *x, t_object *attr, long ac, t_a
 /************************************************************************************************************************/
 t_max_err cmlivecloud_sinterp_set(t_cmlivecloud *x, t_object *attr, long ac, t_atom *av) {
 	if (ac && av) {
-		x->attr_sinterp = atom_getlong(av)? 1 : 0;
+		x->attr_sinterp = atom_getlong(av);
+		if (x->attr_sinterp < CM_INTERP_OFF) {
+			x->attr_sinterp = CM_INTERP_OFF;
+		}
+		else if (x->attr_sinterp >= CM_INTERP_MODES) {
+			x->attr_sinterp = CM_INTERP_MODES - 1;
+		}
+	}
+	return MAX_ERR_NONE;
+}
+
+
+/************************************************************************************************************************/
+/* THE SINC TAPS ATTRIBUTE SET METHOD                                                                                   */
+/************************************************************************************************************************/
+t_max_err cmlivecloud_staps_set(t_cmlivecloud *x, t_object *attr, long ac, t_atom *av) {
+	if (ac && av) {
+		x->attr_staps = atom_getlong(av);
+		if (x->attr_staps <= CM_SINC_MINTAPS) { // round up to the next tap count with a coefficient table
+			x->attr_staps = CM_SINC_MINTAPS;
+		}
+		else if (x->attr_staps <= 16) {
+			x->attr_staps = 16;
+		}
+		else {
+			x->attr_staps = CM_SINC_MAXTAPS;
+		}
 	}
 	return MAX_ERR_NONE;
 }
@@ -1181,6 +1752,74 @@ t_max_err cmlivecloud_zero_set(t_cmlivecloud *x, t_object *attr, long ac, t_atom
 }
 
 
+/************************************************************************************************************************/
+/* THE STREAMING PLAYBACK ATTRIBUTE SET METHOD                                                                          */
+/************************************************************************************************************************/
+t_max_err cmlivecloud_stream_set(t_cmlivecloud *x, t_object *attr, long ac, t_atom *av) {
+	if (ac && av) {
+		x->attr_stream = atom_getlong(av)? 1 : 0;
+	}
+	return MAX_ERR_NONE;
+}
+
+
+/************************************************************************************************************************/
+/* THE RANDOM SEED ATTRIBUTE SET METHOD                                                                                 */
+/************************************************************************************************************************/
+t_max_err cmlivecloud_seed_set(t_cmlivecloud *x, t_object *attr, long ac, t_atom *av) {
+	if (ac && av) {
+		x->attr_seed = atom_getlong(av);
+		cm_rng_reseed(&x->rng, x->attr_seed, x); // applied by the audio thread before the next grain
+	}
+	return MAX_ERR_NONE;
+}
+
+
+/************************************************************************************************************************/
+/* THE DETERMINISTIC MODE ATTRIBUTE SET METHOD                                                                          */
+/************************************************************************************************************************/
+t_max_err cmlivecloud_deterministic_set(t_cmlivecloud *x, t_object *attr, long ac, t_atom *av) {
+	if (ac && av) {
+		x->attr_deterministic = atom_getlong(av)? 1 : 0;
+		if (x->attr_deterministic && x->resize_qelem) { // rebuild the grain storage with all slabs allocated
+			x->resize_request = true;
+			qelem_set(x->resize_qelem);
+		}
+	}
+	return MAX_ERR_NONE;
+}
+
+
+/************************************************************************************************************************/
+/* THE FOOTPRINT METHOD                                                                                                 */
+/************************************************************************************************************************/
+void cmlivecloud_footprint(t_cmlivecloud *x) {
+	// memory the grains would take up if every slot was allocated for the longest grain at the highest pitch
+	double worstcase = (double)x->cloudsize * (x->grainlength * x->m_sr) * MAX_PITCH * 2 * sizeof(double);
+	cm_slab_footprint(x->pool, (t_object *)x, worstcase);
+	cm_envcache_footprint(x->envcache, (t_object *)x);
+}
+
+
+/************************************************************************************************************************/
+/* THE SLAB POOL GROW METHOD (CALLED FROM THE QELEM)                                                                    */
+/************************************************************************************************************************/
+void cmlivecloud_pool_grow(t_cmlivecloud *x) {
+	if (!cm_slab_grow(x->pool)) {
+		object_error((t_object *)x, "out of memory");
+	}
+}
+
+
+/************************************************************************************************************************/
+/* GRAIN MEMORY SIZE                                                                                                    */
+/************************************************************************************************************************/
+// number of bytes required for the longest possible grain (mono)
+t_ptr_size cmlivecloud_grainbytes(t_cmlivecloud *x, long grainlength) {
+	return ((t_ptr_size)(grainlength * x->m_sr) + 1) * sizeof(float);
+}
+
+
 /************************************************************************************************************************/
 /* CUSTOM FUNCTIONS																										*/
 /************************************************************************************************************************/
@@ -1190,15 +1829,6 @@ void cm_panning(cm_panstruct *panstruct, double *pos, t_cmlivecloud *x) {
 	panstruct->right = x->root2ovr2 * (cos((*pos * x->piovr2) * 0.5) + sin((*pos * x->piovr2) * 0.5));
 	return;
 }
-// RANDOM NUMBER GENERATOR (USE POINTERS FOR MORE EFFICIENCY)
-double cm_random(double *min, double *max) {
-#ifdef MAC_VERSION
-	return *min + ((*max - *min) * (((double)arc4random_uniform(RANDMAX)) / (double)RANDMAX));
-#endif
-#ifdef WIN_VERSION
-	return *min + ((*max - *min) * ((double)(rand() % RANDMAX) / (double)RANDMAX));
-#endif
-}
 // LINEAR INTERPOLATION FUNCTION
 double cm_lininterp(double distance, float *buffer, t_atom_long b_channelcount, t_atom_long b_framecount, short channel) {
 	long index = (long)distance; // get truncated index
@@ -0,0 +1,305 @@
+/*
+ cm_distrib.h - distributions of the randomized grain parameters.
+ Copyright (C) 2012 - 2017  Matthias W. Müller - circuit.music.labs
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ info@circuitmusiclabs.com
+
+ */
+
+// NOTE:
+// Every randomized grain parameter has its own distribution between the min and max value of its inlets. One uniform
+// number u in [0, 1) is drawn per parameter and mapped to a position in [0, 1] of the parameter range:
+//
+//   uniform      u
+//   triangular   inverse CDF (one square root), peak in the middle of the range
+//   gauss        inverse CDF table of a normal distribution, the range covers mean -/+ CM_DIST_GAUSSWIDTH deviations
+//   exponential  inverse CDF (one logarithm), density falling by e^-CM_DIST_EXPRATE from min to max
+//   buffer       inverse CDF table of a histogram buffer~ (channel n: parameter n, a mono buffer is used for all)
+//
+// Every distribution costs one random number and a constant number of operations per parameter (no rejection loop):
+// the sequence of the generator does not depend on the distributions and the deterministic mode stays reproducible.
+// The tables have CM_DIST_TABLESIZE intervals and are read with linear interpolation. The histogram table is the
+// inverse of the piecewise linear CDF of the buffer (negative values count as 0, a flat or empty buffer is uniform).
+// It is built on the main thread (qelem) whenever the histogram buffer reports a modification or is replaced and
+// handed to the audio thread with the swap states of cm_swap.h, like the window table of cm_window.h. Until the first
+// table is installed the buffer distribution is uniform.
+// Exponential and buffer distributions are not symmetric: swapping the min and max values mirrors them.
+
+#ifndef CM_DISTRIB_H
+#define CM_DISTRIB_H
+
+#include "ext.h"
+#include "ext_atomic.h"
+#include "buffer.h"
+#include "cm_swap.h"
+#include "cm_random.h"
+#include <math.h>
+
+#define CM_DIST_UNIFORM 0
+#define CM_DIST_TRIANGULAR 1
+#define CM_DIST_GAUSS 2
+#define CM_DIST_EXPONENTIAL 3
+#define CM_DIST_BUFFER 4
+#define CM_DIST_KINDS 5 // number of distributions
+#define CM_DIST_PARAMS 8 // max number of randomized grain parameters
+#define CM_DIST_TABLESIZE 4096 // number of intervals of an inverse CDF table
+#define CM_DIST_GAUSSWIDTH 3.0 // gauss: standard deviations from the mean to min and max
+#define CM_DIST_EXPRATE 5.0 // exponential: decay rate of the density over the parameter range
+
+typedef struct cmdisttable {
+	float *samples; // inverse CDF of every channel (channels * (CM_DIST_TABLESIZE + 1) values)
+	long channels; // number of histogram channels
+	t_buffer_obj *source; // histogram buffer the table was built from
+} cm_dist_table;
+
+typedef struct cmdist {
+	cm_dist_table *active; // table read by the audio thread
+	cm_dist_table *pending; // table built on the main thread, waiting to be installed by the audio thread
+	cm_dist_table *retired; // table replaced by the last swap, freed on the main thread
+	t_int32_atomic state; // swap state (see cm_swap.h)
+	t_int32_atomic generation; // incremented with every modification of the histogram buffer
+	long built; // generation of the last table built on the main thread (-1: none)
+	t_buffer_obj *requested; // histogram buffer of the last rebuild requested by the audio thread
+} cm_dist;
+
+static float cm_dist_gauss[CM_DIST_TABLESIZE + 1]; // inverse CDF of the gauss distribution (shared by all instances)
+
+
+/************************************************************************************************************************/
+/* TABLE CONSTRUCTION (MAIN THREAD)                                                                                     */
+/************************************************************************************************************************/
+// inverse of the piecewise linear CDF of a histogram with bins values (read with stride)
+// returns false if the histogram has no positive value
+static t_bool cm_dist_invert(const float *histogram, long bins, long stride, float *table) {
+	double total = 0.0, sum = 0.0, target, weight, fraction;
+	long i, bin;
+	for (i = 0; i < bins; i++) {
+		weight = histogram[i * stride];
+		total += weight > 0.0 ? weight : 0.0;
+	}
+	if (total <= 0.0) {
+		return false;
+	}
+	bin = 0;
+	for (i = 0; i <= CM_DIST_TABLESIZE; i++) {
+		target = (i == CM_DIST_TABLESIZE) ? total : total * i / CM_DIST_TABLESIZE;
+		// skip the empty bins and the bins below the target (the sums are built in the same order as the total)
+		for (;;) {
+			weight = histogram[bin * stride];
+			weight = weight > 0.0 ? weight : 0.0;
+			if (bin >= bins - 1 || (weight > 0.0 && sum + weight >= target)) {
+				break;
+			}
+			sum += weight;
+			bin++;
+		}
+		fraction = weight > 0.0 ? (target - sum) / weight : 0.0;
+		fraction = fraction < 0.0 ? 0.0 : (fraction > 1.0 ? 1.0 : fraction);
+		table[i] = (float)((bin + fraction) / bins);
+	}
+	return true;
+}
+
+// build the gauss table (once, from the class initialization)
+static void cm_dist_setup(void) {
+	double scale = 1.0 / (CM_DIST_GAUSSWIDTH * sqrt(2.0)); // sqrt(2) deviations (half the range covers CM_DIST_GAUSSWIDTH)
+	double edge = erf(0.5 / scale); // erf value of the max position (truncation)
+	double target, low, high, mid;
+	long i, k;
+	for (i = 0; i <= CM_DIST_TABLESIZE; i++) {
+		target = (2.0 * i / CM_DIST_TABLESIZE - 1.0) * edge; // erf value of the position
+		low = 0.0;
+		high = 1.0;
+		for (k = 0; k < 40; k++) { // bisection (the CDF is monotonic)
+			mid = 0.5 * (low + high);
+			if (erf((mid - 0.5) / scale) < target) {
+				low = mid;
+			}
+			else {
+				high = mid;
+			}
+		}
+		cm_dist_gauss[i] = (float)(0.5 * (low + high));
+	}
+	cm_dist_gauss[0] = 0.0;
+	cm_dist_gauss[CM_DIST_TABLESIZE] = 1.0;
+}
+
+// free a table
+static void cm_dist_table_free(cm_dist_table *table) {
+	if (table) {
+		if (table->samples) {
+			sysmem_freeptr(table->samples);
+		}
+		sysmem_freeptr(table);
+	}
+}
+
+// build the inverse CDF tables of all channels of a histogram buffer (NULL if the buffer has no samples)
+// returns false if memory allocation failed
+static t_bool cm_dist_table_new(cm_dist_table **result, t_buffer_obj *buffer) {
+	cm_dist_table *table;
+	float *samples, *channel;
+	long frames, channels, c, i;
+
+	*result = NULL;
+	samples = buffer ? buffer_locksamples(buffer) : NULL;
+	if (!samples) {
+		return true;
+	}
+	frames = buffer_getframecount(buffer);
+	channels = buffer_getchannelcount(buffer);
+	if (frames < 1 || channels < 1) {
+		buffer_unlocksamples(buffer);
+		return true;
+	}
+	channels = channels < CM_DIST_PARAMS ? channels : CM_DIST_PARAMS;
+	table = (cm_dist_table *)sysmem_newptrclear(sizeof(cm_dist_table));
+	if (table) {
+		table->channels = channels;
+		table->source = buffer;
+		table->samples = (float *)sysmem_newptr(channels * (CM_DIST_TABLESIZE + 1) * sizeof(float));
+		if (table->samples == NULL) {
+			cm_dist_table_free(table);
+			table = NULL;
+		}
+	}
+	if (table) {
+		for (c = 0; c < channels; c++) {
+			channel = table->samples + c * (CM_DIST_TABLESIZE + 1);
+			if (!cm_dist_invert(samples + c, frames, buffer_getchannelcount(buffer), channel)) {
+				for (i = 0; i <= CM_DIST_TABLESIZE; i++) { // flat histogram: uniform
+					channel[i] = (float)i / CM_DIST_TABLESIZE;
+				}
+			}
+		}
+	}
+	buffer_unlocksamples(buffer);
+	*result = table;
+	return table ? true : false;
+}
+
+
+/************************************************************************************************************************/
+/* HANDOVER BETWEEN MAIN AND AUDIO THREAD                                                                               */
+/************************************************************************************************************************/
+static void cm_dist_init(cm_dist *dist) {
+	dist->active = NULL;
+	dist->pending = NULL;
+	dist->retired = NULL;
+	dist->state = CM_SWAP_IDLE;
+	dist->generation = 0;
+	dist->built = -1;
+	dist->requested = NULL;
+}
+
+// the histogram buffer was modified or replaced (any thread): the table has to be rebuilt
+static void cm_dist_modified(cm_dist *dist) {
+	ATOMIC_INCREMENT(&dist->generation);
+}
+
+// audio thread: request a rebuild if the installed table was not built from the current histogram buffer
+// (a buffer~ created after the object); returns true if the qelem must be set
+static t_bool cm_dist_check(cm_dist *dist, t_buffer_obj *buffer) {
+	if ((dist->active ? dist->active->source : NULL) == buffer || dist->requested == buffer || dist->state != CM_SWAP_IDLE) {
+		return false;
+	}
+	dist->requested = buffer;
+	cm_dist_modified(dist);
+	return true;
+}
+
+// main thread (qelem): free the retired table and build a new one if the histogram buffer was modified
+// returns false if memory allocation failed
+static t_bool cm_dist_update(cm_dist *dist, t_buffer_obj *buffer) {
+	long generation = dist->generation;
+	if (dist->state == CM_SWAP_RETIRED) {
+		cm_dist_table_free(dist->retired);
+		dist->retired = NULL;
+		cm_swap_advance(&dist->state, CM_SWAP_RETIRED, CM_SWAP_IDLE);
+	}
+	// a modification arriving during a swap is served after it (the audio thread sets the qelem again)
+	if (dist->state != CM_SWAP_IDLE || dist->built == generation) {
+		return true;
+	}
+	dist->pending = NULL;
+	if (!cm_dist_table_new(&dist->pending, buffer)) {
+		return false; // the grains keep using the installed table
+	}
+	dist->built = generation;
+	cm_swap_advance(&dist->state, CM_SWAP_IDLE, CM_SWAP_READY);
+	return true;
+}
+
+// audio thread: install the table built on the main thread; returns true if the retired table has to be freed
+static t_bool cm_dist_install(cm_dist *dist) {
+	if (dist->state != CM_SWAP_READY) {
+		return false;
+	}
+	dist->retired = dist->active;
+	dist->active = dist->pending;
+	dist->pending = NULL;
+	return cm_swap_advance(&dist->state, CM_SWAP_READY, CM_SWAP_RETIRED);
+}
+
+// free all tables (the qelem must be freed before)
+static void cm_dist_free(cm_dist *dist) {
+	cm_dist_table_free(dist->active);
+	cm_dist_table_free(dist->pending);
+	cm_dist_table_free(dist->retired);
+	cm_dist_init(dist);
+}
+
+
+/************************************************************************************************************************/
+/* SAMPLING (AUDIO THREAD)                                                                                              */
+/************************************************************************************************************************/
+// read an inverse CDF table at u in [0, 1)
+static inline double cm_dist_lookup(const float *table, double u) {
+	double position = u * CM_DIST_TABLESIZE;
+	long index = (long)position;
+	return table[index] + (position - index) * (table[index + 1] - table[index]);
+}
+
+// map a uniform number u in [0, 1) to a position in [0, 1] of the parameter range
+static inline double cm_dist_map(const cm_dist_table *table, t_atom_long kind, long param, double u) {
+	switch (kind) {
+		case CM_DIST_TRIANGULAR:
+			return u < 0.5 ? sqrt(0.5 * u) : 1.0 - sqrt(0.5 * (1.0 - u));
+		case CM_DIST_GAUSS:
+			return cm_dist_lookup(cm_dist_gauss, u);
+		case CM_DIST_EXPONENTIAL:
+			return -log(1.0 - u * (1.0 - exp(-CM_DIST_EXPRATE))) * (1.0 / CM_DIST_EXPRATE);
+		case CM_DIST_BUFFER:
+			if (table) {
+				return cm_dist_lookup(table->samples + (param < table->channels ? param : 0) * (CM_DIST_TABLESIZE + 1), u);
+			}
+			return u;
+		default:
+			return u;
+	}
+}
+
+// draw count grain parameters: values[i] between ranges[2 * i] and ranges[2 * i + 1] (min/max pairs of the grain
+// parameters) with the distributions kinds[i]; table: installed histogram table or NULL
+static inline void cm_dist_fill(cm_rng *rng, const double *ranges, double *values, long count, const t_atom_long *kinds, const cm_dist_table *table) {
+	long i;
+	for (i = 0; i < count; i++) {
+		values[i] = ranges[2 * i] + (ranges[2 * i + 1] - ranges[2 * i]) * cm_dist_map(table, kinds[i], i, cm_rng_unit(rng));
+	}
+}
+
+#endif
@@ -0,0 +1,146 @@
+/*
+ cm_envcache.h - small LRU cache of windows resampled to a grain length.
+ Copyright (C) 2012 - 2017  Matthias W. Müller - circuit.music.labs
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ info@circuitmusiclabs.com
+
+ */
+
+// NOTE:
+// Every rendered grain needs its window resampled to the grain length (the envelope). When grain lengths repeat
+// (synchronous clouds with length min == max, or a few alternating lengths) the same envelope is computed again and again.
+// The cache keeps the last CM_ENVCACHE_ENTRIES envelopes, keyed by the window (table pointer, NULL for analytic windows),
+// a shape value (window interpolation mode or window parameter) and the grain length. On a hit the source render kernel
+// multiplies the source directly with the cached envelope.
+//
+// The envelope memory is allocated on the main thread together with the grain storage (capacity: max grain length),
+// lookups and fills happen on the audio thread only. A window table which is replaced or freed must clear the cache
+// (its address could be reused). The hit/miss counters are posted by the "footprint" message.
+
+#ifndef CM_ENVCACHE_H
+#define CM_ENVCACHE_H
+
+#include "ext.h"
+
+#define CM_ENVCACHE_ENTRIES 4 // number of cached envelopes
+
+typedef struct cmenventry {
+	float *samples; // envelope (capacity values)
+	const void *window; // key: window table (NULL for analytic windows)
+	double shape; // key: window interpolation mode or window parameter
+	double length; // key: grain length in samples (-1: empty entry)
+	unsigned long used; // time stamp of the last use (least recently used entry is replaced)
+} cm_enventry;
+
+typedef struct cmenvcache {
+	cm_enventry entries[CM_ENVCACHE_ENTRIES];
+	long capacity; // max number of values per envelope
+	unsigned long clock; // time stamp counter
+	unsigned long hits; // grains rendered with a cached envelope
+	unsigned long misses; // grains which computed their envelope into the cache
+	unsigned long bypassed; // grains longer than the capacity (envelope written into the grain memory)
+} cm_envcache;
+
+
+/************************************************************************************************************************/
+/* ALLOCATION (MAIN THREAD)                                                                                             */
+/************************************************************************************************************************/
+// free the envelope memory of a cache
+static void cm_envcache_free(cm_envcache *cache) {
+	long e;
+	for (e = 0; e < CM_ENVCACHE_ENTRIES; e++) {
+		if (cache->entries[e].samples) {
+			sysmem_freeptr(cache->entries[e].samples);
+			cache->entries[e].samples = NULL;
+		}
+	}
+}
+
+// allocate the envelope memory for envelopes of up to capacity values; returns false if memory allocation failed
+// (the partly allocated cache is freed by cm_envcache_free)
+static t_bool cm_envcache_new(cm_envcache *cache, long capacity) {
+	long e;
+	memset(cache, 0, sizeof(cm_envcache));
+	cache->capacity = capacity;
+	for (e = 0; e < CM_ENVCACHE_ENTRIES; e++) {
+		cache->entries[e].length = -1.0;
+		cache->entries[e].samples = (float *)sysmem_newptr(capacity * sizeof(float));
+		if (cache->entries[e].samples == NULL) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// post the hit rate and memory of a cache
+static void cm_envcache_footprint(cm_envcache *cache, t_object *x) {
+	unsigned long total = cache->hits + cache->misses + cache->bypassed;
+	object_post(x, "envelope cache: %lu hits, %lu misses, %lu bypassed (%.1f%% hit rate)", cache->hits, cache->misses, cache->bypassed, total ? 100.0 * cache->hits / total : 0.0);
+	object_post(x, "envelope cache: %d entries of %ld samples (%.1f kB)", CM_ENVCACHE_ENTRIES, cache->capacity, CM_ENVCACHE_ENTRIES * cache->capacity * sizeof(float) / 1024.0);
+}
+
+
+/************************************************************************************************************************/
+/* LOOKUP (AUDIO THREAD)                                                                                                */
+/************************************************************************************************************************/
+// forget all envelopes (the window they were computed from was replaced)
+static void cm_envcache_clear(cm_envcache *cache) {
+	long e;
+	for (e = 0; e < CM_ENVCACHE_ENTRIES; e++) {
+		cache->entries[e].length = -1.0;
+		cache->entries[e].used = 0;
+	}
+}
+
+// keep the counters when the cache is replaced together with the grain storage
+static void cm_envcache_inherit(cm_envcache *cache, const cm_envcache *from) {
+	cache->hits = from->hits;
+	cache->misses = from->misses;
+	cache->bypassed = from->bypassed;
+}
+
+// envelope of count values for the key: *cached is true if the envelope is already computed, otherwise the caller
+// writes the envelope into the returned memory; returns NULL if the envelope does not fit into the cache
+static inline float *cm_envcache_get(cm_envcache *cache, const void *window, double shape, double length, long count, t_bool *cached) {
+	cm_enventry *entry, *oldest = cache->entries;
+	long e;
+	cache->clock++;
+	for (e = 0; e < CM_ENVCACHE_ENTRIES; e++) {
+		entry = cache->entries + e;
+		if (entry->length == length && entry->window == window && entry->shape == shape) {
+			entry->used = cache->clock;
+			cache->hits++;
+			*cached = true;
+			return entry->samples;
+		}
+		if (entry->used < oldest->used) {
+			oldest = entry;
+		}
+	}
+	*cached = false;
+	if (count > cache->capacity) {
+		cache->bypassed++;
+		return NULL;
+	}
+	cache->misses++;
+	oldest->window = window;
+	oldest->shape = shape;
+	oldest->length = length;
+	oldest->used = cache->clock;
+	return oldest->samples;
+}
+
+#endif
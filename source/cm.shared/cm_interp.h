@@ -0,0 +1,177 @@
+/*
+ cm_interp.h - sample interpolation modes and their polyphase coefficient tables.
+ Copyright (C) 2012 - 2017  Matthias W. Müller - circuit.music.labs
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ info@circuitmusiclabs.com
+
+ */
+
+// NOTE:
+// The s_interp attribute selects one of the following modes:
+//
+//   0  off       truncated index
+//   1  linear    2 points (cm_lininterp, the former "on" state)
+//   2  hermite   4 points, 3rd order Catmull-Rom Hermite spline
+//   3  lagrange  6 points, 5th order Lagrange polynomial
+//   4  sinc      8, 16 or 32 points (s_taps attribute), Blackman windowed sinc
+//
+// The modes above linear are FIR filters: the output sample is the sum of taps source samples around the read position,
+// weighted with coefficients which only depend on the fractional part of the position. The coefficients are
+// precomputed for CM_INTERP_PHASES fractional positions per sample (phase-major, one row of taps per phase), so every mode
+// runs the same multiply-add loop which the render kernels vectorize with gathered loads.
+// Source positions outside the buffer are clamped to the first and last sample (ringbuffer positions wrap around).
+
+#ifndef CM_INTERP_H
+#define CM_INTERP_H
+
+#include "ext.h"
+#include <math.h> // for sin, cos and atan
+
+#define CM_INTERP_OFF 0
+#define CM_INTERP_LINEAR 1
+#define CM_INTERP_HERMITE 2
+#define CM_INTERP_LAGRANGE 3
+#define CM_INTERP_SINC 4
+#define CM_INTERP_MODES 5 // number of s_interp modes
+#define CM_INTERP_PHASES 1024 // fractional positions per sample in the coefficient tables
+#define CM_SINC_MINTAPS 8
+#define CM_SINC_MAXTAPS 32
+#define CM_SINC_DEFTAPS 16
+
+#ifdef _MSC_VER
+#define CM_INLINE __forceinline
+#else
+#define CM_INLINE inline __attribute__((always_inline))
+#endif
+
+typedef struct cminterptable {
+	long taps; // number of source samples per output sample
+	long offset; // position of the first tap relative to the truncated read position
+	float *coef; // (CM_INTERP_PHASES + 1) rows of taps coefficients
+} cm_interp_table;
+
+static float cm_interp_hermite_coef[(CM_INTERP_PHASES + 1) * 4];
+static float cm_interp_lagrange_coef[(CM_INTERP_PHASES + 1) * 6];
+static float cm_interp_sinc8_coef[(CM_INTERP_PHASES + 1) * 8];
+static float cm_interp_sinc16_coef[(CM_INTERP_PHASES + 1) * 16];
+static float cm_interp_sinc32_coef[(CM_INTERP_PHASES + 1) * 32];
+
+static cm_interp_table cm_interp_hermite = {4, -1, cm_interp_hermite_coef};
+static cm_interp_table cm_interp_lagrange = {6, -2, cm_interp_lagrange_coef};
+static cm_interp_table cm_interp_sinc8 = {8, -3, cm_interp_sinc8_coef};
+static cm_interp_table cm_interp_sinc16 = {16, -7, cm_interp_sinc16_coef};
+static cm_interp_table cm_interp_sinc32 = {32, -15, cm_interp_sinc32_coef};
+
+
+/************************************************************************************************************************/
+/* COEFFICIENT TABLES                                                                                                   */
+/************************************************************************************************************************/
+// Blackman windowed sinc, normalized to unity gain at every phase
+static void cm_interp_sinc_build(cm_interp_table *table) {
+	long p, t;
+	double frac, dist, u, sum;
+	double coef[CM_SINC_MAXTAPS];
+	double pi = 4.0 * atan(1.0);
+	for (p = 0; p <= CM_INTERP_PHASES; p++) {
+		frac = (double)p / (double)CM_INTERP_PHASES;
+		sum = 0.0;
+		for (t = 0; t < table->taps; t++) {
+			dist = (double)(table->offset + t) - frac; // distance of the tap from the read position
+			u = (dist + (double)table->taps / 2.0) / (double)table->taps; // position in the window (0 ... 1)
+			coef[t] = (dist == 0.0) ? 1.0 : sin(pi * dist) / (pi * dist);
+			coef[t] *= 0.42 - 0.5 * cos(2.0 * pi * u) + 0.08 * cos(4.0 * pi * u);
+			sum += coef[t];
+		}
+		for (t = 0; t < table->taps; t++) {
+			table->coef[p * table->taps + t] = (float)(coef[t] / sum);
+		}
+	}
+}
+
+// build all coefficient tables (call once from ext_main)
+static void cm_interp_init(void) {
+	long p, t, m;
+	double f, c;
+	for (p = 0; p <= CM_INTERP_PHASES; p++) {
+		f = (double)p / (double)CM_INTERP_PHASES;
+		// 4-point hermite (taps at -1, 0, 1, 2)
+		cm_interp_hermite_coef[p * 4] = (float)(((-0.5 * f + 1.0) * f - 0.5) * f);
+		cm_interp_hermite_coef[p * 4 + 1] = (float)((1.5 * f - 2.5) * f * f + 1.0);
+		cm_interp_hermite_coef[p * 4 + 2] = (float)(((-1.5 * f + 2.0) * f + 0.5) * f);
+		cm_interp_hermite_coef[p * 4 + 3] = (float)((0.5 * f - 0.5) * f * f);
+		// 6-point lagrange (taps at -2 ... 3)
+		for (t = 0; t < 6; t++) {
+			c = 1.0;
+			for (m = 0; m < 6; m++) {
+				if (m != t) {
+					c *= (f - (double)(m - 2)) / (double)(t - m);
+				}
+			}
+			cm_interp_lagrange_coef[p * 6 + t] = (float)c;
+		}
+	}
+	cm_interp_sinc_build(&cm_interp_sinc8);
+	cm_interp_sinc_build(&cm_interp_sinc16);
+	cm_interp_sinc_build(&cm_interp_sinc32);
+}
+
+// coefficient table of an interpolation mode (NULL for off and linear)
+static const cm_interp_table *cm_interp_select(long mode, long taps) {
+	switch (mode) {
+		case CM_INTERP_HERMITE:
+			return &cm_interp_hermite;
+		case CM_INTERP_LAGRANGE:
+			return &cm_interp_lagrange;
+		case CM_INTERP_SINC:
+			return taps <= 8 ? &cm_interp_sinc8 : (taps <= 16 ? &cm_interp_sinc16 : &cm_interp_sinc32);
+		default:
+			return NULL;
+	}
+}
+
+
+/************************************************************************************************************************/
+/* SCALAR FILTERS (STREAMING ENGINE)                                                                                    */
+/************************************************************************************************************************/
+// filtered sample at distance from an interleaved float buffer
+static CM_INLINE double cm_interp_buffer(const cm_interp_table *table, double distance, const float *buffer, long channels, long frames, long channel) {
+	long index = (long)distance;
+	long t, tap;
+	const float *coef = table->coef + (long)((distance - (double)index) * CM_INTERP_PHASES + 0.5) * table->taps;
+	double value = 0.0;
+	for (t = 0; t < table->taps; t++) {
+		tap = index + table->offset + t;
+		tap = tap < 0 ? 0 : (tap >= frames ? frames - 1 : tap);
+		value += (double)coef[t] * (double)buffer[tap * channels + channel];
+	}
+	return value;
+}
+
+// filtered sample at distance from a ringbuffer (0 <= distance < ringframes)
+static CM_INLINE double cm_interp_ring(const cm_interp_table *table, double distance, const double *ring, long ringframes) {
+	long index = (long)distance;
+	long t, tap;
+	const float *coef = table->coef + (long)((distance - (double)index) * CM_INTERP_PHASES + 0.5) * table->taps;
+	double value = 0.0;
+	for (t = 0; t < table->taps; t++) {
+		tap = index + table->offset + t;
+		tap += tap < 0 ? ringframes : (tap >= ringframes ? -ringframes : 0);
+		value += (double)coef[t] * ring[tap];
+	}
+	return value;
+}
+
+#endif
@@ -0,0 +1,491 @@
+/*
+ cm_mipmap.h - octave pyramid of band-limited sample buffer copies for high pitch ratios.
+ Copyright (C) 2012 - 2017  Matthias W. Müller - circuit.music.labs
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ info@circuitmusiclabs.com
+
+ */
+
+// NOTE:
+// Reading the sample buffer faster than one frame per output sample folds everything above the new Nyquist frequency
+// back into the audible range. Level n of the pyramid is the sample buffer low-pass filtered with a half-band filter and
+// decimated by 2 n times (level 0 is the buffer itself). A grain with a read increment (pitch) of r reads from the
+// lowest level with r / 2^n <= 1, so the source never holds frequencies the grain cannot reproduce.
+//
+// The pyramid is built on a worker thread (started with the first request) and handed to the audio thread with the swap
+// states of cm_swap.h (READY: built, RETIRED: the replaced pyramid can be freed on the main thread). The main thread
+// (qelem) only passes the sample buffer on when the buffer reports a modification. Every modification increments a
+// generation counter: a pyramid of an older generation (or of a buffer with a different frame or channel count) is
+// never read, the grains fall back to level 0 until the new pyramid is installed.
+// A buffer~ written by record~ or peek~ reports a steady stream of modifications. The worker starts a build only after
+// the buffer has not been modified for CM_MIPMAP_QUIET ms and abandons it as soon as the generation changes, so the
+// pending generations are coalesced into one build. The sample buffer is locked for CM_MIPMAP_CHUNK frames of level 1
+// at a time, and cm_mipmap_release stops a build before the buffer~ goes away or the reference is changed.
+// In deterministic mode the pyramid is built on the main thread (cm_mipmap_finish): the output must not depend on
+// when the worker is done.
+// Only the first two channels are decimated, the copies are interleaved like the sample buffer and have one extra
+// frame at the end (copy of the last frame) for the interpolation functions which read one frame past the index.
+
+#ifndef CM_MIPMAP_H
+#define CM_MIPMAP_H
+
+#include "ext.h"
+#include "ext_atomic.h"
+#include "buffer.h"
+#include "ext_systhread.h"
+#include "cm_swap.h"
+#include <math.h> // for sin, cos and atan
+
+#define CM_MIPMAP_LEVELS 4 // level 0 (the buffer) and 3 decimated levels: pitch ratios up to 8 (MAX_PITCH)
+#define CM_MIPMAP_HALF 15 // half length of the half-band filter (31 taps)
+#define CM_MIPMAP_CHANNELS 2 // max number of decimated channels
+#define CM_MIPMAP_QUIET 100 // ms without modification of the sample buffer before the worker builds a pyramid
+#define CM_MIPMAP_CHUNK 32768 // level 1 frames decimated per lock of the sample buffer
+
+// results of a build
+#define CM_MIPMAP_DONE 0 // built (or no pyramid)
+#define CM_MIPMAP_ABANDONED 1 // the buffer was modified, replaced or released during the build
+#define CM_MIPMAP_FAILED 2 // out of memory
+
+typedef struct cmmipmappyramid {
+	float *samples[CM_MIPMAP_LEVELS]; // decimated copies (samples[0] is unused, level 0 is the sample buffer)
+	long frames[CM_MIPMAP_LEVELS]; // number of frames per level (without the extra frame)
+	long levels; // number of valid levels (including level 0)
+	long channels; // number of channels per frame in the decimated copies
+	long source_frames; // frame count of the sample buffer the pyramid was built from
+	long source_channels; // channel count of the sample buffer the pyramid was built from
+	long generation; // buffer generation the pyramid was built from
+} cm_mipmap_pyramid;
+
+typedef struct cmmipmap {
+	cm_mipmap_pyramid *active; // pyramid read by the audio thread
+	cm_mipmap_pyramid *pending; // pyramid built by the worker, waiting to be installed by the audio thread
+	cm_mipmap_pyramid *retired; // pyramid replaced by the last swap, freed on the main thread
+	t_int32_atomic state; // swap state (see cm_swap.h)
+	t_int32_atomic generation; // incremented with every modification of the sample buffer
+	long built; // generation of the last pyramid handed over or failed (-1: none), written by the thread building
+	void *qelem; // qelem of the main thread update (set by the worker after a failed build)
+	t_systhread thread; // worker thread (NULL: not started)
+	t_systhread_mutex lock; // guards the fields below
+	t_systhread_cond wake; // a new request, the end of a build or the end of the worker
+	t_buffer_obj *buffer; // sample buffer to build from (NULL: none or released)
+	t_bool enabled; // pyramid requested (s_mipmap attribute)
+	t_bool busy; // a build is running (worker or main thread)
+	t_bool quit; // the worker ends
+	t_bool failed; // the worker ran out of memory (reported by the next update)
+	long quiet; // generation the worker has waited CM_MIPMAP_QUIET ms for
+	t_int32_atomic cancel; // abandon the running build
+} cm_mipmap;
+
+typedef struct cmmipmapsource {
+	float *samples; // interleaved samples of the selected level
+	long channels; // number of channels per frame
+	long frames; // number of frames
+	double scale; // factor from sample buffer positions to positions in the selected level
+} cm_mipmap_source;
+
+
+/************************************************************************************************************************/
+/* PYRAMID CONSTRUCTION (WORKER THREAD)                                                                                 */
+/************************************************************************************************************************/
+// free a pyramid and all its levels
+static void cm_mipmap_pyramid_free(cm_mipmap_pyramid *pyramid) {
+	long level;
+	if (pyramid) {
+		for (level = 1; level < CM_MIPMAP_LEVELS; level++) {
+			if (pyramid->samples[level]) {
+				sysmem_freeptr(pyramid->samples[level]);
+			}
+		}
+		sysmem_freeptr(pyramid);
+	}
+}
+
+// half-band filter and decimate by 2: output frames first ... first + count - 1 of the (frames + 1) / 2 output frames
+// of frames input frames with stride inchannels (the extra frame is written with the last output frame)
+static void cm_mipmap_decimate(float *out, long outchannels, const float *in, long inchannels, long frames, long channels, const double *coef, long first, long count) {
+	long n, k, c, center, left, right;
+	long outframes = (frames + 1) / 2;
+	double value;
+	for (n = first; n < first + count; n++) {
+		center = n * 2;
+		for (c = 0; c < channels; c++) {
+			value = coef[0] * in[center * inchannels + c];
+			for (k = 1; k <= CM_MIPMAP_HALF; k += 2) { // the even taps of a half-band filter are zero
+				left = center - k < 0 ? 0 : center - k;
+				right = center + k >= frames ? frames - 1 : center + k;
+				value += coef[k] * (in[left * inchannels + c] + in[right * inchannels + c]);
+			}
+			out[n * outchannels + c] = (float)value;
+		}
+	}
+	if (first + count == outframes) {
+		for (c = 0; c < channels; c++) { // extra frame
+			out[outframes * outchannels + c] = out[(outframes - 1) * outchannels + c];
+		}
+	}
+}
+
+// Blackman windowed sinc with the cutoff at half the Nyquist frequency, normalized to unity gain
+static void cm_mipmap_coefficients(double *coef) {
+	double pi = 4.0 * atan(1.0);
+	double sum, u;
+	long k;
+	sum = 0.5;
+	coef[0] = 0.5;
+	for (k = 1; k <= CM_MIPMAP_HALF; k++) {
+		u = (double)(k + CM_MIPMAP_HALF + 1) / (double)(2 * CM_MIPMAP_HALF + 2); // position in the window (0 ... 1)
+		coef[k] = (k % 2) ? sin(pi * 0.5 * k) / (pi * k) : 0.0;
+		coef[k] *= 0.42 - 0.5 * cos(2.0 * pi * u) + 0.08 * cos(4.0 * pi * u);
+		sum += 2.0 * coef[k];
+	}
+	for (k = 0; k <= CM_MIPMAP_HALF; k++) {
+		coef[k] /= sum;
+	}
+}
+
+// allocate a pyramid for a sample buffer of the given size (NULL if memory allocation failed)
+static cm_mipmap_pyramid *cm_mipmap_pyramid_alloc(long frames, long channels, long generation) {
+	cm_mipmap_pyramid *pyramid = (cm_mipmap_pyramid *)sysmem_newptrclear(sizeof(cm_mipmap_pyramid));
+	long level;
+	if (pyramid == NULL) {
+		return NULL;
+	}
+	pyramid->source_frames = frames;
+	pyramid->source_channels = channels;
+	pyramid->channels = channels < CM_MIPMAP_CHANNELS ? channels : CM_MIPMAP_CHANNELS;
+	pyramid->generation = generation;
+	pyramid->frames[0] = frames;
+	pyramid->levels = 1;
+	for (level = 1; level < CM_MIPMAP_LEVELS && pyramid->frames[level - 1] > 1; level++) {
+		pyramid->frames[level] = (pyramid->frames[level - 1] + 1) / 2;
+		pyramid->samples[level] = (float *)sysmem_newptr((pyramid->frames[level] + 1) * pyramid->channels * sizeof(float));
+		if (pyramid->samples[level] == NULL) {
+			cm_mipmap_pyramid_free(pyramid);
+			return NULL;
+		}
+		pyramid->levels++;
+	}
+	return pyramid;
+}
+
+// true if the running build has to be abandoned (the sample buffer was modified, replaced or released)
+static inline t_bool cm_mipmap_abandoned(const cm_mipmap *mipmap, long generation) {
+	return mipmap->cancel || mipmap->generation != generation;
+}
+
+// build the pyramid of the given generation of a sample buffer (NULL if the buffer has no samples): the buffer is
+// locked for CM_MIPMAP_CHUNK frames of level 1 at a time, the build is abandoned as soon as the buffer is modified,
+// replaced or released; returns CM_MIPMAP_DONE, CM_MIPMAP_ABANDONED or CM_MIPMAP_FAILED
+static long cm_mipmap_pyramid_new(cm_mipmap *mipmap, cm_mipmap_pyramid **result, t_buffer_obj *buffer, long generation) {
+	cm_mipmap_pyramid *pyramid;
+	double coef[CM_MIPMAP_HALF + 1];
+	long frames, channels, level, first, count;
+	float *samples;
+
+	*result = NULL;
+	samples = buffer ? buffer_locksamples(buffer) : NULL;
+	if (!samples) {
+		return CM_MIPMAP_DONE;
+	}
+	frames = buffer_getframecount(buffer);
+	channels = buffer_getchannelcount(buffer);
+	buffer_unlocksamples(buffer);
+	pyramid = cm_mipmap_pyramid_alloc(frames, channels, generation);
+	if (pyramid == NULL) {
+		return CM_MIPMAP_FAILED;
+	}
+	cm_mipmap_coefficients(coef);
+	// level 1 from the sample buffer, chunk by chunk
+	for (first = 0; pyramid->levels > 1 && first < pyramid->frames[1]; first += count) {
+		count = pyramid->frames[1] - first < CM_MIPMAP_CHUNK ? pyramid->frames[1] - first : CM_MIPMAP_CHUNK;
+		samples = cm_mipmap_abandoned(mipmap, generation) ? NULL : buffer_locksamples(buffer);
+		if (!samples) {
+			cm_mipmap_pyramid_free(pyramid);
+			return CM_MIPMAP_ABANDONED;
+		}
+		if (buffer_getframecount(buffer) != frames || buffer_getchannelcount(buffer) != channels) { // resized meanwhile
+			buffer_unlocksamples(buffer);
+			cm_mipmap_pyramid_free(pyramid);
+			return CM_MIPMAP_ABANDONED;
+		}
+		cm_mipmap_decimate(pyramid->samples[1], pyramid->channels, samples, channels, frames, pyramid->channels, coef, first, count);
+		buffer_unlocksamples(buffer);
+	}
+	// the other levels from the level above
+	for (level = 2; level < pyramid->levels; level++) {
+		if (cm_mipmap_abandoned(mipmap, generation)) {
+			cm_mipmap_pyramid_free(pyramid);
+			return CM_MIPMAP_ABANDONED;
+		}
+		cm_mipmap_decimate(pyramid->samples[level], pyramid->channels, pyramid->samples[level - 1], pyramid->channels, pyramid->frames[level - 1], pyramid->channels, coef, 0, pyramid->frames[level]);
+	}
+	*result = pyramid;
+	return CM_MIPMAP_DONE;
+}
+
+// build the pyramid of the generation target (-1: no pyramid) and hand it to the audio thread, unless a swap is in flight
+// or it was handed over already (called by the thread which set busy); returns the result of the build
+static long cm_mipmap_build(cm_mipmap *mipmap, t_buffer_obj *buffer, long target) {
+	cm_mipmap_pyramid *pyramid = NULL;
+	long result = CM_MIPMAP_DONE;
+	if (mipmap->state != CM_SWAP_IDLE || mipmap->built == target) {
+		return CM_MIPMAP_DONE;
+	}
+	if (target != -1) {
+		result = cm_mipmap_pyramid_new(mipmap, &pyramid, buffer, target);
+	}
+	if (result == CM_MIPMAP_DONE) {
+		mipmap->pending = pyramid;
+		mipmap->built = target;
+		cm_swap_advance(&mipmap->state, CM_SWAP_IDLE, CM_SWAP_READY);
+	}
+	else if (result == CM_MIPMAP_FAILED) {
+		mipmap->built = target; // the grains keep reading from level 0, retried with the next modification
+	}
+	return result;
+}
+
+
+/************************************************************************************************************************/
+/* WORKER THREAD                                                                                                        */
+/************************************************************************************************************************/
+// wait for requests, build a pyramid once the sample buffer has not been modified for CM_MIPMAP_QUIET ms
+static void *cm_mipmap_worker(cm_mipmap *mipmap) {
+	t_buffer_obj *buffer;
+	long target;
+	systhread_mutex_lock(mipmap->lock);
+	while (!mipmap->quit) {
+		target = mipmap->enabled ? mipmap->generation : -1;
+		if (mipmap->busy || mipmap->state != CM_SWAP_IDLE || mipmap->built == target) {
+			systhread_cond_wait(mipmap->wake, mipmap->lock);
+			continue;
+		}
+		if (target != -1 && mipmap->quiet != target) { // wait for the end of a stream of modifications
+			mipmap->quiet = target;
+			systhread_mutex_unlock(mipmap->lock);
+			systhread_sleep(CM_MIPMAP_QUIET);
+			systhread_mutex_lock(mipmap->lock);
+			continue;
+		}
+		buffer = mipmap->buffer;
+		mipmap->busy = true;
+		systhread_mutex_unlock(mipmap->lock);
+		if (cm_mipmap_build(mipmap, buffer, target) == CM_MIPMAP_FAILED) {
+			mipmap->failed = true;
+			qelem_set(mipmap->qelem);
+		}
+		systhread_mutex_lock(mipmap->lock);
+		mipmap->busy = false;
+		systhread_cond_broadcast(mipmap->wake);
+	}
+	systhread_mutex_unlock(mipmap->lock);
+	systhread_exit(0);
+	return NULL;
+}
+
+// start the worker thread; returns false if it could not be started
+static t_bool cm_mipmap_start(cm_mipmap *mipmap) {
+	if (systhread_mutex_new(&mipmap->lock, 0) != 0) {
+		mipmap->lock = NULL;
+		return false;
+	}
+	if (systhread_cond_new(&mipmap->wake, 0) != 0) {
+		systhread_mutex_free(mipmap->lock);
+		mipmap->lock = NULL;
+		mipmap->wake = NULL;
+		return false;
+	}
+	mipmap->quit = false;
+	if (systhread_create((method)cm_mipmap_worker, mipmap, 0, 0, 0, &mipmap->thread) != 0) {
+		systhread_cond_free(mipmap->wake);
+		systhread_mutex_free(mipmap->lock);
+		mipmap->thread = NULL;
+		mipmap->lock = NULL;
+		mipmap->wake = NULL;
+		return false;
+	}
+	return true;
+}
+
+// end the worker thread (before the qelem it sets is freed)
+static void cm_mipmap_stop(cm_mipmap *mipmap) {
+	unsigned int status;
+	if (!mipmap->thread) {
+		return;
+	}
+	systhread_mutex_lock(mipmap->lock);
+	mipmap->quit = true;
+	mipmap->cancel = true;
+	systhread_cond_broadcast(mipmap->wake);
+	systhread_mutex_unlock(mipmap->lock);
+	systhread_join(mipmap->thread, &status);
+	systhread_cond_free(mipmap->wake);
+	systhread_mutex_free(mipmap->lock);
+	mipmap->thread = NULL;
+	mipmap->lock = NULL;
+	mipmap->wake = NULL;
+	mipmap->cancel = false;
+}
+
+
+/************************************************************************************************************************/
+/* HANDOVER BETWEEN MAIN AND AUDIO THREAD                                                                               */
+/************************************************************************************************************************/
+static void cm_mipmap_init(cm_mipmap *mipmap, void *qelem) {
+	mipmap->active = NULL;
+	mipmap->pending = NULL;
+	mipmap->retired = NULL;
+	mipmap->state = CM_SWAP_IDLE;
+	mipmap->generation = 0;
+	mipmap->built = -1;
+	mipmap->qelem = qelem;
+	mipmap->thread = NULL;
+	mipmap->lock = NULL;
+	mipmap->wake = NULL;
+	mipmap->buffer = NULL;
+	mipmap->enabled = false;
+	mipmap->busy = false;
+	mipmap->quit = false;
+	mipmap->failed = false;
+	mipmap->quiet = -1;
+	mipmap->cancel = false;
+}
+
+// the sample buffer was modified or replaced (any thread): the current pyramid is outdated
+static void cm_mipmap_modified(cm_mipmap *mipmap) {
+	ATOMIC_INCREMENT(&mipmap->generation);
+}
+
+// main thread: free the pyramid replaced by the last swap
+static void cm_mipmap_retire(cm_mipmap *mipmap) {
+	if (mipmap->state == CM_SWAP_RETIRED) {
+		cm_mipmap_pyramid_free(mipmap->retired);
+		mipmap->retired = NULL;
+		cm_swap_advance(&mipmap->state, CM_SWAP_RETIRED, CM_SWAP_IDLE);
+	}
+}
+
+// main thread: build the pyramid of the current generation now (deterministic mode, or no worker thread); returns false
+// if memory allocation failed
+static t_bool cm_mipmap_finish(cm_mipmap *mipmap, t_buffer_obj *buffer, t_bool enabled) {
+	long result;
+	cm_mipmap_retire(mipmap);
+	if (mipmap->thread) { // take over from the worker
+		systhread_mutex_lock(mipmap->lock);
+		mipmap->buffer = buffer;
+		mipmap->enabled = enabled;
+		mipmap->cancel = true;
+		while (mipmap->busy) {
+			systhread_cond_wait(mipmap->wake, mipmap->lock);
+		}
+		mipmap->cancel = false;
+		mipmap->busy = true;
+		systhread_mutex_unlock(mipmap->lock);
+	}
+	result = cm_mipmap_build(mipmap, buffer, enabled ? mipmap->generation : -1);
+	if (mipmap->thread) {
+		systhread_mutex_lock(mipmap->lock);
+		mipmap->busy = false;
+		systhread_cond_broadcast(mipmap->wake);
+		systhread_mutex_unlock(mipmap->lock);
+	}
+	return result != CM_MIPMAP_FAILED;
+}
+
+// main thread (qelem): free the retired pyramid and pass the sample buffer on to the worker, which builds a new pyramid
+// if the buffer was modified (no pyramid when disabled); returns false if memory allocation failed
+static t_bool cm_mipmap_update(cm_mipmap *mipmap, t_buffer_obj *buffer, t_bool enabled) {
+	t_bool failed;
+	if (!mipmap->thread && (!enabled || !cm_mipmap_start(mipmap))) {
+		return cm_mipmap_finish(mipmap, buffer, enabled); // nothing to build, or no worker thread
+	}
+	cm_mipmap_retire(mipmap);
+	// a modification arriving during a swap is served after it (the audio thread sets the qelem again)
+	systhread_mutex_lock(mipmap->lock);
+	mipmap->buffer = buffer;
+	mipmap->enabled = enabled;
+	failed = mipmap->failed;
+	mipmap->failed = false;
+	systhread_cond_broadcast(mipmap->wake);
+	systhread_mutex_unlock(mipmap->lock);
+	return !failed;
+}
+
+// main thread: the sample buffer is about to go away or to be replaced, stop reading it (the next update passes the
+// buffer on again)
+static void cm_mipmap_release(cm_mipmap *mipmap) {
+	if (!mipmap->thread) {
+		return;
+	}
+	systhread_mutex_lock(mipmap->lock);
+	mipmap->buffer = NULL;
+	mipmap->cancel = true;
+	while (mipmap->busy) {
+		systhread_cond_wait(mipmap->wake, mipmap->lock);
+	}
+	mipmap->cancel = false;
+	systhread_mutex_unlock(mipmap->lock);
+}
+
+// audio thread: install the pyramid built by the worker; returns true if the retired pyramid has to be freed
+static t_bool cm_mipmap_install(cm_mipmap *mipmap) {
+	if (mipmap->state != CM_SWAP_READY) {
+		return false;
+	}
+	mipmap->retired = mipmap->active;
+	mipmap->active = mipmap->pending;
+	mipmap->pending = NULL;
+	return cm_swap_advance(&mipmap->state, CM_SWAP_READY, CM_SWAP_RETIRED);
+}
+
+// end the worker and free all pyramids (the qelem must be freed before)
+static void cm_mipmap_free(cm_mipmap *mipmap) {
+	cm_mipmap_stop(mipmap);
+	cm_mipmap_pyramid_free(mipmap->active);
+	cm_mipmap_pyramid_free(mipmap->pending);
+	cm_mipmap_pyramid_free(mipmap->retired);
+	cm_mipmap_init(mipmap, NULL);
+}
+
+
+/************************************************************************************************************************/
+/* LEVEL SELECTION (AUDIO THREAD)                                                                                       */
+/************************************************************************************************************************/
+// select the source for a grain with read increment ratio (level 0 if no valid pyramid exists for the current buffer)
+static inline void cm_mipmap_select(const cm_mipmap *mipmap, double ratio, float *b_sample, long b_channelcount, long b_framecount, cm_mipmap_source *source) {
+	const cm_mipmap_pyramid *pyramid = mipmap->active;
+	long level = 0;
+	source->samples = b_sample;
+	source->channels = b_channelcount;
+	source->frames = b_framecount;
+	source->scale = 1.0;
+	if (!pyramid || pyramid->generation != mipmap->generation || pyramid->source_frames != b_framecount || pyramid->source_channels != b_channelcount) {
+		return;
+	}
+	while (ratio > 1.0 && level < pyramid->levels - 1) {
+		ratio *= 0.5;
+		level++;
+	}
+	if (level > 0) {
+		source->samples = pyramid->samples[level];
+		source->channels = pyramid->channels;
+		source->frames = pyramid->frames[level];
+		source->scale = 1.0 / (double)(1 << level);
+	}
+}
+
+#endif
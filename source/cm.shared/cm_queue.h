@@ -0,0 +1,265 @@
+/*
+ cm_queue.h - lock-free event queue from the message methods to the audio thread.
+ Copyright (C) 2012 - 2017  Matthias W. Müller - circuit.music.labs
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ info@circuitmusiclabs.com
+
+ */
+
+// NOTE:
+// The message methods (bang, grain, float inlets, record) never write the state of the audio thread.
+// Discrete messages (bang, grain, record) become typed events in a bounded single-producer/single-consumer ring. The
+// perform routine drains the ring at the top of every signal vector and applies the events in the order they were sent:
+// every bang triggers a grain (bangs arriving within one vector trigger at consecutive frames, see cm_trigger.h).
+//
+//   producer (main or scheduler thread)   writes the event at head, then publishes head (barrier)
+//   consumer (audio thread)               reads head (barrier), applies the events up to head, then publishes tail
+//
+// The float inlet values are state, not events: only the latest value counts and it must never be lost, not even if
+// thousands of values arrive while the DSP is off. They are published as a complete set through a triple buffer:
+// the producer writes the back set and exchanges it with the middle set (marked as new), the audio thread exchanges
+// the middle set with its front set if it is new. The audio thread always reads a complete set, a value is never
+// read while it is written.
+// Each counter is written by one thread only, an exchange only repeats its compare-and-swap if the other thread
+// exchanged at the same moment: the audio thread never waits. Messages can arrive from the main and from the scheduler
+// thread: the producers take turns through a mutex which the audio thread never touches. A full ring drops the event,
+// the error is posted once per overflow.
+// A grain event carries all grain parameters and its offset in samples from the start of the next signal vector. The
+// audio thread sorts the grain events into the schedule, which keeps them across signal vectors: an offset beyond the
+// vector is carried into the following vectors, a grain which is due but cannot start (cloud full, no grain memory) is
+// due again at the first frame of the next vector. The trigger loop of the perform routine starts the scheduled grains
+// at their frame, before a signal trigger at the same frame; their parameters are not randomized. A full schedule
+// (CM_SCHEDULE_SIZE waiting grains) leaves the remaining events in the ring until grains have started. Nothing is
+// allocated on either side.
+
+#ifndef CM_QUEUE_H
+#define CM_QUEUE_H
+
+#include "ext.h"
+#include "ext_atomic.h"
+#include "ext_systhread.h"
+#include <stdint.h> // for uint32_t
+
+#define CM_QUEUE_SIZE 512 // max number of waiting events (power of two)
+#define CM_QUEUE_PARAMS 16 // max number of float inlets
+#define CM_QUEUE_NEW 4 // flag of the middle set: published by the producer, not yet read by the audio thread
+
+#define CM_EVENT_BANG 0 // trigger a grain
+#define CM_EVENT_RECORD 1 // record on/off (index: 1 on, 0 off)
+#define CM_EVENT_GRAIN 2 // start a grain (frame: offset from the start of the next signal vector, values: grain parameters)
+#define CM_EVENT_VALUES 6 // max number of grain parameters of a grain event
+#define CM_SCHEDULE_SIZE 256 // max number of grain events waiting in the schedule
+
+typedef struct cmevent {
+	long type; // event type
+	long index; // event argument
+	long frame; // offset from the start of the next signal vector (grain events)
+	double values[CM_EVENT_VALUES]; // grain parameters (grain events)
+} cm_event;
+
+typedef struct cmqueue {
+	cm_event events[CM_QUEUE_SIZE]; // ring of events
+	t_int32_atomic head; // number of events written (producer)
+	t_int32_atomic tail; // number of events applied (consumer)
+	double params[3][CM_QUEUE_PARAMS]; // float inlet value sets of the triple buffer
+	t_int32_atomic middle; // index of the middle set (| CM_QUEUE_NEW)
+	long back; // index of the set written by the producer
+	long front; // index of the set read by the audio thread
+	t_systhread_mutex lock; // serializes the producers (never taken by the audio thread)
+	long dropped; // events dropped since the last successful push (producer)
+} cm_queue;
+
+typedef struct cmschedule {
+	cm_event grains[CM_SCHEDULE_SIZE]; // waiting grain events, sorted by frame (relative to the current signal vector)
+	long count; // number of grain events
+	long next; // next grain event to start (the ones before it have started in the current vector)
+	long elapsed; // number of frames of the current signal vector
+} cm_schedule;
+
+
+/************************************************************************************************************************/
+/* ALLOCATION (MAIN THREAD)                                                                                             */
+/************************************************************************************************************************/
+// values: initial float inlet values (count values); returns false if the producer mutex could not be created
+static t_bool cm_queue_init(cm_queue *queue, const double *values, long count) {
+	long i, k;
+	queue->head = 0;
+	queue->tail = 0;
+	for (i = 0; i < 3; i++) {
+		for (k = 0; k < CM_QUEUE_PARAMS; k++) {
+			queue->params[i][k] = k < count ? values[k] : 0.0;
+		}
+	}
+	queue->front = 0;
+	queue->middle = 1;
+	queue->back = 2;
+	queue->dropped = 0;
+	queue->lock = NULL;
+	return systhread_mutex_new(&queue->lock, 0) == 0 ? true : false;
+}
+
+static void cm_queue_free(cm_queue *queue) {
+	if (queue->lock) {
+		systhread_mutex_free(queue->lock);
+	}
+	queue->lock = NULL;
+}
+
+// read a counter of the other thread (the compare-and-swap with the same value is a barrier and never changes it)
+static inline long cm_queue_load(t_int32_atomic *counter) {
+	long value = *counter;
+	ATOMIC_COMPARE_SWAP32(value, value, counter);
+	return value;
+}
+
+
+/************************************************************************************************************************/
+/* PRODUCER (MESSAGE METHODS)                                                                                           */
+/************************************************************************************************************************/
+// append an event; returns false if the queue is full (the first drop of an overflow sets *report)
+static t_bool cm_queue_push(cm_queue *queue, const cm_event *event, t_bool *report) {
+	long head;
+	t_bool result = true;
+	*report = false;
+	systhread_mutex_lock(queue->lock);
+	head = queue->head;
+	if ((uint32_t)(head - cm_queue_load(&queue->tail)) >= CM_QUEUE_SIZE) { // the counters wrap around
+		*report = queue->dropped++ == 0;
+		result = false;
+	}
+	else {
+		queue->events[head & (CM_QUEUE_SIZE - 1)] = *event;
+		queue->dropped = 0;
+		ATOMIC_INCREMENT_BARRIER(&queue->head); // publish the event
+	}
+	systhread_mutex_unlock(queue->lock);
+	return result;
+}
+
+// set a float inlet value: values holds the latest values of all count float inlets (written by the producers only)
+static void cm_queue_param(cm_queue *queue, double *values, long count, long index, double value) {
+	long middle, k;
+	systhread_mutex_lock(queue->lock);
+	values[index] = value;
+	for (k = 0; k < count && k < CM_QUEUE_PARAMS; k++) {
+		queue->params[queue->back][k] = values[k];
+	}
+	do { // exchange the back set with the middle set
+		middle = queue->middle;
+	} while (!ATOMIC_COMPARE_SWAP32(middle, queue->back | CM_QUEUE_NEW, &queue->middle));
+	queue->back = middle & ~CM_QUEUE_NEW;
+	systhread_mutex_unlock(queue->lock);
+}
+
+
+/************************************************************************************************************************/
+/* CONSUMER (AUDIO THREAD)                                                                                              */
+/************************************************************************************************************************/
+// number of complete events waiting
+static inline long cm_queue_count(cm_queue *queue) {
+	return (uint32_t)(cm_queue_load(&queue->head) - queue->tail);
+}
+
+// the k-th waiting event
+static inline const cm_event *cm_queue_event(cm_queue *queue, long k) {
+	return &queue->events[(queue->tail + k) & (CM_QUEUE_SIZE - 1)];
+}
+
+// hand the first count events back to the producer
+static inline void cm_queue_release(cm_queue *queue, long count) {
+	long tail = queue->tail;
+	ATOMIC_COMPARE_SWAP32(tail, tail + count, &queue->tail); // only the audio thread writes tail: always succeeds
+}
+
+// the latest complete set of float inlet values
+static inline const double *cm_queue_params(cm_queue *queue) {
+	long middle = queue->middle;
+	if (middle & CM_QUEUE_NEW) { // exchange the front set with the new middle set (the producer may publish meanwhile)
+		while (!ATOMIC_COMPARE_SWAP32(middle, queue->front, &queue->middle)) {
+			middle = queue->middle;
+		}
+		queue->front = middle & ~CM_QUEUE_NEW;
+	}
+	return queue->params[queue->front];
+}
+
+
+/************************************************************************************************************************/
+/* GRAIN SCHEDULE (AUDIO THREAD)                                                                                        */
+/************************************************************************************************************************/
+// drop all waiting grain events
+static inline void cm_schedule_clear(cm_schedule *schedule) {
+	schedule->count = 0;
+	schedule->next = 0;
+	schedule->elapsed = 0;
+}
+
+// start a signal vector of n frames: remove the grains started in the previous vector and move the waiting ones to the
+// new vector (grains which were due but could not start are due at its first frame)
+static inline void cm_schedule_begin(cm_schedule *schedule, long n) {
+	long k, frame;
+	long count = 0;
+	for (k = schedule->next; k < schedule->count; k++) {
+		frame = schedule->grains[k].frame - schedule->elapsed;
+		schedule->grains[count] = schedule->grains[k];
+		schedule->grains[count++].frame = frame < 0 ? 0 : frame;
+	}
+	schedule->count = count;
+	schedule->next = 0;
+	schedule->elapsed = n;
+}
+
+// add a grain event at its offset from the start of the current vector (negative offsets start at once, events with
+// the same frame keep their order); returns false if the schedule is full
+static inline t_bool cm_schedule_add(cm_schedule *schedule, const cm_event *event) {
+	long k = schedule->count;
+	long frame = event->frame < 0 ? 0 : event->frame;
+	if (k == CM_SCHEDULE_SIZE) {
+		return false;
+	}
+	for (; k > 0 && schedule->grains[k - 1].frame > frame; k--) {
+		schedule->grains[k] = schedule->grains[k - 1];
+	}
+	schedule->grains[k] = *event;
+	schedule->grains[k].frame = frame;
+	schedule->count++;
+	return true;
+}
+
+// true if the next grain event is due at the given frame
+static inline t_bool cm_schedule_due(const cm_schedule *schedule, long frame) {
+	return schedule->next < schedule->count && schedule->grains[schedule->next].frame <= frame;
+}
+
+// the next trigger frame not before the given frame: the next grain event or the next signal trigger (signal)
+static inline long cm_schedule_next(const cm_schedule *schedule, long signal, long frame) {
+	long next = signal;
+	if (schedule->next < schedule->count && schedule->grains[schedule->next].frame < next) {
+		next = schedule->grains[schedule->next].frame;
+	}
+	return next > frame ? next : frame;
+}
+
+// start the next grain event: write its count grain parameters into values (the first scaled ones multiplied with scale)
+static inline void cm_schedule_take(cm_schedule *schedule, double *values, long count, long scaled, double scale) {
+	const cm_event *event = &schedule->grains[schedule->next++];
+	long k;
+	for (k = 0; k < count; k++) {
+		values[k] = k < scaled ? event->values[k] * scale : event->values[k];
+	}
+}
+
+#endif
@@ -0,0 +1,133 @@
+/*
+ cm_random.h - seedable per-instance random number generator for the grain parameters.
+ Copyright (C) 2012 - 2017  Matthias W. Müller - circuit.music.labs
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ info@circuitmusiclabs.com
+
+ */
+
+// NOTE:
+// Every instance owns a xoshiro256++ generator (Blackman/Vigna): four 64 bit words of state, a few shifts, rotations
+// and additions per number, no system call and no shared state between instances or threads, identical on every
+// platform. The random numbers are uniform doubles with the full 53 bit resolution, all parameters of a trigger are
+// drawn in one pass (cm_dist_fill of cm_distrib.h maps them to the distribution of each parameter).
+// The seed is requested on the main thread ("seed" attribute, 0: a seed from the system time and the instance address)
+// and applied by the audio thread before the next trigger (generation counter, the state is never written by two threads).
+// In the deterministic mode the objects request the seed again at every DSP start (CM_RNG_DEFAULTSEED for seed 0): the
+// sequence of grain parameters only depends on the seed and the triggers.
+
+#ifndef CM_RANDOM_H
+#define CM_RANDOM_H
+
+#include "ext.h"
+#include "ext_atomic.h"
+#include <stdint.h>
+
+#define CM_RNG_DEFAULTSEED 1 // seed of the deterministic mode if the seed attribute is 0
+
+typedef struct cmrng {
+	uint64_t state[4]; // xoshiro256++ state (audio thread)
+	uint64_t seed; // seed of the last request (main thread)
+	t_int32_atomic generation; // incremented with every seed request
+	long applied; // generation of the seed the state was built from
+} cm_rng;
+
+
+/************************************************************************************************************************/
+/* SEEDING                                                                                                              */
+/************************************************************************************************************************/
+// splitmix64: expands a seed into the generator state (never all zero)
+static uint64_t cm_rng_splitmix(uint64_t *x) {
+	uint64_t z = (*x += 0x9E3779B97F4A7C15ULL);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
+
+// main thread: request a new seed (0: seed from the system time and the instance address)
+static void cm_rng_reseed(cm_rng *rng, t_atom_long seed, const void *instance) {
+	static uint64_t counter = 0; // different seeds for instances created within the same millisecond
+	if (seed) {
+		rng->seed = (uint64_t)seed;
+	}
+	else {
+		rng->seed = ((uint64_t)systime_ms() << 32) ^ (uint64_t)(uintptr_t)instance ^ (++counter * 0x9E3779B97F4A7C15ULL);
+	}
+	ATOMIC_INCREMENT_BARRIER(&rng->generation); // publish the seed before the new generation
+}
+
+// main thread: initialize the generator of a new instance (the state is valid before the first seed is applied)
+static void cm_rng_init(cm_rng *rng, t_atom_long seed, const void *instance) {
+	uint64_t x;
+	long i;
+	rng->generation = 0;
+	rng->applied = -1;
+	cm_rng_reseed(rng, seed, instance);
+	x = rng->seed;
+	for (i = 0; i < 4; i++) {
+		rng->state[i] = cm_rng_splitmix(&x);
+	}
+	rng->applied = rng->generation;
+}
+
+// audio thread: apply the last requested seed
+static inline void cm_rng_update(cm_rng *rng) {
+	uint64_t x;
+	long i;
+	long generation = rng->generation;
+	ATOMIC_COMPARE_SWAP32(generation, generation, &rng->generation); // barrier: read the seed of this generation
+	if (generation != rng->applied) {
+		x = rng->seed;
+		for (i = 0; i < 4; i++) {
+			rng->state[i] = cm_rng_splitmix(&x);
+		}
+		rng->applied = generation;
+	}
+}
+
+
+/************************************************************************************************************************/
+/* NUMBER GENERATION (AUDIO THREAD)                                                                                     */
+/************************************************************************************************************************/
+static inline uint64_t cm_rng_rotl(const uint64_t x, int k) {
+	return (x << k) | (x >> (64 - k));
+}
+
+// next 64 bit number (xoshiro256++)
+static inline uint64_t cm_rng_next(cm_rng *rng) {
+	uint64_t *s = rng->state;
+	const uint64_t result = cm_rng_rotl(s[0] + s[3], 23) + s[0];
+	const uint64_t t = s[1] << 17;
+	s[2] ^= s[0];
+	s[3] ^= s[1];
+	s[1] ^= s[2];
+	s[0] ^= s[3];
+	s[2] ^= t;
+	s[3] = cm_rng_rotl(s[3], 45);
+	return result;
+}
+
+// uniform double in [0, 1) with 53 bit resolution
+static inline double cm_rng_unit(cm_rng *rng) {
+	return (double)(cm_rng_next(rng) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// uniform double in [min, max)
+static inline double cm_rng_uniform(cm_rng *rng, double min, double max) {
+	return min + (max - min) * cm_rng_unit(rng);
+}
+
+#endif
@@ -0,0 +1,662 @@
+/*
+ cm_render.h - vectorized grain render kernels for the petra cloud objects.
+ Copyright (C) 2012 - 2017  Matthias W. Müller - circuit.music.labs
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ info@circuitmusiclabs.com
+
+ */
+
+// NOTE:
+// A grain is rendered into its grain memory in two passes: first the window values are written, then every
+// window value is multiplied with the (interpolated) source sample at the grain position
+//
+//   position = start + (readpos / length) * span
+//
+// Both passes use the same kernels: cm_render_buffer reads from an interleaved float buffer (buffer~ samples and
+// windows), cm_render_ring reads from the double ringbuffer of cm.livecloud~. On x86 the kernels have SSE2, AVX2
+// and AVX-512 implementations which compute four (AVX2) or eight (AVX-512) grain samples at a time with gathered
+// loads. cm_render_init picks the widest implementation the CPU supports and has to be called once from ext_main.
+// All other architectures use the portable scalar implementation.
+// The read position is a 32.32 fixed point phase accumulator (cm_phase) which is advanced by a constant increment
+// (span / length) per grain sample: the integer part is the frame index, the fractional part the interpolation weight
+// (linear) or the coefficient table row (FIR), the loops have no division and no float to int conversion.
+// Start and increment are truncated to 2^-32 frames, after n grain samples the position is at most (n + 1) * 2^-32
+// frames below the exact position (a grain of 2^20 samples is less than 1/4000 frame off).
+// All implementations advance the same integer phase and round after every multiplication and addition in the same
+// order, so they write the same grain samples (tests/test_render.c compares every kernel with the scalar one). The
+// compiler must not fuse a multiplication and an addition of a kernel into one instruction (the fused result is
+// rounded once): contraction is switched off for this header.
+// The interpolation modes above linear (cm_interp.h) run through the FIR path of the kernels: one gathered load of
+// source samples and coefficients per tap.
+// Speed (bench/bench_render.c, linear, window and source pass): the AVX2 kernels are about 2.2 - 2.5 times as fast as
+// the scalar kernels, the AVX-512 kernels about 3.6 - 3.9 times. This misses the target of 4 - 8 times for AVX2. The
+// source pass is bound by the two loads per grain sample at computed positions, not by the arithmetic: loading both
+// taps of a frame with one vector load did not make it faster, neither did eight samples at a time in float arithmetic
+// (only the window pass gained, and float arithmetic would no longer match the double arithmetic of the scalar kernels).
+// The entry points are static inline, objects which only use one of them don't get an unused function warning.
+
+#ifndef CM_RENDER_H
+#define CM_RENDER_H
+
+#include "ext.h"
+#include "cm_interp.h" // interpolation modes and coefficient tables
+#include <limits.h> // for INT_MAX
+#include <stdint.h> // for uint64_t
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define CM_RENDER_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h> // for __cpuid and _xgetbv
+#define CM_TARGET_AVX2
+#define CM_TARGET_AVX512
+#else
+#define CM_TARGET_AVX2 __attribute__((target("avx2")))
+#define CM_TARGET_AVX512 __attribute__((target("avx2,avx512f")))
+#endif
+#endif
+
+#define CM_TARGET_NONE // kernels for the baseline instruction set
+
+// no fused multiply-add in the kernels (restored at the end of the header for clang and gcc)
+#if defined(__clang__)
+#pragma STDC FP_CONTRACT OFF
+#elif defined(__GNUC__)
+#pragma GCC push_options
+#pragma GCC optimize ("fp-contract=off")
+#elif defined(_MSC_VER)
+#pragma fp_contract (off)
+#endif
+
+#define CM_RENDER_NEAREST 0 // kernel kinds: truncated index
+#define CM_RENDER_LINEAR 1 // 2 point linear interpolation
+#define CM_RENDER_FIR 2 // coefficient table (hermite, lagrange, sinc)
+
+typedef uint64_t cm_phase; // 32.32 fixed point read position
+#define CM_PHASE_ONE 4294967296.0 // 2^32: one frame
+#define CM_PHASE_FRAC 0xffffffffULL // mask of the fractional part
+#define CM_PHASE_ROW_SHIFT 22 // fractional part >> 22: coefficient table row (32 - log2(CM_INTERP_PHASES))
+#define CM_PHASE_ROW_ROUND (1ULL << (CM_PHASE_ROW_SHIFT - 1)) // rounds to the nearest row
+#define CM_PHASE_MAGIC 0x4330000000000000ULL // bits of 2^52: or-ed with the fractional part, the mantissa holds it exactly
+
+// kernel signatures (mul: values to multiply the source samples with, NULL for none; may be the same memory as out)
+typedef void (*cm_render_buffer_method)(float *out, const float *mul, const float *src, long channels, long channel, long frames, cm_phase phase, cm_phase incr, long count, const cm_interp_table *fir);
+typedef void (*cm_render_ring_method)(float *out, const float *mul, const double *ring, long ringframes, cm_phase phase, cm_phase incr, long count, const cm_interp_table *fir);
+typedef struct cmrenderkernels {
+	cm_render_buffer_method buffer[3][2]; // [kernel kind][window multiply]
+	cm_render_ring_method ring[3][2];
+} cm_render_kernels;
+
+// fixed point phase of a (non-negative) position, truncated
+static inline cm_phase cm_phase_from(double position) {
+	return (cm_phase)(position * CM_PHASE_ONE);
+}
+
+
+/************************************************************************************************************************/
+/* SCALAR KERNELS                                                                                                       */
+/************************************************************************************************************************/
+// render the samples first ... count - 1 from an interleaved float buffer (same indexing as cm_lininterp)
+static CM_INLINE void cm_render_buffer_from(long first, float *out, const float *mul, const float *src, long channels, long channel, long frames, cm_phase phase, cm_phase incr, long count, const long kind, const t_bool scale, const cm_interp_table *fir) {
+	long k, t, index, next, tap;
+	double frac, value;
+	const float *coef;
+	phase += (cm_phase)first * incr;
+	for (k = first; k < count; k++) {
+		index = (long)(phase >> 32);
+		if (kind == CM_RENDER_LINEAR) {
+			next = index + 1;
+			if (next > frames) {
+				next = 0;
+			}
+			frac = (double)(phase & CM_PHASE_FRAC) * (1.0 / CM_PHASE_ONE);
+			value = (double)src[index * channels + channel] + frac * ((double)src[next * channels + channel] - (double)src[index * channels + channel]);
+		}
+		else if (kind == CM_RENDER_FIR) {
+			coef = fir->coef + (long)(((phase & CM_PHASE_FRAC) + CM_PHASE_ROW_ROUND) >> CM_PHASE_ROW_SHIFT) * fir->taps;
+			value = 0.0;
+			for (t = 0; t < fir->taps; t++) {
+				tap = index + fir->offset + t;
+				tap = tap < 0 ? 0 : (tap >= frames ? frames - 1 : tap);
+				value += (double)coef[t] * (double)src[tap * channels + channel];
+			}
+		}
+		else {
+			value = src[index * channels + channel];
+		}
+		out[k] = scale ? value * (double)mul[k] : value;
+		phase += incr;
+	}
+}
+
+// render the samples first ... count - 1 from a ringbuffer (the position may run over the end of the ringbuffer once)
+static CM_INLINE void cm_render_ring_from(long first, float *out, const float *mul, const double *ring, long ringframes, cm_phase phase, cm_phase incr, long count, const long kind, const t_bool scale, const cm_interp_table *fir) {
+	long k, t, index, next, tap;
+	double frac, value;
+	const float *coef;
+	phase += (cm_phase)first * incr;
+	for (k = first; k < count; k++) {
+		index = (long)(phase >> 32);
+		if (kind == CM_RENDER_LINEAR) {
+			next = index + 1;
+			frac = (double)(phase & CM_PHASE_FRAC) * (1.0 / CM_PHASE_ONE);
+			if (index >= ringframes) {
+				index -= ringframes;
+			}
+			if (next >= ringframes) {
+				next -= ringframes;
+			}
+			value = ring[index] + frac * (ring[next] - ring[index]);
+		}
+		else if (kind == CM_RENDER_FIR) {
+			coef = fir->coef + (long)(((phase & CM_PHASE_FRAC) + CM_PHASE_ROW_ROUND) >> CM_PHASE_ROW_SHIFT) * fir->taps;
+			if (index >= ringframes) {
+				index -= ringframes;
+			}
+			value = 0.0;
+			for (t = 0; t < fir->taps; t++) {
+				tap = index + fir->offset + t;
+				tap += tap < 0 ? ringframes : (tap >= ringframes ? -ringframes : 0);
+				value += (double)coef[t] * ring[tap];
+			}
+		}
+		else {
+			if (index >= ringframes) {
+				index -= ringframes;
+			}
+			value = ring[index];
+		}
+		out[k] = scale ? value * (double)mul[k] : value;
+		phase += incr;
+	}
+}
+
+static CM_INLINE void cm_render_buffer_scalar(float *out, const float *mul, const float *src, long channels, long channel, long frames, cm_phase phase, cm_phase incr, long count, const long kind, const t_bool scale, const cm_interp_table *fir) {
+	cm_render_buffer_from(0, out, mul, src, channels, channel, frames, phase, incr, count, kind, scale, fir);
+}
+
+static CM_INLINE void cm_render_ring_scalar(float *out, const float *mul, const double *ring, long ringframes, cm_phase phase, cm_phase incr, long count, const long kind, const t_bool scale, const cm_interp_table *fir) {
+	cm_render_ring_from(0, out, mul, ring, ringframes, phase, incr, count, kind, scale, fir);
+}
+
+
+#ifdef CM_RENDER_X86
+/************************************************************************************************************************/
+/* SSE2 KERNELS (TWO SAMPLES AT A TIME)                                                                                 */
+/************************************************************************************************************************/
+// the phases are kept in 64 bit lanes: the high dwords are the frame indices, the low dwords the fractional parts
+static CM_INLINE void cm_render_buffer_sse2(float *out, const float *mul, const float *src, long channels, long channel, long frames, cm_phase phase, cm_phase incr, long count, const long kind, const t_bool scale, const cm_interp_table *fir) {
+	__m128d vfrac, va, vb, vvalue;
+	__m128i vphase = _mm_set_epi64x((long long)(phase + incr), (long long)phase);
+	__m128i vincr = _mm_set1_epi64x((long long)(incr * 2));
+	__m128i vmask = _mm_set1_epi64x((long long)CM_PHASE_FRAC);
+	__m128i vmagic = _mm_set1_epi64x((long long)CM_PHASE_MAGIC);
+	__m128i vround = _mm_set1_epi64x((long long)CM_PHASE_ROW_ROUND);
+	__m128d vtwo52 = _mm_set1_pd(4503599627370496.0);
+	__m128d vscale = _mm_set1_pd(1.0 / CM_PHASE_ONE);
+	int index[4]; // SSE2 has no gather: the indices are extracted and the samples loaded one by one
+	int row[4];
+	const float *c0, *c1;
+	long k, t, i0, i1, n0, n1;
+	for (k = 0; k + 2 <= count; k += 2) {
+		_mm_storeu_si128((__m128i *)index, _mm_shuffle_epi32(vphase, _MM_SHUFFLE(3, 1, 3, 1)));
+		i0 = index[0];
+		i1 = index[1];
+		if (kind == CM_RENDER_LINEAR) {
+			n0 = i0 + 1 > frames ? 0 : i0 + 1;
+			n1 = i1 + 1 > frames ? 0 : i1 + 1;
+			vfrac = _mm_mul_pd(_mm_sub_pd(_mm_castsi128_pd(_mm_or_si128(_mm_and_si128(vphase, vmask), vmagic)), vtwo52), vscale);
+			va = _mm_set_pd(src[i1 * channels + channel], src[i0 * channels + channel]);
+			vb = _mm_set_pd(src[n1 * channels + channel], src[n0 * channels + channel]);
+			vvalue = _mm_add_pd(va, _mm_mul_pd(vfrac, _mm_sub_pd(vb, va)));
+		}
+		else if (kind == CM_RENDER_FIR) {
+			_mm_storeu_si128((__m128i *)row, _mm_shuffle_epi32(_mm_srli_epi64(_mm_add_epi64(_mm_and_si128(vphase, vmask), vround), CM_PHASE_ROW_SHIFT), _MM_SHUFFLE(2, 0, 2, 0)));
+			c0 = fir->coef + row[0] * fir->taps;
+			c1 = fir->coef + row[1] * fir->taps;
+			vvalue = _mm_setzero_pd();
+			for (t = 0; t < fir->taps; t++) {
+				n0 = i0 + fir->offset + t;
+				n1 = i1 + fir->offset + t;
+				n0 = n0 < 0 ? 0 : (n0 >= frames ? frames - 1 : n0);
+				n1 = n1 < 0 ? 0 : (n1 >= frames ? frames - 1 : n1);
+				va = _mm_set_pd(src[n1 * channels + channel], src[n0 * channels + channel]);
+				vvalue = _mm_add_pd(vvalue, _mm_mul_pd(_mm_set_pd(c1[t], c0[t]), va));
+			}
+		}
+		else {
+			vvalue = _mm_set_pd(src[i1 * channels + channel], src[i0 * channels + channel]);
+		}
+		if (scale) {
+			vvalue = _mm_mul_pd(vvalue, _mm_set_pd(mul[k + 1], mul[k]));
+		}
+		_mm_storel_pi((__m64 *)(out + k), _mm_cvtpd_ps(vvalue));
+		vphase = _mm_add_epi64(vphase, vincr);
+	}
+	cm_render_buffer_from(k, out, mul, src, channels, channel, frames, phase, incr, count, kind, scale, fir); // remaining samples
+}
+
+static CM_INLINE void cm_render_ring_sse2(float *out, const float *mul, const double *ring, long ringframes, cm_phase phase, cm_phase incr, long count, const long kind, const t_bool scale, const cm_interp_table *fir) {
+	__m128d vfrac, va, vb, vvalue;
+	__m128i vphase = _mm_set_epi64x((long long)(phase + incr), (long long)phase);
+	__m128i vincr = _mm_set1_epi64x((long long)(incr * 2));
+	__m128i vmask = _mm_set1_epi64x((long long)CM_PHASE_FRAC);
+	__m128i vmagic = _mm_set1_epi64x((long long)CM_PHASE_MAGIC);
+	__m128i vround = _mm_set1_epi64x((long long)CM_PHASE_ROW_ROUND);
+	__m128d vtwo52 = _mm_set1_pd(4503599627370496.0);
+	__m128d vscale = _mm_set1_pd(1.0 / CM_PHASE_ONE);
+	int index[4];
+	int row[4];
+	const float *c0, *c1;
+	long k, t, i0, i1, n0, n1;
+	for (k = 0; k + 2 <= count; k += 2) {
+		_mm_storeu_si128((__m128i *)index, _mm_shuffle_epi32(vphase, _MM_SHUFFLE(3, 1, 3, 1)));
+		i0 = index[0];
+		i1 = index[1];
+		n0 = i0 + 1;
+		n1 = i1 + 1;
+		i0 -= i0 >= ringframes ? ringframes : 0;
+		i1 -= i1 >= ringframes ? ringframes : 0;
+		if (kind == CM_RENDER_LINEAR) {
+			n0 -= n0 >= ringframes ? ringframes : 0;
+			n1 -= n1 >= ringframes ? ringframes : 0;
+			vfrac = _mm_mul_pd(_mm_sub_pd(_mm_castsi128_pd(_mm_or_si128(_mm_and_si128(vphase, vmask), vmagic)), vtwo52), vscale);
+			va = _mm_set_pd(ring[i1], ring[i0]);
+			vb = _mm_set_pd(ring[n1], ring[n0]);
+			vvalue = _mm_add_pd(va, _mm_mul_pd(vfrac, _mm_sub_pd(vb, va)));
+		}
+		else if (kind == CM_RENDER_FIR) {
+			_mm_storeu_si128((__m128i *)row, _mm_shuffle_epi32(_mm_srli_epi64(_mm_add_epi64(_mm_and_si128(vphase, vmask), vround), CM_PHASE_ROW_SHIFT), _MM_SHUFFLE(2, 0, 2, 0)));
+			c0 = fir->coef + row[0] * fir->taps;
+			c1 = fir->coef + row[1] * fir->taps;
+			vvalue = _mm_setzero_pd();
+			for (t = 0; t < fir->taps; t++) {
+				n0 = i0 + fir->offset + t;
+				n1 = i1 + fir->offset + t;
+				n0 += n0 < 0 ? ringframes : (n0 >= ringframes ? -ringframes : 0);
+				n1 += n1 < 0 ? ringframes : (n1 >= ringframes ? -ringframes : 0);
+				vvalue = _mm_add_pd(vvalue, _mm_mul_pd(_mm_set_pd(c1[t], c0[t]), _mm_set_pd(ring[n1], ring[n0])));
+			}
+		}
+		else {
+			vvalue = _mm_set_pd(ring[i1], ring[i0]);
+		}
+		if (scale) {
+			vvalue = _mm_mul_pd(vvalue, _mm_set_pd(mul[k + 1], mul[k]));
+		}
+		_mm_storel_pi((__m64 *)(out + k), _mm_cvtpd_ps(vvalue));
+		vphase = _mm_add_epi64(vphase, vincr);
+	}
+	cm_render_ring_from(k, out, mul, ring, ringframes, phase, incr, count, kind, scale, fir); // remaining samples
+}
+
+
+/************************************************************************************************************************/
+/* AVX2 KERNELS (FOUR SAMPLES AT A TIME)                                                                                */
+/************************************************************************************************************************/
+CM_TARGET_AVX2 static CM_INLINE void cm_render_buffer_avx2(float *out, const float *mul, const float *src, long channels, long channel, long frames, cm_phase phase, cm_phase incr, long count, const long kind, const t_bool scale, const cm_interp_table *fir) {
+	__m256d vfrac, va, vb, vvalue;
+	__m128i vindex, vnext, vrow, vtap;
+	__m256i vphase = _mm256_add_epi64(_mm256_set1_epi64x((long long)phase), _mm256_set_epi64x((long long)(incr * 3), (long long)(incr * 2), (long long)incr, 0));
+	__m256i vincr = _mm256_set1_epi64x((long long)(incr * 4));
+	__m256i vmask = _mm256_set1_epi64x((long long)CM_PHASE_FRAC);
+	__m256i vmagic = _mm256_set1_epi64x((long long)CM_PHASE_MAGIC);
+	__m256i vround = _mm256_set1_epi64x((long long)CM_PHASE_ROW_ROUND);
+	__m256i vhigh = _mm256_setr_epi32(1, 3, 5, 7, 1, 3, 5, 7); // dword permutations: integer parts
+	__m256i vlow = _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6); // low dwords (coefficient table rows)
+	__m256d vtwo52 = _mm256_set1_pd(4503599627370496.0);
+	__m256d vscale = _mm256_set1_pd(1.0 / CM_PHASE_ONE);
+	__m128i vone = _mm_set1_epi32(1);
+	__m128i vzero = _mm_setzero_si128();
+	__m128i vframes = _mm_set1_epi32((int)frames);
+	__m128i vlast = _mm_set1_epi32((int)frames - 1);
+	__m128i vchannels = _mm_set1_epi32((int)channels);
+	__m128i vtaps = _mm_set1_epi32(fir ? (int)fir->taps : 0);
+	__m128i voffset = _mm_set1_epi32(fir ? (int)fir->offset : 0);
+	const float *base = src + channel;
+	long k, t;
+	for (k = 0; k + 4 <= count; k += 4) {
+		vindex = _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(vphase, vhigh));
+		if (kind == CM_RENDER_LINEAR) {
+			vnext = _mm_add_epi32(vindex, vone);
+			vnext = _mm_andnot_si128(_mm_cmpgt_epi32(vnext, vframes), vnext); // next > frames: wrap to 0
+			vfrac = _mm256_mul_pd(_mm256_sub_pd(_mm256_castsi256_pd(_mm256_or_si256(_mm256_and_si256(vphase, vmask), vmagic)), vtwo52), vscale);
+			va = _mm256_cvtps_pd(_mm_i32gather_ps(base, _mm_mullo_epi32(vindex, vchannels), 4));
+			vb = _mm256_cvtps_pd(_mm_i32gather_ps(base, _mm_mullo_epi32(vnext, vchannels), 4));
+			vvalue = _mm256_add_pd(va, _mm256_mul_pd(vfrac, _mm256_sub_pd(vb, va)));
+		}
+		else if (kind == CM_RENDER_FIR) {
+			vrow = _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(_mm256_srli_epi64(_mm256_add_epi64(_mm256_and_si256(vphase, vmask), vround), CM_PHASE_ROW_SHIFT), vlow));
+			vrow = _mm_mullo_epi32(vrow, vtaps);
+			vtap = _mm_add_epi32(vindex, voffset);
+			vvalue = _mm256_setzero_pd();
+			for (t = 0; t < fir->taps; t++) {
+				va = _mm256_cvtps_pd(_mm_i32gather_ps(base, _mm_mullo_epi32(_mm_min_epi32(_mm_max_epi32(vtap, vzero), vlast), vchannels), 4));
+				vb = _mm256_cvtps_pd(_mm_i32gather_ps(fir->coef + t, vrow, 4));
+				vvalue = _mm256_add_pd(vvalue, _mm256_mul_pd(vb, va));
+				vtap = _mm_add_epi32(vtap, vone);
+			}
+		}
+		else {
+			vvalue = _mm256_cvtps_pd(_mm_i32gather_ps(base, _mm_mullo_epi32(vindex, vchannels), 4));
+		}
+		if (scale) {
+			vvalue = _mm256_mul_pd(vvalue, _mm256_cvtps_pd(_mm_loadu_ps(mul + k)));
+		}
+		_mm_storeu_ps(out + k, _mm256_cvtpd_ps(vvalue));
+		vphase = _mm256_add_epi64(vphase, vincr);
+	}
+	cm_render_buffer_from(k, out, mul, src, channels, channel, frames, phase, incr, count, kind, scale, fir); // remaining samples
+}
+
+CM_TARGET_AVX2 static CM_INLINE void cm_render_ring_avx2(float *out, const float *mul, const double *ring, long ringframes, cm_phase phase, cm_phase incr, long count, const long kind, const t_bool scale, const cm_interp_table *fir) {
+	__m256d vfrac, va, vb, vvalue;
+	__m128i vindex, vnext, vrow, vtap;
+	__m256i vphase = _mm256_add_epi64(_mm256_set1_epi64x((long long)phase), _mm256_set_epi64x((long long)(incr * 3), (long long)(incr * 2), (long long)incr, 0));
+	__m256i vincr = _mm256_set1_epi64x((long long)(incr * 4));
+	__m256i vmask = _mm256_set1_epi64x((long long)CM_PHASE_FRAC);
+	__m256i vmagic = _mm256_set1_epi64x((long long)CM_PHASE_MAGIC);
+	__m256i vround = _mm256_set1_epi64x((long long)CM_PHASE_ROW_ROUND);
+	__m256i vhigh = _mm256_setr_epi32(1, 3, 5, 7, 1, 3, 5, 7);
+	__m256i vlow = _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6);
+	__m256d vtwo52 = _mm256_set1_pd(4503599627370496.0);
+	__m256d vscale = _mm256_set1_pd(1.0 / CM_PHASE_ONE);
+	__m128i vone = _mm_set1_epi32(1);
+	__m128i vzero = _mm_setzero_si128();
+	__m128i vlast = _mm_set1_epi32((int)ringframes - 1);
+	__m128i vframes = _mm_set1_epi32((int)ringframes);
+	__m128i vtaps = _mm_set1_epi32(fir ? (int)fir->taps : 0);
+	__m128i voffset = _mm_set1_epi32(fir ? (int)fir->offset : 0);
+	long k, t;
+	for (k = 0; k + 4 <= count; k += 4) {
+		vindex = _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(vphase, vhigh));
+		vnext = _mm_add_epi32(vindex, vone);
+		vindex = _mm_sub_epi32(vindex, _mm_and_si128(_mm_cmpgt_epi32(vindex, vlast), vframes)); // index >= ringframes: wrap
+		if (kind == CM_RENDER_LINEAR) {
+			vnext = _mm_sub_epi32(vnext, _mm_and_si128(_mm_cmpgt_epi32(vnext, vlast), vframes));
+			vfrac = _mm256_mul_pd(_mm256_sub_pd(_mm256_castsi256_pd(_mm256_or_si256(_mm256_and_si256(vphase, vmask), vmagic)), vtwo52), vscale);
+			va = _mm256_i32gather_pd(ring, vindex, 8);
+			vb = _mm256_i32gather_pd(ring, vnext, 8);
+			vvalue = _mm256_add_pd(va, _mm256_mul_pd(vfrac, _mm256_sub_pd(vb, va)));
+		}
+		else if (kind == CM_RENDER_FIR) {
+			vrow = _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(_mm256_srli_epi64(_mm256_add_epi64(_mm256_and_si256(vphase, vmask), vround), CM_PHASE_ROW_SHIFT), vlow));
+			vrow = _mm_mullo_epi32(vrow, vtaps);
+			vtap = _mm_add_epi32(vindex, voffset);
+			vvalue = _mm256_setzero_pd();
+			for (t = 0; t < fir->taps; t++) {
+				vnext = _mm_add_epi32(vtap, _mm_and_si128(_mm_cmpgt_epi32(vzero, vtap), vframes)); // tap < 0: wrap
+				vnext = _mm_sub_epi32(vnext, _mm_and_si128(_mm_cmpgt_epi32(vnext, vlast), vframes)); // tap >= ringframes: wrap
+				va = _mm256_i32gather_pd(ring, vnext, 8);
+				vb = _mm256_cvtps_pd(_mm_i32gather_ps(fir->coef + t, vrow, 4));
+				vvalue = _mm256_add_pd(vvalue, _mm256_mul_pd(vb, va));
+				vtap = _mm_add_epi32(vtap, vone);
+			}
+		}
+		else {
+			vvalue = _mm256_i32gather_pd(ring, vindex, 8);
+		}
+		if (scale) {
+			vvalue = _mm256_mul_pd(vvalue, _mm256_cvtps_pd(_mm_loadu_ps(mul + k)));
+		}
+		_mm_storeu_ps(out + k, _mm256_cvtpd_ps(vvalue));
+		vphase = _mm256_add_epi64(vphase, vincr);
+	}
+	cm_render_ring_from(k, out, mul, ring, ringframes, phase, incr, count, kind, scale, fir); // remaining samples
+}
+
+
+/************************************************************************************************************************/
+/* AVX-512 KERNELS (EIGHT SAMPLES AT A TIME)                                                                            */
+/************************************************************************************************************************/
+CM_TARGET_AVX512 static CM_INLINE void cm_render_buffer_avx512(float *out, const float *mul, const float *src, long channels, long channel, long frames, cm_phase phase, cm_phase incr, long count, const long kind, const t_bool scale, const cm_interp_table *fir) {
+	__m512d vfrac, va, vb, vvalue;
+	__m256i vindex, vnext, vrow, vtap;
+	__m512i vphase = _mm512_add_epi64(_mm512_set1_epi64((long long)phase), _mm512_set_epi64((long long)(incr * 7), (long long)(incr * 6), (long long)(incr * 5), (long long)(incr * 4), (long long)(incr * 3), (long long)(incr * 2), (long long)incr, 0));
+	__m512i vincr = _mm512_set1_epi64((long long)(incr * 8));
+	__m512i vmask = _mm512_set1_epi64((long long)CM_PHASE_FRAC);
+	__m512i vmagic = _mm512_set1_epi64((long long)CM_PHASE_MAGIC);
+	__m512i vround = _mm512_set1_epi64((long long)CM_PHASE_ROW_ROUND);
+	__m512d vtwo52 = _mm512_set1_pd(4503599627370496.0);
+	__m512d vscale = _mm512_set1_pd(1.0 / CM_PHASE_ONE);
+	__m256i vone = _mm256_set1_epi32(1);
+	__m256i vzero = _mm256_setzero_si256();
+	__m256i vframes = _mm256_set1_epi32((int)frames);
+	__m256i vlast = _mm256_set1_epi32((int)frames - 1);
+	__m256i vchannels = _mm256_set1_epi32((int)channels);
+	__m256i vtaps = _mm256_set1_epi32(fir ? (int)fir->taps : 0);
+	__m256i voffset = _mm256_set1_epi32(fir ? (int)fir->offset : 0);
+	const float *base = src + channel;
+	long k, t;
+	for (k = 0; k + 8 <= count; k += 8) {
+		vindex = _mm512_cvtepi64_epi32(_mm512_srli_epi64(vphase, 32));
+		if (kind == CM_RENDER_LINEAR) {
+			vnext = _mm256_add_epi32(vindex, vone);
+			vnext = _mm256_andnot_si256(_mm256_cmpgt_epi32(vnext, vframes), vnext);
+			vfrac = _mm512_mul_pd(_mm512_sub_pd(_mm512_castsi512_pd(_mm512_or_si512(_mm512_and_si512(vphase, vmask), vmagic)), vtwo52), vscale);
+			va = _mm512_cvtps_pd(_mm256_i32gather_ps(base, _mm256_mullo_epi32(vindex, vchannels), 4));
+			vb = _mm512_cvtps_pd(_mm256_i32gather_ps(base, _mm256_mullo_epi32(vnext, vchannels), 4));
+			vvalue = _mm512_add_pd(va, _mm512_mul_pd(vfrac, _mm512_sub_pd(vb, va)));
+		}
+		else if (kind == CM_RENDER_FIR) {
+			vrow = _mm256_mullo_epi32(_mm512_cvtepi64_epi32(_mm512_srli_epi64(_mm512_add_epi64(_mm512_and_si512(vphase, vmask), vround), CM_PHASE_ROW_SHIFT)), vtaps);
+			vtap = _mm256_add_epi32(vindex, voffset);
+			vvalue = _mm512_setzero_pd();
+			for (t = 0; t < fir->taps; t++) {
+				va = _mm512_cvtps_pd(_mm256_i32gather_ps(base, _mm256_mullo_epi32(_mm256_min_epi32(_mm256_max_epi32(vtap, vzero), vlast), vchannels), 4));
+				vb = _mm512_cvtps_pd(_mm256_i32gather_ps(fir->coef + t, vrow, 4));
+				vvalue = _mm512_add_pd(vvalue, _mm512_mul_pd(vb, va));
+				vtap = _mm256_add_epi32(vtap, vone);
+			}
+		}
+		else {
+			vvalue = _mm512_cvtps_pd(_mm256_i32gather_ps(base, _mm256_mullo_epi32(vindex, vchannels), 4));
+		}
+		if (scale) {
+			vvalue = _mm512_mul_pd(vvalue, _mm512_cvtps_pd(_mm256_loadu_ps(mul + k)));
+		}
+		_mm256_storeu_ps(out + k, _mm512_cvtpd_ps(vvalue));
+		vphase = _mm512_add_epi64(vphase, vincr);
+	}
+	cm_render_buffer_from(k, out, mul, src, channels, channel, frames, phase, incr, count, kind, scale, fir); // remaining samples
+}
+
+CM_TARGET_AVX512 static CM_INLINE void cm_render_ring_avx512(float *out, const float *mul, const double *ring, long ringframes, cm_phase phase, cm_phase incr, long count, const long kind, const t_bool scale, const cm_interp_table *fir) {
+	__m512d vfrac, va, vb, vvalue;
+	__m256i vindex, vnext, vrow, vtap;
+	__m512i vphase = _mm512_add_epi64(_mm512_set1_epi64((long long)phase), _mm512_set_epi64((long long)(incr * 7), (long long)(incr * 6), (long long)(incr * 5), (long long)(incr * 4), (long long)(incr * 3), (long long)(incr * 2), (long long)incr, 0));
+	__m512i vincr = _mm512_set1_epi64((long long)(incr * 8));
+	__m512i vmask = _mm512_set1_epi64((long long)CM_PHASE_FRAC);
+	__m512i vmagic = _mm512_set1_epi64((long long)CM_PHASE_MAGIC);
+	__m512i vround = _mm512_set1_epi64((long long)CM_PHASE_ROW_ROUND);
+	__m512d vtwo52 = _mm512_set1_pd(4503599627370496.0);
+	__m512d vscale = _mm512_set1_pd(1.0 / CM_PHASE_ONE);
+	__m256i vone = _mm256_set1_epi32(1);
+	__m256i vzero = _mm256_setzero_si256();
+	__m256i vlast = _mm256_set1_epi32((int)ringframes - 1);
+	__m256i vframes = _mm256_set1_epi32((int)ringframes);
+	__m256i vtaps = _mm256_set1_epi32(fir ? (int)fir->taps : 0);
+	__m256i voffset = _mm256_set1_epi32(fir ? (int)fir->offset : 0);
+	long k, t;
+	for (k = 0; k + 8 <= count; k += 8) {
+		vindex = _mm512_cvtepi64_epi32(_mm512_srli_epi64(vphase, 32));
+		vnext = _mm256_add_epi32(vindex, vone);
+		vindex = _mm256_sub_epi32(vindex, _mm256_and_si256(_mm256_cmpgt_epi32(vindex, vlast), vframes));
+		if (kind == CM_RENDER_LINEAR) {
+			vnext = _mm256_sub_epi32(vnext, _mm256_and_si256(_mm256_cmpgt_epi32(vnext, vlast), vframes));
+			vfrac = _mm512_mul_pd(_mm512_sub_pd(_mm512_castsi512_pd(_mm512_or_si512(_mm512_and_si512(vphase, vmask), vmagic)), vtwo52), vscale);
+			va = _mm512_i32gather_pd(vindex, ring, 8);
+			vb = _mm512_i32gather_pd(vnext, ring, 8);
+			vvalue = _mm512_add_pd(va, _mm512_mul_pd(vfrac, _mm512_sub_pd(vb, va)));
+		}
+		else if (kind == CM_RENDER_FIR) {
+			vrow = _mm256_mullo_epi32(_mm512_cvtepi64_epi32(_mm512_srli_epi64(_mm512_add_epi64(_mm512_and_si512(vphase, vmask), vround), CM_PHASE_ROW_SHIFT)), vtaps);
+			vtap = _mm256_add_epi32(vindex, voffset);
+			vvalue = _mm512_setzero_pd();
+			for (t = 0; t < fir->taps; t++) {
+				vnext = _mm256_add_epi32(vtap, _mm256_and_si256(_mm256_cmpgt_epi32(vzero, vtap), vframes));
+				vnext = _mm256_sub_epi32(vnext, _mm256_and_si256(_mm256_cmpgt_epi32(vnext, vlast), vframes));
+				va = _mm512_i32gather_pd(vnext, ring, 8);
+				vb = _mm512_cvtps_pd(_mm256_i32gather_ps(fir->coef + t, vrow, 4));
+				vvalue = _mm512_add_pd(vvalue, _mm512_mul_pd(vb, va));
+				vtap = _mm256_add_epi32(vtap, vone);
+			}
+		}
+		else {
+			vvalue = _mm512_i32gather_pd(vindex, ring, 8);
+		}
+		if (scale) {
+			vvalue = _mm512_mul_pd(vvalue, _mm512_cvtps_pd(_mm256_loadu_ps(mul + k)));
+		}
+		_mm256_storeu_ps(out + k, _mm512_cvtpd_ps(vvalue));
+		vphase = _mm512_add_epi64(vphase, vincr);
+	}
+	cm_render_ring_from(k, out, mul, ring, ringframes, phase, incr, count, kind, scale, fir); // remaining samples
+}
+#endif
+
+
+/************************************************************************************************************************/
+/* SPECIALIZED VARIANTS                                                                                                 */
+/************************************************************************************************************************/
+// every kernel body is instantiated once per combination of kernel kind and window multiply: the flags are
+// compile-time constants in each variant, so the inlined loop carries no per sample branch on them
+#define CM_RENDER_VARIANTS(target, isa) \
+	target static void cm_render_buffer_##isa##_00(float *out, const float *mul, const float *src, long channels, long channel, long frames, cm_phase phase, cm_phase incr, long count, const cm_interp_table *fir) { \
+		cm_render_buffer_##isa(out, mul, src, channels, channel, frames, phase, incr, count, CM_RENDER_NEAREST, false, fir); \
+	} \
+	target static void cm_render_buffer_##isa##_01(float *out, const float *mul, const float *src, long channels, long channel, long frames, cm_phase phase, cm_phase incr, long count, const cm_interp_table *fir) { \
+		cm_render_buffer_##isa(out, mul, src, channels, channel, frames, phase, incr, count, CM_RENDER_NEAREST, true, fir); \
+	} \
+	target static void cm_render_buffer_##isa##_10(float *out, const float *mul, const float *src, long channels, long channel, long frames, cm_phase phase, cm_phase incr, long count, const cm_interp_table *fir) { \
+		cm_render_buffer_##isa(out, mul, src, channels, channel, frames, phase, incr, count, CM_RENDER_LINEAR, false, fir); \
+	} \
+	target static void cm_render_buffer_##isa##_11(float *out, const float *mul, const float *src, long channels, long channel, long frames, cm_phase phase, cm_phase incr, long count, const cm_interp_table *fir) { \
+		cm_render_buffer_##isa(out, mul, src, channels, channel, frames, phase, incr, count, CM_RENDER_LINEAR, true, fir); \
+	} \
+	target static void cm_render_buffer_##isa##_20(float *out, const float *mul, const float *src, long channels, long channel, long frames, cm_phase phase, cm_phase incr, long count, const cm_interp_table *fir) { \
+		cm_render_buffer_##isa(out, mul, src, channels, channel, frames, phase, incr, count, CM_RENDER_FIR, false, fir); \
+	} \
+	target static void cm_render_buffer_##isa##_21(float *out, const float *mul, const float *src, long channels, long channel, long frames, cm_phase phase, cm_phase incr, long count, const cm_interp_table *fir) { \
+		cm_render_buffer_##isa(out, mul, src, channels, channel, frames, phase, incr, count, CM_RENDER_FIR, true, fir); \
+	} \
+	target static void cm_render_ring_##isa##_00(float *out, const float *mul, const double *ring, long ringframes, cm_phase phase, cm_phase incr, long count, const cm_interp_table *fir) { \
+		cm_render_ring_##isa(out, mul, ring, ringframes, phase, incr, count, CM_RENDER_NEAREST, false, fir); \
+	} \
+	target static void cm_render_ring_##isa##_01(float *out, const float *mul, const double *ring, long ringframes, cm_phase phase, cm_phase incr, long count, const cm_interp_table *fir) { \
+		cm_render_ring_##isa(out, mul, ring, ringframes, phase, incr, count, CM_RENDER_NEAREST, true, fir); \
+	} \
+	target static void cm_render_ring_##isa##_10(float *out, const float *mul, const double *ring, long ringframes, cm_phase phase, cm_phase incr, long count, const cm_interp_table *fir) { \
+		cm_render_ring_##isa(out, mul, ring, ringframes, phase, incr, count, CM_RENDER_LINEAR, false, fir); \
+	} \
+	target static void cm_render_ring_##isa##_11(float *out, const float *mul, const double *ring, long ringframes, cm_phase phase, cm_phase incr, long count, const cm_interp_table *fir) { \
+		cm_render_ring_##isa(out, mul, ring, ringframes, phase, incr, count, CM_RENDER_LINEAR, true, fir); \
+	} \
+	target static void cm_render_ring_##isa##_20(float *out, const float *mul, const double *ring, long ringframes, cm_phase phase, cm_phase incr, long count, const cm_interp_table *fir) { \
+		cm_render_ring_##isa(out, mul, ring, ringframes, phase, incr, count, CM_RENDER_FIR, false, fir); \
+	} \
+	target static void cm_render_ring_##isa##_21(float *out, const float *mul, const double *ring, long ringframes, cm_phase phase, cm_phase incr, long count, const cm_interp_table *fir) { \
+		cm_render_ring_##isa(out, mul, ring, ringframes, phase, incr, count, CM_RENDER_FIR, true, fir); \
+	} \
+	static const cm_render_kernels cm_render_##isa##_kernels = { \
+		{ { cm_render_buffer_##isa##_00, cm_render_buffer_##isa##_01 }, { cm_render_buffer_##isa##_10, cm_render_buffer_##isa##_11 }, { cm_render_buffer_##isa##_20, cm_render_buffer_##isa##_21 } }, \
+		{ { cm_render_ring_##isa##_00, cm_render_ring_##isa##_01 }, { cm_render_ring_##isa##_10, cm_render_ring_##isa##_11 }, { cm_render_ring_##isa##_20, cm_render_ring_##isa##_21 } } \
+	};
+
+CM_RENDER_VARIANTS(CM_TARGET_NONE, scalar)
+#ifdef CM_RENDER_X86
+CM_RENDER_VARIANTS(CM_TARGET_NONE, sse2)
+CM_RENDER_VARIANTS(CM_TARGET_AVX2, avx2)
+CM_RENDER_VARIANTS(CM_TARGET_AVX512, avx512)
+#endif
+
+
+/************************************************************************************************************************/
+/* RUNTIME DISPATCH                                                                                                     */
+/************************************************************************************************************************/
+static const cm_render_kernels *cm_render_selected = &cm_render_scalar_kernels;
+
+// build the interpolation tables, detect the instruction sets supported by the CPU and select the kernels (call once from ext_main)
+static void cm_render_init(void) {
+	cm_interp_init();
+#ifdef CM_RENDER_X86
+	t_bool avx2 = false;
+	t_bool avx512 = false;
+#ifdef _MSC_VER
+	int info[4];
+	unsigned long long xcr0 = 0;
+	__cpuid(info, 1);
+	if (info[2] & (1 << 27)) { // OSXSAVE: the operating system saves the extended registers
+		xcr0 = _xgetbv(0);
+	}
+	__cpuid(info, 0);
+	if (info[0] >= 7) {
+		__cpuidex(info, 7, 0);
+		avx2 = (info[1] & (1 << 5)) && (xcr0 & 0x06) == 0x06;
+		avx512 = avx2 && (info[1] & (1 << 16)) && (xcr0 & 0xe6) == 0xe6;
+	}
+#else
+	__builtin_cpu_init();
+	avx2 = __builtin_cpu_supports("avx2") ? true : false;
+	avx512 = (avx2 && __builtin_cpu_supports("avx512f")) ? true : false;
+#endif
+	if (avx512) {
+		cm_render_selected = &cm_render_avx512_kernels;
+	}
+	else if (avx2) {
+		cm_render_selected = &cm_render_avx2_kernels;
+	}
+	else { // SSE2 is part of every x86-64 CPU
+		cm_render_selected = &cm_render_sse2_kernels;
+	}
+#endif
+}
+
+
+/************************************************************************************************************************/
+/* KERNEL ENTRY POINTS                                                                                                  */
+/************************************************************************************************************************/
+// kernel kind of an interpolation mode (CM_INTERP_...)
+static inline long cm_render_kind(long interp) {
+	return interp > CM_INTERP_LINEAR ? CM_RENDER_FIR : (interp == CM_INTERP_LINEAR ? CM_RENDER_LINEAR : CM_RENDER_NEAREST);
+}
+
+// out[k] = source sample at (start + (k / length) * span), multiplied with mul[k] if mul is not NULL, for k = 0 ... count - 1
+// interp is an interpolation mode (CM_INTERP_...), taps the number of sinc taps (the variant is selected once per call, i.e. once per grain)
+static inline void cm_render_buffer(float *out, const float *mul, const float *src, long channels, long channel, long frames, double start, double span, double length, long count, long interp, long taps) {
+	const cm_render_kernels *kernels = cm_render_selected;
+	if ((frames + 1) * channels > INT_MAX) { // the vector kernels use 32 bit indices
+		kernels = &cm_render_scalar_kernels;
+	}
+	kernels->buffer[cm_render_kind(interp)][mul ? 1 : 0](out, mul, src, channels, channel, frames, cm_phase_from(start), cm_phase_from(span / length), count, cm_interp_select(interp, taps));
+}
+
+// same for the ringbuffer of cm.livecloud~ (start + span must not exceed two ringbuffer lengths)
+static inline void cm_render_ring(float *out, const float *mul, const double *ring, long ringframes, double start, double span, double length, long count, long interp, long taps) {
+	const cm_render_kernels *kernels = cm_render_selected;
+	if (ringframes * 2 > INT_MAX) {
+		kernels = &cm_render_scalar_kernels;
+	}
+	kernels->ring[cm_render_kind(interp)][mul ? 1 : 0](out, mul, ring, ringframes, cm_phase_from(start), cm_phase_from(span / length), count, cm_interp_select(interp, taps));
+}
+
+#if defined(__clang__)
+#pragma STDC FP_CONTRACT DEFAULT
+#elif defined(__GNUC__)
+#pragma GCC pop_options
+#endif // MSVC: contraction stays off (the default of /fp:precise)
+
+#endif
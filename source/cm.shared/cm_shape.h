@@ -0,0 +1,391 @@
+/*
+ cm_shape.h - analytic parametric grain windows computed per grain without window tables.
+ Copyright (C) 2012 - 2017  Matthias W. Müller - circuit.music.labs
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ info@circuitmusiclabs.com
+
+ */
+
+// NOTE:
+// The windows are computed at the grain length with one shape parameter per grain (the alpha range 0.1 - 10), so the
+// parameter can be randomized for every grain and no window memory is needed. A window is split into segments
+// (attack taper, flat part, release taper) and every segment is evaluated with a recurrence from exact start values:
+//   gauss     exp(-a (n - N/2)^2), a = 2 param^2 / N^2: g(n + 1) = g(n) * r(n), r(n + 1) = r(n) * exp(-2a) (2 multiplies)
+//   expodec   exp(-param * n / N) (instant attack, exponential decay): 1 multiply
+//   rexpodec  exp(-param * (N - n) / N) (exponential attack, instant release): 1 multiply
+//   tukey     raised cosine tapers of param / 10 of the grain length and a flat part: cosine rotator, 4 multiplies
+//   skew      raised cosine with the peak at param / 10 of the grain length: cosine rotator, 4 multiplies
+// The recurrences restart from the exact values at every segment boundary and every CM_SHAPE_RENORM samples, the error
+// stays below 1e-12. Two shapes have no such recurrence:
+//   kaiser    I0(beta sqrt(1 - t^2)) / I0(beta), beta = param: the bessel series is a polynomial in t^2 (no sqrt) with
+//             4 - 19 terms for beta 0.1 - 10
+//   planck    planck-taper with tapers of param / 20 of the grain length: exp and a division per taper sample
+// They are split into CM_SHAPE_PIECES pieces (planck: per taper, kaiser: per window, fewer for beta below 10 as the
+// error of a piece grows with about beta^2), each piece is the cubic through the exact values at its ends and thirds,
+// evaluated with forward differences (3 additions per sample, 3 exact values per piece, the end value is the start of
+// the next piece). The error stays below 1e-8 for beta up to 10. Pieces shorter than CM_SHAPE_PIECE_MIN samples (short
+// grains, narrow tapers) would need more exact values than they have samples, they are evaluated directly.
+// cm_shape_fill evaluates a block of samples segment by segment: the segment end and the mode are tested once per
+// segment, so every sample costs only its recurrence. Rendered grains store the whole window in the envelope cache
+// (cm_envcache.h, key: the shape name and the parameter), the streaming engine fills CM_SHAPE_BLOCK samples at a time.
+
+#ifndef CM_SHAPE_H
+#define CM_SHAPE_H
+
+#include <math.h>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846264338327950288
+#endif
+
+#define CM_SHAPE_GAUSS 0
+#define CM_SHAPE_TUKEY 1
+#define CM_SHAPE_KAISER 2
+#define CM_SHAPE_PLANCK 3
+#define CM_SHAPE_EXPODEC 4
+#define CM_SHAPE_REXPODEC 5
+#define CM_SHAPE_SKEW 6
+#define CM_SHAPE_KINDS 7 // number of window shapes
+#define CM_SHAPE_RENORM 1024 // the recurrences restart from the exact values every CM_SHAPE_RENORM samples
+#define CM_SHAPE_KAISER_TERMS 32 // max number of bessel series terms
+#define CM_SHAPE_PIECES 128 // cubic pieces per planck taper or kaiser window of beta 10 (and above)
+#define CM_SHAPE_PIECE_MIN 4 // min piece length (samples), shorter pieces are evaluated directly
+#define CM_SHAPE_BLOCK 64 // window samples per cm_shape_fill call of the streaming engine
+
+// segment evaluation modes
+#define CM_SHAPE_CONST 0 // constant value
+#define CM_SHAPE_EXP 1 // value *= ratio, ratio *= decay
+#define CM_SHAPE_COS 2 // offset + scale * cos, rotated by the step angle
+#define CM_SHAPE_EXACT 3 // kaiser, planck: window function evaluated at every position
+#define CM_SHAPE_CUBIC 4 // kaiser, planck: value += step1, step1 += step2, step2 += step3
+
+// shape names (enum labels of the shape attribute, the address of a name is the envelope cache key of the shape)
+static const char cm_shape_names[CM_SHAPE_KINDS][10] = { "gauss", "tukey", "kaiser", "planck", "expodec", "rexpodec", "skew" };
+
+// 1 / k^2: coefficient ratios of the bessel series sum (u^k / (k!)^2)
+#define CM_SHAPE_INVSQ(k) (1.0 / ((double)(k) * (double)(k)))
+static const double cm_shape_invsq[CM_SHAPE_KAISER_TERMS + 1] = {
+	0.0, CM_SHAPE_INVSQ(1), CM_SHAPE_INVSQ(2), CM_SHAPE_INVSQ(3), CM_SHAPE_INVSQ(4), CM_SHAPE_INVSQ(5), CM_SHAPE_INVSQ(6),
+	CM_SHAPE_INVSQ(7), CM_SHAPE_INVSQ(8), CM_SHAPE_INVSQ(9), CM_SHAPE_INVSQ(10), CM_SHAPE_INVSQ(11), CM_SHAPE_INVSQ(12),
+	CM_SHAPE_INVSQ(13), CM_SHAPE_INVSQ(14), CM_SHAPE_INVSQ(15), CM_SHAPE_INVSQ(16), CM_SHAPE_INVSQ(17), CM_SHAPE_INVSQ(18),
+	CM_SHAPE_INVSQ(19), CM_SHAPE_INVSQ(20), CM_SHAPE_INVSQ(21), CM_SHAPE_INVSQ(22), CM_SHAPE_INVSQ(23), CM_SHAPE_INVSQ(24),
+	CM_SHAPE_INVSQ(25), CM_SHAPE_INVSQ(26), CM_SHAPE_INVSQ(27), CM_SHAPE_INVSQ(28), CM_SHAPE_INVSQ(29), CM_SHAPE_INVSQ(30),
+	CM_SHAPE_INVSQ(31), CM_SHAPE_INVSQ(32)
+};
+
+typedef struct cmshape {
+	long kind; // window shape
+	double param; // shape parameter
+	long length; // window length
+	long edge; // next position where the state is recomputed (segment boundary or renormalization)
+	long mode; // evaluation mode of the current segment
+	double value; // CM_SHAPE_CONST, CM_SHAPE_EXP, CM_SHAPE_CUBIC: window value at the current position
+	double ratio; // CM_SHAPE_EXP: ratio of the next window value to the current one
+	double decay; // CM_SHAPE_EXP: ratio of the next ratio to the current one
+	double cosine, sine; // CM_SHAPE_COS: cosine and sine of the current angle
+	double rcos, rsin; // CM_SHAPE_COS: cosine and sine of the step angle
+	double offset, scale; // CM_SHAPE_COS: window value = offset + scale * cosine
+	double step1, step2, step3; // CM_SHAPE_CUBIC: forward differences of the cubic at the current position
+	long node; // kaiser, planck: position of the exact value at the end of the last piece (the start of the next one)
+	double nodevalue; // kaiser, planck: exact value at node
+	double origin; // kaiser: position of t = 0, planck: window edge of the current taper
+	double width; // kaiser: 1 / (N / 2), planck: taper length
+	double piece; // kaiser: piece length
+	double quarter; // kaiser: beta^2 / 4
+	double norm; // kaiser: 1 / I0(beta)
+	long terms; // kaiser: number of series terms
+} cm_shape;
+
+
+/************************************************************************************************************************/
+/* SEGMENT SETUP                                                                                                        */
+/************************************************************************************************************************/
+// start a raised cosine segment 0.5 - 0.5 * cos(angle + step * (n - pos)) at position pos
+static void cm_shape_cosine(cm_shape *shape, double angle, double step) {
+	shape->mode = CM_SHAPE_COS;
+	shape->cosine = cos(angle);
+	shape->sine = sin(angle);
+	shape->rcos = cos(step);
+	shape->rsin = sin(step);
+	shape->offset = 0.5;
+	shape->scale = -0.5;
+}
+
+// bessel series sum (u^k / (k!)^2) = I0(2 sqrt(u)) with the given number of terms (horner scheme)
+static inline double cm_shape_bessel(double u, long terms) {
+	double sum = 1.0;
+	long k;
+	for (k = terms; k > 0; k--) {
+		sum = 1.0 + sum * u * cm_shape_invsq[k];
+	}
+	return sum;
+}
+
+// kaiser or planck window value at position pos (planck: of the taper at shape->origin)
+static inline double cm_shape_exact(const cm_shape *shape, double pos) {
+	double t, m;
+	if (shape->kind == CM_SHAPE_KAISER) {
+		t = (pos - shape->origin) * shape->width;
+		return cm_shape_bessel(shape->quarter * (1.0 - t * t), shape->terms) * shape->norm;
+	}
+	m = fabs(pos - shape->origin); // distance from the window edge
+	if (m <= 0.0) {
+		return 0.0;
+	}
+	if (m >= shape->width) {
+		return 1.0;
+	}
+	return 1.0 / (1.0 + exp(shape->width / m - shape->width / (shape->width - m)));
+}
+
+// start a kaiser or planck piece of the given length at position pos (not beyond end, which is set to the end of the
+// piece): the cubic through the exact values at the ends and thirds of the piece, evaluated with forward differences
+static void cm_shape_piece(cm_shape *shape, long pos, double length, long *end) {
+	double h, y0, y1, y2, y3, f1, f2, f3, b, c, d;
+	if (length < CM_SHAPE_PIECE_MIN) { // short grain or narrow taper
+		shape->mode = CM_SHAPE_EXACT;
+		return;
+	}
+	length = length < CM_SHAPE_RENORM ? ceil(length) : CM_SHAPE_RENORM;
+	if (pos + (long)length < *end) {
+		*end = pos + (long)length;
+	}
+	h = (*end - pos) / 3.0;
+	y0 = pos == shape->node ? shape->nodevalue : cm_shape_exact(shape, pos);
+	y1 = cm_shape_exact(shape, pos + h);
+	y2 = cm_shape_exact(shape, pos + 2.0 * h);
+	y3 = cm_shape_exact(shape, *end);
+	shape->node = *end;
+	shape->nodevalue = y3;
+	f1 = y1 - y0; // newton forward differences at the nodes
+	f2 = y2 - 2.0 * y1 + y0;
+	f3 = y3 - 3.0 * y2 + 3.0 * y1 - y0;
+	b = (f1 - 0.5 * f2 + f3 / 3.0) / h; // cubic y0 + b x + c x^2 + d x^3
+	c = 0.5 * (f2 - f3) / (h * h);
+	d = f3 / (6.0 * h * h * h);
+	shape->mode = CM_SHAPE_CUBIC;
+	shape->value = y0;
+	shape->step1 = b + c + d; // forward differences at x = 0 for a step of one sample
+	shape->step2 = 2.0 * c + 6.0 * d;
+	shape->step3 = 6.0 * d;
+}
+
+// compute the exact state at position pos and the position of the next recomputation
+static void cm_shape_seek(cm_shape *shape, long pos) {
+	double N = shape->length - 1;
+	double p = shape->param;
+	double a, n, taper, peak;
+	long end = shape->length; // end of the current segment
+	if (N <= 0.0) { // single sample window
+		shape->mode = CM_SHAPE_CONST;
+		shape->value = 1.0;
+		shape->edge = pos + CM_SHAPE_RENORM;
+		return;
+	}
+	switch (shape->kind) {
+		case CM_SHAPE_TUKEY:
+			taper = N * (p / 20.0); // each taper covers half of param / 10 of the window
+			if (taper > N * 0.5) {
+				taper = N * 0.5;
+			}
+			if (pos < taper) { // attack: 0.5 - 0.5 * cos(pi * n / taper)
+				cm_shape_cosine(shape, M_PI * pos / taper, M_PI / taper);
+				end = (long)ceil(taper);
+			}
+			else if (pos <= N - taper) { // flat part
+				shape->mode = CM_SHAPE_CONST;
+				shape->value = 1.0;
+				end = (long)floor(N - taper) + 1;
+			}
+			else { // release: 0.5 - 0.5 * cos(pi * (N - n) / taper)
+				cm_shape_cosine(shape, M_PI * (N - pos) / taper, -M_PI / taper);
+			}
+			break;
+		case CM_SHAPE_SKEW:
+			peak = N * (p / 10.0);
+			if (peak > N) {
+				peak = N;
+			}
+			if (pos <= peak) { // attack: 0.5 - 0.5 * cos(pi * n / peak)
+				cm_shape_cosine(shape, M_PI * pos / peak, M_PI / peak);
+				end = (long)floor(peak) + 1;
+			}
+			else { // release: 0.5 - 0.5 * cos(pi * (N - n) / (N - peak))
+				cm_shape_cosine(shape, M_PI * (N - pos) / (N - peak), -M_PI / (N - peak));
+			}
+			break;
+		case CM_SHAPE_KAISER: // the series constants are computed by cm_shape_init
+			cm_shape_piece(shape, pos, shape->piece, &end);
+			break;
+		case CM_SHAPE_PLANCK:
+			taper = N * (p / 20.0);
+			if (taper > N * 0.5) {
+				taper = N * 0.5;
+			}
+			shape->width = taper;
+			if (pos < taper) { // attack taper
+				shape->origin = 0.0;
+				end = (long)ceil(taper);
+				cm_shape_piece(shape, pos, taper / CM_SHAPE_PIECES, &end);
+			}
+			else if (pos <= N - taper) { // flat part
+				shape->mode = CM_SHAPE_CONST;
+				shape->value = 1.0;
+				end = (long)floor(N - taper) + 1;
+			}
+			else { // release taper
+				if (shape->origin != N) { // the node of the attack taper belongs to the other window edge
+					shape->origin = N;
+					shape->node = -1;
+				}
+				cm_shape_piece(shape, pos, taper / CM_SHAPE_PIECES, &end);
+			}
+			break;
+		case CM_SHAPE_EXPODEC:
+			shape->mode = CM_SHAPE_EXP;
+			shape->value = exp(-p * pos / N);
+			shape->ratio = exp(-p / N);
+			shape->decay = 1.0;
+			break;
+		case CM_SHAPE_REXPODEC:
+			shape->mode = CM_SHAPE_EXP;
+			shape->value = exp(-p * (N - pos) / N);
+			shape->ratio = exp(p / N);
+			shape->decay = 1.0;
+			break;
+		default: // CM_SHAPE_GAUSS: stdev = N / (2 * alpha)
+			a = 2.0 * p * p / (N * N);
+			n = pos - N / 2;
+			shape->mode = CM_SHAPE_EXP;
+			shape->value = exp(-a * n * n);
+			shape->ratio = exp(-a * (2.0 * n + 1.0));
+			shape->decay = exp(-2.0 * a);
+			break;
+	}
+	shape->edge = end < pos + CM_SHAPE_RENORM ? end : pos + CM_SHAPE_RENORM;
+}
+
+
+/************************************************************************************************************************/
+/* WINDOW EVALUATION                                                                                                    */
+/************************************************************************************************************************/
+// start a window (the state is computed at the first call of cm_shape_fill)
+static void cm_shape_init(cm_shape *shape, long kind, double param, long length) {
+	double term, sum, share;
+	long k;
+	shape->kind = (kind >= 0 && kind < CM_SHAPE_KINDS) ? kind : CM_SHAPE_GAUSS;
+	shape->param = param;
+	shape->length = length;
+	shape->edge = 0;
+	shape->node = -1;
+	shape->origin = 0.0;
+	if (shape->kind == CM_SHAPE_KAISER && length > 1) {
+		shape->origin = (length - 1) * 0.5;
+		shape->width = 2.0 / (length - 1);
+		shape->quarter = param * param * 0.25;
+		// number of terms: the last term is below 1e-10 of the sum at the window center
+		term = 1.0;
+		sum = 1.0;
+		for (k = 1; k < CM_SHAPE_KAISER_TERMS; k++) {
+			term *= shape->quarter * cm_shape_invsq[k];
+			sum += term;
+			if (term < 1e-10 * sum) {
+				break;
+			}
+		}
+		shape->terms = k;
+		shape->norm = 1.0 / cm_shape_bessel(shape->quarter, shape->terms);
+		// CM_SHAPE_PIECES * sqrt(beta / 10) pieces (at least 1 / 8 of them): the same error as at beta 10
+		share = (param > 0.0 && param < 10.0) ? sqrt(param * 0.1) : 1.0;
+		shape->piece = length / (CM_SHAPE_PIECES * (share > 0.125 ? share : 0.125));
+	}
+}
+
+// write the count window values from position pos on (the positions of a window must be passed in order, starting at 0)
+// segment by segment: the mode and the segment end are not tested per sample
+static void cm_shape_fill(cm_shape *shape, long pos, long count, float *out) {
+	double value, ratio, decay, cosine, sine, c, step1, step2, step3;
+	long k, run;
+	while (count > 0) {
+		if (pos >= shape->edge) {
+			cm_shape_seek(shape, pos);
+		}
+		run = shape->edge - pos < count ? shape->edge - pos : count;
+		switch (shape->mode) {
+			case CM_SHAPE_EXP:
+				value = shape->value;
+				ratio = shape->ratio;
+				decay = shape->decay;
+				for (k = 0; k < run; k++) {
+					out[k] = value;
+					value *= ratio;
+					ratio *= decay;
+				}
+				shape->value = value;
+				shape->ratio = ratio;
+				break;
+			case CM_SHAPE_COS:
+				cosine = shape->cosine;
+				sine = shape->sine;
+				for (k = 0; k < run; k++) {
+					out[k] = shape->offset + shape->scale * cosine;
+					c = cosine * shape->rcos - sine * shape->rsin;
+					sine = sine * shape->rcos + cosine * shape->rsin;
+					cosine = c;
+				}
+				shape->cosine = cosine;
+				shape->sine = sine;
+				break;
+			case CM_SHAPE_CUBIC:
+				value = shape->value;
+				step1 = shape->step1;
+				step2 = shape->step2;
+				step3 = shape->step3;
+				for (k = 0; k < run; k++) {
+					out[k] = value;
+					value += step1;
+					step1 += step2;
+					step2 += step3;
+				}
+				shape->value = value;
+				shape->step1 = step1;
+				shape->step2 = step2;
+				break;
+			case CM_SHAPE_CONST:
+				for (k = 0; k < run; k++) {
+					out[k] = shape->value;
+				}
+				break;
+			default: // CM_SHAPE_EXACT
+				for (k = 0; k < run; k++) {
+					out[k] = cm_shape_exact(shape, pos + k);
+				}
+				break;
+		}
+		out += run;
+		pos += run;
+		count -= run;
+	}
+}
+
+// write a whole window of the given length
+static void cm_shape_window(float *window, long length, long kind, double param) {
+	cm_shape shape;
+	cm_shape_init(&shape, kind, param, length);
+	cm_shape_fill(&shape, 0, length, window);
+}
+
+#endif
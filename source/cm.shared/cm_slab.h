@@ -0,0 +1,317 @@
+/*
+ cm_slab.h - size-class slab allocator for the grain memory of the petra cloud objects.
+ Copyright (C) 2012 - 2017  Matthias W. Müller - circuit.music.labs
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ info@circuitmusiclabs.com
+
+ */
+
+// NOTE:
+// Grain memory is handed out in blocks of a fixed set of size classes (CM_SLAB_STEPS classes per octave).
+// All slabs have the same size (one block of the largest class). A slab is assigned to a size class when a block of
+// that class is needed and no slab of the class has room left, its blocks are carved from it one by one and recycled
+// through the free list of the slab when a grain has finished playing. A slab counts its blocks in use: when the last
+// one is released the slab leaves its size class and returns to the unassigned slabs, so changing grain lengths never
+// pin memory to size classes which are no longer used. A slab in use always holds at least one playing grain: one slab
+// per grain is always sufficient.
+// Allocating and releasing blocks only happens on the audio thread and never calls the system allocator. New slabs are
+// allocated on the main thread (cm_slab_grow) when the audio thread runs out of memory and published through an atomic
+// slab counter.
+
+#ifndef CM_SLAB_H
+#define CM_SLAB_H
+
+#include "ext.h"
+#include "ext_atomic.h"
+
+#define CM_SLAB_MIN_BYTES 256 // block size of the smallest size class in bytes
+#define CM_SLAB_STEPS 4 // number of size classes per octave
+#define CM_SLAB_MAX_CLASSES 160 // max number of size classes
+#define CM_SLAB_PREFILL 2 // number of slabs allocated when the pool is created
+#define CM_SLAB_PREFILL_ALL 0x7fffffff // prefill: allocate every slab the pool can hold (the pool never runs out)
+
+
+/************************************************************************************************************************/
+/* SLAB POOL STRUCTURES                                                                                                 */
+/************************************************************************************************************************/
+typedef struct cmslab {
+	char *memory; // slab memory
+	long sizeclass; // size class the slab is carved into (-1 if not assigned)
+	t_ptr_size offset; // offset of the next uncarved block in the slab
+	void *freelist; // released blocks of the slab
+	long live; // number of blocks in use
+	long prev; // previous slab in the list of its size class or of the unassigned slabs (-1 if none)
+	long next; // next slab in the list of its size class or of the unassigned slabs (-1 if none)
+} cm_slab;
+
+typedef struct cmslabpool {
+	cm_slab *slabs; // slab array
+	long capacity; // max number of slabs
+	t_int32_atomic count; // number of slabs with allocated memory (written by the main thread)
+	t_int32_atomic grow; // number of additional slabs requested by the audio thread
+	long assigned; // number of slabs which have ever been assigned to a size class (the others are untouched)
+	long unassigned; // first of the released slabs which are not assigned to a size class (-1 if none)
+	t_ptr_size slabbytes; // size of one slab in bytes
+	long classes; // number of size classes
+	t_ptr_size classbytes[CM_SLAB_MAX_CLASSES]; // block size of each size class
+	long partial[CM_SLAB_MAX_CLASSES]; // first slab of each size class with room for another block (-1 if none)
+	long live[CM_SLAB_MAX_CLASSES]; // number of blocks in use for each size class
+	t_ptr_size bytes_used; // bytes currently handed out to grains
+	t_ptr_size bytes_peak; // max of bytes_used since the pool was created
+	long fallbacks; // number of requests which could not be served
+} cm_slabpool;
+
+
+/************************************************************************************************************************/
+/* POOL CREATION AND DESTRUCTION (MAIN THREAD)                                                                          */
+/************************************************************************************************************************/
+// add slabs to the pool; returns the number of slabs actually added
+static long cm_slab_add(cm_slabpool *pool, long slabs) {
+	long added = 0;
+	long index;
+	while (added < slabs && pool->count < pool->capacity) {
+		index = pool->count;
+		pool->slabs[index].memory = sysmem_newptr(pool->slabbytes);
+		if (pool->slabs[index].memory == NULL) {
+			break;
+		}
+		pool->slabs[index].sizeclass = -1;
+		pool->slabs[index].offset = 0;
+		pool->slabs[index].freelist = NULL;
+		pool->slabs[index].live = 0;
+		pool->slabs[index].prev = -1;
+		pool->slabs[index].next = -1;
+		ATOMIC_INCREMENT_BARRIER(&pool->count); // publish the slab to the audio thread
+		added++;
+	}
+	return added;
+}
+
+// create a pool for blocks of up to maxbytes; capacity is the max number of slabs, prefill the number of slabs allocated now
+static t_bool cm_slab_new(cm_slabpool *pool, t_ptr_size maxbytes, long capacity, long prefill) {
+	long i;
+	t_ptr_size octave = CM_SLAB_MIN_BYTES;
+
+	memset(pool, 0, sizeof(cm_slabpool));
+
+	// build the size class table: CM_SLAB_STEPS equally spaced classes per octave, the last class holds maxbytes
+	pool->classes = 0;
+	while (pool->classes < CM_SLAB_MAX_CLASSES) {
+		pool->classbytes[pool->classes] = octave + (octave / CM_SLAB_STEPS) * (pool->classes % CM_SLAB_STEPS);
+		if (pool->classbytes[pool->classes++] >= maxbytes) {
+			break;
+		}
+		if (pool->classes % CM_SLAB_STEPS == 0) {
+			octave *= 2;
+		}
+	}
+	pool->slabbytes = pool->classbytes[pool->classes - 1];
+
+	for (i = 0; i < pool->classes; i++) {
+		pool->partial[i] = -1;
+	}
+	pool->unassigned = -1;
+
+	// empty slabs leave their size class: one slab per grain is always sufficient
+	pool->capacity = capacity;
+	pool->slabs = (cm_slab *)sysmem_newptrclear(pool->capacity * sizeof(cm_slab));
+	if (pool->slabs == NULL) {
+		return false;
+	}
+	cm_slab_add(pool, prefill);
+	return true;
+}
+
+// free all slabs (no grain must be playing)
+static void cm_slab_free(cm_slabpool *pool) {
+	long i;
+	if (pool->slabs) {
+		for (i = 0; i < pool->count; i++) {
+			sysmem_freeptr(pool->slabs[i].memory);
+		}
+		sysmem_freeptr(pool->slabs);
+	}
+	pool->slabs = NULL;
+	pool->count = 0;
+	pool->capacity = 0;
+}
+
+// allocate the slabs requested by the audio thread; returns false if memory allocation failed
+static t_bool cm_slab_grow(cm_slabpool *pool) {
+	long added;
+	long requested = pool->grow;
+	if (requested <= 0 || pool->slabs == NULL) {
+		return true;
+	}
+	added = cm_slab_add(pool, requested);
+	while (added--) {
+		ATOMIC_DECREMENT(&pool->grow);
+	}
+	if (pool->count < pool->capacity && pool->grow > 0) {
+		return false;
+	}
+	return true;
+}
+
+
+/************************************************************************************************************************/
+/* BLOCK ALLOCATION (AUDIO THREAD)                                                                                      */
+/************************************************************************************************************************/
+// true if the slab has no room for another block of its size class
+static inline t_bool cm_slab_full(cm_slabpool *pool, cm_slab *slab) {
+	return slab->freelist == NULL && slab->offset + pool->classbytes[slab->sizeclass] > pool->slabbytes;
+}
+
+// insert a slab at the head of a slab list
+static inline void cm_slab_link(cm_slabpool *pool, long *head, long s) {
+	pool->slabs[s].prev = -1;
+	pool->slabs[s].next = *head;
+	if (*head >= 0) {
+		pool->slabs[*head].prev = s;
+	}
+	*head = s;
+}
+
+// remove a slab from a slab list
+static inline void cm_slab_unlink(cm_slabpool *pool, long *head, long s) {
+	cm_slab *slab = &pool->slabs[s];
+	if (slab->prev >= 0) {
+		pool->slabs[slab->prev].next = slab->next;
+	}
+	else {
+		*head = slab->next;
+	}
+	if (slab->next >= 0) {
+		pool->slabs[slab->next].prev = slab->prev;
+	}
+	slab->prev = -1;
+	slab->next = -1;
+}
+
+// get a block of at least the requested size; returns NULL if the pool is exhausted (the slab of the block is written
+// for cm_slab_release)
+static void *cm_slab_alloc(cm_slabpool *pool, t_ptr_size bytes, long *slabindex) {
+	void *block;
+	cm_slab *slab;
+	long c = 0;
+	long s;
+
+	// find the smallest size class holding the requested number of bytes
+	while (c < pool->classes && pool->classbytes[c] < bytes) {
+		c++;
+	}
+	if (c == pool->classes) {
+		pool->fallbacks++;
+		return NULL;
+	}
+
+	s = pool->partial[c];
+	if (s < 0) { // no slab of this size class has room left: assign a released or an untouched slab
+		if (pool->unassigned >= 0) {
+			s = pool->unassigned;
+			cm_slab_unlink(pool, &pool->unassigned, s);
+		}
+		else if (pool->assigned < pool->count && pool->slabs[pool->assigned].memory) {
+			s = pool->assigned++;
+		}
+		else { // out of slabs: ask the main thread for another one
+			if (pool->count + pool->grow < pool->capacity) {
+				ATOMIC_INCREMENT(&pool->grow);
+			}
+			pool->fallbacks++;
+			return NULL;
+		}
+		slab = &pool->slabs[s];
+		slab->sizeclass = c;
+		slab->offset = 0;
+		slab->freelist = NULL;
+		slab->live = 0;
+		cm_slab_link(pool, &pool->partial[c], s);
+	}
+
+	slab = &pool->slabs[s];
+	if (slab->freelist) { // recycle a released block
+		block = slab->freelist;
+		slab->freelist = *(void **)block;
+	}
+	else { // carve a new block
+		block = slab->memory + slab->offset;
+		slab->offset += pool->classbytes[c];
+	}
+	slab->live++;
+	if (cm_slab_full(pool, slab)) {
+		cm_slab_unlink(pool, &pool->partial[c], s);
+	}
+
+	pool->live[c]++;
+	pool->bytes_used += pool->classbytes[c];
+	if (pool->bytes_used > pool->bytes_peak) {
+		pool->bytes_peak = pool->bytes_used;
+	}
+	*slabindex = s;
+	return block;
+}
+
+// return a block to its slab; the last block in use returns the slab to the unassigned slabs
+static void cm_slab_release(cm_slabpool *pool, void *block, long slabindex) {
+	cm_slab *slab = &pool->slabs[slabindex];
+	long c = slab->sizeclass;
+	t_bool full = cm_slab_full(pool, slab);
+	*(void **)block = slab->freelist;
+	slab->freelist = block;
+	slab->live--;
+	pool->live[c]--;
+	pool->bytes_used -= pool->classbytes[c];
+	if (slab->live == 0) { // empty: leave the size class
+		if (!full) {
+			cm_slab_unlink(pool, &pool->partial[c], slabindex);
+		}
+		slab->sizeclass = -1;
+		slab->freelist = NULL;
+		cm_slab_link(pool, &pool->unassigned, slabindex);
+	}
+	else if (full) { // room for a block again
+		cm_slab_link(pool, &pool->partial[c], slabindex);
+	}
+}
+
+
+/************************************************************************************************************************/
+/* FOOTPRINT REPORT                                                                                                     */
+/************************************************************************************************************************/
+// post the memory usage of the pool to the max window (worstcase: bytes the old per-slot allocation would have used)
+static void cm_slab_footprint(cm_slabpool *pool, t_object *x, double worstcase) {
+	long c, s, slabs, used = 0;
+	double kb = 1.0 / 1024.0;
+	object_post(x, "grain memory: %ld of %ld slabs allocated, %.1f kB each (%.1f kB reserved)", (long)pool->count, pool->capacity, pool->slabbytes * kb, pool->count * pool->slabbytes * kb);
+	object_post(x, "grain memory: %.1f kB in use, peak %.1f kB, %ld requests not served", pool->bytes_used * kb, pool->bytes_peak * kb, pool->fallbacks);
+	for (c = 0; c < pool->classes; c++) {
+		slabs = 0;
+		for (s = 0; s < pool->assigned; s++) {
+			if (pool->slabs[s].sizeclass == c) {
+				slabs++;
+			}
+		}
+		used += slabs;
+		if (slabs) {
+			object_post(x, "grain memory: size class %ld (%.1f kB) - %ld slabs, %ld blocks in use", c, pool->classbytes[c] * kb, slabs, pool->live[c]);
+		}
+	}
+	object_post(x, "grain memory: %ld slabs assigned to size classes, %ld slabs free", used, (long)pool->count - used);
+	object_post(x, "grain memory: worst case per-slot allocation would be %.1f kB", worstcase * kb);
+}
+
+#endif
@@ -0,0 +1,55 @@
+/*
+ cm_swap.h - handover of rebuilt grain storage between the main thread and the audio thread.
+ Copyright (C) 2012 - 2017  Matthias W. Müller - circuit.music.labs
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ info@circuitmusiclabs.com
+
+ */
+
+// NOTE:
+// Changing the cloud size, the max grain length (or the ringbuffer length of cm.livecloud~) never stops the cloud.
+// The new grain storage is built on the main thread and handed to the audio thread through an atomic swap state:
+//
+//   IDLE -> READY      main thread: the new storage is complete
+//   READY -> DRAINING  audio thread: the new storage is installed, the playing grains were moved into it,
+//                      but their memory still belongs to the retired storage
+//   DRAINING -> RETIRED  audio thread: the last grain of the retired storage has finished
+//   RETIRED -> IDLE    main thread: the retired storage is freed
+//
+// Each transition is done by exactly one thread, the pointers of the storage are written before the state is
+// published. Only one swap is in flight at a time: requests arriving meanwhile are served when the state is IDLE again.
+
+#ifndef CM_SWAP_H
+#define CM_SWAP_H
+
+#include "ext.h"
+#include "ext_atomic.h"
+
+#define CM_SWAP_IDLE 0 // no swap in flight
+#define CM_SWAP_READY 1 // new storage waiting to be installed by the audio thread
+#define CM_SWAP_DRAINING 2 // new storage installed, grains of the retired storage still playing
+#define CM_SWAP_RETIRED 3 // retired storage unused, waiting to be freed by the main thread
+
+
+/************************************************************************************************************************/
+/* STATE TRANSITION                                                                                                     */
+/************************************************************************************************************************/
+// move the swap state from one state to the next (with memory barrier); returns false if the state was not in the expected state
+static t_bool cm_swap_advance(t_int32_atomic *state, long from, long to) {
+	return ATOMIC_COMPARE_SWAP32(from, to, state) ? true : false;
+}
+
+#endif
@@ -0,0 +1,196 @@
+/*
+ cm_trigger.h - trigger detection pre-scan for the signal vectors of the petra cloud objects.
+ Copyright (C) 2012 - 2017  Matthias W. Müller - circuit.music.labs
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ info@circuitmusiclabs.com
+
+ */
+
+// NOTE:
+// The trigger input of a signal vector is scanned in one pass before any grain is started or mixed.
+// Every frame is compared with its predecessor without branches (the loops are vectorized by the compiler)
+// and the result is stored as one flag byte per frame. The perform routines then jump from trigger to trigger
+// with cm_trigger_next, which skips eight frames at a time, and process the frames in between as one block.
+// The detection gives exactly the same trigger frames as the former per-sample detection, including the
+// handling of a bang (it triggers at the first frame of the vector which is not triggered by the signal). Several bangs
+// waiting for the same vector trigger at consecutive free frames, bangs which find no free frame wait for the next one.
+// At most one bang per frame of the vector waits (cm_trigger_bang), and a vector which is not played (no buffer, an
+// oversized vector) drops its bangs as it drops its signal triggers (cm_trigger_skip): bangs sent while the buffer is
+// missing do not fire as a burst once it is back.
+// Grain parameters of signal-connected inlets are read at the trigger frame, not at the first frame of the vector:
+// cm_sigparams_collect lists the connected inlets once per vector, cm_sigparams_read reads only those at a trigger
+// (frames without a trigger cost nothing, the grain parameters are sample accurate at any vector size).
+
+#ifndef CM_TRIGGER_H
+#define CM_TRIGGER_H
+
+#include "ext.h"
+#include <stdint.h> // for uint64_t
+#include <string.h> // for memcpy
+#include <math.h> // for signbit
+
+#define CM_TRIGGER_THRESHOLD 0.9 // min falling step of the trigger ramp
+#define CM_TRIGGER_PADDING 8 // number of zero flags behind the last frame (for reading eight flags at a time)
+#define CM_SIGPARAMS_MAX 16 // max number of grain parameter inlets
+
+
+/************************************************************************************************************************/
+/* TRIGGER SCAN STRUCTURE                                                                                               */
+/************************************************************************************************************************/
+typedef struct cmtriggerscan {
+	char *flags; // trigger flag for each frame of the signal vector
+	long size; // max number of frames (max vector size)
+	long count; // number of frames in the current signal vector
+} cm_triggerscan;
+
+typedef struct cmsigparams {
+	long count; // number of signal-connected grain parameters
+	long index[CM_SIGPARAMS_MAX]; // grain parameter index
+	double *in[CM_SIGPARAMS_MAX]; // signal input vector
+	double scale[CM_SIGPARAMS_MAX]; // factor from the signal value to the grain parameter
+} cm_sigparams;
+
+
+/************************************************************************************************************************/
+/* ALLOCATION (MAIN THREAD)                                                                                             */
+/************************************************************************************************************************/
+// make room for signal vectors of up to maxvectorsize frames; returns false if memory allocation failed
+static t_bool cm_trigger_resize(cm_triggerscan *scan, long maxvectorsize) {
+	if (scan->flags && scan->size >= maxvectorsize) {
+		return true;
+	}
+	if (scan->flags) {
+		sysmem_freeptr(scan->flags);
+	}
+	scan->flags = (char *)sysmem_newptrclear(maxvectorsize + CM_TRIGGER_PADDING);
+	if (scan->flags == NULL) {
+		scan->size = 0;
+		return false;
+	}
+	scan->size = maxvectorsize;
+	scan->count = 0;
+	return true;
+}
+
+static void cm_trigger_free(cm_triggerscan *scan) {
+	if (scan->flags) {
+		sysmem_freeptr(scan->flags);
+	}
+	scan->flags = NULL;
+	scan->size = 0;
+}
+
+
+/************************************************************************************************************************/
+/* TRIGGER DETECTION (AUDIO THREAD)                                                                                     */
+/************************************************************************************************************************/
+// flag all trigger frames of the signal vector; tr_prev holds the last trigger sample of the previous vector and is updated,
+// the pending bangs are consumed as far as they could be placed; returns false if the vector is larger than the scan arrays
+static t_bool cm_trigger_scan(cm_triggerscan *scan, double *tr_sigin, long n, double *tr_prev, t_atom_long zero, long *bangs) {
+	char *flags = scan->flags;
+	long k;
+
+	if (n > scan->size || flags == NULL) {
+		return false;
+	}
+	scan->count = n;
+	if (n <= 0) {
+		return true;
+	}
+
+	if (zero) { // zero crossing
+		flags[0] = signbit(tr_sigin[0]) != signbit(*tr_prev);
+		for (k = 1; k < n; k++) {
+			flags[k] = signbit(tr_sigin[k]) != signbit(tr_sigin[k - 1]);
+		}
+	}
+	else { // falling edge of the ramp
+		flags[0] = (*tr_prev - tr_sigin[0]) > CM_TRIGGER_THRESHOLD;
+		for (k = 1; k < n; k++) {
+			flags[k] = (tr_sigin[k - 1] - tr_sigin[k]) > CM_TRIGGER_THRESHOLD;
+		}
+	}
+	memset(flags + n, 0, CM_TRIGGER_PADDING);
+	*tr_prev = tr_sigin[n - 1];
+
+	// every bang triggers at the next frame which is not triggered by the signal
+	for (k = 0; k < n && *bangs > 0; k++) {
+		if (!flags[k]) {
+			flags[k] = 1;
+			(*bangs)--;
+		}
+	}
+	return true;
+}
+
+// count a bang of the event queue as pending; at most n bangs (one per frame of the signal vector of n frames) wait
+static void cm_trigger_bang(long *bangs, long n) {
+	if (*bangs < n) {
+		(*bangs)++;
+	}
+}
+
+// a signal vector which does not reach cm_trigger_scan: drop the pending bangs
+static void cm_trigger_skip(long *bangs) {
+	*bangs = 0;
+}
+
+// get the first trigger frame after the given frame (pass -1 for the first trigger); returns the vector size if there is none
+static long cm_trigger_next(cm_triggerscan *scan, long frame) {
+	uint64_t word;
+	long k = frame + 1;
+	// skip eight frames at a time as long as none of them is flagged
+	while (k < scan->count) {
+		memcpy(&word, scan->flags + k, sizeof(uint64_t));
+		if (word) {
+			break;
+		}
+		k += 8;
+	}
+	while (k < scan->count && !scan->flags[k]) {
+		k++;
+	}
+	return k < scan->count ? k : scan->count;
+}
+
+
+/************************************************************************************************************************/
+/* SIGNAL-RATE GRAIN PARAMETERS (AUDIO THREAD)                                                                          */
+/************************************************************************************************************************/
+// list the signal-connected inlets of the count grain parameters (ins[k] is the input vector of parameter k);
+// the first scaled parameters are multiplied with scale (ms values to samples)
+static inline void cm_sigparams_collect(cm_sigparams *params, const short *connect_status, double **ins, long count, long scaled, double scale) {
+	long k;
+	params->count = 0;
+	for (k = 0; k < count && k < CM_SIGPARAMS_MAX; k++) {
+		if (connect_status[k]) {
+			params->index[params->count] = k;
+			params->in[params->count] = ins[k];
+			params->scale[params->count] = k < scaled ? scale : 1.0;
+			params->count++;
+		}
+	}
+}
+
+// write the signal-connected grain parameters at the given frame into grain_params
+static inline void cm_sigparams_read(const cm_sigparams *params, double *grain_params, long frame) {
+	long k;
+	for (k = 0; k < params->count; k++) {
+		grain_params[params->index[k]] = params->in[k][frame] * params->scale[k];
+	}
+}
+
+#endif
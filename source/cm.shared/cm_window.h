@@ -0,0 +1,197 @@
+/*
+ cm_window.h - internal copy of a window buffer for lock-free window lookups on the audio thread.
+ Copyright (C) 2012 - 2017  Matthias W. Müller - circuit.music.labs
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ info@circuitmusiclabs.com
+
+ */
+
+// NOTE:
+// The grains never read the window buffer~ itself: the first channel of the buffer is copied into a contiguous table
+// of a power-of-two length (resampled with linear interpolation if the buffer length is not a power of two) with one
+// guard value at the end for the interpolation functions which read one frame past the index.
+// The table is built on the main thread (qelem) whenever the window buffer reports a modification or is replaced and
+// handed to the audio thread with the swap states of cm_swap.h (READY: built, RETIRED: the replaced table can be freed).
+// The audio thread neither locks the window buffer nor reads it with the channel stride of the buffer.
+// A table is self-contained: until a newer table is installed the grains keep using the installed one.
+
+#ifndef CM_WINDOW_H
+#define CM_WINDOW_H
+
+#include "ext.h"
+#include "ext_atomic.h"
+#include "buffer.h"
+#include "cm_swap.h"
+
+#define CM_WINDOW_MAXLENGTH 65536 // max table length (longer window buffers are downsampled)
+
+typedef struct cmwindowtable {
+	float *samples; // window values (length + 1 values)
+	long length; // table length (power of two)
+	t_buffer_obj *source; // window buffer the table was built from
+} cm_window_table;
+
+typedef struct cmwindow {
+	cm_window_table *active; // table read by the audio thread
+	cm_window_table *pending; // table built on the main thread, waiting to be installed by the audio thread
+	cm_window_table *retired; // table replaced by the last swap, freed on the main thread
+	t_int32_atomic state; // swap state (see cm_swap.h)
+	t_int32_atomic generation; // incremented with every modification of the window buffer
+	long built; // generation of the last table built on the main thread (-1: none)
+	t_buffer_obj *requested; // window buffer of the last rebuild requested by the audio thread
+} cm_window;
+
+
+/************************************************************************************************************************/
+/* TABLE CONSTRUCTION (MAIN THREAD)                                                                                     */
+/************************************************************************************************************************/
+// free a table
+static void cm_window_table_free(cm_window_table *table) {
+	if (table) {
+		if (table->samples) {
+			sysmem_freeptr(table->samples);
+		}
+		sysmem_freeptr(table);
+	}
+}
+
+// copy the first channel of a window buffer into a new table (NULL if the buffer has no samples)
+// returns false if memory allocation failed
+static t_bool cm_window_table_new(cm_window_table **result, t_buffer_obj *buffer) {
+	cm_window_table *table;
+	float *samples;
+	long frames, channels, length, i, index;
+	double position, fraction, step;
+
+	*result = NULL;
+	samples = buffer ? buffer_locksamples(buffer) : NULL;
+	if (!samples) {
+		return true;
+	}
+	frames = buffer_getframecount(buffer);
+	channels = buffer_getchannelcount(buffer);
+	if (frames < 1) {
+		buffer_unlocksamples(buffer);
+		return true;
+	}
+	for (length = 1; length < frames && length < CM_WINDOW_MAXLENGTH; length <<= 1);
+	table = (cm_window_table *)sysmem_newptrclear(sizeof(cm_window_table));
+	if (table) {
+		table->length = length;
+		table->source = buffer;
+		table->samples = (float *)sysmem_newptr((length + 1) * sizeof(float));
+		if (table->samples == NULL) {
+			cm_window_table_free(table);
+			table = NULL;
+		}
+	}
+	if (table) {
+		step = (double)frames / (double)length; // 1.0 if the buffer length is a power of two (plain copy)
+		for (i = 0; i < length; i++) {
+			position = i * step;
+			index = (long)position;
+			fraction = position - index;
+			if (index + 1 < frames) {
+				table->samples[i] = (float)(samples[index * channels] + fraction * (samples[(index + 1) * channels] - samples[index * channels]));
+			}
+			else {
+				table->samples[i] = samples[index * channels];
+			}
+		}
+		table->samples[length] = samples[(frames - 1) * channels]; // guard value
+	}
+	buffer_unlocksamples(buffer);
+	*result = table;
+	return table ? true : false;
+}
+
+
+/************************************************************************************************************************/
+/* HANDOVER BETWEEN MAIN AND AUDIO THREAD                                                                               */
+/************************************************************************************************************************/
+static void cm_window_init(cm_window *window) {
+	window->active = NULL;
+	window->pending = NULL;
+	window->retired = NULL;
+	window->state = CM_SWAP_IDLE;
+	window->generation = 0;
+	window->built = -1;
+	window->requested = NULL;
+}
+
+// the window buffer was modified or replaced (any thread): the table has to be rebuilt
+static void cm_window_modified(cm_window *window) {
+	ATOMIC_INCREMENT(&window->generation);
+}
+
+// audio thread: request a rebuild if the installed table was not built from the current window buffer
+// (a buffer~ created after the object); returns true if the qelem must be set
+static t_bool cm_window_check(cm_window *window, t_buffer_obj *buffer) {
+	if ((window->active ? window->active->source : NULL) == buffer || window->requested == buffer || window->state != CM_SWAP_IDLE) {
+		return false;
+	}
+	window->requested = buffer;
+	cm_window_modified(window);
+	return true;
+}
+
+// main thread (qelem): free the retired table and build a new one if the window buffer was modified
+// returns false if memory allocation failed
+static t_bool cm_window_update(cm_window *window, t_buffer_obj *buffer) {
+	long generation = window->generation;
+	if (window->state == CM_SWAP_RETIRED) {
+		cm_window_table_free(window->retired);
+		window->retired = NULL;
+		cm_swap_advance(&window->state, CM_SWAP_RETIRED, CM_SWAP_IDLE);
+	}
+	// a modification arriving during a swap is served after it (the audio thread sets the qelem again)
+	if (window->state != CM_SWAP_IDLE || window->built == generation) {
+		return true;
+	}
+	window->pending = NULL;
+	if (!cm_window_table_new(&window->pending, buffer)) {
+		return false; // the grains keep using the installed table
+	}
+	window->built = generation;
+	cm_swap_advance(&window->state, CM_SWAP_IDLE, CM_SWAP_READY);
+	return true;
+}
+
+// audio thread: install the table built on the main thread; scale is the factor from positions in the replaced table
+// to positions in the new table (for grains reading the table while playing); returns true if the retired table has to be freed
+static t_bool cm_window_install(cm_window *window, double *scale) {
+	*scale = 1.0;
+	if (window->state != CM_SWAP_READY) {
+		return false;
+	}
+	if (window->active && window->pending) {
+		*scale = (double)window->pending->length / (double)window->active->length;
+	}
+	window->retired = window->active;
+	window->active = window->pending;
+	window->pending = NULL;
+	return cm_swap_advance(&window->state, CM_SWAP_READY, CM_SWAP_RETIRED);
+}
+
+// free all tables (the qelem must be freed before)
+static void cm_window_free(cm_window *window) {
+	cm_window_table_free(window->active);
+	cm_window_table_free(window->pending);
+	cm_window_table_free(window->retired);
+	cm_window_init(window);
+}
+
+#endif
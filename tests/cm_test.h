@@ -0,0 +1,66 @@
+/*
+ cm_test.h - minimal check macros for the standalone tests of the shared petra headers.
+ Copyright (C) 2012 - 2017  Matthias W. Müller - circuit.music.labs
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ info@circuitmusiclabs.com
+
+ */
+
+#ifndef CM_TEST_H
+#define CM_TEST_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+static long cm_test_failures = 0;
+
+// report a failed check (the test continues, the failures are counted)
+#define CM_CHECK(cond, ...) do { \
+	if (!(cond)) { \
+		printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+		printf(__VA_ARGS__); \
+		printf("\n"); \
+		cm_test_failures++; \
+	} \
+} while (0)
+
+// exit status of the test program
+static int cm_test_result(const char *name) {
+	printf("%s: %s (%ld failures)\n", name, cm_test_failures ? "FAILED" : "ok", cm_test_failures);
+	return cm_test_failures ? 1 : 0;
+}
+
+// reproducible test input (splitmix64), independent of cm_random.h
+static uint64_t cm_test_state = 0x5EED5EEDULL;
+
+static inline uint64_t cm_test_next(void) {
+	uint64_t z = (cm_test_state += 0x9E3779B97F4A7C15ULL);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
+
+// uniform double in [0, 1)
+static inline double cm_test_unit(void) {
+	return (double)(cm_test_next() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// uniform integer in [0, range)
+static inline long cm_test_below(long range) {
+	return (long)(cm_test_next() % (uint64_t)range);
+}
+
+#endif
@@ -0,0 +1,24 @@
+/*
+ buffer.h - host build stand-in for the Max SDK buffer~ interface (tests and benchmarks only).
+ A buffer object is a plain interleaved float array.
+ */
+
+#ifndef CM_TEST_BUFFER_H
+#define CM_TEST_BUFFER_H
+
+#include "ext.h"
+
+typedef struct _buffer_obj {
+	float *samples; // interleaved samples
+	t_atom_long frames; // number of frames
+	t_atom_long channels; // number of channels
+	volatile long locks; // number of buffer_locksamples calls not yet unlocked
+} t_buffer_obj;
+typedef t_object t_buffer_ref;
+
+float *buffer_locksamples(t_buffer_obj *b);
+void buffer_unlocksamples(t_buffer_obj *b);
+t_atom_long buffer_getchannelcount(t_buffer_obj *b);
+t_atom_long buffer_getframecount(t_buffer_obj *b);
+
+#endif
@@ -0,0 +1,43 @@
+/*
+ ext.h - host build stand-in for the subset of the Max SDK used by the shared petra headers (tests and benchmarks only).
+ The externals are always built against the real Max SDK.
+ */
+
+#ifndef CM_TEST_EXT_H
+#define CM_TEST_EXT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef long t_atom_long;
+typedef long t_bool;
+typedef long t_max_err;
+typedef double t_double;
+typedef unsigned long t_ptr_size;
+typedef long t_ptr_int;
+typedef struct _symbol { char *s_name; } t_symbol;
+typedef struct _atom { int a_type; } t_atom;
+typedef struct _object { int o; } t_object;
+typedef void *(*method)(void *, ...);
+
+#ifndef true
+#define true 1
+#endif
+#ifndef false
+#define false 0
+#endif
+#define MAX_ERR_NONE 0
+#define MAX_ERR_GENERIC -1
+
+char *sysmem_newptr(long size);
+char *sysmem_newptrclear(long size);
+char *sysmem_resizeptr(void *p, long size);
+char *sysmem_resizeptrclear(void *p, long size);
+void sysmem_freeptr(void *p);
+void object_post(t_object *x, const char *s, ...);
+void object_error(t_object *x, const char *s, ...);
+unsigned int systime_ms(void);
+void qelem_set(void *q);
+
+#endif
@@ -0,0 +1,19 @@
+/*
+ ext_atomic.h - host build stand-in for the Max SDK atomics (tests and benchmarks only).
+ The barrier variants are full barriers, as in the Max SDK.
+ */
+
+#ifndef CM_TEST_EXT_ATOMIC_H
+#define CM_TEST_EXT_ATOMIC_H
+
+#include <stdint.h>
+
+typedef volatile int32_t t_int32_atomic;
+
+#define ATOMIC_INCREMENT(p) __atomic_add_fetch((int32_t *)(p), 1, __ATOMIC_RELAXED)
+#define ATOMIC_DECREMENT(p) __atomic_sub_fetch((int32_t *)(p), 1, __ATOMIC_RELAXED)
+#define ATOMIC_INCREMENT_BARRIER(p) __atomic_add_fetch((int32_t *)(p), 1, __ATOMIC_SEQ_CST)
+#define ATOMIC_DECREMENT_BARRIER(p) __atomic_sub_fetch((int32_t *)(p), 1, __ATOMIC_SEQ_CST)
+#define ATOMIC_COMPARE_SWAP32(o, n, p) __sync_bool_compare_and_swap((int32_t *)(p), (o), (n))
+
+#endif
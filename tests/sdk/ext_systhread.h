@@ -0,0 +1,28 @@
+/*
+ ext_systhread.h - host build stand-in for the Max SDK thread functions (tests and benchmarks only).
+ */
+
+#ifndef CM_TEST_EXT_SYSTHREAD_H
+#define CM_TEST_EXT_SYSTHREAD_H
+
+#include "ext.h"
+
+typedef void *t_systhread;
+typedef void *t_systhread_mutex;
+typedef void *t_systhread_cond;
+
+long systhread_create(method entryproc, void *arg, long stacksize, long priority, long flags, t_systhread *thread);
+long systhread_join(t_systhread thread, unsigned int *retval);
+void systhread_exit(long status);
+void systhread_sleep(long milliseconds);
+long systhread_mutex_new(t_systhread_mutex *pmutex, long flags);
+long systhread_mutex_free(t_systhread_mutex pmutex);
+long systhread_mutex_lock(t_systhread_mutex pmutex);
+long systhread_mutex_unlock(t_systhread_mutex pmutex);
+long systhread_cond_new(t_systhread_cond *pcondition, long flags);
+long systhread_cond_free(t_systhread_cond pcondition);
+long systhread_cond_wait(t_systhread_cond pcondition, t_systhread_mutex pmutex);
+long systhread_cond_signal(t_systhread_cond pcondition);
+long systhread_cond_broadcast(t_systhread_cond pcondition);
+
+#endif
@@ -0,0 +1,160 @@
+/*
+ maxsdk.c - host build implementation of the Max SDK stand-ins (tests and benchmarks only).
+ */
+
+#include "ext.h"
+#include "ext_systhread.h"
+#include "buffer.h"
+#include <pthread.h>
+#include <stdarg.h>
+#include <time.h>
+#include <unistd.h>
+
+char *sysmem_newptr(long size) {
+	return (char *)malloc(size > 0 ? size : 1);
+}
+
+char *sysmem_newptrclear(long size) {
+	return (char *)calloc(1, size > 0 ? size : 1);
+}
+
+char *sysmem_resizeptr(void *p, long size) {
+	return (char *)realloc(p, size > 0 ? size : 1);
+}
+
+char *sysmem_resizeptrclear(void *p, long size) {
+	return (char *)realloc(p, size > 0 ? size : 1); // the tests never rely on the cleared tail
+}
+
+void sysmem_freeptr(void *p) {
+	free(p);
+}
+
+void object_post(t_object *x, const char *s, ...) {
+	va_list args;
+	va_start(args, s);
+	vprintf(s, args);
+	va_end(args);
+	printf("\n");
+}
+
+void object_error(t_object *x, const char *s, ...) {
+	va_list args;
+	va_start(args, s);
+	printf("error: ");
+	vprintf(s, args);
+	va_end(args);
+	printf("\n");
+}
+
+void qelem_set(void *q) { // the tests pass a counter as the qelem
+	if (q) {
+		__sync_add_and_fetch((long *)q, 1);
+	}
+}
+
+unsigned int systime_ms(void) {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (unsigned int)(t.tv_sec * 1000 + t.tv_nsec / 1000000);
+}
+
+long systhread_create(method entryproc, void *arg, long stacksize, long priority, long flags, t_systhread *thread) {
+	pthread_t *t = (pthread_t *)malloc(sizeof(pthread_t));
+	if (t == NULL || pthread_create(t, NULL, (void *(*)(void *))entryproc, arg) != 0) {
+		free(t);
+		return 1;
+	}
+	*thread = t;
+	return 0;
+}
+
+long systhread_join(t_systhread thread, unsigned int *retval) {
+	pthread_join(*(pthread_t *)thread, NULL);
+	free(thread);
+	if (retval) {
+		*retval = 0;
+	}
+	return 0;
+}
+
+void systhread_exit(long status) {
+}
+
+void systhread_sleep(long milliseconds) {
+	usleep(milliseconds * 1000);
+}
+
+long systhread_mutex_new(t_systhread_mutex *pmutex, long flags) {
+	pthread_mutex_t *mutex = (pthread_mutex_t *)malloc(sizeof(pthread_mutex_t));
+	if (mutex == NULL || pthread_mutex_init(mutex, NULL) != 0) {
+		free(mutex);
+		return 1;
+	}
+	*pmutex = mutex;
+	return 0;
+}
+
+long systhread_mutex_free(t_systhread_mutex pmutex) {
+	pthread_mutex_destroy((pthread_mutex_t *)pmutex);
+	free(pmutex);
+	return 0;
+}
+
+long systhread_mutex_lock(t_systhread_mutex pmutex) {
+	return pthread_mutex_lock((pthread_mutex_t *)pmutex);
+}
+
+long systhread_mutex_unlock(t_systhread_mutex pmutex) {
+	return pthread_mutex_unlock((pthread_mutex_t *)pmutex);
+}
+
+long systhread_cond_new(t_systhread_cond *pcondition, long flags) {
+	pthread_cond_t *cond = (pthread_cond_t *)malloc(sizeof(pthread_cond_t));
+	if (cond == NULL || pthread_cond_init(cond, NULL) != 0) {
+		free(cond);
+		return 1;
+	}
+	*pcondition = cond;
+	return 0;
+}
+
+long systhread_cond_free(t_systhread_cond pcondition) {
+	pthread_cond_destroy((pthread_cond_t *)pcondition);
+	free(pcondition);
+	return 0;
+}
+
+long systhread_cond_wait(t_systhread_cond pcondition, t_systhread_mutex pmutex) {
+	return pthread_cond_wait((pthread_cond_t *)pcondition, (pthread_mutex_t *)pmutex);
+}
+
+long systhread_cond_signal(t_systhread_cond pcondition) {
+	return pthread_cond_signal((pthread_cond_t *)pcondition);
+}
+
+long systhread_cond_broadcast(t_systhread_cond pcondition) {
+	return pthread_cond_broadcast((pthread_cond_t *)pcondition);
+}
+
+float *buffer_locksamples(t_buffer_obj *b) {
+	if (b && b->samples) {
+		__sync_add_and_fetch(&b->locks, 1);
+		return b->samples;
+	}
+	return NULL;
+}
+
+void buffer_unlocksamples(t_buffer_obj *b) {
+	if (b && b->samples) {
+		__sync_sub_and_fetch(&b->locks, 1);
+	}
+}
+
+t_atom_long buffer_getchannelcount(t_buffer_obj *b) {
+	return b ? b->channels : 0;
+}
+
+t_atom_long buffer_getframecount(t_buffer_obj *b) {
+	return b ? b->frames : 0;
+}
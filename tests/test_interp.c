@@ -0,0 +1,226 @@
+/*
+ test_interp.c - standalone test of the interpolation tables (cm_interp.h) and the fixed point read position (cm_render.h).
+ Copyright (C) 2012 - 2017  Matthias W. Müller - circuit.music.labs
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ info@circuitmusiclabs.com
+
+ */
+
+// 1. Every row of the hermite, lagrange and sinc tables must hold the closed-form kernel at the row's fractional
+//    position, rounded to float (the kernels below are written independently of cm_interp_init).
+// 2. The 32.32 fixed point read position must stay at most (n + 1) * 2^-32 frames below the exact position
+//    start + n * span / count, also after 1e6 samples.
+// 3. Rendered grains must match the former double math (position computed per sample, cm_lininterp and
+//    cm_interp_buffer) within that position error: linear output by at most twice the position error plus float
+//    rounding, FIR output rounded to float, with the coefficient row of either end of the position error (the rows
+//    differ only where the position error crosses a row boundary).
+
+#include "cm_test.h"
+#include "cm_render.h"
+#include <math.h>
+
+#define GRAINS 40
+#define MAXCOUNT 200000
+#define MAXPITCH 8.0
+#define FRAMES (long)(MAXCOUNT * MAXPITCH + 64)
+
+static const double pi = 3.14159265358979323846;
+
+
+/************************************************************************************************************************/
+/* 1. COEFFICIENT TABLES                                                                                                */
+/************************************************************************************************************************/
+// Catmull-Rom kernel at distance x from the read position
+static double kernel_hermite(double x) {
+	x = fabs(x);
+	if (x < 1.0) {
+		return 1.5 * x * x * x - 2.5 * x * x + 1.0;
+	}
+	if (x < 2.0) {
+		return -0.5 * x * x * x + 2.5 * x * x - 4.0 * x + 2.0;
+	}
+	return 0.0;
+}
+
+// Lagrange basis polynomial of the tap at node (nodes -2 ... 3) at fractional position f
+static double kernel_lagrange(long node, double f) {
+	double c = 1.0;
+	long m;
+	for (m = -2; m <= 3; m++) {
+		if (m != node) {
+			c *= (f - (double)m) / (double)(node - m);
+		}
+	}
+	return c;
+}
+
+// Blackman windowed sinc of taps points at distance x from the read position (not normalized)
+static double kernel_sinc(double x, long taps) {
+	double s = x == 0.0 ? 1.0 : sin(pi * x) / (pi * x);
+	return s * (0.42 + 0.5 * cos(2.0 * pi * x / (double)taps) + 0.08 * cos(4.0 * pi * x / (double)taps));
+}
+
+static void check_table(const cm_interp_table *table, const char *name) {
+	double exact[CM_SINC_MAXTAPS];
+	double f, sum, error, maxerror = 0.0;
+	long p, t;
+	for (p = 0; p <= CM_INTERP_PHASES; p++) {
+		f = (double)p / (double)CM_INTERP_PHASES;
+		sum = 0.0;
+		for (t = 0; t < table->taps; t++) {
+			if (table == &cm_interp_hermite) {
+				exact[t] = kernel_hermite((double)(table->offset + t) - f);
+			}
+			else if (table == &cm_interp_lagrange) {
+				exact[t] = kernel_lagrange(table->offset + t, f);
+			}
+			else {
+				exact[t] = kernel_sinc((double)(table->offset + t) - f, table->taps);
+				sum += exact[t];
+			}
+		}
+		for (t = 0; t < table->taps; t++) {
+			if (sum != 0.0) {
+				exact[t] /= sum; // unity gain
+			}
+			error = fabs((double)table->coef[p * table->taps + t] - exact[t]);
+			if (error > maxerror) {
+				maxerror = error;
+			}
+			if (error > fabs(exact[t]) * 0x1.0001p-24 + 1e-13) {
+				CM_CHECK(false, "%s: row %ld, tap %ld is %.9g, expected %.9g", name, p, t, table->coef[p * table->taps + t], exact[t]);
+				return;
+			}
+		}
+	}
+	printf("%s table: max error %.2g\n", name, maxerror);
+}
+
+static void test_tables(void) {
+	check_table(&cm_interp_hermite, "hermite");
+	check_table(&cm_interp_lagrange, "lagrange");
+	check_table(&cm_interp_sinc8, "sinc 8");
+	check_table(&cm_interp_sinc16, "sinc 16");
+	check_table(&cm_interp_sinc32, "sinc 32");
+}
+
+
+/************************************************************************************************************************/
+/* 2. FIXED POINT READ POSITION                                                                                         */
+/************************************************************************************************************************/
+static void test_position(void) {
+	long double exact, error, maxerror = 0.0;
+	double start, span;
+	cm_phase phase, incr;
+	long grain, count, n;
+	for (grain = 0; grain < 20; grain++) {
+		count = 1000000;
+		span = count * (0.05 + MAXPITCH * cm_test_unit());
+		start = 1000.0 * cm_test_unit();
+		phase = cm_phase_from(start);
+		incr = cm_phase_from(span / count);
+		for (n = 0; n < count; n++) {
+			exact = (long double)start + (long double)n * ((long double)span / (long double)count);
+			error = exact - (long double)phase / (long double)CM_PHASE_ONE;
+			if (error > maxerror) {
+				maxerror = error;
+			}
+			// double precision reference on platforms without extended long double
+			if (error < -exact * 0x1p-52 || error > (n + 1) * 0x1p-32 + exact * 0x1p-52) {
+				CM_CHECK(false, "grain %ld: position %ld off by %Lg frames", grain, n, error);
+				break;
+			}
+			phase += incr;
+		}
+	}
+	printf("position: max error %.2Lg frames after 1e6 samples\n", maxerror);
+}
+
+
+/************************************************************************************************************************/
+/* 3. RENDERED GRAINS                                                                                                   */
+/************************************************************************************************************************/
+// the former double math of the linear mode (cm_lininterp)
+static double lininterp(double distance, const float *src, long channels, long frames, long channel) {
+	long index = (long)distance;
+	long next = index + 1 > frames ? 0 : index + 1;
+	double frac = distance - (double)index;
+	return src[index * channels + channel] + frac * (src[next * channels + channel] - src[index * channels + channel]);
+}
+
+static void test_render(void) {
+	static const long modes[] = {CM_INTERP_LINEAR, CM_INTERP_HERMITE, CM_INTERP_LAGRANGE, CM_INTERP_SINC, CM_INTERP_SINC, CM_INTERP_SINC};
+	static const long sinctaps[] = {0, 0, 0, 8, 16, 32};
+	float *src, *out;
+	double start, span, position, bound, lower, upper, value, error;
+	double maxerror[6] = {0.0};
+	long grain, mode, count, channels, channel, k;
+	const cm_interp_table *fir;
+
+	src = (float *)malloc(sizeof(float) * (FRAMES + 1) * 2);
+	out = (float *)malloc(sizeof(float) * MAXCOUNT);
+	for (grain = 0; grain < GRAINS; grain++) {
+		channels = 1 + cm_test_below(2);
+		channel = cm_test_below(channels);
+		for (k = 0; k < (FRAMES + 1) * channels; k++) {
+			src[k] = (float)(2.0 * cm_test_unit() - 1.0); // noise: the largest differences between neighbouring rows
+		}
+		count = 1 + cm_test_below(MAXCOUNT);
+		span = count * (0.05 + MAXPITCH * cm_test_unit());
+		start = (FRAMES - 2 - span) * cm_test_unit();
+		for (mode = 0; mode < 6; mode++) {
+			fir = cm_interp_select(modes[mode], sinctaps[mode]);
+			cm_render_scalar_kernels.buffer[cm_render_kind(modes[mode])][0](out, NULL, src, channels, channel, FRAMES, cm_phase_from(start), cm_phase_from(span / count), count, fir);
+			for (k = 0; k < count; k++) {
+				position = start + ((double)k / (double)count) * span; // the former per-sample position
+				bound = (k + 1) * 0x1p-32 + position * 0x1p-51;
+				if (fir == NULL) {
+					value = lininterp(position, src, channels, FRAMES, channel);
+					error = fabs(out[k] - value);
+					if (error > 2.0 * bound + fabs(value) * 0x1p-24 + 0x1p-23) { // cm_lininterp rounds the difference of the samples to float
+						CM_CHECK(false, "linear: grain %ld, sample %ld differs by %g", grain, k, error);
+						break;
+					}
+				}
+				else {
+					lower = cm_interp_buffer(fir, position - bound, src, channels, FRAMES, channel);
+					upper = cm_interp_buffer(fir, position + bound, src, channels, FRAMES, channel);
+					error = fabs(out[k] - upper) < fabs(out[k] - lower) ? fabs(out[k] - upper) : fabs(out[k] - lower);
+					if (error > fabs(upper) * 0x1p-24 + fabs(lower) * 0x1p-24 + 1e-12) {
+						CM_CHECK(false, "mode %ld, taps %ld: grain %ld, sample %ld differs by %g", modes[mode], sinctaps[mode], grain, k, error);
+						break;
+					}
+					error = fabs(out[k] - cm_interp_buffer(fir, position, src, channels, FRAMES, channel));
+				}
+				if (error > maxerror[mode]) {
+					maxerror[mode] = error;
+				}
+			}
+		}
+	}
+	printf("linear: max difference %.2g\n", maxerror[0]);
+	printf("hermite, lagrange, sinc 8/16/32: max difference %.2g, %.2g, %.2g/%.2g/%.2g\n", maxerror[1], maxerror[2], maxerror[3], maxerror[4], maxerror[5]);
+	free(src);
+	free(out);
+}
+
+int main(void) {
+	cm_interp_init();
+	test_tables();
+	test_position();
+	test_render();
+	return cm_test_result("test_interp");
+}
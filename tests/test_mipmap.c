@@ -0,0 +1,205 @@
+/*
+ test_mipmap.c - standalone test of the source pyramid worker (cm_mipmap.h).
+ Copyright (C) 2012 - 2017  Matthias W. Müller - circuit.music.labs
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ info@circuitmusiclabs.com
+
+ */
+
+// The main thread (as the qelem of the objects) passes a sample buffer to the worker, the audio thread is played by
+// installing the pyramids handed over. Every pyramid must equal the pyramid decimated in one piece (the chunks of level 1
+// join without seams) and belong to the generation it claims.
+// 1. build      cm_mipmap_update returns before the build starts, the pyramid of the buffer is handed over later
+// 2. stream     100 modifications 5 ms apart (record~ writing into the buffer) are coalesced into a few builds, the
+//               last pyramid belongs to the last generation
+// 3. abandon    a modification during the build of a long buffer: the outdated pyramid is never handed over
+// 4. release    cm_mipmap_release during the build of a long buffer returns without waiting for the build, and the
+//               buffer is neither locked nor read afterwards
+// 5. finish     the deterministic build on the main thread takes over from the worker, the pyramid is ready on return
+// 6. disable    no pyramid is handed over when the attribute is off
+
+#include "cm_test.h"
+#include "cm_mipmap.h"
+#include <unistd.h>
+
+#define FRAMES 200001 // short buffer: several chunks of level 1, odd frame counts on every level
+#define LONGFRAMES 6000000 // long buffer: the build takes much longer than a chunk
+#define CHANNELS 3 // two decimated channels, the stride of the sample buffer differs from the copies
+#define TIMEOUT 20000 // ms
+
+static long qelems; // qelem_set calls of the worker
+
+static void fill(t_buffer_obj *buffer, long frames) {
+	long k;
+	buffer->frames = frames;
+	buffer->channels = CHANNELS;
+	buffer->locks = 0;
+	buffer->samples = (float *)malloc(sizeof(float) * frames * CHANNELS);
+	for (k = 0; k < frames * CHANNELS; k++) {
+		buffer->samples[k] = (float)(2.0 * cm_test_unit() - 1.0);
+	}
+}
+
+// the pyramid decimated in one piece
+static cm_mipmap_pyramid *reference(t_buffer_obj *buffer, long generation) {
+	cm_mipmap_pyramid *pyramid = cm_mipmap_pyramid_alloc(buffer->frames, buffer->channels, generation);
+	double coef[CM_MIPMAP_HALF + 1];
+	long level;
+	cm_mipmap_coefficients(coef);
+	for (level = 1; level < pyramid->levels; level++) {
+		if (level == 1) {
+			cm_mipmap_decimate(pyramid->samples[1], pyramid->channels, buffer->samples, buffer->channels, buffer->frames, pyramid->channels, coef, 0, pyramid->frames[1]);
+		}
+		else {
+			cm_mipmap_decimate(pyramid->samples[level], pyramid->channels, pyramid->samples[level - 1], pyramid->channels, pyramid->frames[level - 1], pyramid->channels, coef, 0, pyramid->frames[level]);
+		}
+	}
+	return pyramid;
+}
+
+// the pyramid handed over equals the reference of the buffer
+static void compare(const cm_mipmap_pyramid *pyramid, t_buffer_obj *buffer, long generation, const char *mode) {
+	cm_mipmap_pyramid *expected = reference(buffer, generation);
+	long level;
+	CM_CHECK(pyramid != NULL, "%s: no pyramid", mode);
+	if (pyramid) {
+		CM_CHECK(pyramid->generation == generation, "%s: pyramid of generation %ld handed over, expected %ld", mode, pyramid->generation, generation);
+		CM_CHECK(pyramid->levels == expected->levels && pyramid->channels == expected->channels, "%s: %ld levels of %ld channels", mode, pyramid->levels, pyramid->channels);
+		for (level = 1; level < pyramid->levels && level < expected->levels; level++) {
+			CM_CHECK(pyramid->frames[level] == expected->frames[level] && !memcmp(pyramid->samples[level], expected->samples[level], (expected->frames[level] + 1) * expected->channels * sizeof(float)), "%s: level %ld differs from the pyramid decimated in one piece", mode, level);
+		}
+	}
+	cm_mipmap_pyramid_free(expected);
+}
+
+// wait until a pyramid is handed over; returns false after TIMEOUT ms
+static t_bool wait_ready(cm_mipmap *mipmap) {
+	long waited;
+	for (waited = 0; waited < TIMEOUT && mipmap->state != CM_SWAP_READY; waited++) {
+		usleep(1000);
+	}
+	return mipmap->state == CM_SWAP_READY;
+}
+
+// wait until the worker reads the buffer; returns false after TIMEOUT ms
+static t_bool wait_busy(cm_mipmap *mipmap, t_buffer_obj *buffer) {
+	long waited;
+	for (waited = 0; waited < TIMEOUT * 10 && !(mipmap->busy && buffer->locks); waited++) {
+		usleep(100);
+	}
+	return mipmap->busy && buffer->locks;
+}
+
+// the audio thread installs the pyramid, the qelem frees the retired one
+static void swap(cm_mipmap *mipmap, t_buffer_obj *buffer, t_bool enabled) {
+	cm_mipmap_install(mipmap);
+	cm_mipmap_update(mipmap, buffer, enabled);
+}
+
+int main(void) {
+	cm_mipmap mipmap;
+	t_buffer_obj buffer, longbuffer;
+	unsigned int start, elapsed, build;
+	cm_mipmap_pyramid *pyramid;
+	long k, handovers, generation;
+
+	fill(&buffer, FRAMES);
+	fill(&longbuffer, LONGFRAMES);
+	cm_mipmap_init(&mipmap, &qelems);
+
+	// 1. build
+	cm_mipmap_modified(&mipmap);
+	CM_CHECK(cm_mipmap_update(&mipmap, &buffer, true), "build: update failed");
+	CM_CHECK(mipmap.thread != NULL, "build: no worker thread");
+	CM_CHECK(mipmap.state == CM_SWAP_IDLE && !buffer.locks, "build: the buffer was read before the update returned");
+	CM_CHECK(wait_ready(&mipmap), "build: no pyramid handed over");
+	compare(mipmap.pending, &buffer, mipmap.generation, "build");
+	CM_CHECK(buffer.locks == 0, "build: buffer left locked");
+	swap(&mipmap, &buffer, true);
+	CM_CHECK(mipmap.active && mipmap.state == CM_SWAP_IDLE, "build: pyramid not installed");
+
+	// 2. stream
+	handovers = 0;
+	for (k = 0; k < 100; k++) {
+		buffer.samples[cm_test_below(FRAMES * CHANNELS)] = (float)cm_test_unit();
+		cm_mipmap_modified(&mipmap);
+		cm_mipmap_update(&mipmap, &buffer, true);
+		if (mipmap.state == CM_SWAP_READY) { // the buffer was quiet for a moment (a slow machine)
+			handovers++;
+			swap(&mipmap, &buffer, true);
+		}
+		usleep(5000);
+	}
+	CM_CHECK(handovers <= 10, "stream: %ld pyramids handed over for 100 modifications", handovers);
+	CM_CHECK(wait_ready(&mipmap), "stream: no pyramid after the last modification");
+	compare(mipmap.pending, &buffer, mipmap.generation, "stream");
+	swap(&mipmap, &buffer, true);
+
+	// 3. abandon
+	cm_mipmap_modified(&mipmap);
+	cm_mipmap_update(&mipmap, &longbuffer, true);
+	CM_CHECK(wait_busy(&mipmap, &longbuffer), "abandon: the worker does not read the buffer");
+	longbuffer.samples[0] = 0.5f;
+	cm_mipmap_modified(&mipmap);
+	cm_mipmap_update(&mipmap, &longbuffer, true);
+	generation = mipmap.generation;
+	CM_CHECK(wait_ready(&mipmap), "abandon: no pyramid handed over");
+	compare(mipmap.pending, &longbuffer, generation, "abandon");
+	swap(&mipmap, &longbuffer, true);
+
+	// 4. release
+	start = systime_ms();
+	pyramid = reference(&longbuffer, 0);
+	build = systime_ms() - start;
+	cm_mipmap_pyramid_free(pyramid);
+	cm_mipmap_modified(&mipmap);
+	cm_mipmap_update(&mipmap, &longbuffer, true);
+	CM_CHECK(wait_busy(&mipmap, &longbuffer), "release: the worker does not read the buffer");
+	start = systime_ms();
+	cm_mipmap_release(&mipmap);
+	elapsed = systime_ms() - start;
+	CM_CHECK(!mipmap.busy && longbuffer.locks == 0 && mipmap.buffer == NULL, "release: the buffer is still read");
+	CM_CHECK(elapsed * 4 <= build, "release: waited %u ms, the whole build takes %u ms", elapsed, build);
+	free(longbuffer.samples); // the buffer~ is gone
+	longbuffer.samples = NULL;
+	longbuffer.frames = 0;
+	CM_CHECK(wait_ready(&mipmap), "release: no handover without buffer");
+	CM_CHECK(mipmap.pending == NULL, "release: pyramid of a released buffer handed over");
+	swap(&mipmap, NULL, true);
+
+	// 5. finish
+	cm_mipmap_modified(&mipmap);
+	cm_mipmap_update(&mipmap, &buffer, true);
+	CM_CHECK(cm_mipmap_finish(&mipmap, &buffer, true), "finish: build failed");
+	CM_CHECK(mipmap.state == CM_SWAP_READY, "finish: no pyramid on return");
+	compare(mipmap.pending, &buffer, mipmap.generation, "finish");
+	swap(&mipmap, &buffer, true);
+	usleep((CM_MIPMAP_QUIET + 50) * 1000);
+	CM_CHECK(mipmap.state == CM_SWAP_IDLE, "finish: the worker built the same generation again");
+
+	// 6. disable
+	cm_mipmap_update(&mipmap, &buffer, false);
+	CM_CHECK(wait_ready(&mipmap), "disable: nothing handed over");
+	CM_CHECK(mipmap.pending == NULL, "disable: pyramid handed over");
+	swap(&mipmap, &buffer, false);
+	CM_CHECK(mipmap.active == NULL && mipmap.state == CM_SWAP_IDLE, "disable: pyramid still installed");
+
+	CM_CHECK(qelems == 0, "%ld failed builds reported", qelems);
+	cm_mipmap_free(&mipmap);
+	CM_CHECK(mipmap.thread == NULL && buffer.locks == 0, "worker not ended");
+	free(buffer.samples);
+	return cm_test_result("test_mipmap");
+}
@@ -0,0 +1,206 @@
+/*
+ test_queue.c - multi-producer stress test of the message queue (cm_queue.h).
+ Copyright (C) 2012 - 2017  Matthias W. Müller - circuit.music.labs
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ info@circuitmusiclabs.com
+
+ */
+
+// PRODUCERS threads (as the main and the scheduler thread of Max) push events and set float inlet values as fast as
+// they can, while the consumer (as the audio thread) drains the queue once per "signal vector", sometimes late enough
+// for the ring to overflow. The counters start close to the 32 bit boundaries, so they wrap around during the run.
+// 1. The events of every producer must arrive complete and in the order they were pushed, every event which was
+//    accepted must arrive and the overflow must be reported once per overflow.
+// 2. Every float inlet value set read by the consumer must be a set one producer has written (producer p writes its
+//    inlet 2p and then 2p + 1 with the same value), the values never go back, and the last values are never lost.
+// 3. In the bang run the consumer handles the events as the perform routines do (cm_trigger_bang, then cm_trigger_scan
+//    of a trigger signal without triggers), but every fourth stretch of vectors has no buffer (cm_trigger_skip). At most
+//    one bang per frame may wait, a vector without buffer leaves no bang behind, and the first vector after the buffer
+//    is back fires only the bangs which arrived with it.
+
+#include "cm_test.h"
+#include "cm_queue.h"
+#include "cm_trigger.h"
+#include <pthread.h>
+#include <unistd.h>
+
+#define PRODUCERS 3
+#define MESSAGES 400000 // per producer
+#define VECTOR 64 // frames per signal vector (bang run)
+#define STRETCH 32 // vectors per stretch with or without buffer (bang run)
+
+typedef struct producer {
+	long id;
+	long pushed; // accepted events
+	long dropped; // refused events
+	long reports; // overflows reported
+} producer;
+
+static cm_queue queue;
+static double inlets[2 * PRODUCERS]; // the objects' float inlet values (written by the producers only)
+static volatile long finished;
+static long type; // event type pushed by the producers
+
+static void *produce(void *arg) {
+	producer *p = (producer *)arg;
+	cm_event event;
+	t_bool report;
+	long i, k;
+	for (i = 1; i <= MESSAGES; i++) {
+		memset(&event, 0, sizeof(cm_event));
+		event.type = type;
+		event.index = p->id;
+		event.frame = p->pushed; // sequence number of the accepted events
+		for (k = 0; k < CM_EVENT_VALUES; k++) {
+			event.values[k] = (double)(p->pushed * CM_EVENT_VALUES + k);
+		}
+		if (cm_queue_push(&queue, &event, &report)) {
+			p->pushed++;
+		}
+		else {
+			p->dropped++;
+		}
+		p->reports += report ? 1 : 0;
+		cm_queue_param(&queue, inlets, 2 * PRODUCERS, 2 * p->id, (double)i);
+		cm_queue_param(&queue, inlets, 2 * PRODUCERS, 2 * p->id + 1, (double)i);
+	}
+	__sync_add_and_fetch(&finished, 1);
+	return NULL;
+}
+
+static void run(int32_t start, long event_type, const char *mode) {
+	pthread_t threads[PRODUCERS];
+	producer producers[PRODUCERS];
+	double initial[2 * PRODUCERS] = {0.0};
+	double last[2 * PRODUCERS] = {0.0};
+	long received[PRODUCERS] = {0};
+	long vectors = 0, events = 0, drops = 0, reports = 0, torn = 0;
+	long i, k, n, id;
+	long bangs = 0, arrived, pending, triggered, fired = 0, skipped = 0, frame;
+	double signal[VECTOR] = {0.0};
+	double tr_prev = 0.0;
+	t_bool done, stalled = false;
+	const cm_event *event;
+	const double *values;
+	cm_triggerscan scan = {NULL, 0, 0};
+
+	CM_CHECK(cm_queue_init(&queue, initial, 2 * PRODUCERS), "%s: no mutex", mode);
+	CM_CHECK(cm_trigger_resize(&scan, VECTOR), "%s: allocation failed", mode);
+	type = event_type;
+	queue.head = start;
+	queue.tail = start;
+	memset(inlets, 0, sizeof(inlets));
+	finished = 0;
+	for (i = 0; i < PRODUCERS; i++) {
+		producers[i].id = i;
+		producers[i].pushed = producers[i].dropped = producers[i].reports = 0;
+		pthread_create(&threads[i], NULL, produce, &producers[i]);
+	}
+
+	do {
+		done = finished == PRODUCERS;
+		// events
+		n = cm_queue_count(&queue);
+		CM_CHECK(n >= 0 && n <= CM_QUEUE_SIZE, "%s: %ld events waiting", mode, n);
+		arrived = 0;
+		for (k = 0; k < n; k++) {
+			event = cm_queue_event(&queue, k);
+			id = event->index;
+			if (event->type == CM_EVENT_BANG) {
+				cm_trigger_bang(&bangs, VECTOR);
+				arrived++;
+			}
+			if (id < 0 || id >= PRODUCERS || event->frame != received[id]) {
+				CM_CHECK(false, "%s: event %ld of producer %ld out of order (expected %ld)", mode, event->frame, id, id >= 0 && id < PRODUCERS ? received[id] : -1);
+				break;
+			}
+			for (i = 0; i < CM_EVENT_VALUES; i++) {
+				if (event->values[i] != (double)(event->frame * CM_EVENT_VALUES + i)) {
+					CM_CHECK(false, "%s: event %ld of producer %ld incomplete", mode, event->frame, id);
+					break;
+				}
+			}
+			received[id]++;
+			events++;
+		}
+		cm_queue_release(&queue, n);
+		// bangs
+		if (event_type == CM_EVENT_BANG) {
+			CM_CHECK(bangs <= VECTOR, "%s: %ld bangs waiting for a vector of %d frames", mode, bangs, VECTOR);
+			if ((vectors / STRETCH) % 4 == 3) { // no buffer: the vector does not reach the trigger scan
+				cm_trigger_skip(&bangs);
+				CM_CHECK(bangs == 0, "%s: bangs left behind by a vector without buffer", mode);
+				skipped += arrived;
+				stalled = true;
+			}
+			else {
+				pending = bangs;
+				CM_CHECK(!stalled || pending <= arrived, "%s: %ld bangs fired after the buffer came back, %ld arrived", mode, pending, arrived);
+				CM_CHECK(cm_trigger_scan(&scan, signal, VECTOR, &tr_prev, 0, &bangs), "%s: vector refused", mode);
+				triggered = 0;
+				for (frame = cm_trigger_next(&scan, -1); frame < VECTOR; frame = cm_trigger_next(&scan, frame)) {
+					triggered++;
+				}
+				CM_CHECK(bangs == 0 && triggered == pending, "%s: %ld of %ld bangs fired in a vector without signal triggers", mode, triggered, pending);
+				fired += triggered;
+				stalled = false;
+			}
+		}
+		// float inlets
+		values = cm_queue_params(&queue);
+		for (i = 0; i < PRODUCERS; i++) {
+			if (values[2 * i + 1] != values[2 * i] && values[2 * i + 1] != values[2 * i] - 1.0) {
+				torn++;
+			}
+			CM_CHECK(values[2 * i] >= last[2 * i] && values[2 * i + 1] >= last[2 * i + 1], "%s: inlet value of producer %ld went back", mode, i);
+			last[2 * i] = values[2 * i];
+			last[2 * i + 1] = values[2 * i + 1];
+		}
+		vectors++;
+		usleep(vectors % 64 ? 20 : 2000); // now and then a late vector: the ring overflows
+	} while (!done || cm_queue_count(&queue));
+
+	for (i = 0; i < PRODUCERS; i++) {
+		pthread_join(threads[i], NULL);
+		CM_CHECK(received[i] == producers[i].pushed, "%s: producer %ld: %ld events accepted, %ld received", mode, i, producers[i].pushed, received[i]);
+		CM_CHECK(producers[i].pushed + producers[i].dropped == MESSAGES, "%s: producer %ld lost track of events", mode, i);
+		drops += producers[i].dropped;
+		reports += producers[i].reports;
+	}
+	CM_CHECK(torn == 0, "%s: %ld torn inlet value sets", mode, torn);
+	CM_CHECK(reports <= drops && (drops == 0 || reports > 0), "%s: %ld overflows reported for %ld dropped events", mode, reports, drops);
+	values = cm_queue_params(&queue);
+	for (i = 0; i < 2 * PRODUCERS; i++) {
+		CM_CHECK(values[i] == (double)MESSAGES, "%s: last value of inlet %ld lost (%g)", mode, i, values[i]);
+	}
+	CM_CHECK((uint32_t)(queue.head - start) == (uint32_t)events, "%s: head counter off after the wrap", mode);
+	if (event_type == CM_EVENT_BANG) {
+		CM_CHECK(fired + skipped <= events && fired > 0 && skipped > 0, "%s: %ld bangs fired and %ld skipped of %ld", mode, fired, skipped, events);
+		printf("%s: %ld vectors, %ld bangs, %ld fired, %ld dropped without buffer, %ld dropped (%ld overflows)\n", mode, vectors, events, fired, skipped, drops, reports);
+	}
+	else {
+		printf("%s: %ld vectors, %ld events, %ld dropped (%ld overflows)\n", mode, vectors, events, drops, reports);
+	}
+	cm_trigger_free(&scan);
+	cm_queue_free(&queue);
+}
+
+int main(void) {
+	run(INT32_MAX - 1000, CM_EVENT_GRAIN, "signed wrap");
+	run(-1000, CM_EVENT_GRAIN, "unsigned wrap");
+	run(0, CM_EVENT_BANG, "bangs");
+	return cm_test_result("test_queue");
+}
@@ -0,0 +1,279 @@
+/*
+ test_render.c - standalone test of the grain render kernels (cm_render.h) and of the deterministic render pipeline.
+ Copyright (C) 2012 - 2017  Matthias W. Müller - circuit.music.labs
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ info@circuitmusiclabs.com
+
+ */
+
+// 1. Every kernel implementation the CPU supports (SSE2, AVX2, AVX-512) must write bit-identical grain samples to the
+//    scalar kernels, for every kernel kind, with and without window multiply, for buffers and ringbuffers and for
+//    grain lengths which are not multiples of the vector width.
+// 2. A small grain cloud built from the deterministic parts of the objects (seeded generator, parameter distributions,
+//    prefilled slab pool, window and source render passes, pan/gain mix) is rendered twice from the same seed and once
+//    with every kernel implementation: all outputs must be bit-identical.
+// Implementations the CPU does not support are reported as skipped.
+
+#include "cm_test.h"
+#include "cm_render.h"
+#include "cm_slab.h"
+#include "cm_distrib.h"
+#include <math.h>
+
+#define TRIALS 400
+#define MAXCOUNT 700
+#define KINDS 7 // nearest, linear, hermite, lagrange, sinc 8, sinc 16, sinc 32
+
+typedef struct kernelset {
+	const char *name;
+	const cm_render_kernels *kernels;
+} kernelset;
+
+static kernelset sets[4];
+static long setcount = 0;
+
+static void find_kernels(void) {
+	sets[setcount].name = "scalar";
+	sets[setcount++].kernels = &cm_render_scalar_kernels;
+#ifdef CM_RENDER_X86
+	sets[setcount].name = "sse2";
+	sets[setcount++].kernels = &cm_render_sse2_kernels;
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		sets[setcount].name = "avx2";
+		sets[setcount++].kernels = &cm_render_avx2_kernels;
+	}
+	else {
+		printf("avx2 kernels: skipped (not supported by this CPU)\n");
+	}
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("avx512f")) {
+		sets[setcount].name = "avx512";
+		sets[setcount++].kernels = &cm_render_avx512_kernels;
+	}
+	else {
+		printf("avx512 kernels: skipped (not supported by this CPU)\n");
+	}
+#else
+	printf("vector kernels: skipped (not an x86 build)\n");
+#endif
+}
+
+// interpolation mode and sinc taps of a test kind
+static void kind_mode(long kind, long *interp, long *taps) {
+	static const long modes[KINDS] = {CM_INTERP_OFF, CM_INTERP_LINEAR, CM_INTERP_HERMITE, CM_INTERP_LAGRANGE, CM_INTERP_SINC, CM_INTERP_SINC, CM_INTERP_SINC};
+	static const long sinctaps[KINDS] = {0, 0, 0, 0, 8, 16, 32};
+	*interp = modes[kind];
+	*taps = sinctaps[kind];
+}
+
+
+/************************************************************************************************************************/
+/* 1. KERNEL IMPLEMENTATIONS                                                                                            */
+/************************************************************************************************************************/
+static void test_kernels(void) {
+	float *src, *mul, *expected, *out;
+	double *ring;
+	long trial, kind, scale, set, k;
+	long frames, channels, channel, count, interp, taps, ringframes;
+	double start, span;
+	cm_phase phase, incr;
+	const cm_interp_table *fir;
+	long compared = 0;
+
+	src = (float *)malloc(sizeof(float) * 20002 * 2);
+	ring = (double *)malloc(sizeof(double) * 20002);
+	mul = (float *)malloc(sizeof(float) * MAXCOUNT);
+	expected = (float *)malloc(sizeof(float) * MAXCOUNT);
+	out = (float *)malloc(sizeof(float) * MAXCOUNT);
+
+	for (trial = 0; trial < TRIALS; trial++) {
+		frames = 1000 + cm_test_below(19000);
+		channels = 1 + cm_test_below(2);
+		channel = cm_test_below(channels);
+		for (k = 0; k < (frames + 1) * channels; k++) {
+			src[k] = (float)(2.0 * cm_test_unit() - 1.0);
+		}
+		ringframes = frames;
+		for (k = 0; k < ringframes; k++) {
+			ring[k] = 2.0 * cm_test_unit() - 1.0;
+		}
+		for (k = 0; k < MAXCOUNT; k++) {
+			mul[k] = (float)cm_test_unit();
+		}
+		count = 1 + cm_test_below(MAXCOUNT);
+		span = count * (0.05 + 8.0 * cm_test_unit()); // pitch 0.05 ... 8
+		if (span > frames - 2) {
+			span = frames - 2;
+		}
+		start = (frames - 2 - span) * cm_test_unit();
+		phase = cm_phase_from(start);
+		incr = cm_phase_from(span / count);
+
+		for (kind = 0; kind < KINDS; kind++) {
+			kind_mode(kind, &interp, &taps);
+			fir = cm_interp_select(interp, taps);
+			for (scale = 0; scale < 2; scale++) {
+				// interleaved buffer
+				cm_render_scalar_kernels.buffer[cm_render_kind(interp)][scale](expected, scale ? mul : NULL, src, channels, channel, frames, phase, incr, count, fir);
+				for (set = 1; set < setcount; set++) {
+					memset(out, 0, sizeof(float) * MAXCOUNT);
+					sets[set].kernels->buffer[cm_render_kind(interp)][scale](out, scale ? mul : NULL, src, channels, channel, frames, phase, incr, count, fir);
+					CM_CHECK(memcmp(out, expected, sizeof(float) * count) == 0, "%s buffer kernel differs from scalar (mode %ld, taps %ld, window %ld, count %ld)", sets[set].name, interp, taps, scale, count);
+					compared++;
+				}
+				// ringbuffer, the grain may run over the end once
+				phase = cm_phase_from(fmod(start + ringframes * 0.9, (double)ringframes));
+				cm_render_scalar_kernels.ring[cm_render_kind(interp)][scale](expected, scale ? mul : NULL, ring, ringframes, phase, incr, count, fir);
+				for (set = 1; set < setcount; set++) {
+					memset(out, 0, sizeof(float) * MAXCOUNT);
+					sets[set].kernels->ring[cm_render_kind(interp)][scale](out, scale ? mul : NULL, ring, ringframes, phase, incr, count, fir);
+					CM_CHECK(memcmp(out, expected, sizeof(float) * count) == 0, "%s ring kernel differs from scalar (mode %ld, taps %ld, window %ld, count %ld)", sets[set].name, interp, taps, scale, count);
+					compared++;
+				}
+				phase = cm_phase_from(start);
+			}
+		}
+	}
+	printf("kernel implementations: %ld grains compared with the scalar kernels\n", compared);
+	free(src);
+	free(ring);
+	free(mul);
+	free(expected);
+	free(out);
+}
+
+
+/************************************************************************************************************************/
+/* 2. DETERMINISTIC RENDER PIPELINE                                                                                     */
+/************************************************************************************************************************/
+#define SR 44.1 // samples per ms
+#define CLOUDSIZE 24
+#define GRAINLENGTH 200 // max grain length in ms
+#define OUTFRAMES 88200
+#define SOURCEFRAMES 44100
+#define WINDOWFRAMES 512
+
+typedef struct testgrain {
+	float *memory;
+	long slab;
+	long length;
+	long pos;
+	double left, right;
+} testgrain;
+
+// render OUTFRAMES stereo frames of a cloud triggered every few frames, as the objects do in deterministic mode
+static void render_cloud(const cm_render_kernels *kernels, double *output, const float *source, const float *window, long kind) {
+	cm_slabpool pool;
+	cm_rng rng;
+	testgrain grains[CLOUDSIZE];
+	t_atom_long dists[5] = {CM_DIST_UNIFORM, CM_DIST_TRIANGULAR, CM_DIST_GAUSS, CM_DIST_UNIFORM, CM_DIST_EXPONENTIAL};
+	double ranges[10] = {0.0, 900.0 * SR, 5.0 * SR, GRAINLENGTH * SR, 0.25, 4.0, -1.0, 1.0, 0.1, 1.0}; // start, length (samples), pitch, pan, gain
+	double values[5];
+	float *envelope = (float *)malloc(sizeof(float) * (long)(GRAINLENGTH * SR + 1));
+	long interp, taps, count = 0;
+	long frame, i, length;
+	double span, angle;
+	const cm_render_kernels *selected = cm_render_selected;
+
+	kind_mode(kind, &interp, &taps);
+	cm_render_selected = kernels;
+	cm_slab_new(&pool, (t_ptr_size)(GRAINLENGTH * SR + 1) * sizeof(float), CLOUDSIZE, CM_SLAB_PREFILL_ALL);
+	cm_rng_init(&rng, 12345, NULL);
+	memset(output, 0, sizeof(double) * OUTFRAMES * 2);
+
+	for (frame = 0; frame < OUTFRAMES; frame++) {
+		if (frame % 37 == 0 && count < CLOUDSIZE) { // trigger
+			cm_rng_update(&rng);
+			cm_dist_fill(&rng, ranges, values, 5, dists, NULL);
+			length = (long)values[1];
+			span = length * values[2];
+			if (values[0] + span > SOURCEFRAMES - 2) {
+				values[0] = SOURCEFRAMES - 2 - span;
+			}
+			grains[count].memory = (float *)cm_slab_alloc(&pool, length * sizeof(float), &grains[count].slab);
+			CM_CHECK(grains[count].memory != NULL, "prefilled pool refused a grain");
+			if (grains[count].memory == NULL) {
+				continue;
+			}
+			cm_render_buffer(envelope, NULL, window, 1, 0, WINDOWFRAMES, 0.0, (double)WINDOWFRAMES, (double)length, length, CM_INTERP_LINEAR, 0);
+			cm_render_buffer(grains[count].memory, envelope, source, 1, 0, SOURCEFRAMES, values[0], span, (double)length, length, interp, taps);
+			angle = (values[3] + 1.0) * 0.25 * 3.14159265358979323846;
+			grains[count].left = cos(angle) * values[4];
+			grains[count].right = sin(angle) * values[4];
+			grains[count].length = length;
+			grains[count].pos = 0;
+			count++;
+		}
+		for (i = 0; i < count; i++) { // mix and finish
+			output[frame * 2] += grains[i].memory[grains[i].pos] * grains[i].left;
+			output[frame * 2 + 1] += grains[i].memory[grains[i].pos] * grains[i].right;
+			if (++grains[i].pos == grains[i].length) {
+				cm_slab_release(&pool, grains[i].memory, grains[i].slab);
+				grains[i--] = grains[--count];
+			}
+		}
+	}
+	while (count--) {
+		cm_slab_release(&pool, grains[count].memory, grains[count].slab);
+	}
+	CM_CHECK(pool.fallbacks == 0, "%ld grains fell back", pool.fallbacks);
+	cm_slab_free(&pool);
+	free(envelope);
+	cm_render_selected = selected;
+}
+
+static void test_pipeline(void) {
+	float *source = (float *)malloc(sizeof(float) * (SOURCEFRAMES + 1));
+	float *window = (float *)malloc(sizeof(float) * (WINDOWFRAMES + 1));
+	double *first = (double *)malloc(sizeof(double) * OUTFRAMES * 2);
+	double *again = (double *)malloc(sizeof(double) * OUTFRAMES * 2);
+	long k, kind, set;
+	double energy = 0.0;
+
+	for (k = 0; k <= SOURCEFRAMES; k++) {
+		source[k] = (float)(0.5 * sin(k * 0.031) + 0.3 * sin(k * 0.0071) + 0.2 * (2.0 * cm_test_unit() - 1.0));
+	}
+	for (k = 0; k <= WINDOWFRAMES; k++) {
+		window[k] = (float)(0.5 - 0.5 * cos(2.0 * 3.14159265358979323846 * k / WINDOWFRAMES));
+	}
+	for (kind = 0; kind < KINDS; kind++) {
+		render_cloud(&cm_render_scalar_kernels, first, source, window, kind);
+		render_cloud(&cm_render_scalar_kernels, again, source, window, kind);
+		CM_CHECK(memcmp(first, again, sizeof(double) * OUTFRAMES * 2) == 0, "two renders from the same seed differ (kind %ld)", kind);
+		for (set = 1; set < setcount; set++) {
+			render_cloud(sets[set].kernels, again, source, window, kind);
+			CM_CHECK(memcmp(first, again, sizeof(double) * OUTFRAMES * 2) == 0, "%s render differs from the scalar render (kind %ld)", sets[set].name, kind);
+		}
+		for (k = 0; k < OUTFRAMES * 2; k++) {
+			energy += first[k] * first[k];
+		}
+	}
+	CM_CHECK(energy > 1.0, "the cloud renders silence");
+	printf("deterministic pipeline: %d kinds rendered twice and with %ld kernel implementations\n", KINDS, setcount);
+	free(source);
+	free(window);
+	free(first);
+	free(again);
+}
+
+int main(void) {
+	cm_render_init();
+	cm_dist_setup();
+	find_kernels();
+	test_kernels();
+	test_pipeline();
+	return cm_test_result("test_render");
+}
@@ -0,0 +1,141 @@
+/*
+ test_schedule.c - standalone test of the grain schedule of the grain message (cm_queue.h).
+ Copyright (C) 2012 - 2017  Matthias W. Müller - circuit.music.labs
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ info@circuitmusiclabs.com
+
+ */
+
+// Grain messages with random offsets (also far beyond the signal vector) are sent between signal vectors of changing
+// sizes and started by a copy of the trigger loop of the perform routines, mixed with signal triggers.
+// 1. With free slots every grain must start at exactly the sample it was scheduled for, grains at the same sample in
+//    the order they were sent.
+// 2. With a small cloud, grains which cannot start must start later instead of being lost, never before their sample.
+
+#include "cm_test.h"
+#include "cm_queue.h"
+
+#define VECTORS 20000
+#define MAXVECTOR 256
+#define MAXGRAINS 100000
+
+typedef struct sent {
+	long due; // absolute sample the grain was scheduled for
+	long started; // absolute sample it started at (-1: not yet)
+} sent;
+
+static sent grains[MAXGRAINS];
+static cm_schedule schedule;
+static cm_queue queue;
+
+static void run(long cloudsize, long duration, const char *mode) {
+	double params[1] = {0.0};
+	cm_event event;
+	const cm_event *queued;
+	t_bool report, scheduled, trigger;
+	long sentcount = 0, started = 0, signals = 0;
+	long clock = 0; // absolute sample of the current vector start
+	long playing[64]; // end samples of the playing grains
+	long count = 0;
+	long vector, n, k, i, frame, tr_frame, last, lastdue, messages, events;
+	char flags[MAXVECTOR];
+
+	cm_queue_init(&queue, params, 1);
+	cm_schedule_clear(&schedule);
+	for (vector = 0; vector < VECTORS; vector++) {
+		n = 1 + cm_test_below(MAXVECTOR);
+		// messages between two vectors: offsets from the start of the next vector
+		messages = cm_test_below(4);
+		for (k = 0; k < messages && sentcount < MAXGRAINS; k++) {
+			memset(&event, 0, sizeof(event));
+			event.type = CM_EVENT_GRAIN;
+			event.frame = cm_test_below(8) ? cm_test_below(2 * MAXVECTOR) : cm_test_below(20000);
+			event.values[0] = (double)sentcount;
+			if (cm_queue_push(&queue, &event, &report)) {
+				grains[sentcount].due = clock + event.frame;
+				grains[sentcount++].started = -1;
+			}
+		}
+		// signal triggers of this vector
+		for (k = 0; k < n; k++) {
+			flags[k] = cm_test_below(50) == 0;
+		}
+
+		// drain the queue (as the objects' events methods)
+		events = cm_queue_count(&queue);
+		cm_schedule_begin(&schedule, n);
+		for (k = 0; k < events; k++) {
+			queued = cm_queue_event(&queue, k);
+			if (!cm_schedule_add(&schedule, queued)) {
+				break;
+			}
+		}
+		cm_queue_release(&queue, k);
+
+		// trigger loop (as the perform routines)
+		for (tr_frame = 0; tr_frame < n && !flags[tr_frame]; tr_frame++);
+		frame = cm_schedule_next(&schedule, tr_frame, 0);
+		last = -1;
+		lastdue = -1;
+		while (frame < n) {
+			trigger = true;
+			scheduled = cm_schedule_due(&schedule, frame);
+			for (i = 0; i < count; i++) { // grains which have finished free their slots
+				if (playing[i] <= clock + frame) {
+					playing[i--] = playing[--count];
+				}
+			}
+			if (count < cloudsize) {
+				trigger = false;
+				playing[count++] = clock + frame + duration;
+				if (scheduled) {
+					cm_schedule_take(&schedule, params, 1, 0, 1.0);
+					i = (long)params[0];
+					grains[i].started = clock + frame;
+					CM_CHECK(grains[i].started >= grains[i].due, "%s: grain %ld started %ld samples early", mode, i, grains[i].due - grains[i].started);
+					if (cloudsize > 32) {
+						CM_CHECK(grains[i].started == grains[i].due, "%s: grain %ld started %ld samples late", mode, i, grains[i].started - grains[i].due);
+						CM_CHECK(grains[i].due > lastdue || (grains[i].due == lastdue && i > last), "%s: grain %ld started out of order", mode, i);
+					}
+					last = i;
+					lastdue = grains[i].due;
+					started++;
+				}
+				else {
+					for (tr_frame = frame + 1; tr_frame < n && !flags[tr_frame]; tr_frame++);
+					signals++;
+				}
+			}
+			frame = trigger ? frame + 1 : cm_schedule_next(&schedule, tr_frame, frame);
+		}
+		clock += n;
+	}
+
+	// every grain due before the last vectors has started (the rest is still waiting)
+	for (i = 0; i < sentcount; i++) {
+		if (grains[i].due < clock - 20000 - 64 * duration) {
+			CM_CHECK(grains[i].started >= 0, "%s: grain %ld (due at %ld) never started", mode, i, grains[i].due);
+		}
+	}
+	printf("%s: %ld grains sent, %ld started, %ld signal triggers\n", mode, sentcount, started, signals);
+	cm_queue_free(&queue);
+}
+
+int main(void) {
+	run(64, 1, "free cloud");
+	run(3, 60, "full cloud");
+	return cm_test_result("test_schedule");
+}
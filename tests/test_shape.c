@@ -0,0 +1,134 @@
+/*
+ test_shape.c - standalone test of the analytic grain windows (cm_shape.h).
+ Copyright (C) 2012 - 2017  Matthias W. Müller - circuit.music.labs
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ info@circuitmusiclabs.com
+
+ */
+
+// 1. Every window (all shapes, short and long grains, parameters 0.1 - 10 and the limits) must hold the closed-form
+//    shape within TOLERANCE (float rounding and the error of the kaiser and planck pieces). The references below are
+//    written independently of cm_shape_seek.
+// 2. Filling a window in blocks of random length (the streaming engine) must give the same floats as the whole window.
+
+#include "cm_test.h"
+#include "cm_shape.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TOLERANCE 1e-7
+#define SPLITS 20 // random block splits per window
+
+static const double pi = 3.14159265358979323846;
+
+// lengths: single sample, shorter than a kaiser piece, odd and even (the planck tapers of param 10 meet or leave one
+// sample between them), 150 ms, longer than CM_SHAPE_PIECES renormalization intervals
+static const long lengths[] = { 1, 2, 3, 7, 100, 511, 512, 6615, 6616, 150000 };
+#define LENGTHS (long)(sizeof(lengths) / sizeof(long))
+static const double params[] = { 0.1, 0.5, 1.0, 3.0, 10.0, 20.0 };
+#define PARAMS (long)(sizeof(params) / sizeof(double))
+
+// I0(x) by its power series, summed until the terms vanish
+static double bessel_i0(double x) {
+	double term = 1.0, sum = 1.0;
+	long k;
+	for (k = 1; term > 1e-17 * sum; k++) {
+		term *= (x * x / 4.0) / ((double)k * k);
+		sum += term;
+	}
+	return sum;
+}
+
+// raised cosine attack of the given length at distance m from its start
+static double rise(double m, double length) {
+	return 0.5 - 0.5 * cos(pi * m / length);
+}
+
+// closed-form window value at position n of a window of length N + 1
+static double reference(long kind, double p, double n, double N) {
+	double taper, peak, m, t;
+	if (N <= 0.0) {
+		return 1.0;
+	}
+	switch (kind) {
+		case CM_SHAPE_TUKEY:
+			taper = fmin(N * p / 20.0, N * 0.5);
+			m = fmin(n, N - n);
+			return m < taper ? rise(m, taper) : 1.0;
+		case CM_SHAPE_SKEW:
+			peak = fmin(N * p / 10.0, N);
+			return n <= peak ? rise(n, peak) : rise(N - n, N - peak);
+		case CM_SHAPE_KAISER:
+			t = 2.0 * n / N - 1.0;
+			return bessel_i0(p * sqrt(fmax(1.0 - t * t, 0.0))) / bessel_i0(p);
+		case CM_SHAPE_PLANCK:
+			taper = fmin(N * p / 20.0, N * 0.5);
+			m = n < taper ? n : N - n;
+			if (m <= 0.0) {
+				return 0.0;
+			}
+			return m < taper ? 1.0 / (1.0 + exp(taper / m - taper / (taper - m))) : 1.0;
+		case CM_SHAPE_EXPODEC:
+			return exp(-p * n / N);
+		case CM_SHAPE_REXPODEC:
+			return exp(-p * (N - n) / N);
+		default: // CM_SHAPE_GAUSS
+			return exp(-0.5 * pow((n - N / 2.0) / (N / (2.0 * p)), 2.0));
+	}
+}
+
+int main(void) {
+	float *window = (float *)malloc(sizeof(float) * lengths[LENGTHS - 1]);
+	float *blocks = (float *)malloc(sizeof(float) * lengths[LENGTHS - 1]);
+	cm_shape shape;
+	double error, maxerror, p;
+	long kind, l, k, n, s, length, count, worst;
+
+	for (kind = 0; kind < CM_SHAPE_KINDS; kind++) {
+		for (l = 0; l < LENGTHS; l++) {
+			length = lengths[l];
+			for (k = 0; k < PARAMS + 4; k++) {
+				p = k < PARAMS ? params[k] : 0.1 + 9.9 * cm_test_unit();
+				// 1. closed form
+				cm_shape_window(window, length, kind, p);
+				maxerror = 0.0;
+				worst = 0;
+				for (n = 0; n < length; n++) {
+					error = fabs(window[n] - reference(kind, p, n, length - 1));
+					if (!(error <= maxerror)) {
+						maxerror = error;
+						worst = n;
+					}
+				}
+				CM_CHECK(maxerror <= TOLERANCE, "%s, length %ld, param %g: error %.2e at %ld", cm_shape_names[kind], length, p, maxerror, worst);
+				// 2. blocks
+				for (s = 0; s < SPLITS; s++) {
+					cm_shape_init(&shape, kind, p, length);
+					for (n = 0; n < length; n += count) {
+						count = 1 + cm_test_below(s % 2 ? CM_SHAPE_BLOCK : 2 * CM_SHAPE_RENORM);
+						count = count < length - n ? count : length - n;
+						cm_shape_fill(&shape, n, count, blocks + n);
+					}
+					CM_CHECK(!memcmp(window, blocks, sizeof(float) * length), "%s, length %ld, param %g: the blocks differ from the whole window", cm_shape_names[kind], length, p);
+				}
+			}
+		}
+	}
+	free(window);
+	free(blocks);
+	return cm_test_result("test_shape");
+}
@@ -0,0 +1,123 @@
+/*
+ test_slab.c - standalone test of the slab allocator of the grain memory (cm_slab.h).
+ Copyright (C) 2012 - 2017  Matthias W. Müller - circuit.music.labs
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ info@circuitmusiclabs.com
+
+ */
+
+// A cloud of CLOUDSIZE grains starts and finishes grains with lengths drifting through all size classes. With a
+// prefilled pool (deterministic mode) every grain must get memory as long as the cloud has a free slot, the blocks of
+// the playing grains must never overlap and the pool must return to its initial state when the cloud is empty.
+
+#include "cm_test.h"
+#include "cm_slab.h"
+#include <math.h>
+
+#define CLOUDSIZE 48
+#define MAXBYTES (10000 * 2 * sizeof(float)) // longest grain: 10000 stereo frames
+#define ROUNDS 200000
+
+typedef struct grain {
+	float *memory;
+	long slab;
+	long frames;
+	float tag;
+} grain;
+
+// length of the next grain: a random length around a center which drifts from the shortest to the longest grains
+static long next_frames(long round) {
+	double center = 0.5 + 0.5 * sin(round * 0.0005);
+	long frames = (long)((0.05 + 0.95 * center * (0.5 + 0.5 * cm_test_unit())) * (MAXBYTES / (2 * sizeof(float))));
+	return frames < 1 ? 1 : frames;
+}
+
+static void check_grains(grain *grains, long count) {
+	long i, k;
+	for (i = 0; i < count; i++) {
+		for (k = 0; k < grains[i].frames * 2; k += 97) {
+			if (grains[i].memory[k] != grains[i].tag) {
+				CM_CHECK(false, "grain %ld: memory overwritten at sample %ld", i, k);
+				return;
+			}
+		}
+	}
+}
+
+static void run(long prefill, const char *mode) {
+	cm_slabpool pool;
+	grain grains[CLOUDSIZE];
+	long count = 0;
+	long served = 0, refused = 0;
+	long round, i, k;
+
+	CM_CHECK(cm_slab_new(&pool, MAXBYTES, CLOUDSIZE, prefill), "%s: pool creation failed", mode);
+	for (round = 0; round < ROUNDS; round++) {
+		if (count < CLOUDSIZE && (count == 0 || cm_test_below(3))) { // start a grain
+			grain *g = &grains[count];
+			g->frames = next_frames(round);
+			g->memory = (float *)cm_slab_alloc(&pool, g->frames * 2 * sizeof(float), &g->slab);
+			if (g->memory) {
+				g->tag = (float)round;
+				for (k = 0; k < g->frames * 2; k++) {
+					g->memory[k] = g->tag;
+				}
+				count++;
+				served++;
+			}
+			else {
+				refused++;
+				cm_slab_grow(&pool); // the main thread serves the request
+			}
+		}
+		else { // finish a random grain
+			i = cm_test_below(count);
+			cm_slab_release(&pool, grains[i].memory, grains[i].slab);
+			grains[i] = grains[--count];
+		}
+		if (round % 1000 == 0) {
+			check_grains(grains, count);
+		}
+	}
+	check_grains(grains, count);
+	while (count) {
+		count--;
+		cm_slab_release(&pool, grains[count].memory, grains[count].slab);
+	}
+
+	if (prefill == CM_SLAB_PREFILL_ALL) {
+		CM_CHECK(refused == 0, "%s: %ld of %ld grains refused with a prefilled pool", mode, refused, served + refused);
+	}
+	else {
+		CM_CHECK(refused <= CLOUDSIZE, "%s: %ld grains refused, more than the slabs grown on request", mode, refused);
+	}
+	CM_CHECK(pool.count <= CLOUDSIZE, "%s: %ld slabs allocated for %d grains", mode, (long)pool.count, CLOUDSIZE);
+	CM_CHECK(pool.bytes_used == 0, "%s: %lu bytes still in use", mode, (unsigned long)pool.bytes_used);
+	for (i = 0; i < pool.classes; i++) {
+		CM_CHECK(pool.live[i] == 0 && pool.partial[i] < 0, "%s: size class %ld not empty", mode, i);
+	}
+	for (i = 0; i < pool.assigned; i++) {
+		CM_CHECK(pool.slabs[i].sizeclass < 0 && pool.slabs[i].live == 0, "%s: slab %ld still assigned", mode, i);
+	}
+	printf("%s: %ld grains served, %ld refused, %ld slabs\n", mode, served, refused, (long)pool.count);
+	cm_slab_free(&pool);
+}
+
+int main(void) {
+	run(CM_SLAB_PREFILL_ALL, "prefilled pool");
+	run(CM_SLAB_PREFILL, "growing pool");
+	return cm_test_result("test_slab");
+}
@@ -0,0 +1,170 @@
+/*
+ test_trigger.c - standalone test of the trigger pre-scan (cm_trigger.h).
+ Copyright (C) 2012 - 2017  Matthias W. Müller - circuit.music.labs
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ info@circuitmusiclabs.com
+
+ */
+
+// Signal vectors of random sizes (mostly not multiples of eight) are scanned with cm_trigger_scan and walked with
+// cm_trigger_next. The trigger frames, the bangs left over and the trigger sample carried into the next vector must be
+// the same as with the former per-sample detection of the perform routines, for ramps with random frequencies and
+// resets (also falling steps right at the threshold), for zero crossing input (also zeros of both signs) and with
+// bangs waiting for the vector.
+
+#include "cm_test.h"
+#include "cm_trigger.h"
+
+#define VECTORS 50000
+#define MAXVECTOR 300
+
+static double input[MAXVECTOR];
+static long expected[MAXVECTOR];
+
+// the former per-sample detection (one bang per frame which is not triggered by the signal)
+static long detect(const double *tr_sigin, long n, double *tr_prev, t_atom_long zero, long *bangs, long *frames) {
+	t_bool trigger;
+	double tr_curr;
+	long count = 0;
+	long k;
+	for (k = 0; k < n; k++) {
+		tr_curr = tr_sigin[k];
+		trigger = false;
+		if (zero) {
+			if (signbit(tr_curr) != signbit(*tr_prev)) {
+				trigger = true;
+			}
+			else if (*bangs > 0) {
+				trigger = true;
+				(*bangs)--;
+			}
+		}
+		else {
+			if ((*tr_prev - tr_curr) > 0.9) {
+				trigger = true;
+			}
+			else if (*bangs > 0) {
+				trigger = true;
+				(*bangs)--;
+			}
+		}
+		if (trigger) {
+			frames[count++] = k;
+		}
+		*tr_prev = tr_curr;
+	}
+	return count;
+}
+
+// ramp from 0 to 1 with a random frequency, sometimes reset early or falling by a step close to the threshold
+static void fill_ramp(double *phase, long n) {
+	double increment = cm_test_below(4) ? cm_test_unit() * 0.05 : cm_test_unit() * 0.6;
+	long k;
+	for (k = 0; k < n; k++) {
+		switch (cm_test_below(200)) {
+			case 0: // reset
+				*phase = 0.0;
+				break;
+			case 1: // steps at the threshold
+				*phase = *phase >= 0.9 ? *phase - 0.9 : *phase + 0.9;
+				break;
+			case 2:
+				*phase = *phase >= 0.95 ? *phase - 0.9 - 1e-9 : *phase;
+				break;
+			default:
+				*phase += increment;
+				if (*phase >= 1.0) {
+					*phase -= 1.0;
+				}
+		}
+		input[k] = *phase;
+	}
+}
+
+// zero crossing input: sines and noise with exact zeros of both signs
+static void fill_zero(double *phase, long n) {
+	double increment = cm_test_unit() * 0.3;
+	long k;
+	for (k = 0; k < n; k++) {
+		*phase += increment;
+		switch (cm_test_below(40)) {
+			case 0:
+				input[k] = 0.0;
+				break;
+			case 1:
+				input[k] = -0.0;
+				break;
+			case 2:
+				input[k] = cm_test_unit() - 0.5;
+				break;
+			default:
+				input[k] = sin(*phase);
+		}
+	}
+}
+
+static void run(t_atom_long zero, const char *mode) {
+	cm_triggerscan scan = {NULL, 0, 0};
+	double scan_prev = 0.0, ref_prev = 0.0;
+	double phase = 0.0;
+	long scan_bangs = 0, ref_bangs = 0;
+	long triggers = 0, bangs = 0;
+	long vector, n, count, i, frame, waiting;
+
+	CM_CHECK(cm_trigger_resize(&scan, MAXVECTOR), "%s: allocation failed", mode);
+	for (vector = 0; vector < VECTORS; vector++) {
+		n = cm_test_below(8) ? 1 + cm_test_below(MAXVECTOR) : 8 * (1 + cm_test_below(MAXVECTOR / 8));
+		if (zero) {
+			fill_zero(&phase, n);
+		}
+		else {
+			fill_ramp(&phase, n);
+		}
+		// bangs received since the last vector (sometimes more than the vector can take)
+		waiting = cm_test_below(3) ? 0 : (cm_test_below(20) ? 1 + cm_test_below(3) : cm_test_below(2 * MAXVECTOR));
+		scan_bangs += waiting;
+		ref_bangs += waiting;
+		bangs += waiting;
+
+		count = detect(input, n, &ref_prev, zero, &ref_bangs, expected);
+		CM_CHECK(cm_trigger_scan(&scan, input, n, &scan_prev, zero, &scan_bangs), "%s: vector of %ld frames refused", mode, n);
+
+		i = 0;
+		for (frame = cm_trigger_next(&scan, -1); frame < n && i < count && frame == expected[i]; frame = cm_trigger_next(&scan, frame)) {
+			i++;
+		}
+		CM_CHECK(frame == n && i == count, "%s: vector %ld (%ld frames): trigger %ld at frame %ld, expected %ld", mode, vector, n, i, frame, i < count ? expected[i] : n);
+		CM_CHECK(scan_bangs == ref_bangs, "%s: vector %ld: %ld bangs left, expected %ld", mode, vector, scan_bangs, ref_bangs);
+		CM_CHECK(scan_prev == ref_prev && signbit(scan_prev) == signbit(ref_prev), "%s: vector %ld: trigger sample not carried over", mode, vector);
+		triggers += count;
+	}
+
+	// an empty vector changes nothing, a vector larger than the scan arrays is refused
+	scan_prev = ref_prev = 0.5;
+	scan_bangs = 1;
+	CM_CHECK(cm_trigger_scan(&scan, input, 0, &scan_prev, zero, &scan_bangs), "%s: empty vector refused", mode);
+	CM_CHECK(cm_trigger_next(&scan, -1) == 0 && scan_prev == 0.5 && scan_bangs == 1, "%s: empty vector changed the state", mode);
+	CM_CHECK(!cm_trigger_scan(&scan, input, MAXVECTOR + 1, &scan_prev, zero, &scan_bangs), "%s: oversized vector accepted", mode);
+
+	printf("%s: %ld vectors, %ld triggers, %ld bangs\n", mode, (long)VECTORS, triggers, bangs);
+	cm_trigger_free(&scan);
+}
+
+int main(void) {
+	run(0, "ramp");
+	run(1, "zero crossing");
+	return cm_test_result("test_trigger");
+}